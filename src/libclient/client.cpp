@@ -7,6 +7,7 @@
 #include "controller/ntpcontroller.h"
 #include "controller/resultcontroller.h"
 #include "network/networkmanager.h"
+#include "network/resolver.h"
 #include "task/taskexecutor.h"
 #include "task/taskstorage.h"
 #include "scheduler/schedulerstorage.h"
@@ -18,6 +19,7 @@
 #include "trafficbudgetmanager.h"
 #include "result/resultstorage.h"
 #include "connectiontester.h"
+#include "devicestatesampler.h"
 
 #include <QCoreApplication>
 #include <QNetworkAccessManager>
@@ -72,6 +74,8 @@ public:
         scheduler.setExecutor(&executor);
 
         connect(&executor, SIGNAL(finished(ScheduleDefinition, Result)), this, SLOT(taskFinished(ScheduleDefinition, Result)));
+        connect(&executor, SIGNAL(resultAvailable(ScheduleDefinition, Result)), this,
+                SLOT(taskFinished(ScheduleDefinition, Result)));
         connect(&loginController, SIGNAL(finished()), this, SLOT(loginStatusChanged()));
     }
 
@@ -95,6 +99,7 @@ public:
 
     Settings settings;
     NetworkManager networkManager;
+    Resolver resolver;
 
     TaskController taskController;
     ReportController reportController;
@@ -106,6 +111,7 @@ public:
 
     TrafficBudgetManager trafficBudgetManager;
     ConnectionTester connectionTester;
+    DeviceStateSampler deviceStateSampler;
 
 #ifdef Q_OS_UNIX
     static int sigintFd[2];
@@ -364,6 +370,7 @@ bool Client::init()
     d->resultController.init(&d->resultScheduler, &d->scheduler, &d->settings);
     d->ntpController.init();
     d->trafficBudgetManager.init();
+    d->deviceStateSampler.start();
 
     if (!d->settings.isPassive())
     {
@@ -383,19 +390,19 @@ bool Client::init()
     tests.append(ScheduleDefinition(ScheduleId(1), TaskId(1), "ping", timing, PingDefinition("measure-it.net", 4, 200, 4000, 64, 33434, 33434, 74,
                                                                                              ping::System).toVariant(), precondition));
     tests.append(ScheduleDefinition(ScheduleId(2), TaskId(2), "btc_ma", timing, BulkTransportCapacityDefinition("141.82.57.241", 5106, 1048576,
-                                                                                     10).toVariant(), precondition));
+                                                                                     10, "download", 0).toVariant(), precondition));
     tests.append(ScheduleDefinition(ScheduleId(3), TaskId(3), "btc_ma", timing, BulkTransportCapacityDefinition("141.82.57.241", 5106, 1048576,
-                                                                                     10).toVariant(), precondition)); // this is for btc upload which is not implemented yet
+                                                                                     10, "download", 0).toVariant(), precondition)); // upload once the measurement points support it
     tests.append(ScheduleDefinition(ScheduleId(4), TaskId(4), "ping", timing, PingDefinition("measure-it.net", 4, 200, 1000, 64, 33434, 33434, 74,
                                                                   ping::Udp).toVariant(), precondition));
     tests.append(ScheduleDefinition(ScheduleId(5), TaskId(5), "ping", timing, PingDefinition("measure-it.net", 4, 200, 1000, 64, 33434, 33434, 74,
                                                                   ping::Tcp).toVariant(), precondition));
     tests.append(ScheduleDefinition(ScheduleId(6), TaskId(6), "dnslookup", timing, DnslookupDefinition("measure-it.net").toVariant(), precondition));
     tests.append(ScheduleDefinition(ScheduleId(7), TaskId(7), "httpdownload", timing,
-                                HTTPDownloadDefinition("http://www.measure-it.net:80/static/measurement/67108864", false, 1, 10000, 3000, 1000, 0).toVariant(),
+                                HTTPDownloadDefinition("http://www.measure-it.net:80/static/measurement/67108864", false, 1, 10000, 3000, 1000, 0, false).toVariant(),
                                 precondition));
     tests.append(ScheduleDefinition(ScheduleId(8), TaskId(8), "packettrains_ma", timing, PacketTrainsDefinition("141.82.57.241", 5106, 1000, 48, 1,
-                                                                                     10485760, 262144000, 200000000).toVariant(),
+                                                                                     10485760, 262144000, 200000000, "trains").toVariant(),
                                 precondition));
     tests.append(ScheduleDefinition(ScheduleId(9), TaskId(9), "reversednslookup", timing, ReverseDnslookupDefinition("141.82.57.241").toVariant(),
                                 precondition));
@@ -428,7 +435,7 @@ bool Client::autoLogin()
 
 void Client::btc(const QString &host)
 {
-    BulkTransportCapacityDefinition btcDef(host, 5106, 1024 * 1024, 10);
+    BulkTransportCapacityDefinition btcDef(host, 5106, 1024 * 1024, 10, "download", 0);
     TimingPtr timing(new ImmediateTiming());
     ScheduleDefinition testDefinition(ScheduleId(2), d->scheduler.nextImmediateTask("btc_ma", btcDef.toVariant()),
                                       timing, Precondition());
@@ -438,7 +445,7 @@ void Client::btc(const QString &host)
 void Client::http(const QString &url, bool avoidCaches, int threads, int targetTime,
                   int rampUpTime, int slotLength, quint16 sourcePort)
 {
-    HTTPDownloadDefinition httpDef(url, avoidCaches, threads, targetTime, rampUpTime, slotLength, sourcePort);
+    HTTPDownloadDefinition httpDef(url, avoidCaches, threads, targetTime, rampUpTime, slotLength, sourcePort, false);
     TimingPtr timing(new ImmediateTiming());
     ScheduleDefinition testDefinition(ScheduleId(7), d->scheduler.nextImmediateTask("httpdownload", httpDef.toVariant()),
                                       timing, Precondition());
@@ -635,6 +642,16 @@ TrafficBudgetManager *Client::trafficBudgetManager() const
     return &d->trafficBudgetManager;
 }
 
+Resolver *Client::resolver() const
+{
+    return &d->resolver;
+}
+
+DeviceStateSampler *Client::deviceStateSampler() const
+{
+    return &d->deviceStateSampler;
+}
+
 ConnectionTester *Client::connectionTester() const
 {
     return &d->connectionTester;
@@ -23,6 +23,8 @@ class QNetworkAccessManager;
 class TrafficBudgetManager;
 class ResultScheduler;
 class ConnectionTester;
+class Resolver;
+class DeviceStateSampler;
 
 ////////////////////////////////////////////////////////////
 
@@ -82,6 +84,8 @@ public:
 
     Settings *settings() const;
     TrafficBudgetManager *trafficBudgetManager() const;
+    Resolver *resolver() const;
+    DeviceStateSampler *deviceStateSampler() const;
 
     ConnectionTester *connectionTester() const;
 
@@ -26,6 +26,8 @@
 #include <QNetworkReply>
 
 #ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <unistd.h>
 #include <netinet/in.h>
 #include <arpa/nameser.h>
 #include <arpa/inet.h>
@@ -41,6 +43,23 @@
 #include <sys/system_properties.h>
 #endif
 
+#ifdef Q_OS_LINUX
+// ICMP ping sockets are only allowed for the groups in
+// net.ipv4.ping_group_range
+static bool icmpSocketAvailable()
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+
+    if (sock < 0)
+    {
+        return false;
+    }
+
+    close(sock);
+    return true;
+}
+#endif
+
 class ConnectionTester::Private : public QObject
 {
     Q_OBJECT
@@ -341,10 +360,32 @@ QString ConnectionTester::Private::publicIpAddress() const
 bool ConnectionTester::Private::canPing(const QString &host, int *averagePing) const
 {
     // TODO: invoke scheduler or tell scheduler something is going on outside of its control
-    PingDefinitionPtr pingDef(new PingDefinition(host, 4, 200, 1000, 64, 0, 0, 0, ping::System));
     Ping ping;
-    ping.prepare(NULL, pingDef);
-    ping.start();
+    PingDefinitionPtr pingDef;
+#if defined(Q_OS_LINUX)
+    // ICMP ping sockets save spawning the system ping, which is still needed
+    // if they are not allowed. Decided up front so only the ping which
+    // actually runs is charged.
+    if (icmpSocketAvailable())
+    {
+        pingDef = PingDefinitionPtr(new PingDefinition(host, 4, 200, 1000, 64, 0, 0, 56, ping::Icmp));
+    }
+    else
+#endif
+    {
+        pingDef = PingDefinitionPtr(new PingDefinition(host, 4, 200, 1000, 64, 0, 0, 0, ping::System));
+    }
+
+    if (!ping.prepare(NULL, pingDef) || !ping.start())
+    {
+        if (averagePing)
+        {
+            *averagePing = 0;
+        }
+
+        return false;
+    }
+
     ping.waitForFinished();
 
     int resultAvg = ping.averagePingTime();
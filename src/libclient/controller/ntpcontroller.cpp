@@ -2,6 +2,8 @@
 #include <QHostInfo>
 
 #include "ntpcontroller.h"
+#include "../client.h"
+#include "../network/resolver.h"
 #include "../log/logger.h"
 
 LOGGER(NtpController);
@@ -88,8 +90,11 @@ NtpController::~NtpController()
 
 void NtpController::update()
 {
-    QHostInfo hostInfo = QHostInfo::fromName("ptbtime1.ptb.de");
+    Client::instance()->resolver()->lookupHost("ptbtime1.ptb.de", this, SLOT(serverResolved(QHostInfo)));
+}
 
+void NtpController::serverResolved(const QHostInfo &hostInfo)
+{
     if (!hostInfo.addresses().isEmpty())
     {
         QHostAddress ntpServer = hostInfo.addresses().first();
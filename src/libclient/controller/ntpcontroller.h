@@ -7,6 +7,7 @@
 #include <QDateTime>
 #include <QObject>
 #include <QUdpSocket>
+#include <QHostInfo>
 
 class CLIENT_API NtpController : public Controller
 {
@@ -37,6 +38,7 @@ private:
 
 private slots:
     void readResponse();
+    void serverResolved(const QHostInfo &hostInfo);
 
 public slots:
     void update();
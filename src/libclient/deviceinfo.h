@@ -13,6 +13,7 @@ public:
     /// @returns A sha-224 hash or an empty string on error
     QString deviceId() const;
     qreal cpuUsage() const;
+    /// @returns Available memory in KiB, 0 if unknown
     quint32 freeMemory() const;
     qint32 signalStrength() const;
     qint8 batteryLevel() const;
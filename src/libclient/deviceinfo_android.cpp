@@ -138,11 +138,6 @@ qint8 DeviceInfo::batteryLevel() const
     return capacityRemaining * 100 / capacityMaximum;
 }
 
-quint32 DeviceInfo::freeMemory() const
-{
-    return 0;
-}
-
 qint32 DeviceInfo::signalStrength() const
 {
     return d->netInfo.callMethod<jint>("getSignalStrength");
@@ -0,0 +1,41 @@
+#include "deviceinfo.h"
+
+#include <QFile>
+#include <QList>
+#include <QByteArray>
+
+// shared by the desktop and android builds, both have /proc
+
+quint32 DeviceInfo::freeMemory() const
+{
+    QFile file("/proc/meminfo");
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return 0;
+    }
+
+    quint32 memFree = 0;
+
+    // MemAvailable (since Linux 3.14) includes reclaimable caches
+    while (!file.atEnd())
+    {
+        QList<QByteArray> toks = file.readLine().simplified().split(' ');
+
+        if (toks.size() < 2)
+        {
+            continue;
+        }
+
+        if (toks[0] == "MemAvailable:")
+        {
+            return toks[1].toUInt();
+        }
+        else if (toks[0] == "MemFree:")
+        {
+            memFree = toks[1].toUInt();
+        }
+    }
+
+    return memFree;
+}
@@ -0,0 +1,176 @@
+#include "devicestatesampler.h"
+#include "deviceinfo.h"
+#include "network/networkmanager.h"
+#include "client.h"
+#include "log/logger.h"
+
+LOGGER(DeviceStateSampler);
+
+class DeviceStateWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceStateWorker(DeviceStateSampler *sampler)
+    : sampler(sampler)
+    , deviceInfo(NULL)
+    {
+    }
+
+    ~DeviceStateWorker()
+    {
+        delete deviceInfo;
+    }
+
+    DeviceStateSampler *sampler;
+    // created in the worker thread
+    DeviceInfo *deviceInfo;
+
+public slots:
+    // the connection mode and signal strength come from objects owned by
+    // the main thread and are read there, the rest may block
+    void sample(int connectionMode, int signalStrength)
+    {
+        DeviceState state;
+
+        if (!deviceInfo)
+        {
+            deviceInfo = new DeviceInfo;
+        }
+
+        // cpuUsage() sleeps between two readings, only this thread waits
+        state.valid = true;
+        state.cpuUsage = deviceInfo->cpuUsage();
+        state.freeMemory = deviceInfo->freeMemory();
+        state.signalStrength = signalStrength;
+        state.batteryLevel = deviceInfo->batteryLevel();
+        state.availableDiskSpace = deviceInfo->availableDiskSpace();
+        state.connectionMode = connectionMode;
+
+        sampler->publish(state);
+    }
+};
+
+DeviceStateSampler::DeviceStateSampler(QObject *parent)
+: QObject(parent)
+, m_worker(new DeviceStateWorker(this))
+, m_deviceInfo(NULL)
+, m_sequence(0)
+, m_valid(0)
+, m_cpuUsage(-1000)
+, m_freeMemory(0)
+, m_signalStrength(-1)
+, m_batteryLevel(-1)
+, m_diskSpaceHigh(-1)
+, m_diskSpaceLow(-1)
+, m_connectionMode(0)
+{
+    m_thread.setObjectName("DeviceStateSampler");
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(sample()));
+}
+
+DeviceStateSampler::~DeviceStateSampler()
+{
+    stop();
+
+    // never started
+    delete m_worker;
+    delete m_deviceInfo;
+}
+
+void DeviceStateSampler::start(int interval)
+{
+    if (!m_worker)
+    {
+        return;
+    }
+
+    if (!m_deviceInfo)
+    {
+        m_deviceInfo = new DeviceInfo;
+    }
+
+    if (!m_thread.isRunning())
+    {
+        m_thread.start(QThread::LowPriority);
+    }
+
+    m_timer.start(interval);
+    sample();
+    LOG_DEBUG(QString("Sampling device state every %1 ms").arg(interval));
+}
+
+void DeviceStateSampler::stop()
+{
+    m_timer.stop();
+
+    if (!m_thread.isRunning())
+    {
+        return;
+    }
+
+    // the worker deletes itself when the thread finishes
+    m_thread.quit();
+    m_thread.wait();
+    m_worker = NULL;
+}
+
+void DeviceStateSampler::sample()
+{
+    if (!m_worker)
+    {
+        return;
+    }
+
+    int connectionMode = Client::instance()->networkManager()->connectionMode();
+    int signalStrength = m_deviceInfo->signalStrength();
+
+    QMetaObject::invokeMethod(m_worker, "sample", Qt::QueuedConnection, Q_ARG(int, connectionMode),
+                              Q_ARG(int, signalStrength));
+}
+
+DeviceState DeviceStateSampler::snapshot() const
+{
+    DeviceState state;
+    int sequence;
+
+    // retry while a sample is being published
+    do
+    {
+        while ((sequence = m_sequence.loadAcquire()) & 1)
+        {
+        }
+
+        state.valid = m_valid.loadAcquire();
+        state.cpuUsage = m_cpuUsage.loadAcquire() / 1000.0;
+        state.freeMemory = (quint32)m_freeMemory.loadAcquire();
+        state.signalStrength = m_signalStrength.loadAcquire();
+        state.batteryLevel = (qint8)m_batteryLevel.loadAcquire();
+        state.availableDiskSpace = ((qlonglong)m_diskSpaceHigh.loadAcquire() << 32) |
+                                   (quint32)m_diskSpaceLow.loadAcquire();
+        state.connectionMode = m_connectionMode.loadAcquire();
+    } while (m_sequence.loadAcquire() != sequence);
+
+    return state;
+}
+
+void DeviceStateSampler::publish(const DeviceState &state)
+{
+    // only called from the worker thread, so there is a single writer
+    m_sequence.fetchAndAddOrdered(1);
+
+    m_valid.storeRelease(state.valid);
+    m_cpuUsage.storeRelease(qRound(state.cpuUsage * 1000));
+    m_freeMemory.storeRelease((int)state.freeMemory);
+    m_signalStrength.storeRelease(state.signalStrength);
+    m_batteryLevel.storeRelease(state.batteryLevel);
+    m_diskSpaceHigh.storeRelease((int)(state.availableDiskSpace >> 32));
+    m_diskSpaceLow.storeRelease((int)(state.availableDiskSpace & 0xffffffff));
+    m_connectionMode.storeRelease(state.connectionMode);
+
+    m_sequence.fetchAndAddOrdered(1);
+}
+
+#include "devicestatesampler.moc"
@@ -0,0 +1,69 @@
+#ifndef DEVICESTATESAMPLER_H
+#define DEVICESTATESAMPLER_H
+
+#include "export.h"
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QAtomicInt>
+
+class DeviceStateWorker;
+class DeviceInfo;
+
+struct DeviceState
+{
+    bool valid;
+    qreal cpuUsage;
+    quint32 freeMemory;
+    qint32 signalStrength;
+    qint8 batteryLevel;
+    qlonglong availableDiskSpace;
+    int connectionMode;
+};
+
+/*
+ * Samples the device state (CPU, memory, battery, disk, connection) in a
+ * background thread, so reading it never blocks. Connection mode and signal
+ * strength use objects of the main thread and are read there on each tick. The latest sample is
+ * published as a seqlock: one writer, readers retry instead of waiting.
+ */
+class CLIENT_API DeviceStateSampler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceStateSampler(QObject *parent = 0);
+    ~DeviceStateSampler();
+
+    void start(int interval = 5000);
+    void stop();
+
+    DeviceState snapshot() const;
+
+private slots:
+    void sample();
+
+private:
+    friend class DeviceStateWorker;
+
+    void publish(const DeviceState &state);
+
+    QThread m_thread;
+    QTimer m_timer;
+    DeviceStateWorker *m_worker;
+    DeviceInfo *m_deviceInfo; // main thread
+
+    // odd while publish() is writing
+    QAtomicInt m_sequence;
+    QAtomicInt m_valid;
+    QAtomicInt m_cpuUsage; // per mille
+    QAtomicInt m_freeMemory;
+    QAtomicInt m_signalStrength;
+    QAtomicInt m_batteryLevel;
+    QAtomicInt m_diskSpaceHigh;
+    QAtomicInt m_diskSpaceLow;
+    QAtomicInt m_connectionMode;
+};
+
+#endif // DEVICESTATESAMPLER_H
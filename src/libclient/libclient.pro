@@ -54,7 +54,24 @@ android {
                storage/storagepaths_android.cpp \
                log/logger_android.cpp \
                deviceinfo_android.cpp \
+               deviceinfo_linux.cpp \
+               measurement/http/downloadengine.cpp \
+               measurement/http/httpupload.cpp \
+               measurement/http/httpupload_definition.cpp \
+               measurement/http/httpupload_plugin.cpp \
+               measurement/http/uploadengine.cpp \
                measurement/ping/ping_linux.cpp \
+               measurement/pingsweep/pingsweep.cpp \
+               measurement/pingsweep/pingsweep_definition.cpp \
+               measurement/pingsweep/pingsweep_plugin.cpp \
+               measurement/traceroute/continuoustraceroute.cpp \
+               measurement/traceroute/continuoustraceroute_definition.cpp \
+               measurement/traceroute/multipathtraceroute.cpp \
+               measurement/traceroute/multipathtraceroute_definition.cpp \
+               measurement/traceroute/udpprober.cpp \
+               measurement/traceroutecampaign/traceroutecampaign.cpp \
+               measurement/traceroutecampaign/traceroutecampaign_definition.cpp \
+               measurement/traceroutecampaign/traceroutecampaign_plugin.cpp \
                measurement/wifilookup/wifilookup_android.cpp
 } else: ios {
     SOURCES += log/logger_all.cpp \
@@ -70,12 +87,29 @@ android {
 
     osx: SOURCES += deviceinfo_osx.cpp \
                     measurement/ping/ping_osx.cpp
-    else:unix: SOURCES += deviceinfo_unix.cpp
+    else:unix: SOURCES += deviceinfo_unix.cpp \
+                          deviceinfo_linux.cpp
     else: SOURCES += deviceinfo.cpp \
                      measurement/ping/ping_win.cpp
 
     linux {
-        SOURCES += measurement/ping/ping_linux.cpp
+        SOURCES += measurement/http/downloadengine.cpp \
+                   measurement/http/httpupload.cpp \
+                   measurement/http/httpupload_definition.cpp \
+                   measurement/http/httpupload_plugin.cpp \
+                   measurement/http/uploadengine.cpp \
+                   measurement/ping/ping_linux.cpp \
+                   measurement/pingsweep/pingsweep.cpp \
+                   measurement/pingsweep/pingsweep_definition.cpp \
+                   measurement/pingsweep/pingsweep_plugin.cpp \
+                   measurement/traceroute/continuoustraceroute.cpp \
+                   measurement/traceroute/continuoustraceroute_definition.cpp \
+                   measurement/traceroute/multipathtraceroute.cpp \
+                   measurement/traceroute/multipathtraceroute_definition.cpp \
+                   measurement/traceroute/udpprober.cpp \
+                   measurement/traceroutecampaign/traceroutecampaign.cpp \
+                   measurement/traceroutecampaign/traceroutecampaign_definition.cpp \
+                   measurement/traceroutecampaign/traceroutecampaign_plugin.cpp
     }
 }
 
@@ -115,6 +149,8 @@ SOURCES +=  \
     task/taskstorage.cpp \
     task/task.cpp \
     network/networkmanager.cpp \
+    network/resolver.cpp \
+    network/tcpinfoseries.cpp \
     measurement/measurementfactory.cpp \
     measurement/measurement.cpp \
     measurement/measurementdefinition.cpp \
@@ -143,6 +179,17 @@ SOURCES +=  \
     measurement/http/httpdownload.cpp \
     measurement/http/httpdownload_definition.cpp \
     measurement/http/httpdownload_plugin.cpp \
+    measurement/http/httpresponseparser.cpp \
+    measurement/pageload/pageload.cpp \
+    measurement/pageload/pageload_definition.cpp \
+    measurement/pageload/pageload_plugin.cpp \
+    measurement/videostreaming/videostreaming.cpp \
+    measurement/videostreaming/videostreaming_definition.cpp \
+    measurement/videostreaming/videostreaming_plugin.cpp \
+    measurement/dnsquery/dnsmessage.cpp \
+    measurement/dnsquery/dnsquery.cpp \
+    measurement/dnsquery/dnsquery_definition.cpp \
+    measurement/dnsquery/dnsquery_plugin.cpp \
     timing/ondemandtiming.cpp \
     log/filelogger.cpp \
     measurement/ping/ping_definition.cpp \
@@ -169,6 +216,7 @@ SOURCES +=  \
     precondition.cpp \
     network/requests/uploadrequest.cpp \
     localinformation.cpp \
+    devicestatesampler.cpp \
     measurement/wifilookup/wifilookup_definition.cpp \
     measurement/wifilookup/wifilookup_plugin.cpp \
     storage/storage.cpp \
@@ -181,6 +229,25 @@ SOURCES +=  \
     controller/resultcontroller.cpp \
     measurement/upnp/upnp_definition.cpp
 
+linux|android {
+    HEADERS += measurement/http/downloadengine.h \
+               measurement/http/httpupload.h \
+               measurement/http/httpupload_definition.h \
+               measurement/http/httpupload_plugin.h \
+               measurement/http/uploadengine.h \
+               measurement/pingsweep/pingsweep.h \
+               measurement/pingsweep/pingsweep_definition.h \
+               measurement/pingsweep/pingsweep_plugin.h \
+               measurement/traceroute/continuoustraceroute.h \
+               measurement/traceroute/continuoustraceroute_definition.h \
+               measurement/traceroute/multipathtraceroute.h \
+               measurement/traceroute/multipathtraceroute_definition.h \
+               measurement/traceroute/udpprober.h \
+               measurement/traceroutecampaign/traceroutecampaign.h \
+               measurement/traceroutecampaign/traceroutecampaign_definition.h \
+               measurement/traceroutecampaign/traceroutecampaign_plugin.h
+}
+
 HEADERS += \
     export.h \
     client.h \
@@ -215,6 +282,8 @@ HEADERS += \
     task/task.h \
     serializable.h \
     network/networkmanager.h \
+    network/resolver.h \
+    network/tcpinfoseries.h \
     measurement/measurementfactory.h \
     measurement/measurement.h \
     measurement/measurementdefinition.h \
@@ -244,6 +313,17 @@ HEADERS += \
     measurement/http/httpdownload.h \
     measurement/http/httpdownload_definition.h \
     measurement/http/httpdownload_plugin.h \
+    measurement/http/httpresponseparser.h \
+    measurement/pageload/pageload.h \
+    measurement/pageload/pageload_definition.h \
+    measurement/pageload/pageload_plugin.h \
+    measurement/videostreaming/videostreaming.h \
+    measurement/videostreaming/videostreaming_definition.h \
+    measurement/videostreaming/videostreaming_plugin.h \
+    measurement/dnsquery/dnsmessage.h \
+    measurement/dnsquery/dnsquery.h \
+    measurement/dnsquery/dnsquery_definition.h \
+    measurement/dnsquery/dnsquery_plugin.h \
     timing/ondemandtiming.h \
     log/filelogger.h \
     measurement/ping/ping.h \
@@ -271,6 +351,7 @@ HEADERS += \
     precondition.h \
     network/requests/uploadrequest.h \
     localinformation.h \
+    devicestatesampler.h \
     measurement/wifilookup/wifilookup.h \
     measurement/wifilookup/wifilookup_definition.h \
     measurement/wifilookup/wifilookup_plugin.h \
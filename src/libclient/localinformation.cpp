@@ -1,7 +1,7 @@
 #include "localinformation.h"
 #include "client.h"
 #include "settings.h"
-#include "measurement/upnp/upnp.h"
+#include "devicestatesampler.h"
 
 LocalInformation::LocalInformation()
 {
@@ -11,13 +11,19 @@ QVariantMap LocalInformation::getVariables() const
 {
     QVariantMap map;
     Settings* settings = Client::instance()->settings();
-
-    map.insert("cpu_usage", deviceInfo.cpuUsage());
-    map.insert("free_memory", deviceInfo.freeMemory());
-    map.insert("signal_strength", deviceInfo.signalStrength());
-    map.insert("battery_level", deviceInfo.batteryLevel());
-    map.insert("available_disk_space", deviceInfo.availableDiskSpace());
-    map.insert("connection_mode", networkMangager.connectionMode());
+    // sampled in the background, copying it does not block
+    DeviceState state = Client::instance()->deviceStateSampler()->snapshot();
+
+    // left out until the first sample exists, the defaults are no readings
+    if (state.valid)
+    {
+        map.insert("cpu_usage", state.cpuUsage);
+        map.insert("free_memory", state.freeMemory);
+        map.insert("signal_strength", state.signalStrength);
+        map.insert("battery_level", state.batteryLevel);
+        map.insert("available_disk_space", state.availableDiskSpace);
+        map.insert("connection_mode", state.connectionMode);
+    }
     map.insert("tbm_active", settings->trafficBudgetManagerActive());
     map.insert("available_traffic", settings->allowedTraffic());
     map.insert("available_mobile_traffic", settings->allowedMobileTraffic());
@@ -25,10 +31,6 @@ QVariantMap LocalInformation::getVariables() const
     map.insert("used_mobile_traffic", settings->usedMobileTraffic());
     map.insert("mm_active", settings->mobileMeasurementsActive());
 
-    UPnP measurement;
-
-    measurement.start();
-
     return map;
 }
 
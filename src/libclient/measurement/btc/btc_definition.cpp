@@ -1,11 +1,14 @@
 #include "btc_definition.h"
 
 BulkTransportCapacityDefinition::BulkTransportCapacityDefinition(const QString &host, quint16 port,
-                                                                 quint64 initialDataSize, quint16 slices)
+                                                                 quint64 initialDataSize, quint16 slices,
+                                                                 const QString &direction, quint32 duration)
 : host(host)
 , port(port)
 , initialDataSize(initialDataSize)
 , slices(slices)
+, direction(direction)
+, duration(duration)
 {
 }
 
@@ -20,6 +23,8 @@ QVariant BulkTransportCapacityDefinition::toVariant() const
     map.insert("port", port);
     map.insert("initial_data_size", initialDataSize);
     map.insert("slices", slices);
+    map.insert("direction", direction);
+    map.insert("duration", duration);
     return map;
 }
 
@@ -30,5 +35,22 @@ BulkTransportCapacityDefinitionPtr BulkTransportCapacityDefinition::fromVariant(
     return BulkTransportCapacityDefinitionPtr(new BulkTransportCapacityDefinition(map.value("host", "").toString(),
                                                                                   map.value("port", 0).toUInt(),
                                                                                   map.value("initial_data_size", 1024 * 1024).toUInt(),
-                                                                                  map.value("slices", 10).toUInt()));
+                                                                                  map.value("slices", 10).toUInt(),
+                                                                                  map.value("direction", "download").toString(),
+                                                                                  map.value("duration", 0).toUInt()));
+}
+
+quint64 BulkTransportCapacityDefinition::request(Command command, quint64 argument)
+{
+    return ((quint64)command << 56) | (argument & Q_UINT64_C(0x00ffffffffffffff));
+}
+
+BulkTransportCapacityDefinition::Command BulkTransportCapacityDefinition::requestCommand(quint64 request)
+{
+    return (Command)(request >> 56);
+}
+
+quint64 BulkTransportCapacityDefinition::requestArgument(quint64 request)
+{
+    return request & Q_UINT64_C(0x00ffffffffffffff);
 }
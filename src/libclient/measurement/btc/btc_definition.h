@@ -11,9 +11,30 @@ typedef QList<BulkTransportCapacityDefinitionPtr> BulkTransportCapacityDefinitio
 class BulkTransportCapacityDefinition : public MeasurementDefinition
 {
 public:
-    BulkTransportCapacityDefinition(const QString &host, quint16 port, quint64 initialDataSize, quint16 slices);
+    BulkTransportCapacityDefinition(const QString &host, quint16 port, quint64 initialDataSize, quint16 slices,
+                                    const QString &direction, quint32 duration);
     ~BulkTransportCapacityDefinition();
 
+    // Requests from MA to MP are a quint64 with the command in the top byte,
+    // so a plain byte count is a SendBytes request. Peers without commands
+    // take any request as a byte count, so the MA first sends an empty
+    // SendBytes request. Those peers answer it with nothing, peers that
+    // understand commands answer with request(Hello, protocolVersion).
+    enum Command
+    {
+        SendBytes = 0,
+        SendUntilStop = 1,
+        Stop = 2,
+        Receive = 3, // the MP discards everything on this connection
+        Hello = 4 // only sent by the MP
+    };
+
+    static const int protocolVersion = 1;
+
+    static quint64 request(Command command, quint64 argument = 0);
+    static Command requestCommand(quint64 request);
+    static quint64 requestArgument(quint64 request);
+
     // Storage
     static BulkTransportCapacityDefinitionPtr fromVariant(const QVariant &variant);
 
@@ -22,6 +43,8 @@ public:
     quint16 port;
     quint64 initialDataSize;
     quint16 slices;
+    QString direction; // download, upload or bidirectional
+    quint32 duration; // ms, 0 sizes the download by a pre-test instead
 
     // Serializable interface
     QVariant toVariant() const;
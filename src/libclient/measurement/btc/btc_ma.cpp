@@ -1,44 +1,174 @@
 #include "btc_ma.h"
+#include "btc_mp.h"
 #include "../../log/logger.h"
 #include "../../network/networkmanager.h"
 #include "../../client.h"
 #include "../../trafficbudgetmanager.h"
+#include "../../networkhelper.h"
 
 #include <QDataStream>
 #include <numeric>
 #include <QtCore/QtMath>
 
+#if defined(Q_OS_LINUX)
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
+
 LOGGER(BulkTransportCapacityMA);
 
 BulkTransportCapacityMA::BulkTransportCapacityMA(QObject *parent)
 : Measurement(parent)
 , m_preTest(true)
+, m_download(true)
+, m_upload(false)
+, m_handshake(false)
 , m_tcpSocket(NULL)
-, m_lasttime(-1)
+, m_bytesExpected(0)
 , m_status(Unknown)
+, m_payloadOffset(0)
+, m_reservedTraffic(0)
 {
     connect(this, SIGNAL(error(const QString &)), this,
             SLOT(setErrorString(const QString &)));
+    connect(&m_tcpInfoTimer, SIGNAL(timeout()), this, SLOT(sampleTcpInfo()));
+
+    m_durationTimer.setSingleShot(true);
+    connect(&m_durationTimer, SIGNAL(timeout()), this, SLOT(durationElapsed()));
+
+    m_helloTimer.setSingleShot(true);
+    connect(&m_helloTimer, SIGNAL(timeout()), this, SLOT(helloTimedOut()));
+
+    m_downloadFlow.socket = NULL;
+    m_uploadFlow.socket = NULL;
+    resetFlow(m_downloadFlow);
+    resetFlow(m_uploadFlow);
 }
 
 bool BulkTransportCapacityMA::start()
 {
     m_status = BulkTransportCapacityMA::Running;
 
-    LOG_INFO("Sending initial data size to server");
-    sendRequest(definition->initialDataSize);
+    // only the pre-test works with peers that do not understand commands
+    if (definition->duration > 0)
+    {
+        LOG_INFO("Asking the peer for its protocol version");
+        m_handshake = true;
+        m_helloTimer.start(helloTimeout);
+        sendRequest(m_tcpSocket, BulkTransportCapacityDefinition::request(BulkTransportCapacityDefinition::SendBytes));
+    }
+    else
+    {
+        startTransfer();
+    }
 
     return true;
 }
 
-void BulkTransportCapacityMA::sendRequest(quint64 bytes)
+void BulkTransportCapacityMA::startTransfer()
+{
+    m_time.start();
+
+    if (definition->duration > 0)
+    {
+        m_downloadFlow.tcpInfo.reserve(definition->duration / tcpInfoInterval + 2);
+        m_uploadFlow.tcpInfo.reserve(definition->duration / tcpInfoInterval + 2);
+        m_tcpInfoTime.start();
+        m_tcpInfoTimer.start(tcpInfoInterval);
+        m_durationTimer.start(definition->duration);
+    }
+
+    if (m_download)
+    {
+        m_downloadFlow.socket = m_tcpSocket;
+
+        if (definition->duration > 0)
+        {
+            LOG_INFO("Requesting data until the duration elapsed");
+            sendRequest(m_tcpSocket, BulkTransportCapacityDefinition::request(BulkTransportCapacityDefinition::SendUntilStop));
+        }
+        else
+        {
+            LOG_INFO("Sending initial data size to server");
+            m_bytesExpected = definition->initialDataSize;
+            sendRequest(m_tcpSocket, definition->initialDataSize);
+        }
+    }
+
+    if (m_upload)
+    {
+        if (!m_download)
+        {
+            m_uploadFlow.socket = m_tcpSocket;
+            uploadConnected();
+        }
+        else
+        {
+            // the peer accepts a second connection for the other direction
+            m_uploadFlow.socket = new QTcpSocket(this);
+            connect(m_uploadFlow.socket, SIGNAL(connected()), this, SLOT(uploadConnected()));
+            connect(m_uploadFlow.socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+                    SLOT(handleError(QAbstractSocket::SocketError)));
+            m_uploadFlow.socket->connectToHost(definition->host, definition->port);
+        }
+    }
+}
+
+void BulkTransportCapacityMA::sendRequest(QTcpSocket *socket, quint64 request)
+{
+    QDataStream out(socket);
+    out << request;
+}
+
+void BulkTransportCapacityMA::resetFlow(Flow &flow)
+{
+    flow.measuring = false;
+    flow.bytes = 0;
+    flow.totalBytes = 0;
+    flow.baseBytes = 0;
+    flow.sampleTimes.clear();
+    flow.sampleBytes.clear();
+}
+
+void BulkTransportCapacityMA::addSample(Flow &flow, qint64 bytes)
+{
+    flow.bytes = qMax(flow.bytes, bytes);
+    flow.sampleTimes.append(m_time.nsecsElapsed());
+    flow.sampleBytes.append(flow.bytes);
+}
+
+qint64 BulkTransportCapacityMA::deliveredBytes(const Flow &flow) const
 {
-    // invalidate timer
-    m_time.invalidate();
+#if defined(Q_OS_LINUX)
+    // bytes still in the send queue have not reached the peer yet
+    int queued = 0;
 
-    m_bytesExpected = bytes;
-    QDataStream out(m_tcpSocket);
-    out << bytes;
+    if (ioctl(flow.socket->socketDescriptor(), SIOCOUTQ, &queued) == 0)
+    {
+        return flow.totalBytes - queued;
+    }
+#endif
+
+    return flow.totalBytes;
+}
+
+void BulkTransportCapacityMA::writePayload()
+{
+    QTcpSocket *socket = m_uploadFlow.socket;
+
+    // only a few buffers are queued, bytesWritten() asks for more
+    while (m_status == BulkTransportCapacityMA::Running &&
+           socket->bytesToWrite() < BulkTransportCapacityMP::writeAhead)
+    {
+        qint64 written = socket->write(m_payload.constData() + m_payloadOffset, m_payload.size() - m_payloadOffset);
+
+        if (written <= 0)
+        {
+            return;
+        }
+
+        m_payloadOffset = (m_payloadOffset + written) % m_payload.size();
+    }
 }
 
 void BulkTransportCapacityMA::calculateResult()
@@ -46,8 +176,10 @@ void BulkTransportCapacityMA::calculateResult()
     // if we are in pretest-phase we need to calculate the bytes for the big test
     if (m_preTest)
     {
+        qint64 time = m_downloadFlow.sampleTimes.last() - m_downloadFlow.sampleTimes.first();
+
         // get the download speed in kbyte
-        qreal downloadSpeed = (m_bytesReceived / 1024.0) / (((m_lasttime / 1000.0) / 1000) / 1000);
+        qreal downloadSpeed = (m_downloadFlow.bytes / 1024.0) / (((time / 1000.0) / 1000) / 1000);
 
         LOG_INFO(QString("Speed (pretest): %1 KByte/s").arg(downloadSpeed, 0, 'f', 0));
 
@@ -57,10 +189,16 @@ void BulkTransportCapacityMA::calculateResult()
         // Request high amount of data
         LOG_INFO("Sending test data size to server");
         m_preTest = false;
+        resetFlow(m_downloadFlow);
 
         if (Client::instance()->trafficBudgetManager()->addUsedTraffic(m_bytesExpected))
         {
-            sendRequest(m_bytesExpected);
+            sendRequest(m_tcpSocket, m_bytesExpected);
+
+            // the test should take about 3 seconds
+            m_downloadFlow.tcpInfo.reserve(5000 / tcpInfoInterval);
+            m_tcpInfoTime.start();
+            m_tcpInfoTimer.start(tcpInfoInterval);
         }
         else
         {
@@ -71,94 +209,272 @@ void BulkTransportCapacityMA::calculateResult()
     }
     else
     {
-        // calculate download speed for n slices
-        int slices = 10; // TODO 10 slices, as parameter?
-        int slice_size = ceil((double)m_times.size() / slices); // round up to get the correct number of slices
+        finishMeasurement();
+    }
+}
+
+void BulkTransportCapacityMA::finishMeasurement()
+{
+    m_durationTimer.stop();
+    m_tcpInfoTimer.stop();
+    sampleTcpInfo();
+
+    m_status = BulkTransportCapacityMA::Finished;
+
+    if (definition->duration > 0 && m_download)
+    {
+        sendRequest(m_tcpSocket, BulkTransportCapacityDefinition::request(BulkTransportCapacityDefinition::Stop));
+    }
+
+    QVariantMap download = flowResult(m_downloadFlow);
+    QVariantMap upload = flowResult(m_uploadFlow);
+
+    // the main direction keeps the original keys
+    m_results = m_download ? download : upload;
+    m_results.remove("slices");
+    m_results.insert("direction", definition->direction);
+    m_results.insert("duration", definition->duration);
+
+    if (m_download)
+    {
+        m_results.insert("download", download);
+    }
 
-        // counters
-        qint64 bytes = 0;
-        qint64 time = 0;
+    if (m_upload)
+    {
+        m_results.insert("upload", upload);
+    }
+
+    LOG_INFO(QString("Speed (mean): %1 KByte/s").arg(m_results.value("kBs_avg").toDouble(), 0, 'f', 0));
+
+    emit finished();
+}
+
+bool BulkTransportCapacityMA::reservationUsed() const
+{
+    return definition->duration > 0 &&
+           (quint64)(m_downloadFlow.totalBytes + m_uploadFlow.totalBytes) >= m_reservedTraffic;
+}
 
-        // calculate slices
-        for (int i = 0; i < m_times.size(); i++)
+QVariantMap BulkTransportCapacityMA::flowResult(const Flow &flow) const
+{
+    QVariantMap res;
+    int samples = flow.sampleTimes.size();
+
+    if (samples < 2)
+    {
+        return res;
+    }
+
+    // split the measured time into equally long slices
+    qint64 begin = flow.sampleTimes.first();
+    qint64 length = flow.sampleTimes.last() - begin;
+    int slices = definition->slices;
+    int sample = 0;
+    qint64 sliceStartBytes = flow.sampleBytes.first();
+    QList<qreal> speeds;
+    QVariantList sliceList;
+
+    for (int i = 0; i < slices; i++)
+    {
+        qint64 sliceBegin = begin + length * i / slices;
+        qint64 sliceEnd = begin + length * (i + 1) / slices;
+
+        // bytes up to the last sample within the slice
+        while (sample + 1 < samples && flow.sampleTimes.at(sample + 1) <= sliceEnd)
         {
-            bytes += m_bytesReceivedList.at(i);
-            time += m_times.at(i);
-
-            // calculate a slice if enough samples are added up or if this is the last iteration
-            if (((i + 1) % slice_size) == 0 || i == m_times.size() - 1) // calculate a slice
-            {
-                qreal speed = (bytes / 1024.0) / (((time / 1000.0) / 1000) / 1000);
-                m_downloadSpeeds << speed;
-
-                // reset counters
-                bytes = 0;
-                time = 0;
-            }
+            sample++;
         }
 
-        // calculate mean speed
-        qreal sum = std::accumulate(m_downloadSpeeds.begin(), m_downloadSpeeds.end(), 0.0);
-        qreal mean = sum / m_downloadSpeeds.size();
-        LOG_INFO(QString("Speed (mean): %1 KByte/s").arg(mean, 0, 'f', 0));
+        qint64 bytes = flow.sampleBytes.at(sample) - sliceStartBytes;
+        sliceStartBytes = flow.sampleBytes.at(sample);
 
-        /* At the moment deactivated
-        // calculate standard deviation
-        qreal sq_sum = std::inner_product(speeds.begin(), speeds.end(), speeds.begin(), 0.0);
-        qreal stdev = qSqrt(sq_sum / speeds.size() - mean * mean);
-        LOG_INFO(QString("Standard deviation: %1").arg(stdev, 0, 'f', 0));
-        */
+        qreal speed = sliceEnd > sliceBegin ? (bytes / 1024.0) / ((sliceEnd - sliceBegin) / 1000000000.0) : 0.0;
+        speeds << speed;
 
-        /* At the moment deactivated to get all results
-        // get ride of the lower and upper 20%
-        qSort(speeds);
-        int percentil = slices * 0.2;
-        sum = std::accumulate(speeds.begin()+percentil, speeds.end()-percentil, 0.0);
-        mean = sum / (speeds.size() - 2 * percentil);
-        LOG_INFO(QString("Speed (60 percentil mean): %1 KByte/s").arg(mean, 0, 'f', 0));
-        */
+        QVariantMap slice;
+        slice.insert("start_ns", sliceBegin);
+        slice.insert("end_ns", sliceEnd);
+        slice.insert("bytes", bytes);
+        sliceList << slice;
+    }
 
-        m_status = BulkTransportCapacityMA::Finished;
+    QVariantList speedList;
+    qreal avg = 0.0;
 
-        emit finished();
+    foreach (qreal val, speeds)
+    {
+        speedList << val;
+        avg += val;
     }
+
+    avg /= speeds.size();
+
+    // calculate standard deviation
+    qreal sq_sum = std::inner_product(speeds.begin(), speeds.end(), speeds.begin(), 0.0);
+    qreal stdev = qSqrt(qMax(0.0, sq_sum / speeds.size() - avg * avg));
+
+    res.insert("kBs_avg", avg);
+    res.insert("kBs_min", *std::min_element(speeds.begin(), speeds.end()));
+    res.insert("kBs_max", *std::max_element(speeds.begin(), speeds.end()));
+    res.insert("kBs_stddev", stdev);
+    res.insert("kBs", speedList);
+    res.insert("bytes", flow.bytes);
+    res.insert("duration_ns", length);
+    res.insert("slices", sliceList);
+
+    if (!flow.tcpInfo.isEmpty())
+    {
+        res.insert("tcp_info", flow.tcpInfo.toVariant());
+    }
+
+    return res;
 }
 
 void BulkTransportCapacityMA::receiveResponse()
 {
-    qint64 time = m_time.nsecsElapsed();
+    // whatever arrives after the end is not measured
+    if (m_status != BulkTransportCapacityMA::Running)
+    {
+        m_tcpSocket->readAll();
+        return;
+    }
 
-    // if the timer is not valid this is the first response packet
-    if (!m_time.isValid())
+    if (m_handshake)
     {
-        // reset variables
-        m_bytesReceived = 0;
-        m_lasttime = 0;
+        if (m_tcpSocket->bytesAvailable() < (int)sizeof(quint64))
+        {
+            return;
+        }
 
-        // this packet counts to the total bytes, but not to the measurement bytes in m_bytesReceived
-        m_totalBytesReceived = m_tcpSocket->bytesAvailable();
+        QDataStream in(m_tcpSocket);
+        quint64 reply;
+        in >> reply;
 
-        // ignor the first data received
-        m_tcpSocket->readAll();
+        m_handshake = false;
+        m_helloTimer.stop();
+
+        if (BulkTransportCapacityDefinition::requestCommand(reply) != BulkTransportCapacityDefinition::Hello ||
+            BulkTransportCapacityDefinition::requestArgument(reply) < BulkTransportCapacityDefinition::protocolVersion)
+        {
+            LOG_ERROR("Peer does not understand commands");
+            emit error("peer does not support this mode");
+            return;
+        }
+
+        startTransfer();
+        return;
+    }
+
+    Flow &flow = m_downloadFlow;
+    qint64 bytes = m_tcpSocket->bytesAvailable();
+    m_tcpSocket->readAll(); // we don't care for the data-content
 
-        m_time.restart();
+    flow.totalBytes += bytes;
+
+    // the first data only starts the measurement, it does not count
+    if (!flow.measuring)
+    {
+        flow.measuring = true;
+        addSample(flow, 0);
     }
-    else // this is a response within an active measurement
+    else
     {
-        qint64 bytes = m_tcpSocket->bytesAvailable();
-        m_bytesReceivedList << bytes;
-        m_times << time - m_lasttime;
-        m_bytesReceived += bytes;
-        m_totalBytesReceived += bytes;
-        m_tcpSocket->readAll(); // we don't care for the data-content
-        m_lasttime = time;
+        addSample(flow, flow.bytes + bytes);
     }
 
     // check if all measurement data was received
-    if (m_totalBytesReceived >= m_bytesExpected)
+    if (definition->duration == 0 && flow.totalBytes >= m_bytesExpected)
     {
         calculateResult();
     }
+    else if (reservationUsed())
+    {
+        LOG_INFO("Reserved traffic used up");
+        finishMeasurement();
+    }
+}
+
+void BulkTransportCapacityMA::helloTimedOut()
+{
+    // peers without commands answer the empty request with nothing
+    m_handshake = false;
+    LOG_ERROR("Peer did not answer the hello");
+    emit error("peer does not support this mode");
+}
+
+void BulkTransportCapacityMA::uploadConnected()
+{
+    m_payload = NetworkHelper::incompressiblePayload(BulkTransportCapacityMP::payloadSize);
+
+    connect(m_uploadFlow.socket, SIGNAL(bytesWritten(qint64)), this, SLOT(uploadWritten(qint64)));
+
+    LOG_INFO("Uploading until the duration elapsed");
+    sendRequest(m_uploadFlow.socket, BulkTransportCapacityDefinition::request(BulkTransportCapacityDefinition::Receive));
+    writePayload();
+}
+
+void BulkTransportCapacityMA::uploadWritten(qint64 bytes)
+{
+    if (m_status != BulkTransportCapacityMA::Running)
+    {
+        return;
+    }
+
+    Flow &flow = m_uploadFlow;
+    flow.totalBytes += bytes;
+
+    qint64 delivered = deliveredBytes(flow);
+
+    // as for downloads the first data only starts the measurement
+    if (!flow.measuring)
+    {
+        flow.measuring = true;
+        flow.baseBytes = delivered;
+        addSample(flow, 0);
+    }
+    else
+    {
+        addSample(flow, delivered - flow.baseBytes);
+    }
+
+    if (reservationUsed())
+    {
+        LOG_INFO("Reserved traffic used up");
+        finishMeasurement();
+        return;
+    }
+
+    writePayload();
+}
+
+void BulkTransportCapacityMA::durationElapsed()
+{
+    LOG_INFO("Duration elapsed");
+
+    if (m_upload && m_uploadFlow.measuring)
+    {
+        // one last look at what has been delivered by now
+        addSample(m_uploadFlow, deliveredBytes(m_uploadFlow) - m_uploadFlow.baseBytes);
+    }
+
+    finishMeasurement();
+}
+
+void BulkTransportCapacityMA::sampleTcpInfo()
+{
+    qint64 time = m_tcpInfoTime.elapsed();
+
+    // in the bidirectional mode each direction has its own connection
+    if (m_downloadFlow.socket)
+    {
+        m_downloadFlow.tcpInfo.sample(m_downloadFlow.socket->socketDescriptor(), time);
+    }
+
+    if (m_uploadFlow.socket && m_uploadFlow.socket->state() == QAbstractSocket::ConnectedState)
+    {
+        m_uploadFlow.tcpInfo.sample(m_uploadFlow.socket->socketDescriptor(), time);
+    }
 }
 
 void BulkTransportCapacityMA::serverDisconnected()
@@ -197,6 +513,28 @@ bool BulkTransportCapacityMA::prepare(NetworkManager *networkManager,
         return false;
     }
 
+    if (definition->slices < 1 || definition->slices > maxSlices)
+    {
+        setErrorString("requested number of slices wrong");
+        return false;
+    }
+
+    m_download = definition->direction == "download" || definition->direction == "bidirectional";
+    m_upload = definition->direction == "upload" || definition->direction == "bidirectional";
+
+    if (!m_download && !m_upload)
+    {
+        setErrorString(QString("unknown direction: %1").arg(definition->direction));
+        return false;
+    }
+
+    // only a download can be sized by a pre-test
+    if (m_upload && definition->duration == 0)
+    {
+        setErrorString("upload requires a duration");
+        return false;
+    }
+
     QString hostname = QString("%1:%2").arg(definition->host).arg(definition->port);
 
     m_tcpSocket = qobject_cast<QTcpSocket *>(networkManager->establishConnection(hostname, taskId(), "btc_mp", definition,
@@ -210,14 +548,35 @@ bool BulkTransportCapacityMA::prepare(NetworkManager *networkManager,
 
     m_tcpSocket->setParent(this);
     m_bytesExpected = 0;
-    m_preTest = true;
+    m_preTest = definition->duration == 0;
 
-    if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(definition->initialDataSize))
+    if (m_preTest && !Client::instance()->trafficBudgetManager()->addUsedTraffic(definition->initialDataSize))
     {
         setErrorString("not enough traffic available");
         return false;
     }
 
+    if (!m_preTest)
+    {
+        // the size is not known up front, so the worst case is reserved;
+        // what the peer queued before the stop is reserved on top
+        int flows = (m_download ? 1 : 0) + (m_upload ? 1 : 0);
+        m_reservedTraffic = (quint64)definition->duration * maxBytesPerSecond / 1000 * flows;
+        quint64 reservation = m_reservedTraffic + flows * BulkTransportCapacityMP::writeAhead;
+
+        if (reservation > 0xffffffff)
+        {
+            setErrorString("duration too long for the traffic budget");
+            return false;
+        }
+
+        if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(reservation))
+        {
+            setErrorString("not enough traffic available");
+            return false;
+        }
+    }
+
     // Signal for new data
     connect(m_tcpSocket, SIGNAL(readyRead()), this, SLOT(receiveResponse()));
 
@@ -233,6 +592,15 @@ bool BulkTransportCapacityMA::prepare(NetworkManager *networkManager,
 
 bool BulkTransportCapacityMA::stop()
 {
+    m_helloTimer.stop();
+    m_durationTimer.stop();
+    m_tcpInfoTimer.stop();
+
+    if (m_uploadFlow.socket && m_uploadFlow.socket != m_tcpSocket)
+    {
+        m_uploadFlow.socket->abort();
+    }
+
     if (m_tcpSocket)
     {
         m_tcpSocket->disconnectFromHost();
@@ -249,34 +617,5 @@ bool BulkTransportCapacityMA::stop()
 
 Result BulkTransportCapacityMA::result() const
 {
-    QVariantMap res;
-    QVariantList downSpeeds;
-    float avg = 0.0;
-
-    // get max and min
-    QList<qreal>::const_iterator it = std::max_element(m_downloadSpeeds.begin(), m_downloadSpeeds.end());
-    float max = *it;
-    it = std::min_element(m_downloadSpeeds.begin(), m_downloadSpeeds.end());
-    float min = *it;
-
-    // calculate average and fill downspeeds
-    foreach (qreal val, m_downloadSpeeds)
-    {
-        downSpeeds << val;
-        avg += val;
-    }
-
-    avg /= m_downloadSpeeds.size();
-
-    // calculate standard deviation
-    qreal sq_sum = std::inner_product(m_downloadSpeeds.begin(), m_downloadSpeeds.end(), m_downloadSpeeds.begin(), 0.0);
-    qreal stdev = qSqrt(sq_sum / m_downloadSpeeds.size() - avg * avg);
-
-    res.insert("kBs_avg", avg);
-    res.insert("kBs_min", min);
-    res.insert("kBs_max", max);
-    res.insert("kBs_stddev", stdev);
-    res.insert("kBs", downSpeeds);
-
-    return Result(res, definition->measurementUuid);
+    return Result(m_results, definition->measurementUuid);
 }
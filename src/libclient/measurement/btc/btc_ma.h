@@ -3,11 +3,25 @@
 
 #include "../measurement.h"
 #include "btc_definition.h"
+#include "../../network/tcpinfoseries.h"
 
 #include <QObject>
 #include <QTcpSocket>
 #include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
 
+/*
+ * Measures the bulk transport capacity to a btc_mp peer. By default the
+ * download size is derived from a pre-test so that the transfer takes about
+ * three seconds. With a duration the peer sends until it is told to stop,
+ * the upload direction sends to the peer instead and the bidirectional mode
+ * does both at the same time over a second connection. Every flow records
+ * (monotonic ns, bytes) samples that are split into equally long slices.
+ * These modes need a peer that understands commands, which is checked by a
+ * handshake first. Their traffic is reserved up front for the worst case
+ * and the transfer ends early once the reservation is used up.
+ */
 class BulkTransportCapacityMA : public Measurement
 {
     Q_OBJECT
@@ -23,24 +37,62 @@ public:
     Result result() const;
 
 private:
-    void sendRequest(quint64 bytes);
+    struct Flow
+    {
+        QTcpSocket *socket;
+        bool measuring; // the first packets are not measured
+        qint64 bytes; // measured bytes
+        qint64 totalBytes; // received resp. handed to the kernel
+        qint64 baseBytes; // delivered bytes when the upload measurement began
+        QVector<qint64> sampleTimes; // ns on m_time
+        QVector<qint64> sampleBytes; // measured bytes up to the sample
+        TcpInfoSeries tcpInfo;
+    };
+
+    void startTransfer();
+    void sendRequest(QTcpSocket *socket, quint64 request);
+    void resetFlow(Flow &flow);
+    void addSample(Flow &flow, qint64 bytes);
+    qint64 deliveredBytes(const Flow &flow) const;
+    void writePayload();
     void calculateResult();
+    void finishMeasurement();
+    bool reservationUsed() const;
+    QVariantMap flowResult(const Flow &flow) const;
 
     BulkTransportCapacityDefinitionPtr definition;
     bool m_preTest;
+    bool m_download;
+    bool m_upload;
+    bool m_handshake; // waiting for the answer to the hello
     QTcpSocket *m_tcpSocket;
     QElapsedTimer m_time;
-    qint64 m_bytesReceived; // without first packets
-    qint64 m_totalBytesReceived; // with first packets
     qint64 m_bytesExpected;
-    qint64 m_lasttime;
-    QList<qreal> m_downloadSpeeds;
     Status m_status;
-    QVector<qint64> m_bytesReceivedList;
-    QVector<qint64> m_times;
+    Flow m_downloadFlow;
+    Flow m_uploadFlow;
+    QByteArray m_payload;
+    int m_payloadOffset;
+    QTimer m_durationTimer;
+    QTimer m_helloTimer;
+    quint64 m_reservedTraffic; // bytes, duration mode only
+    QVariantMap m_results;
+    QTimer m_tcpInfoTimer;
+    QElapsedTimer m_tcpInfoTime;
+
+    static const int tcpInfoInterval = 100; // ms
+    static const int maxSlices = 1000;
+    static const int helloTimeout = 3000; // ms
+    // per direction, the duration mode reserves traffic for this rate
+    static const int maxBytesPerSecond = 12500000;
 
 private slots:
     void receiveResponse();
+    void helloTimedOut();
+    void uploadConnected();
+    void uploadWritten(qint64 bytes);
+    void durationElapsed();
+    void sampleTcpInfo();
     void serverDisconnected();
     void handleError(QAbstractSocket::SocketError socketError);
 };
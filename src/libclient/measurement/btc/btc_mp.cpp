@@ -1,6 +1,7 @@
 #include "btc_mp.h"
 #include "../../log/logger.h"
 #include "../../network/networkmanager.h"
+#include "../../networkhelper.h"
 
 #include <QDataStream>
 
@@ -9,10 +10,11 @@ LOGGER(BulkTransportCapacityMP);
 BulkTransportCapacityMP::BulkTransportCapacityMP(QObject *parent)
 : Measurement(parent)
 , m_tcpServer(NULL)
+, m_payload(NetworkHelper::incompressiblePayload(payloadSize))
+, m_scratch(payloadSize, Qt::Uninitialized)
 {
     connect(this, SIGNAL(error(const QString &)), this,
             SLOT(setErrorString(const QString &)));
-    resetServer();
 }
 
 bool BulkTransportCapacityMP::start()
@@ -23,59 +25,172 @@ bool BulkTransportCapacityMP::start()
     return ret;
 }
 
-qint64 BulkTransportCapacityMP::sendResponse(quint64 bytes)
+void BulkTransportCapacityMP::handleRequest(QTcpSocket *socket, quint64 request)
 {
-    // send data back
-    QByteArray data;
-    data.resize(bytes);
-    data.fill('X'); // TODO: do we need to randomize this to prevent compression on the path?
-    return m_tcpSocket->write(data);
+    Client &client = m_clients[socket];
+    quint64 argument = BulkTransportCapacityDefinition::requestArgument(request);
+
+    switch (BulkTransportCapacityDefinition::requestCommand(request))
+    {
+    case BulkTransportCapacityDefinition::SendBytes:
+        // an empty request asks which commands we understand
+        if (argument == 0)
+        {
+            QDataStream out(socket);
+            out << BulkTransportCapacityDefinition::request(BulkTransportCapacityDefinition::Hello,
+                                                            BulkTransportCapacityDefinition::protocolVersion);
+            return;
+        }
+
+        // send data back, writePayload() keeps the socket fed from now on
+        client.bytesRemaining = argument;
+        client.unbounded = false;
+        break;
+
+    case BulkTransportCapacityDefinition::SendUntilStop:
+        client.unbounded = true;
+        break;
+
+    case BulkTransportCapacityDefinition::Stop:
+        // whatever is queued in the socket still goes out
+        client.bytesRemaining = 0;
+        client.unbounded = false;
+        break;
+
+    case BulkTransportCapacityDefinition::Receive:
+        client.receiving = true;
+        break;
+
+    default:
+        LOG_WARNING(QString("Unknown request %1").arg(request, 16, 16, QChar('0')));
+        return;
+    }
+
+    writePayload(socket);
 }
 
-void BulkTransportCapacityMP::resetServer()
+void BulkTransportCapacityMP::writePayload(QTcpSocket *socket)
 {
-    m_tcpSocket = 0;
+    if (!m_clients.contains(socket))
+    {
+        return;
+    }
+
+    Client &client = m_clients[socket];
+
+    // only a few buffers are queued, bytesWritten() asks for more
+    while ((client.unbounded || client.bytesRemaining > 0) && socket->bytesToWrite() < writeAhead)
+    {
+        qint64 size = m_payload.size() - client.payloadOffset;
+
+        if (!client.unbounded)
+        {
+            size = qMin<quint64>(client.bytesRemaining, size);
+        }
+
+        qint64 written = socket->write(m_payload.constData() + client.payloadOffset, size);
+
+        if (written <= 0)
+        {
+            LOG_WARNING(QString("Unable to write response: %1").arg(socket->errorString()));
+            client.bytesRemaining = 0;
+            client.unbounded = false;
+            return;
+        }
+
+        if (!client.unbounded)
+        {
+            client.bytesRemaining -= written;
+        }
+
+        client.payloadOffset = (client.payloadOffset + written) % m_payload.size();
+    }
 }
 
 void BulkTransportCapacityMP::newClientConnection()
 {
     LOG_INFO("New client connection");
 
-    if (!m_tcpSocket)
-    {
-        m_tcpSocket = m_tcpServer->nextPendingConnection();
+    QTcpSocket *socket = m_tcpServer->nextPendingConnection();
 
-        connect(m_tcpSocket, SIGNAL(disconnected()), this, SIGNAL(finished()));
-        connect(m_tcpSocket, SIGNAL(disconnected()), m_tcpSocket, SLOT(deleteLater()));
-        connect(m_tcpSocket, SIGNAL(readyRead()), this, SLOT(receiveRequest()));
-        connect(m_tcpSocket, SIGNAL(destroyed()), this, SLOT(resetServer()));
+    if (m_clients.size() >= maxClients)
+    {
+        LOG_WARNING("There are already enough clients connected, abort");
+        socket->abort();
+        delete socket;
+        return;
     }
-    else
+
+    Client client;
+    client.bytesRemaining = 0;
+    client.unbounded = false;
+    client.receiving = false;
+    client.payloadOffset = 0;
+    m_clients.insert(socket, client);
+
+    connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    connect(socket, SIGNAL(readyRead()), this, SLOT(receiveRequest()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(continueWriting()));
+}
+
+void BulkTransportCapacityMP::clientDisconnected()
+{
+    m_clients.remove(qobject_cast<QTcpSocket *>(sender()));
+
+    // done once the last connection of the MA is gone
+    if (m_clients.isEmpty())
     {
-        LOG_WARNING("There is already a client connected, abort");
-        QTcpSocket *next = m_tcpServer->nextPendingConnection();
-        next->abort();
-        delete next;
+        emit finished();
     }
 }
 
 void BulkTransportCapacityMP::receiveRequest()
 {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    // uploaded data is only counted by the MA
+    if (m_clients.value(socket).receiving)
+    {
+        discard(socket);
+        return;
+    }
+
     LOG_INFO("New client request");
 
     // abort if received data is not what we expected
-    if (m_tcpSocket->bytesAvailable() < (int)sizeof(quint64))
+    if (socket->bytesAvailable() < (int)sizeof(quint64))
     {
         LOG_DEBUG("Data length is not what we expected");
         return;
     }
 
-    // get bytes from message
-    QDataStream in(m_tcpSocket);
+    // get requests from message
+    QDataStream in(socket);
+
+    while (socket->bytesAvailable() >= (int)sizeof(quint64) && !m_clients.value(socket).receiving)
+    {
+        quint64 request;
+        in >> request;
+        handleRequest(socket, request);
+    }
+
+    if (m_clients.value(socket).receiving)
+    {
+        discard(socket);
+    }
+}
 
-    quint64 bytes;
-    in >> bytes;
-    sendResponse(bytes);
+void BulkTransportCapacityMP::discard(QTcpSocket *socket)
+{
+    while (socket->read(m_scratch.data(), m_scratch.size()) > 0)
+    {
+    }
+}
+
+void BulkTransportCapacityMP::continueWriting()
+{
+    writePayload(qobject_cast<QTcpSocket *>(sender()));
 }
 
 void BulkTransportCapacityMP::handleError(QAbstractSocket::SocketError socketError)
@@ -106,7 +221,7 @@ bool BulkTransportCapacityMP::prepare(NetworkManager *networkManager,
         setErrorString("Definition is empty");
     }
 
-    m_tcpSocket = 0;
+    m_clients.clear();
     m_tcpServer = networkManager->createServerSocket();
     m_tcpServer->setParent(this);
 
@@ -122,7 +237,10 @@ bool BulkTransportCapacityMP::prepare(NetworkManager *networkManager,
 
 bool BulkTransportCapacityMP::stop()
 {
-    delete m_tcpSocket;
+    QList<QTcpSocket *> sockets = m_clients.keys();
+    m_clients.clear();
+    qDeleteAll(sockets);
+
     return true;
 }
 
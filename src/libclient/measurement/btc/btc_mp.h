@@ -5,6 +5,7 @@
 #include "btc_definition.h"
 
 #include <QObject>
+#include <QHash>
 #include <QTcpServer>
 #include <QTcpSocket>
 
@@ -22,17 +23,39 @@ public:
     bool stop();
     Result result() const;
 
+    static const int payloadSize = 65536;
+    // bytes kept queued in a socket, refilled as they are written
+    static const int writeAhead = 4 * payloadSize;
+
 private:
-    qint64 sendResponse(quint64 bytes);
+    struct Client
+    {
+        quint64 bytesRemaining;
+        bool unbounded; // sends until a Stop request
+        bool receiving;
+        int payloadOffset;
+    };
+
+    void handleRequest(QTcpSocket *socket, quint64 request);
+    void writePayload(QTcpSocket *socket);
+    void discard(QTcpSocket *socket);
 
     BulkTransportCapacityDefinitionPtr definition;
     QTcpServer *m_tcpServer;
-    QTcpSocket *m_tcpSocket;
+    QHash<QTcpSocket *, Client> m_clients;
+
+    // the responses are streamed from this buffer, memory stays constant
+    QByteArray m_payload;
+    QByteArray m_scratch;
+
+    // the bidirectional mode uses a second connection
+    static const int maxClients = 2;
 
 private slots:
-    void resetServer();
     void newClientConnection();
+    void clientDisconnected();
     void receiveRequest();
+    void continueWriting();
     void handleError(QAbstractSocket::SocketError socketError);
 };
 
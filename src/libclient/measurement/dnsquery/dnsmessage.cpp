@@ -0,0 +1,448 @@
+#include "dnsmessage.h"
+
+#include <QHostAddress>
+#include <QStringList>
+#include <QUrl>
+#include <QtEndian>
+
+#include <string.h>
+
+namespace
+{
+    inline quint16 read16(const QByteArray &data, int offset)
+    {
+        return qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(data.constData() + offset));
+    }
+
+    inline quint32 read32(const QByteArray &data, int offset)
+    {
+        return qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + offset));
+    }
+
+    inline void append16(QByteArray &data, quint16 value)
+    {
+        data.append((char)(value >> 8));
+        data.append((char)(value & 0xff));
+    }
+}
+
+DnsMessage::DnsMessage()
+: m_id(0)
+, m_response(false)
+, m_truncated(false)
+, m_rcode(0)
+, m_questionType(0)
+, m_answerCount(0)
+{
+}
+
+QByteArray DnsMessage::query(quint16 id, const QString &name, quint16 type)
+{
+    QByteArray ace = QUrl::toAce(name);
+
+    if (ace.endsWith('.'))
+    {
+        ace.chop(1);
+    }
+
+    if (ace.isEmpty() || ace.size() > maxNameSize - 2)
+    {
+        return QByteArray();
+    }
+
+    QByteArray data;
+    data.reserve(headerSize + ace.size() + 6);
+
+    append16(data, id);
+    append16(data, 0x0100); // standard query, recursion desired
+    append16(data, 1); // QDCOUNT
+    append16(data, 0); // ANCOUNT
+    append16(data, 0); // NSCOUNT
+    append16(data, 0); // ARCOUNT
+
+    foreach (const QByteArray &label, ace.split('.'))
+    {
+        if (label.isEmpty() || label.size() > maxLabelSize)
+        {
+            return QByteArray();
+        }
+
+        data.append((char)label.size());
+        data.append(label);
+    }
+
+    data.append('\0');
+    append16(data, type);
+    append16(data, 1); // class IN
+
+    return data;
+}
+
+quint16 DnsMessage::typeFromString(const QString &type)
+{
+    QString upper = type.toUpper();
+
+    if (upper == "A")
+    {
+        return A;
+    }
+    else if (upper == "NS")
+    {
+        return NS;
+    }
+    else if (upper == "CNAME")
+    {
+        return CNAME;
+    }
+    else if (upper == "SOA")
+    {
+        return SOA;
+    }
+    else if (upper == "PTR")
+    {
+        return PTR;
+    }
+    else if (upper == "MX")
+    {
+        return MX;
+    }
+    else if (upper == "TXT")
+    {
+        return TXT;
+    }
+    else if (upper == "AAAA")
+    {
+        return AAAA;
+    }
+    else if (upper == "SRV")
+    {
+        return SRV;
+    }
+    else if (upper == "ANY")
+    {
+        return ANY;
+    }
+
+    return 0;
+}
+
+QString DnsMessage::typeToString(quint16 type)
+{
+    switch (type)
+    {
+    case A:
+        return "A";
+
+    case NS:
+        return "NS";
+
+    case CNAME:
+        return "CNAME";
+
+    case SOA:
+        return "SOA";
+
+    case PTR:
+        return "PTR";
+
+    case MX:
+        return "MX";
+
+    case TXT:
+        return "TXT";
+
+    case AAAA:
+        return "AAAA";
+
+    case SRV:
+        return "SRV";
+
+    case ANY:
+        return "ANY";
+
+    default:
+        return QString("TYPE%1").arg(type);
+    }
+}
+
+QString DnsMessage::rcodeToString(int rcode)
+{
+    switch (rcode)
+    {
+    case 0:
+        return "NOERROR";
+
+    case 1:
+        return "FORMERR";
+
+    case 2:
+        return "SERVFAIL";
+
+    case 3:
+        return "NXDOMAIN";
+
+    case 4:
+        return "NOTIMP";
+
+    case 5:
+        return "REFUSED";
+
+    default:
+        return QString("RCODE%1").arg(rcode);
+    }
+}
+
+bool DnsMessage::parse(const QByteArray &data)
+{
+    m_answers.clear();
+
+    if (data.size() < headerSize)
+    {
+        return false;
+    }
+
+    quint16 flags = read16(data, 2);
+    int questions = read16(data, 4);
+
+    m_id = read16(data, 0);
+    m_response = flags & 0x8000;
+    m_truncated = flags & 0x0200;
+    m_rcode = flags & 0x000f;
+    m_answerCount = read16(data, 6);
+    m_questionName.clear();
+    m_questionType = 0;
+
+    int offset = headerSize;
+
+    for (int i = 0; i < questions; i++)
+    {
+        QString name;
+
+        if (!readName(data, &offset, &name) || offset + 4 > data.size())
+        {
+            return false;
+        }
+
+        if (i == 0)
+        {
+            m_questionName = name;
+            m_questionType = read16(data, offset);
+        }
+
+        offset += 4;
+    }
+
+    // a truncated response may end within the answers
+    for (int i = 0; i < m_answerCount; i++)
+    {
+        Record record;
+
+        if (!readRecord(data, &offset, &record))
+        {
+            return m_truncated;
+        }
+
+        m_answers.append(record);
+    }
+
+    return true;
+}
+
+bool DnsMessage::readName(const QByteArray &data, int *offset, QString *name)
+{
+    QByteArray result;
+    int pos = *offset;
+    int pointers = 0;
+    bool jumped = false;
+
+    forever
+    {
+        if (pos >= data.size())
+        {
+            return false;
+        }
+
+        quint8 length = data.at(pos);
+
+        // compression pointer to an earlier name
+        if ((length & 0xc0) == 0xc0)
+        {
+            if (pos + 1 >= data.size() || ++pointers > maxPointers)
+            {
+                return false;
+            }
+
+            if (!jumped)
+            {
+                *offset = pos + 2;
+                jumped = true;
+            }
+
+            pos = ((length & 0x3f) << 8) | (quint8)data.at(pos + 1);
+            continue;
+        }
+
+        if (length & 0xc0)
+        {
+            return false;
+        }
+
+        if (length == 0)
+        {
+            if (!jumped)
+            {
+                *offset = pos + 1;
+            }
+
+            break;
+        }
+
+        if (pos + 1 + length > data.size() || result.size() + length + 1 > maxNameSize)
+        {
+            return false;
+        }
+
+        if (!result.isEmpty())
+        {
+            result.append('.');
+        }
+
+        result.append(data.constData() + pos + 1, length);
+        pos += 1 + length;
+    }
+
+    *name = QString::fromLatin1(result);
+    return true;
+}
+
+bool DnsMessage::readRecord(const QByteArray &data, int *offset, Record *record)
+{
+    if (!readName(data, offset, &record->name) || *offset + 10 > data.size())
+    {
+        return false;
+    }
+
+    record->type = read16(data, *offset);
+    record->ttl = read32(data, *offset + 4);
+
+    int length = read16(data, *offset + 8);
+    int rdata = *offset + 10;
+
+    if (rdata + length > data.size())
+    {
+        return false;
+    }
+
+    *offset = rdata + length;
+
+    // names inside the data may point anywhere into the message
+    int pos = rdata;
+    QString name;
+
+    switch (record->type)
+    {
+    case A:
+        if (length == 4)
+        {
+            record->value = QHostAddress(read32(data, rdata)).toString();
+        }
+
+        break;
+
+    case AAAA:
+        if (length == 16)
+        {
+            Q_IPV6ADDR address;
+            memcpy(address.c, data.constData() + rdata, sizeof(address.c));
+            record->value = QHostAddress(address).toString();
+        }
+
+        break;
+
+    case NS:
+    case CNAME:
+    case PTR:
+        if (readName(data, &pos, &name))
+        {
+            record->value = name;
+        }
+
+        break;
+
+    case MX:
+        pos += 2;
+
+        if (length > 2 && readName(data, &pos, &name))
+        {
+            record->value = QString("%1 %2").arg(read16(data, rdata)).arg(name);
+        }
+
+        break;
+
+    case TXT:
+    {
+        QStringList strings;
+
+        while (pos < rdata + length)
+        {
+            int size = (quint8)data.at(pos);
+
+            if (pos + 1 + size > rdata + length)
+            {
+                break;
+            }
+
+            strings << QString::fromUtf8(data.constData() + pos + 1, size);
+            pos += 1 + size;
+        }
+
+        record->value = strings.join(" ");
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return true;
+}
+
+quint16 DnsMessage::id() const
+{
+    return m_id;
+}
+
+bool DnsMessage::isResponse() const
+{
+    return m_response;
+}
+
+bool DnsMessage::isTruncated() const
+{
+    return m_truncated;
+}
+
+int DnsMessage::rcode() const
+{
+    return m_rcode;
+}
+
+QString DnsMessage::questionName() const
+{
+    return m_questionName;
+}
+
+quint16 DnsMessage::questionType() const
+{
+    return m_questionType;
+}
+
+int DnsMessage::answerCount() const
+{
+    return m_answerCount;
+}
+
+QList<DnsMessage::Record> DnsMessage::answers() const
+{
+    return m_answers;
+}
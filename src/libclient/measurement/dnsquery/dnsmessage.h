@@ -0,0 +1,82 @@
+#ifndef DNSMESSAGE_H
+#define DNSMESSAGE_H
+
+#include "../../export.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/*
+ * Builds DNS queries and parses responses in the wire format of RFC 1035.
+ * Only what a latency measurement needs is decoded: the header, the first
+ * question and the answer section. Values are rendered as text for the
+ * common record types, other records only report their type and TTL.
+ */
+class CLIENT_API DnsMessage
+{
+public:
+    struct Record
+    {
+        QString name;
+        quint16 type;
+        quint32 ttl;
+        QString value; // empty for types that are not decoded
+    };
+
+    enum Type
+    {
+        A = 1,
+        NS = 2,
+        CNAME = 5,
+        SOA = 6,
+        PTR = 12,
+        MX = 15,
+        TXT = 16,
+        AAAA = 28,
+        SRV = 33,
+        ANY = 255
+    };
+
+    DnsMessage();
+
+    // a recursive query for name, empty if the name can not be encoded
+    static QByteArray query(quint16 id, const QString &name, quint16 type);
+
+    // 0 for unknown types
+    static quint16 typeFromString(const QString &type);
+    static QString typeToString(quint16 type);
+    static QString rcodeToString(int rcode);
+
+    // returns false for malformed messages
+    bool parse(const QByteArray &data);
+
+    quint16 id() const;
+    bool isResponse() const;
+    bool isTruncated() const;
+    int rcode() const;
+    QString questionName() const;
+    quint16 questionType() const;
+    int answerCount() const;
+    QList<Record> answers() const;
+
+private:
+    static bool readName(const QByteArray &data, int *offset, QString *name);
+    bool readRecord(const QByteArray &data, int *offset, Record *record);
+
+    quint16 m_id;
+    bool m_response;
+    bool m_truncated;
+    int m_rcode;
+    QString m_questionName;
+    quint16 m_questionType;
+    int m_answerCount;
+    QList<Record> m_answers;
+
+    static const int headerSize = 12;
+    static const int maxLabelSize = 63;
+    static const int maxNameSize = 255;
+    static const int maxPointers = 16;
+};
+
+#endif // DNSMESSAGE_H
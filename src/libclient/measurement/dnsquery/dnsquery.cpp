@@ -0,0 +1,640 @@
+#include "dnsquery.h"
+#include "../../log/logger.h"
+
+#include <QDateTime>
+#include <QTcpSocket>
+#include <QtEndian>
+
+LOGGER(DnsQuery);
+
+namespace
+{
+    // a dual stack socket reports IPv4 senders as v4-mapped IPv6 addresses
+    QHostAddress plainAddress(const QHostAddress &address)
+    {
+        if (address.protocol() != QAbstractSocket::IPv6Protocol)
+        {
+            return address;
+        }
+
+        Q_IPV6ADDR ip6 = address.toIPv6Address();
+
+        for (int i = 0; i < 10; i++)
+        {
+            if (ip6[i] != 0)
+            {
+                return address;
+            }
+        }
+
+        if (ip6[10] != 0xff || ip6[11] != 0xff)
+        {
+            return address;
+        }
+
+        return QHostAddress(qFromBigEndian<quint32>(ip6.c + 12));
+    }
+}
+
+DnsQuery::DnsQuery(QObject *parent)
+: Measurement(parent)
+, currentStatus(DnsQuery::Unknown)
+, datagram(maxDatagramSize, Qt::Uninitialized)
+, running(0)
+, pendingQueries(0)
+, done(false)
+{
+    connect(this, SIGNAL(error(const QString &)), this,
+            SLOT(setErrorString(const QString &)));
+
+    timer.setSingleShot(true);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(timeout()));
+    connect(&udpSocket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+}
+
+DnsQuery::~DnsQuery()
+{
+    abortAll();
+}
+
+Measurement::Status DnsQuery::status() const
+{
+    return currentStatus;
+}
+
+bool DnsQuery::prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager)
+
+    definition = measurementDefinition.dynamicCast<DnsQueryDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("received NULL definition");
+        return false;
+    }
+
+    if (definition->timeout > maxTimeout || definition->timeout < minTimeout)
+    {
+        setErrorString("requested timeout wrong");
+        return false;
+    }
+
+    if (definition->retries > maxRetries || definition->retries < 0)
+    {
+        setErrorString("requested number of retries wrong");
+        return false;
+    }
+
+    if (definition->concurrency > maxConcurrency || definition->concurrency < 1)
+    {
+        setErrorString("requested concurrency wrong");
+        return false;
+    }
+
+    if (definition->names.isEmpty() || definition->types.isEmpty() || definition->servers.isEmpty())
+    {
+        setErrorString("names, types and servers must not be empty");
+        return false;
+    }
+
+    if (definition->names.size() * definition->types.size() * definition->servers.size() > maxQueries)
+    {
+        setErrorString("too many queries requested");
+        return false;
+    }
+
+    queries.clear();
+    queue.clear();
+    pendingIds.clear();
+
+    // one query per server, name and type, all allocated up front
+    queries.reserve(definition->names.size() * definition->types.size() * definition->servers.size());
+
+    foreach (const QString &server, definition->servers)
+    {
+        QHostAddress address;
+        quint16 port;
+
+        if (!parseServer(server, &address, &port))
+        {
+            setErrorString(QString("invalid DNS server: %1").arg(server));
+            return false;
+        }
+
+        foreach (const QString &name, definition->names)
+        {
+            foreach (const QString &typeName, definition->types)
+            {
+                Query query;
+                query.name = name;
+                query.type = DnsMessage::typeFromString(typeName);
+                query.server = address;
+                query.port = port;
+                query.id = 0;
+                query.attempts = 0;
+                query.started = false;
+                query.done = false;
+                query.truncated = false;
+                query.socket = NULL;
+                query.sentTime = -1;
+                query.deadline = -1;
+                query.rtt = -1;
+                query.tcpStartTime = -1;
+                query.tcpRtt = -1;
+                query.rcode = -1;
+                query.answerCount = 0;
+
+                if (query.type == 0)
+                {
+                    setErrorString(QString("unknown record type: %1").arg(typeName));
+                    return false;
+                }
+
+                if (DnsMessage::query(0, name, query.type).isEmpty())
+                {
+                    setErrorString(QString("invalid name: %1").arg(name));
+                    return false;
+                }
+
+                queue.append(queries.size());
+                queries.append(query);
+            }
+        }
+    }
+
+    pendingQueries = queries.size();
+    running = 0;
+    done = false;
+
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    return true;
+}
+
+bool DnsQuery::start()
+{
+    clock.start();
+    setStatus(DnsQuery::Running);
+
+    if (!udpSocket.bind(QHostAddress::Any, 0))
+    {
+        // reported by the return value, error() would have the executor
+        // drop us before it reads the error string
+        setStatus(DnsQuery::Error);
+        setErrorString(QString("Unable to bind UDP socket: %1").arg(udpSocket.errorString()));
+        return false;
+    }
+
+    dispatch();
+
+    return true;
+}
+
+bool DnsQuery::stop()
+{
+    timer.stop();
+    done = true;
+    abortAll();
+
+    return true;
+}
+
+Result DnsQuery::result() const
+{
+    return Result(results);
+}
+
+void DnsQuery::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+bool DnsQuery::parseServer(const QString &server, QHostAddress *address, quint16 *port)
+{
+    QString host = server;
+    *port = defaultPort;
+
+    // a port needs brackets around IPv6 addresses, [::1]:53
+    if (host.startsWith('['))
+    {
+        int end = host.indexOf(']');
+
+        if (end < 0)
+        {
+            return false;
+        }
+
+        if (end + 1 < host.size())
+        {
+            bool ok;
+            *port = host.mid(end + 2).toUShort(&ok);
+
+            if (!ok || host.at(end + 1) != ':')
+            {
+                return false;
+            }
+        }
+
+        host = host.mid(1, end - 1);
+    }
+    else if (host.count(':') == 1)
+    {
+        bool ok;
+        *port = host.section(':', 1).toUShort(&ok);
+        host = host.section(':', 0, 0);
+
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    return *port != 0 && address->setAddress(host);
+}
+
+quint16 DnsQuery::unusedId() const
+{
+    quint16 id;
+
+    do
+    {
+        id = qrand() & 0xffff;
+    }
+    while (pendingIds.contains(id));
+
+    return id;
+}
+
+void DnsQuery::dispatch()
+{
+    while (running < definition->concurrency && !queue.isEmpty())
+    {
+        int index = queue.takeFirst();
+        queries[index].started = true;
+        running++;
+        sendQuery(index);
+    }
+
+    armTimer();
+}
+
+void DnsQuery::sendQuery(int index)
+{
+    Query &query = queries[index];
+
+    // a retry gets a new id, late answers to the old one are ignored
+    query.id = unusedId();
+    query.message = DnsMessage::query(query.id, query.name, query.type);
+    query.attempts++;
+    query.sentTime = clock.nsecsElapsed();
+    query.deadline = query.sentTime + definition->timeout * Q_INT64_C(1000000);
+
+    pendingIds.insert(query.id, index);
+
+    if (udpSocket.writeDatagram(query.message, query.server, query.port) < 0)
+    {
+        pendingIds.remove(query.id);
+        finishQuery(index, NULL, QString("send: %1").arg(udpSocket.errorString()));
+    }
+}
+
+void DnsQuery::startTcp(int index)
+{
+    Query &query = queries[index];
+
+    query.socket = new QTcpSocket(this);
+    query.tcpBuffer.clear();
+    query.tcpStartTime = clock.nsecsElapsed();
+    query.deadline = query.tcpStartTime + definition->timeout * Q_INT64_C(1000000);
+    tcpQueries.insert(query.socket, index);
+
+    connect(query.socket, SIGNAL(connected()), this, SLOT(tcpConnected()));
+    connect(query.socket, SIGNAL(readyRead()), this, SLOT(tcpReadyRead()));
+    connect(query.socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+            SLOT(tcpError(QAbstractSocket::SocketError)));
+
+    query.socket->connectToHost(query.server, query.port);
+}
+
+void DnsQuery::finishQuery(int index, const DnsMessage *response, const QString &error)
+{
+    Query &query = queries[index];
+
+    if (query.done)
+    {
+        return;
+    }
+
+    if (response)
+    {
+        query.rcode = response->rcode();
+        query.answerCount = response->answerCount();
+        query.answers = response->answers();
+    }
+
+    if (query.socket)
+    {
+        tcpQueries.remove(query.socket);
+        query.socket->abort();
+        query.socket->deleteLater();
+        query.socket = NULL;
+    }
+
+    query.error = error;
+    query.done = true;
+    query.deadline = -1;
+    running--;
+    pendingQueries--;
+
+    if (!error.isEmpty())
+    {
+        LOG_DEBUG(QString("Query for %1 failed: %2").arg(query.name).arg(error));
+    }
+
+    if (!done)
+    {
+        dispatch();
+        checkFinished();
+    }
+}
+
+void DnsQuery::armTimer()
+{
+    qint64 deadline = -1;
+
+    foreach (const Query &query, queries)
+    {
+        if (query.started && !query.done && (deadline < 0 || query.deadline < deadline))
+        {
+            deadline = query.deadline;
+        }
+    }
+
+    if (deadline < 0)
+    {
+        timer.stop();
+        return;
+    }
+
+    // round up so the deadline has passed when the timer fires
+    qint64 remaining = deadline - clock.nsecsElapsed();
+    timer.start(qMax<qint64>(0, (remaining + 999999) / 1000000));
+}
+
+void DnsQuery::checkFinished()
+{
+    if (done || pendingQueries > 0)
+    {
+        return;
+    }
+
+    done = true;
+    timer.stop();
+    calculateResults();
+    setStatus(DnsQuery::Finished);
+
+    // called from socket signals, let them return first
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+void DnsQuery::calculateResults()
+{
+    QVariantList queryList;
+    int timeouts = 0;
+    int failures = 0;
+
+    foreach (const Query &query, queries)
+    {
+        QVariantList ttls;
+        QVariantList answers;
+
+        foreach (const DnsMessage::Record &record, query.answers)
+        {
+            QVariantMap answer;
+            answer.insert("name", record.name);
+            answer.insert("type", DnsMessage::typeToString(record.type));
+            answer.insert("ttl", record.ttl);
+            answer.insert("value", record.value);
+            answers << answer;
+
+            ttls << record.ttl;
+        }
+
+        QVariantMap map;
+        map.insert("name", query.name);
+        map.insert("type", DnsMessage::typeToString(query.type));
+        map.insert("server", QString("%1:%2").arg(query.server.toString()).arg(query.port));
+        map.insert("attempts", query.attempts);
+        map.insert("rtt_ns", query.rtt);
+        map.insert("truncated", query.truncated);
+        map.insert("tcp_rtt_ns", query.tcpRtt);
+        map.insert("answer_count", query.answerCount);
+        map.insert("ttls", ttls);
+        map.insert("answers", answers);
+
+        if (query.rcode >= 0)
+        {
+            map.insert("rcode", query.rcode);
+            map.insert("rcode_name", DnsMessage::rcodeToString(query.rcode));
+        }
+
+        if (!query.error.isEmpty())
+        {
+            map.insert("error", query.error);
+            failures++;
+
+            if (query.error == "timeout")
+            {
+                timeouts++;
+            }
+        }
+
+        queryList << map;
+    }
+
+    results.clear();
+    results.insert("duration_ns", clock.nsecsElapsed());
+    results.insert("query_count", queries.size());
+    results.insert("failed", failures);
+    results.insert("timeouts", timeouts);
+    results.insert("queries", queryList);
+}
+
+void DnsQuery::abortAll()
+{
+    foreach (QTcpSocket *socket, tcpQueries.keys())
+    {
+        socket->abort();
+        socket->deleteLater();
+        queries[tcpQueries.value(socket)].socket = NULL;
+    }
+
+    tcpQueries.clear();
+    pendingIds.clear();
+    udpSocket.close();
+}
+
+void DnsQuery::readDatagrams()
+{
+    while (udpSocket.hasPendingDatagrams())
+    {
+        QHostAddress sender;
+        quint16 senderPort;
+        qint64 size = udpSocket.readDatagram(datagram.data(), datagram.size(), &sender, &senderPort);
+        qint64 now = clock.nsecsElapsed();
+
+        if (size < 0)
+        {
+            break;
+        }
+
+        DnsMessage response;
+
+        if (!response.parse(datagram.left(size)) || !response.isResponse())
+        {
+            LOG_DEBUG(QString("Ignoring malformed datagram from %1").arg(sender.toString()));
+            continue;
+        }
+
+        int index = pendingIds.value(response.id(), -1);
+
+        if (index < 0)
+        {
+            LOG_DEBUG(QString("Ignoring response with unknown id %1").arg(response.id()));
+            continue;
+        }
+
+        Query &query = queries[index];
+
+        // only the server that was asked may answer, and only the question asked
+        if (plainAddress(sender) != plainAddress(query.server) || senderPort != query.port ||
+            response.questionName().compare(query.name, Qt::CaseInsensitive) != 0 ||
+            response.questionType() != query.type)
+        {
+            LOG_DEBUG(QString("Ignoring response from %1 that does not match its query").arg(sender.toString()));
+            continue;
+        }
+
+        pendingIds.remove(query.id);
+        query.rtt = now - query.sentTime;
+
+        if (response.isTruncated())
+        {
+            query.truncated = true;
+            startTcp(index);
+            armTimer();
+            continue;
+        }
+
+        finishQuery(index, &response, QString());
+    }
+}
+
+void DnsQuery::tcpConnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    const Query &query = queries.at(tcpQueries.value(socket));
+
+    // over TCP every message is preceded by its length
+    QByteArray length(2, Qt::Uninitialized);
+    qToBigEndian<quint16>(query.message.size(), reinterpret_cast<uchar *>(length.data()));
+
+    socket->write(length + query.message);
+}
+
+void DnsQuery::tcpReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    if (!tcpQueries.contains(socket))
+    {
+        return;
+    }
+
+    int index = tcpQueries.value(socket);
+    Query &query = queries[index];
+
+    query.tcpBuffer.append(socket->readAll());
+
+    if (query.tcpBuffer.size() < 2)
+    {
+        return;
+    }
+
+    int length = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(query.tcpBuffer.constData()));
+
+    if (query.tcpBuffer.size() < 2 + length)
+    {
+        return;
+    }
+
+    query.tcpRtt = clock.nsecsElapsed() - query.tcpStartTime;
+
+    DnsMessage response;
+
+    if (!response.parse(query.tcpBuffer.mid(2, length)) || !response.isResponse() ||
+        response.id() != query.id)
+    {
+        finishQuery(index, NULL, "malformed TCP response");
+        return;
+    }
+
+    finishQuery(index, &response, QString());
+}
+
+void DnsQuery::tcpError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError)
+
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    if (!tcpQueries.contains(socket))
+    {
+        return;
+    }
+
+    finishQuery(tcpQueries.value(socket), NULL, QString("tcp: %1").arg(socket->errorString()));
+}
+
+void DnsQuery::timeout()
+{
+    qint64 now = clock.nsecsElapsed();
+
+    for (int i = 0; i < queries.size() && !done; i++)
+    {
+        Query &query = queries[i];
+
+        if (!query.started || query.done || query.deadline > now)
+        {
+            continue;
+        }
+
+        if (query.socket)
+        {
+            finishQuery(i, NULL, "tcp timeout");
+            continue;
+        }
+
+        pendingIds.remove(query.id);
+
+        if (query.attempts <= definition->retries)
+        {
+            LOG_DEBUG(QString("Retrying query for %1").arg(query.name));
+            sendQuery(i);
+        }
+        else
+        {
+            finishQuery(i, NULL, "timeout");
+        }
+    }
+
+    if (!done)
+    {
+        armTimer();
+    }
+}
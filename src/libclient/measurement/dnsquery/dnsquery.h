@@ -0,0 +1,115 @@
+#ifndef DNSQUERY_H
+#define DNSQUERY_H
+
+#include "../measurement.h"
+#include "dnsmessage.h"
+#include "dnsquery_definition.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QVector>
+
+class QTcpSocket;
+
+/*
+ * Sends raw DNS queries over UDP for every combination of name, type and
+ * server, up to concurrency of them at the same time from one socket.
+ * Responses are matched by transaction id, server and question. A query
+ * that times out is sent again with a new id until the retries are used
+ * up, a truncated response is repeated over TCP. Each query reports the
+ * round trip time of its last attempt, the rcode and the answers.
+ */
+class CLIENT_API DnsQuery : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit DnsQuery(QObject *parent = 0);
+    ~DnsQuery();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+private:
+    struct Query
+    {
+        QString name;
+        quint16 type;
+        QHostAddress server;
+        quint16 port;
+        QByteArray message; // with the id of the current attempt
+        quint16 id;
+        int attempts;
+        bool started;
+        bool done;
+        bool truncated;
+        QTcpSocket *socket; // TCP fallback, NULL if unused
+        QByteArray tcpBuffer;
+        // ns since the start of the measurement, -1 if not reached
+        qint64 sentTime;
+        qint64 deadline;
+        qint64 rtt;
+        qint64 tcpStartTime;
+        qint64 tcpRtt;
+        int rcode;
+        int answerCount;
+        QList<DnsMessage::Record> answers;
+        QString error;
+    };
+
+    void setStatus(Status status);
+    static bool parseServer(const QString &server, QHostAddress *address, quint16 *port);
+    quint16 unusedId() const;
+    void dispatch();
+    void sendQuery(int query);
+    void startTcp(int query);
+    void finishQuery(int query, const DnsMessage *response, const QString &error);
+    void armTimer();
+    void checkFinished();
+    void calculateResults();
+    void abortAll();
+
+    DnsQueryDefinitionPtr definition;
+    Status currentStatus;
+
+    QElapsedTimer clock;
+    QTimer timer; // fires at the earliest deadline of a running query
+    QUdpSocket udpSocket;
+    QVector<Query> queries;
+    QHash<quint16, int> pendingIds; // UDP queries waiting for an answer
+    QHash<QTcpSocket *, int> tcpQueries;
+    QList<int> queue;
+    QByteArray datagram;
+    int running;
+    int pendingQueries;
+    bool done;
+
+    QVariantMap results;
+
+    static const int maxQueries = 1000;
+    static const int maxRetries = 10;
+    static const int maxConcurrency = 100;
+    static const int maxTimeout = 30000;
+    static const int minTimeout = 100;
+    static const int defaultPort = 53;
+    static const int maxDatagramSize = 65536;
+
+private slots:
+    void readDatagrams();
+    void tcpConnected();
+    void tcpReadyRead();
+    void tcpError(QAbstractSocket::SocketError socketError);
+    void timeout();
+
+signals:
+    void statusChanged(Status status);
+};
+
+#endif // DNSQUERY_H
@@ -0,0 +1,42 @@
+#include "dnsquery_definition.h"
+
+DnsQueryDefinition::DnsQueryDefinition(const QStringList &names, const QStringList &types,
+                                       const QStringList &servers, const int timeout, const int retries,
+                                       const int concurrency)
+: names(names)
+, types(types)
+, servers(servers)
+, timeout(timeout)
+, retries(retries)
+, concurrency(concurrency)
+{
+
+}
+
+DnsQueryDefinition::~DnsQueryDefinition()
+{
+
+}
+
+DnsQueryDefinitionPtr DnsQueryDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    return DnsQueryDefinitionPtr(new DnsQueryDefinition(map.value("names").toStringList(),
+                                                        map.value("types", QStringList() << "A").toStringList(),
+                                                        map.value("servers").toStringList(),
+                                                        map.value("timeout", 2000).toInt(),
+                                                        map.value("retries", 2).toInt(),
+                                                        map.value("concurrency", 10).toInt()));
+}
+
+QVariant DnsQueryDefinition::toVariant() const
+{
+    QVariantMap map;
+    map.insert("names", names);
+    map.insert("types", types);
+    map.insert("servers", servers);
+    map.insert("timeout", timeout);
+    map.insert("retries", retries);
+    map.insert("concurrency", concurrency);
+    return map;
+}
@@ -0,0 +1,35 @@
+#ifndef DNSQUERY_DEFINITION_H
+#define DNSQUERY_DEFINITION_H
+
+#include "../measurementdefinition.h"
+
+#include <QStringList>
+
+class DnsQueryDefinition;
+
+typedef QSharedPointer<DnsQueryDefinition> DnsQueryDefinitionPtr;
+typedef QList<DnsQueryDefinitionPtr> DnsQueryDefinitionList;
+
+class CLIENT_API DnsQueryDefinition : public MeasurementDefinition
+{
+public:
+    DnsQueryDefinition(const QStringList &names, const QStringList &types, const QStringList &servers,
+                       const int timeout, const int retries, const int concurrency);
+    ~DnsQueryDefinition();
+
+    // Storage
+    static DnsQueryDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getters
+    QStringList names;
+    QStringList types; // A, AAAA, MX, ...; every name is queried for every type
+    QStringList servers; // address or address:port ([address]:port for IPv6)
+    int timeout; // ms per attempt
+    int retries; // attempts after the first one timed out
+    int concurrency; // queries in flight at the same time
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // DNSQUERY_DEFINITION_H
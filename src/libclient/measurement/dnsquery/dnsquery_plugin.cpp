@@ -0,0 +1,21 @@
+#include "dnsquery_plugin.h"
+#include "dnsquery.h"
+#include "dnsquery_definition.h"
+
+QStringList DnsQueryPlugin::measurements() const
+{
+    return QStringList()
+           << "dnsquery";
+}
+
+MeasurementPtr DnsQueryPlugin::createMeasurement(const QString &name)
+{
+    Q_UNUSED(name);
+    return MeasurementPtr(new DnsQuery);
+}
+
+MeasurementDefinitionPtr DnsQueryPlugin::createMeasurementDefinition(const QString &name, const QVariant &data)
+{
+    Q_UNUSED(name);
+    return DnsQueryDefinition::fromVariant(data);
+}
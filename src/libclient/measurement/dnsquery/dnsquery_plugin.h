@@ -0,0 +1,16 @@
+#ifndef DNSQUERY_PLUGIN_H
+#define DNSQUERY_PLUGIN_H
+
+#include "../measurementplugin.h"
+
+class DnsQueryPlugin : public MeasurementPlugin
+{
+public:
+    // MeasurementPlugin interface
+    QStringList measurements() const;
+
+    MeasurementPtr createMeasurement(const QString &name);
+    MeasurementDefinitionPtr createMeasurementDefinition(const QString &name, const QVariant &data);
+};
+
+#endif // DNSQUERY_PLUGIN_H
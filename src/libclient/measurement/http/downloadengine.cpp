@@ -0,0 +1,739 @@
+#include "downloadengine.h"
+#include "../../log/logger.h"
+
+#include <QDateTime>
+#include <QRegularExpression>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+LOGGER(DownloadEngine);
+
+DownloadEngine::DownloadEngine(const QUrl &url, const QHostAddress &server, int streams, int targetTimeMs,
+                               int rampUpTimeMs, int slotLengthMs, bool avoidCaches, quint16 sourcePort,
+                               bool adaptive, QObject *parent)
+: QThread(parent)
+, m_url(url)
+, m_server(server)
+, m_targetTime(targetTimeMs)
+, m_rampUpTime(rampUpTimeMs)
+, m_slotLength(slotLengthMs)
+, m_avoidCaches(avoidCaches)
+, m_sourcePort(sourcePort)
+, m_adaptive(adaptive)
+, m_scratch(scratchSize, Qt::Uninitialized)
+, m_remoteLength(0)
+, m_nextPort(sourcePort)
+, m_epollFd(-1)
+, m_firstRequest(-1)
+, m_windowBegin(-1)
+, m_windowEnd(-1)
+, m_stoppedEarly(false)
+, m_usedStreams(0)
+, m_nextTick(0)
+, m_totalBytes(0)
+, m_tickBytes(0)
+, m_lastRate(0.0)
+, m_plateauRate(0.0)
+, m_slotsSinceChange(0)
+, m_windowSlots(0)
+, m_stop(0)
+{
+    Stream stream;
+    stream.fd = -1;
+    stream.status = DownloadThread::Inactive;
+    stream.connectTime = -1;
+    stream.connectedTime = -1;
+    stream.requestTime = 0;
+    stream.requestSentTime = -1;
+    stream.firstByteTime = -1;
+    stream.headerTime = -1;
+    stream.lastReadTime = 0;
+    stream.headerMatched = 0;
+    stream.windowBytes = 0;
+    stream.windowFirstRead = -1;
+    stream.windowLastRead = -1;
+    //the download never lasts longer than waiting for the first byte,
+    //the ramp-up and the target time, so this is all we need
+    stream.slotBytes.fill(0, (firstByteReceivedTimeout + m_rampUpTime + m_targetTime) / m_slotLength + 2);
+    stream.tcpInfo.reserve(stream.slotBytes.size());
+
+    m_streams.fill(stream, streams);
+
+    //the window is never longer than the target time
+    m_windowRates.fill(0.0, m_targetTime / m_slotLength + 1);
+}
+
+DownloadEngine::~DownloadEngine()
+{
+    stop();
+    wait();
+}
+
+void DownloadEngine::stop()
+{
+    m_stop.storeRelease(1);
+}
+
+int DownloadEngine::streamCount() const
+{
+    return m_streams.size();
+}
+
+DownloadThread::DownloadThreadStatus DownloadEngine::streamStatus(int stream) const
+{
+    return m_streams[stream].status;
+}
+
+qint64 DownloadEngine::measuredTimeInNs(int stream) const
+{
+    const Stream &s = m_streams[stream];
+
+    if (m_windowBegin < 0 || s.lastReadTime < m_windowBegin)
+    {
+        return 0;
+    }
+
+    return qMin(s.lastReadTime, m_windowEnd) - m_windowBegin;
+}
+
+qreal DownloadEngine::averageThroughput(int stream) const
+{
+    const Stream &s = m_streams[stream];
+
+    if (s.windowFirstRead < 0 || s.windowLastRead <= s.windowFirstRead)
+    {
+        return 0.0;
+    }
+
+    return (8.0 * (qreal)s.windowBytes)/(((qreal)(s.windowLastRead - s.windowFirstRead))/1000000000.0);
+}
+
+QList<qreal> DownloadEngine::measurementSlots(int stream) const
+{
+    const Stream &s = m_streams[stream];
+    QList<qreal> slotList;
+
+    //slots start with the request, the slot of the last read is still incomplete
+    int completeSlots = qMin((int)((s.lastReadTime - s.requestTime) / ((qint64)m_slotLength * 1000000)),
+                             s.slotBytes.size());
+
+    for (int i = 0; i < completeSlots; i++)
+    {
+        slotList << ((qreal)s.slotBytes[i] * 8) / (m_slotLength / 1000.0);
+    }
+
+    return slotList;
+}
+
+QString DownloadEngine::errorString() const
+{
+    return m_errorString;
+}
+
+int DownloadEngine::usedStreams() const
+{
+    return m_usedStreams;
+}
+
+qint64 DownloadEngine::rampUpTimeInNs() const
+{
+    return m_windowBegin < 0 ? 0 : m_windowBegin - m_firstRequest;
+}
+
+qint64 DownloadEngine::windowLengthInNs() const
+{
+    return m_windowBegin < 0 ? 0 : m_windowEnd - m_windowBegin;
+}
+
+bool DownloadEngine::stoppedEarly() const
+{
+    return m_stoppedEarly;
+}
+
+QVariantMap DownloadEngine::tcpInfo(int stream) const
+{
+    const TcpInfoSeries &series = m_streams[stream].tcpInfo;
+
+    //toVariant() always has its keys, empty means nothing was sampled
+    return series.isEmpty() ? QVariantMap() : series.toVariant();
+}
+
+QVariantMap DownloadEngine::phases(int stream) const
+{
+    const Stream &s = m_streams[stream];
+
+    QVariantMap map;
+    map.insert("connect_ns", DownloadThread::phaseDuration(s.connectTime, s.connectedTime));
+    map.insert("request_ns", DownloadThread::phaseDuration(s.requestTime, s.requestSentTime));
+    map.insert("ttfb_ns", DownloadThread::phaseDuration(s.requestSentTime, s.firstByteTime));
+    map.insert("header_ns", DownloadThread::phaseDuration(s.firstByteTime, s.headerTime));
+    map.insert("body_ns", DownloadThread::phaseDuration(s.headerTime, s.lastReadTime));
+    return map;
+}
+
+void DownloadEngine::run()
+{
+    m_clock.start();
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_epollFd < 0)
+    {
+        m_errorString = QString("could not create epoll instance: %1").arg(strerror(errno));
+        return;
+    }
+
+    //the adaptive mode starts with one stream and adds more while it pays off
+    if (!openStreams(m_adaptive ? 1 : m_streams.size()))
+    {
+        m_errorString = "Unable to establish a TCP connection";
+    }
+    else if (awaitConnections() == 0)
+    {
+        m_errorString = "Unable to establish a TCP connection";
+    }
+    else if (sendRequests() == 0)
+    {
+        m_errorString = "No thread able to download after TCP connection was established.";
+    }
+    else
+    {
+        receive();
+    }
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        //streams still reading when the window ended are the successful ones
+        closeStream(i, m_streams[i].status == DownloadThread::DownloadInProgress ?
+                    DownloadThread::FinishedSuccess : m_streams[i].status);
+    }
+
+    close(m_epollFd);
+    m_epollFd = -1;
+}
+
+bool DownloadEngine::openStreams(int count)
+{
+    memset(&m_remote, 0, sizeof(m_remote));
+
+    if (m_server.protocol() == QAbstractSocket::IPv6Protocol)
+    {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&m_remote;
+        Q_IPV6ADDR address = m_server.toIPv6Address();
+
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(m_url.port(defaultPort));
+        memcpy(&sin6->sin6_addr, &address, sizeof(sin6->sin6_addr));
+        m_remoteLength = sizeof(struct sockaddr_in6);
+    }
+    else
+    {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&m_remote;
+
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(m_url.port(defaultPort));
+        sin->sin_addr.s_addr = htonl(m_server.toIPv4Address());
+        m_remoteLength = sizeof(struct sockaddr_in);
+    }
+
+    //build all requests first so that they leave back to back
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        QString path = m_url.path();
+
+        if (m_avoidCaches)
+        {
+            path.append(QString("?timestamp=%1_%2")
+                        .arg(QDateTime::currentDateTime().toString("yy_MM_dd_HH_mm_ss_zzz")).arg(i));
+        }
+
+        m_requests << QString("GET %1 HTTP/1.1\r\n"
+                              "Host: %2\r\n"
+                              "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.9; rv:31.0) Gecko/20100101 Firefox/31.0\r\n"
+                              "Referer: http://www.measure-it.net\r\n\r\n").arg(path).arg(m_url.host()).toLatin1();
+    }
+
+    int opened = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        opened += openStream();
+    }
+
+    return opened > 0;
+}
+
+bool DownloadEngine::openStream()
+{
+    int i = m_usedStreams++;
+    Stream &stream = m_streams[i];
+    int family = m_remote.ss_family;
+
+    stream.fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (stream.fd < 0)
+    {
+        LOG_ERROR(QString("Could not create socket: %1").arg(strerror(errno)));
+        stream.status = DownloadThread::FinishedError;
+        return false;
+    }
+
+    if (m_sourcePort > 0)
+    {
+        struct sockaddr_storage local;
+        bool bound = false;
+
+        memset(&local, 0, sizeof(local));
+        local.ss_family = family;
+
+        //every stream needs its own port, try the next 16 like DownloadThread
+        for (int tries = 0; tries < 16 && !bound; tries++, m_nextPort++)
+        {
+            if (family == AF_INET6)
+            {
+                ((struct sockaddr_in6 *)&local)->sin6_port = htons(m_nextPort);
+            }
+            else
+            {
+                ((struct sockaddr_in *)&local)->sin_port = htons(m_nextPort);
+            }
+
+            bound = bind(stream.fd, (struct sockaddr *)&local, m_remoteLength) == 0;
+        }
+
+        if (!bound)
+        {
+            LOG_ERROR("Could not bind port");
+            closeStream(i, DownloadThread::FinishedError);
+            return false;
+        }
+    }
+
+    if (::connect(stream.fd, (struct sockaddr *)&m_remote, m_remoteLength) < 0 && errno != EINPROGRESS)
+    {
+        LOG_ERROR(QString("Could not connect: %1").arg(strerror(errno)));
+        closeStream(i, DownloadThread::FinishedError);
+        return false;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLOUT;
+    event.data.u32 = i;
+
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, stream.fd, &event) < 0)
+    {
+        closeStream(i, DownloadThread::FinishedError);
+        return false;
+    }
+
+    stream.connectTime = m_clock.nsecsElapsed();
+    stream.status = DownloadThread::ConnectingTCP;
+
+    return true;
+}
+
+int DownloadEngine::awaitConnections()
+{
+    QVector<struct epoll_event> events(m_streams.size());
+    qint64 deadline = m_clock.elapsed() + tcpConnectTimeout;
+    int connecting = 0;
+    int connected = 0;
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        connecting += m_streams[i].status == DownloadThread::ConnectingTCP;
+    }
+
+    while (connecting > 0 && m_clock.elapsed() < deadline && !m_stop.loadAcquire())
+    {
+        int timeout = qMin<qint64>(deadline - m_clock.elapsed(), pollInterval);
+        int ready = epoll_wait(m_epollFd, events.data(), events.size(), qMax(timeout, 0));
+
+        for (int n = 0; n < ready; n++)
+        {
+            int i = events[n].data.u32;
+
+            if (m_streams[i].status != DownloadThread::ConnectingTCP)
+            {
+                continue;
+            }
+
+            connecting--;
+            connected += connectionDone(i);
+        }
+    }
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        if (m_streams[i].status == DownloadThread::ConnectingTCP)
+        {
+            closeStream(i, DownloadThread::FinishedError);
+        }
+    }
+
+    LOG_DEBUG(QString("%1 of %2 streams connected").arg(connected).arg(m_usedStreams));
+
+    return connected;
+}
+
+bool DownloadEngine::connectionDone(int i)
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+
+    if (getsockopt(m_streams[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+    {
+        closeStream(i, DownloadThread::FinishedError);
+        return false;
+    }
+
+    //from now on we only wait for data
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = i;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_streams[i].fd, &event);
+
+    m_streams[i].connectedTime = m_clock.nsecsElapsed();
+    m_streams[i].status = DownloadThread::ConnectedTCP;
+
+    return true;
+}
+
+int DownloadEngine::sendRequests()
+{
+    int sent = 0;
+
+    for (int i = 0; i < m_usedStreams; i++)
+    {
+        if (m_streams[i].status == DownloadThread::ConnectedTCP)
+        {
+            sent += sendRequest(i);
+        }
+    }
+
+    LOG_DEBUG("Engine: get requests sent");
+
+    return sent;
+}
+
+bool DownloadEngine::sendRequest(int i)
+{
+    Stream &stream = m_streams[i];
+
+    stream.requestTime = m_clock.nsecsElapsed();
+
+    if (m_firstRequest < 0)
+    {
+        m_firstRequest = stream.requestTime;
+    }
+
+    //a request always fits into the empty send buffer
+    if (send(stream.fd, m_requests[i].constData(), m_requests[i].size(), MSG_NOSIGNAL) != m_requests[i].size())
+    {
+        closeStream(i, DownloadThread::FinishedError);
+        return false;
+    }
+
+    stream.requestSentTime = m_clock.nsecsElapsed();
+    stream.status = DownloadThread::AwaitingFirstByte;
+
+    return true;
+}
+
+void DownloadEngine::receive()
+{
+    QVector<struct epoll_event> events(m_streams.size());
+    qint64 firstByteDeadline = m_clock.nsecsElapsed() + (qint64)firstByteReceivedTimeout * 1000000;
+
+    m_nextTick = m_clock.nsecsElapsed() + (qint64)m_slotLength * 1000000;
+
+    while (!m_stop.loadAcquire())
+    {
+        qint64 now = m_clock.nsecsElapsed();
+        int awaiting = 0;
+        int downloading = 0;
+
+        for (int i = 0; i < m_usedStreams; i++)
+        {
+            awaiting += m_streams[i].status == DownloadThread::AwaitingFirstByte ||
+                        m_streams[i].status == DownloadThread::ConnectingTCP;
+            downloading += m_streams[i].status == DownloadThread::DownloadInProgress;
+        }
+
+        if (now >= m_nextTick)
+        {
+            sampleTcpInfo(now);
+
+            if (m_adaptive)
+            {
+                adapt(now);
+            }
+
+            m_nextTick += (qint64)m_slotLength * 1000000;
+        }
+
+        if (m_adaptive)
+        {
+            if (awaiting + downloading == 0)
+            {
+                m_errorString = "No thread able to download after TCP connection was established.";
+                return;
+            }
+        }
+        else if (m_windowBegin < 0 && (awaiting == 0 || now >= firstByteDeadline))
+        {
+            for (int i = 0; i < m_streams.size(); i++)
+            {
+                if (m_streams[i].status == DownloadThread::AwaitingFirstByte)
+                {
+                    LOG_ERROR("Engine: no response received");
+                    closeStream(i, DownloadThread::FinishedError);
+                }
+            }
+
+            if (downloading == 0)
+            {
+                m_errorString = "No thread able to download after TCP connection was established.";
+                return;
+            }
+
+            //every stream is downloading, give TCP the ramp-up time
+            m_windowBegin = now + (qint64)m_rampUpTime * 1000000;
+            m_windowEnd = m_windowBegin + (qint64)m_targetTime * 1000000;
+            LOG_DEBUG(QString("Engine: %1 streams downloading").arg(downloading));
+        }
+
+        if ((m_windowBegin >= 0 && now >= m_windowEnd) || awaiting + downloading == 0)
+        {
+            return;
+        }
+
+        int timeout = pollInterval;
+
+        if (m_windowBegin >= 0)
+        {
+            timeout = qMin<qint64>(timeout, (m_windowEnd - now) / 1000000 + 1);
+        }
+
+        timeout = qMin<qint64>(timeout, qMax<qint64>(m_nextTick - now, 0) / 1000000 + 1);
+
+        int ready = epoll_wait(m_epollFd, events.data(), events.size(), timeout);
+
+        now = m_clock.nsecsElapsed();
+
+        for (int n = 0; n < ready; n++)
+        {
+            int i = events[n].data.u32;
+
+            //streams added by the adaptive mode connect while the others download
+            if (m_streams[i].status == DownloadThread::ConnectingTCP)
+            {
+                if (connectionDone(i))
+                {
+                    sendRequest(i);
+                }
+
+                continue;
+            }
+
+            readStream(i, now);
+        }
+    }
+}
+
+void DownloadEngine::sampleTcpInfo(qint64 now)
+{
+    for (int i = 0; i < m_usedStreams; i++)
+    {
+        Stream &stream = m_streams[i];
+
+        if (stream.status == DownloadThread::DownloadInProgress)
+        {
+            stream.tcpInfo.sample(stream.fd, (now - stream.requestTime) / 1000000);
+        }
+    }
+}
+
+void DownloadEngine::adapt(qint64 now)
+{
+    //aggregate throughput of all streams during the last slot
+    qreal rate = (m_totalBytes - m_tickBytes) * 8.0 / (m_slotLength / 1000.0);
+
+    m_tickBytes = m_totalBytes;
+
+    for (int i = 0; i < m_usedStreams; i++)
+    {
+        const Stream &stream = m_streams[i];
+
+        //streams added late have their own timeouts
+        if ((stream.status == DownloadThread::ConnectingTCP &&
+             now - stream.connectTime > (qint64)tcpConnectTimeout * 1000000) ||
+            (stream.status == DownloadThread::AwaitingFirstByte &&
+             now - stream.requestTime > (qint64)firstByteReceivedTimeout * 1000000))
+        {
+            closeStream(i, DownloadThread::FinishedError);
+        }
+    }
+
+    if (m_windowBegin >= 0)
+    {
+        if (m_windowSlots < m_windowRates.size())
+        {
+            m_windowRates[m_windowSlots++] = rate;
+        }
+
+        //steady state: the last slots all stay close to their mean
+        if (m_windowSlots >= stableSlots && now - m_windowBegin >= (qint64)minWindowTime * 1000000)
+        {
+            qreal mean = 0.0;
+
+            for (int k = m_windowSlots - stableSlots; k < m_windowSlots; k++)
+            {
+                mean += m_windowRates[k] / stableSlots;
+            }
+
+            bool stable = mean > 0.0;
+
+            for (int k = m_windowSlots - stableSlots; k < m_windowSlots && stable; k++)
+            {
+                stable = qAbs(m_windowRates[k] - mean) <= mean * stablePercent / 100.0;
+            }
+
+            if (stable && now < m_windowEnd)
+            {
+                LOG_DEBUG(QString("Engine: steady state after %1 ms").arg((now - m_windowBegin) / 1000000));
+                m_windowEnd = now;
+                m_stoppedEarly = true;
+            }
+        }
+
+        return;
+    }
+
+    m_slotsSinceChange++;
+
+    //slow start is over once the throughput of a slot stops growing, a
+    //slot without any data (e.g. before the first byte) is no plateau
+    bool plateau = m_slotsSinceChange >= 2 && rate > 0 &&
+                   rate <= m_lastRate * (1.0 + growthPercent / 100.0);
+    bool rampUpOver = m_firstRequest >= 0 && now - m_firstRequest >= (qint64)m_rampUpTime * 1000000;
+
+    m_lastRate = rate;
+
+    if (plateau && !rampUpOver)
+    {
+        //another stream only pays off if the last one did
+        if ((m_plateauRate == 0.0 || rate > m_plateauRate * (1.0 + growthPercent / 100.0)) &&
+            m_usedStreams < m_streams.size())
+        {
+            LOG_DEBUG(QString("Engine: %1 bps with %2 streams, adding one").arg(rate).arg(m_usedStreams));
+            m_plateauRate = rate;
+            m_slotsSinceChange = 0;
+            openStream();
+            return;
+        }
+
+        rampUpOver = true;
+    }
+
+    if (rampUpOver)
+    {
+        m_windowBegin = now;
+        m_windowEnd = now + (qint64)m_targetTime * 1000000;
+        LOG_DEBUG(QString("Engine: ramp-up over after %1 ms with %2 streams")
+                  .arg((now - m_firstRequest) / 1000000).arg(m_usedStreams));
+    }
+}
+
+void DownloadEngine::readStream(int i, qint64 now)
+{
+    Stream &stream = m_streams[i];
+    qint64 bytes = 0;
+    ssize_t readResult;
+
+    if (stream.fd < 0)
+    {
+        return;
+    }
+
+    //drain everything into the scratch buffer, nothing is allocated here
+    while ((readResult = recv(stream.fd, m_scratch.data(), m_scratch.size(), 0)) > 0)
+    {
+        if (stream.status == DownloadThread::AwaitingFirstByte)
+        {
+            stream.firstByteTime = now;
+
+            QRegularExpression re("HTTP/\\d\\.\\d\\s+(\\d+)\\s+.*");
+            QString HTTPResponseCode = re.match(QByteArray(m_scratch.constData(), qMin<int>(readResult, 64)))
+                                       .captured(1);
+
+            if (HTTPResponseCode != "200")
+            {
+                LOG_ERROR(QString("Engine: unexpected HTTP response code %1").arg(HTTPResponseCode));
+                closeStream(i, DownloadThread::FinishedError);
+                return;
+            }
+
+            stream.status = DownloadThread::DownloadInProgress;
+        }
+
+        if (stream.headerTime < 0 &&
+            DownloadThread::headerEnd(m_scratch.constData(), readResult, &stream.headerMatched) >= 0)
+        {
+            stream.headerTime = now;
+        }
+
+        bytes += readResult;
+    }
+
+    if (bytes > 0)
+    {
+        m_totalBytes += bytes;
+        stream.lastReadTime = now;
+
+        int slot = (now - stream.requestTime) / ((qint64)m_slotLength * 1000000);
+
+        if (slot < stream.slotBytes.size())
+        {
+            stream.slotBytes[slot] += bytes;
+        }
+
+        if (m_windowBegin >= 0 && now >= m_windowBegin && now <= m_windowEnd)
+        {
+            if (stream.windowFirstRead < 0)
+            {
+                stream.windowFirstRead = now;
+            }
+
+            stream.windowLastRead = now;
+            stream.windowBytes += bytes;
+        }
+    }
+
+    if (readResult == 0 || (readResult < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        //a premature disconnect ends the stream like in DownloadThread
+        closeStream(i, stream.status == DownloadThread::DownloadInProgress ?
+                    DownloadThread::FinishedSuccess : DownloadThread::FinishedError);
+    }
+}
+
+void DownloadEngine::closeStream(int i, DownloadThread::DownloadThreadStatus status)
+{
+    Stream &stream = m_streams[i];
+
+    if (stream.fd >= 0)
+    {
+        //closing removes the socket from the epoll set
+        close(stream.fd);
+        stream.fd = -1;
+    }
+
+    stream.status = status;
+}
@@ -0,0 +1,141 @@
+#ifndef DOWNLOADENGINE_H
+#define DOWNLOADENGINE_H
+
+#include "httpdownload.h"
+#include "../../network/tcpinfoseries.h"
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QUrl>
+#include <QVector>
+
+#include <sys/socket.h>
+
+/*
+ * Drives all streams of an HTTPDownload from a single thread with epoll
+ * instead of one thread per stream. All streams connect first, then the
+ * requests go out back to back (start barrier). The measurement window
+ * starts rampUpTime after every stream received its first byte or timed
+ * out, the engine stops reading when it ends. Received data is drained into
+ * one scratch buffer and binned into slots as it arrives.
+ *
+ * In the adaptive mode the engine starts with one stream and adds another
+ * whenever the aggregate slot throughput stopped growing (end of slow start)
+ * but is clearly above the level before the last stream was added, up to the
+ * given number of streams. The window then starts right away, rampUpTime is
+ * only the upper bound, and ends early once the slot throughput is stable.
+ */
+class DownloadEngine : public QThread
+{
+    Q_OBJECT
+
+public:
+    DownloadEngine(const QUrl &url, const QHostAddress &server, int streams, int targetTimeMs,
+                   int rampUpTimeMs, int slotLengthMs, bool avoidCaches, quint16 sourcePort,
+                   bool adaptive = false, QObject *parent = 0);
+    ~DownloadEngine();
+
+    // thread safe, the engine finishes within pollInterval
+    void stop();
+
+    // only valid once the thread has finished
+    int streamCount() const;
+    DownloadThread::DownloadThreadStatus streamStatus(int stream) const;
+    qint64 measuredTimeInNs(int stream) const; //time the stream read within the window
+    qreal averageThroughput(int stream) const; //average throughput in bps within the window
+    QList<qreal> measurementSlots(int stream) const; //throughput of each complete slot in bps
+    QString errorString() const;
+    int usedStreams() const;
+    qint64 rampUpTimeInNs() const; //from the first request to the start of the window
+    qint64 windowLengthInNs() const;
+    bool stoppedEarly() const;
+    QVariantMap tcpInfo(int stream) const; //TCP_INFO sampled once per slot, empty without samples
+    QVariantMap phases(int stream) const; //connect, request, ttfb, header and body in ns
+
+protected:
+    void run();
+
+private:
+    struct Stream
+    {
+        int fd;
+        DownloadThread::DownloadThreadStatus status;
+        //all times are relative to the engine clock in ns, -1 if not reached
+        qint64 connectTime;
+        qint64 connectedTime;
+        qint64 requestTime;
+        qint64 requestSentTime;
+        qint64 firstByteTime;
+        qint64 headerTime;
+        qint64 lastReadTime;
+        int headerMatched;
+        qint64 windowBytes;
+        qint64 windowFirstRead;
+        qint64 windowLastRead;
+        QVector<qint64> slotBytes;
+        TcpInfoSeries tcpInfo;
+    };
+
+    bool openStreams(int count);
+    bool openStream();
+    int awaitConnections();
+    bool connectionDone(int stream);
+    int sendRequests();
+    bool sendRequest(int stream);
+    void receive();
+    void sampleTcpInfo(qint64 now);
+    void adapt(qint64 now);
+    void readStream(int stream, qint64 now);
+    void closeStream(int stream, DownloadThread::DownloadThreadStatus status);
+
+    QUrl m_url;
+    QHostAddress m_server;
+    int m_targetTime;
+    int m_rampUpTime;
+    int m_slotLength;
+    bool m_avoidCaches;
+    quint16 m_sourcePort;
+    bool m_adaptive;
+
+    QVector<Stream> m_streams;
+    QList<QByteArray> m_requests;
+    QByteArray m_scratch;
+    struct sockaddr_storage m_remote;
+    socklen_t m_remoteLength;
+    quint16 m_nextPort;
+    int m_epollFd;
+    QElapsedTimer m_clock;
+    qint64 m_firstRequest;
+    qint64 m_windowBegin;
+    qint64 m_windowEnd;
+    bool m_stoppedEarly;
+
+    int m_usedStreams;
+    qint64 m_nextTick; //end of the current slot on the engine clock
+
+    //adaptive mode
+    qint64 m_totalBytes;
+    qint64 m_tickBytes;
+    qreal m_lastRate;
+    qreal m_plateauRate; //aggregate throughput before the last stream was added
+    int m_slotsSinceChange;
+    QVector<qreal> m_windowRates;
+    int m_windowSlots;
+    QAtomicInt m_stop;
+    QString m_errorString;
+
+    //same limits as DownloadThread
+    static const int tcpConnectTimeout = 5000;
+    static const int firstByteReceivedTimeout = 5000;
+    static const int defaultPort = 80;
+    static const int scratchSize = 262144;
+    static const int pollInterval = 100;
+    static const int stableSlots = 3;
+    static const int minWindowTime = 2000;
+    static const int growthPercent = 10; //more throughput than this counts as growth
+    static const int stablePercent = 5; //slots within this of their mean are stable
+};
+
+#endif // DOWNLOADENGINE_H
@@ -1,7 +1,13 @@
 #include "httpdownload.h"
 #include "../../log/logger.h"
+#include "../../client.h"
+#include "../../network/resolver.h"
 #include "types.h"
 
+#if defined(Q_OS_LINUX)
+#include "downloadengine.h"
+#endif
+
 #include <QRegularExpression>
 #include <QtMath>
 #include <numeric>
@@ -9,16 +15,37 @@
 LOGGER(HTTPDownload);
 
 DownloadThread::DownloadThread (const QUrl &url, const QHostInfo &server, int targetTimeMs,
-                                bool cacheTest, quint16 sourcePort, QObject *parent)
+                                int rampUpTimeMs, int slotLengthMs, bool cacheTest,
+                                quint16 sourcePort, QObject *parent)
 : QObject(parent)
 , url(url)
 , server(server)
 , targetTime(targetTimeMs)
+, rampUpTime(rampUpTimeMs)
+, slotLength(slotLengthMs)
 , avoidCaches(cacheTest)
 , sourcePort(sourcePort)
 , socket(NULL)
 , tStatus(Inactive)
+, timeToFirstByte(0)
+, scratch(scratchSize, Qt::Uninitialized)
+, lastReadTime(0)
+, windowBegin(0)
+, windowEnd(-1)
+, windowBytes(0)
+, windowFirstRead(-1)
+, windowLastRead(-1)
+, connectedTime(-1)
+, requestTime(-1)
+, requestSentTime(-1)
+, firstByteTime(-1)
+, headerTime(-1)
+, lastReadPhaseTime(-1)
+, headerMatched(0)
 {
+    //the download never lasts longer than waiting for the first byte,
+    //the ramp-up and the target time, so this is all we need
+    slotBytes.fill(0, (firstByteReceivedTimeout + rampUpTime + targetTime) / slotLength + 2);
 }
 
 DownloadThread::~DownloadThread()
@@ -54,12 +81,12 @@ qint64 DownloadThread::startTimeInNs() const
 
 qint64 DownloadThread::endTimeInNs() const
 {
-    return startTime.toMSecsSinceEpoch() * 1000000 + timeIntervals.last();
+    return startTime.toMSecsSinceEpoch() * 1000000 + lastReadTime;
 }
 
 qint64 DownloadThread::runTimeInNs() const
 {
-    return timeIntervals.last();
+    return lastReadTime;
 }
 
 void DownloadThread::startTCPConnection()
@@ -77,7 +104,11 @@ void DownloadThread::startTCPConnection()
         return;
     }
 
+    phaseTimer.start();
+
     socket = new QTcpSocket();
+    //keep Qt's buffer as small as ours, read() drains both on every readyRead
+    socket->setReadBufferSize(scratchSize);
 
     if (sourcePort > 0)
     {
@@ -116,6 +147,7 @@ void DownloadThread::startTCPConnection()
     {
         //for the successfully connected sockets, we should track the disconnection
         connect(socket, &QTcpSocket::disconnected, this, &DownloadThread::disconnectionHandling);
+        connectedTime = phaseTimer.nsecsElapsed();
         tStatus = ConnectedTCP;
         LOG_DEBUG("Thread connected");
         emit TCPConnected(true);
@@ -165,6 +197,7 @@ void DownloadThread::startDownload()
 
     //log actual time of start
     startTime = QDateTime::currentDateTime();
+    requestTime = phaseTimer.nsecsElapsed();
 
     //send the HTTP GET
     while(bytesWritten < request.length())
@@ -182,6 +215,10 @@ void DownloadThread::startDownload()
         bytesWritten += writeResult;
     }
 
+    //written means handed to Qt, make sure it reached the kernel
+    socket->flush();
+    requestSentTime = phaseTimer.nsecsElapsed();
+
     LOG_DEBUG("Thread: get request sent");
 
     //start eplapsed timer for calculating the time slots
@@ -195,13 +232,16 @@ void DownloadThread::startDownload()
         LOG_DEBUG("Thread: received response");
 
         timeToFirstByte = measurementTimer.nsecsElapsed();
+        firstByteTime = phaseTimer.nsecsElapsed();
         tStatus = DownloadInProgress;
         //connect readyRead of the socket with read() for further reads
         connect(socket, &QTcpSocket::readyRead, this, &DownloadThread::read);
 
-        //call read and check for HTTP response code
+        //check for HTTP response code before read() discards it
         QRegularExpression re("HTTP/\\d\\.\\d\\s+(\\d+)\\s+.*");
-        QString HTTPResponseCode = re.match(read()).captured(1);
+        QString HTTPResponseCode = re.match(socket->peek(64)).captured(1);
+
+        read();
 
         if (HTTPResponseCode == "200")
         {
@@ -223,92 +263,122 @@ void DownloadThread::startDownload()
     }
 }
 
-QByteArray DownloadThread::read()
+void DownloadThread::read()
 {
     if (!socket->isOpen())
     {
         disconnectionHandling();
-        return QByteArray();
+        return;
     }
 
-    bytesReceived << socket->bytesAvailable();
-    timeIntervals << measurementTimer.nsecsElapsed();
+    qint64 now = measurementTimer.nsecsElapsed();
+    qint64 bytes = 0;
+    qint64 readResult;
 
-    return socket->readAll();
-}
+    //drain everything into the scratch buffer, nothing is allocated here
+    while ((readResult = socket->read(scratch.data(), scratch.size())) > 0)
+    {
+        if (headerTime < 0 && headerEnd(scratch.constData(), readResult, &headerMatched) >= 0)
+        {
+            headerTime = phaseTimer.nsecsElapsed();
+        }
 
-qreal DownloadThread::averageThroughput(qint64 sTime, qint64 eTime) const
-{
-    int i = 0;
+        bytes += readResult;
+    }
 
-    qint64 bytes = 0;
+    if (bytes == 0)
+    {
+        return;
+    }
 
-    qint64 begin = sTime - startTimeInNs();
-    qint64 end = eTime - startTimeInNs();
+    lastReadTime = now;
+    lastReadPhaseTime = phaseTimer.nsecsElapsed();
 
-    int startSlot = -1;
-    int endSlot = -1;
+    int slot = now / ((qint64)slotLength * 1000000);
 
-    for (i = 0; i < timeIntervals.size(); i++)
+    if (slot < slotBytes.size())
     {
-        //start after "begin"
-        if (timeIntervals[i] < begin)
+        slotBytes[slot] += bytes;
+    }
+
+    if (now >= windowBegin && now <= windowEnd)
+    {
+        if (windowFirstRead < 0)
         {
-            continue;
+            windowFirstRead = now;
         }
 
-        if (startSlot < 0)
+        windowLastRead = now;
+        windowBytes += bytes;
+    }
+}
+
+QVariantMap DownloadThread::phases() const
+{
+    QVariantMap map;
+    map.insert("connect_ns", phaseDuration(0, connectedTime));
+    map.insert("request_ns", phaseDuration(requestTime, requestSentTime));
+    map.insert("ttfb_ns", phaseDuration(requestSentTime, firstByteTime));
+    map.insert("header_ns", phaseDuration(firstByteTime, headerTime));
+    map.insert("body_ns", phaseDuration(headerTime, lastReadPhaseTime));
+    return map;
+}
+
+int DownloadThread::headerEnd(const char *data, int size, int *matched)
+{
+    static const char end[] = "\r\n\r\n";
+
+    for (int i = 0; i < size; i++)
+    {
+        if (data[i] == end[*matched])
         {
-            startSlot = i;
+            if (++(*matched) == 4)
+            {
+                return i + 1;
+            }
         }
-
-        if (timeIntervals[i] > end)
+        else
         {
-            break;
+            //only a CR can start the sequence again
+            *matched = data[i] == '\r' ? 1 : 0;
         }
+    }
 
-        endSlot = i;
+    return -1;
+}
 
-        bytes += bytesReceived[i];
-    }
+qint64 DownloadThread::phaseDuration(qint64 begin, qint64 end)
+{
+    return begin < 0 || end < begin ? -1 : end - begin;
+}
+
+void DownloadThread::setMeasurementWindow(qint64 sTime, qint64 eTime)
+{
+    windowBegin = sTime - startTimeInNs();
+    windowEnd = eTime - startTimeInNs();
+}
 
-    if (endSlot < 0 || startSlot < 0)
+qreal DownloadThread::averageThroughput() const
+{
+    if (windowFirstRead < 0 || windowLastRead <= windowFirstRead)
     {
         //this should only happen is we have a wrong time window
         return 0.0;
     }
 
-    return (8.0 * (qreal)bytes)/(((qreal)(timeIntervals[endSlot] - timeIntervals[startSlot]))/1000000000.0);
+    return (8.0 * (qreal)windowBytes)/(((qreal)(windowLastRead - windowFirstRead))/1000000000.0);
 }
 
-QList<qreal> DownloadThread::measurementSlots(int slotLength) const
+QList<qreal> DownloadThread::measurementSlots() const
 {
-    int i = 0;
-
     QList<qreal> slotList;
 
-    int bytes = 0;
-    qint64 currentSlotTime = slotLength * 1000000;
-    int lastSlot = 0;
+    //the slot of the last read is still incomplete
+    int completeSlots = qMin((int)(lastReadTime / ((qint64)slotLength * 1000000)), slotBytes.size());
 
-    for (i = 0; i < timeIntervals.size(); i++)
+    for (int i = 0; i < completeSlots; i++)
     {
-        if (timeIntervals[i] > currentSlotTime && i != 0)
-        {
-            slotList << ((qreal)bytes * 8) / ((timeIntervals[i-1] - timeIntervals[lastSlot])/1000000000.0);
-
-            bytes = bytesReceived[i];
-            currentSlotTime += slotLength * 1000000;
-            if (timeIntervals[i] > currentSlotTime)
-            {
-                currentSlotTime = timeIntervals[i];
-            }
-            lastSlot = i - 1;
-        }
-        else
-        {
-            bytes += bytesReceived[i];
-        }
+        slotList << ((qreal)slotBytes[i] * 8) / (slotLength / 1000.0);
     }
 
     return slotList;
@@ -334,6 +404,8 @@ void DownloadThread::stopDownload()
 HTTPDownload::HTTPDownload(QObject *parent)
 : Measurement(parent)
 , currentStatus(HTTPDownload::Unknown)
+, engine(NULL)
+, lookupTime(-1)
 , overallBandwidth(0.0)
 , connectedThreads(0)
 , unconnectedThreads(0)
@@ -347,6 +419,11 @@ HTTPDownload::HTTPDownload(QObject *parent)
 
 HTTPDownload::~HTTPDownload()
 {
+#if defined(Q_OS_LINUX)
+    //waits for the engine thread
+    delete engine;
+#endif
+
     //deleting workers not needed - done by deleteLater already
     qDeleteAll(threads);
 }
@@ -394,6 +471,14 @@ bool HTTPDownload::prepare(NetworkManager *networkManager,
         return false;
     }
 
+#if !defined(Q_OS_LINUX)
+    if (definition->adaptive)
+    {
+        setErrorString("adaptive mode not supported on this platform");
+        return false;
+    }
+#endif
+
     //set the URL to be used by all threads
     //use a QUrl object to have its convenience functions at hand later
     //do not use setUrl! will not produce proper results e.g. for www.domain-name.tld etc.
@@ -416,8 +501,10 @@ bool HTTPDownload::start()
     //TODO: add a timer to check wheather this has actually gone through or not
 
     //when the lookup finishes, we want to call the startThreads() function
-    //that starts the actual measurement/threads 
-    QHostInfo::lookupHost(requestUrl.host(), this, SLOT(startThreads(QHostInfo)));
+    //that starts the actual measurement/threads; cached answers skip the
+    //DNS round trip but are delivered from the event loop as well
+    lookupTimer.start();
+    Client::instance()->resolver()->lookupHost(requestUrl.host(), this, SLOT(startThreads(QHostInfo)));
 
     return true;
 }
@@ -425,6 +512,8 @@ bool HTTPDownload::start()
 //this function starts the actual measurement
 bool HTTPDownload::startThreads(const QHostInfo &server)
 {
+    lookupTime = lookupTimer.nsecsElapsed();
+
     //check if the name resolution was actually successful
     if (server.error() != QHostInfo::NoError)
     {
@@ -435,6 +524,24 @@ bool HTTPDownload::startThreads(const QHostInfo &server)
     // save (first) destination IP for the results
     destinationIP = server.addresses().first();
 
+#if defined(Q_OS_LINUX)
+    //one thread for all streams, it runs the whole download and we
+    //only calculate the results once it is done
+    engine = new DownloadEngine(requestUrl, destinationIP, definition->threads, definition->targetTime,
+                                definition->rampUpTime, definition->slotLength, definition->avoidCaches,
+                                definition->sourcePort, definition->adaptive);
+
+    connect(engine, &QThread::finished, this, &HTTPDownload::engineFinished);
+
+    setStatus(HTTPDownload::Running);
+
+    LOG_DEBUG(QString("Starting engine with %1 streams").arg(definition->threads));
+
+    engine->start();
+
+    return true;
+#endif
+
     int n = 0;
 
     //start all threads
@@ -442,7 +549,8 @@ bool HTTPDownload::startThreads(const QHostInfo &server)
     {
         //create a worker thread that starts an actual download
         QThread *workerThread = new QThread();
-        DownloadThread *worker = new DownloadThread(requestUrl, server, definition->targetTime, definition->avoidCaches,
+        DownloadThread *worker = new DownloadThread(requestUrl, server, definition->targetTime, definition->rampUpTime,
+                                                    definition->slotLength, definition->avoidCaches,
                                                     definition->sourcePort, workerThread);
 
         //store the references to the threads/workers
@@ -464,6 +572,9 @@ bool HTTPDownload::startThreads(const QHostInfo &server)
 
         connect(worker, &DownloadThread::firstByteReceived, this, &HTTPDownload::downloadStartedTracking);
 
+        //this signal tells the threads which reads count for the average
+        connect(this, &HTTPDownload::measurementWindow, worker, &DownloadThread::setMeasurementWindow);
+
         connect(worker, &DownloadThread::TCPDisconnected, this, &HTTPDownload::prematureDisconnectedTracking);
 
         //when the thread finishes, do some cleanup
@@ -559,6 +670,10 @@ void HTTPDownload::downloadStartedTracking(bool success)
         }
 
         downloadStartTime = QDateTime::currentDateTime().addMSecs(definition->rampUpTime);
+        //the threads account the window while reading, it starts after the ramp-up
+        emit measurementWindow(downloadStartTime.toMSecsSinceEpoch() * 1000000,
+                               downloadStartTime.toMSecsSinceEpoch() * 1000000 + \
+                               ((qint64) (definition->targetTime)) * 1000000);
         //when this timer fires we stop all downloads
         LOG_DEBUG("Start timer to wait for download");
         downloadTimer.singleShot(definition->targetTime + definition->rampUpTime, this, SLOT(downloadFinished()));
@@ -616,6 +731,107 @@ void HTTPDownload::downloadFinished()
     }
 }
 
+void HTTPDownload::engineFinished()
+{
+#if defined(Q_OS_LINUX)
+    LOG_DEBUG("Download finished (engine)");
+
+    setStatus(HTTPDownload::Finished);
+
+    for (int i = 0; i < streamCount(); i++)
+    {
+        if (streamStatus(i) == DownloadThread::FinishedSuccess)
+        {
+            calculateResults();
+            emit finished();
+            return;
+        }
+    }
+
+    emit error(engine->errorString().isEmpty() ? QString("Unable to calculate accurate results on the measurement.")
+                                               : engine->errorString());
+#endif
+}
+
+int HTTPDownload::streamCount() const
+{
+#if defined(Q_OS_LINUX)
+    return engine ? engine->streamCount() : 0;
+#else
+    return workers.size();
+#endif
+}
+
+DownloadThread::DownloadThreadStatus HTTPDownload::streamStatus(int stream) const
+{
+#if defined(Q_OS_LINUX)
+    return engine->streamStatus(stream);
+#else
+    return workers[stream]->threadStatus();
+#endif
+}
+
+qint64 HTTPDownload::measuredTimeInNs(int stream) const
+{
+#if defined(Q_OS_LINUX)
+    return engine->measuredTimeInNs(stream);
+#else
+    return workers[stream]->runTimeInNs() - \
+           (downloadStartTime.toMSecsSinceEpoch() * 1000000 - workers[stream]->startTimeInNs());
+#endif
+}
+
+qreal HTTPDownload::averageThroughput(int stream) const
+{
+#if defined(Q_OS_LINUX)
+    return engine->averageThroughput(stream);
+#else
+    return workers[stream]->averageThroughput();
+#endif
+}
+
+QList<qreal> HTTPDownload::measurementSlots(int stream) const
+{
+#if defined(Q_OS_LINUX)
+    return engine->measurementSlots(stream);
+#else
+    return workers[stream]->measurementSlots();
+#endif
+}
+
+QVariantMap HTTPDownload::tcpInfo(int stream) const
+{
+#if defined(Q_OS_LINUX)
+    return engine->tcpInfo(stream);
+#else
+    //TCP_INFO is Linux only
+    Q_UNUSED(stream);
+    return QVariantMap();
+#endif
+}
+
+QVariantMap HTTPDownload::phases(int stream) const
+{
+#if defined(Q_OS_LINUX)
+    QVariantMap map = engine->phases(stream);
+#else
+    QVariantMap map = workers[stream]->phases();
+#endif
+
+    map.insert("dns_ns", lookupTime);
+    return map;
+}
+
+qint64 HTTPDownload::measurementTimeInNs() const
+{
+#if defined(Q_OS_LINUX)
+    //the adaptive mode may end the window early
+    return engine->windowLengthInNs();
+#else
+    return (qint64)definition->targetTime * 1000000;
+#endif
+}
+
 //we ony trust the results if the threads have measured something useful
 bool HTTPDownload::resultsTrustable()
 {
@@ -626,9 +842,9 @@ bool HTTPDownload::resultsTrustable()
 
     int unfinishedThreads = 0;
 
-    for (i = 0; i < workers.size(); i++)
+    for (i = 0; i < streamCount(); i++)
     {
-        if(workers[i]->threadStatus() != DownloadThread::FinishedSuccess)
+        if(streamStatus(i) != DownloadThread::FinishedSuccess)
         {
             unfinishedThreads++;
             continue;
@@ -636,9 +852,7 @@ bool HTTPDownload::resultsTrustable()
 
         //if run time during the measurement period of _all_ threads is above
         //75% of the target time, we assume the measure
-        if(workers[i]->runTimeInNs() - \
-                (downloadStartTime.toMSecsSinceEpoch() * 1000000 - workers[i]->startTimeInNs())
-                < (((double)definition->targetTime * 1000000) * 0.75))
+        if(measuredTimeInNs(i) < ((double)measurementTimeInNs() * 0.75))
         {
            return false;
         }
@@ -663,11 +877,11 @@ bool HTTPDownload::calculateResults()
     LOG_DEBUG("Check if results are trustable");
     bool resultsOK = resultsTrustable();
 
-    for(int i = 0; i < workers.size(); i++)
+    for(int i = 0; i < streamCount(); i++)
     {
         LOG_DEBUG("Check which treads to consider");
         //only consider threads that finished successfully
-        if(workers[i]->threadStatus() != DownloadThread::FinishedSuccess)
+        if(streamStatus(i) != DownloadThread::FinishedSuccess)
         {
             continue;
         }
@@ -677,13 +891,11 @@ bool HTTPDownload::calculateResults()
         num_threads++;
 
         QVariantMap thread;
-        qreal avg = workers[i]->averageThroughput(downloadStartTime.toMSecsSinceEpoch() * 1000000, \
-                                                  downloadStartTime.toMSecsSinceEpoch() * 1000000 + \
-                                                  ((qint64) (definition->targetTime)) * 1000000);
+        qreal avg = averageThroughput(i);
         thread.insert("avg", avg);
         overallBandwidth += avg;
 
-        QList<qreal> measurementSlots = workers[i]->measurementSlots(definition->slotLength);
+        QList<qreal> measurementSlots = measurementSlots(i);
 
         // get max and min
         QList<qreal>::const_iterator it = std::max_element(measurementSlots.begin(), measurementSlots.end());
@@ -704,6 +916,14 @@ bool HTTPDownload::calculateResults()
         }
 
         thread.insert("slots", listToVariant(measurementSlots));
+        thread.insert("phases", phases(i));
+
+        QVariantMap tcpInfoSeries = tcpInfo(i);
+
+        if (!tcpInfoSeries.isEmpty())
+        {
+            thread.insert("tcp_info", tcpInfoSeries);
+        }
 
         threadResults.append(thread);
     }
@@ -714,11 +934,27 @@ bool HTTPDownload::calculateResults()
     results.insert("bandwidth_bps_per_thread", threadResults);
     results.insert("destination_ip", destinationIP.toString());
 
+#if defined(Q_OS_LINUX)
+    results.insert("adaptive", definition->adaptive);
+    results.insert("stream_count", engine->usedStreams());
+    results.insert("ramp_up_time", engine->rampUpTimeInNs() / 1000000);
+    results.insert("measurement_time", engine->windowLengthInNs() / 1000000);
+    results.insert("stopped_early", engine->stoppedEarly());
+#endif
+
     return true;
 }
 
 bool HTTPDownload::stop()
 {
+#if defined(Q_OS_LINUX)
+    if (engine)
+    {
+        engine->stop();
+        engine->wait();
+    }
+#endif
+
     foreach (const QPointer<DownloadThread> &downloadThread, workers)
     {
         if (!downloadThread.isNull())
@@ -8,6 +8,7 @@
 #include <QHostInfo>
 #include <QUrl>
 #include <QList>
+#include <QVector>
 #include <QThread>
 #include <QTimer>
 #include <QTcpSocket>
@@ -31,7 +32,8 @@ public:
     };
 
     DownloadThread (const QUrl &url, const QHostInfo &server, int targetTimeMs = 10000,
-                    bool avoidCaches = false, quint16 sourcePort = 0, QObject *parent = 0);
+                    int rampUpTimeMs = 3000, int slotLengthMs = 1000, bool avoidCaches = false,
+                    quint16 sourcePort = 0, QObject *parent = 0);
     ~DownloadThread();
 
     DownloadThreadStatus threadStatus() const;
@@ -41,8 +43,15 @@ public:
     qint64 endTimeInNs() const;
     qint64 runTimeInNs() const;
 
-    qreal averageThroughput(qint64 sTime, qint64 eTime) const; //average througput in bps
-    QList<qreal> measurementSlots(int slotLength) const; //slotLength in ms
+    qreal averageThroughput() const; //average througput in bps within the measurement window
+    QList<qreal> measurementSlots() const; //throughput of each complete slot in bps
+    QVariantMap phases() const; //connect, request, ttfb, header and body in ns
+
+    //returns the offset after the end of the HTTP header in data or -1,
+    //matched keeps the state between reads and starts at 0
+    static int headerEnd(const char *data, int size, int *matched);
+    //duration between two monotonic times, -1 if a phase was not reached
+    static qint64 phaseDuration(qint64 begin, qint64 end);
 
 private:
 
@@ -52,6 +61,10 @@ private:
     QHostInfo server;
     //the time in which the download should finish (from the definition) im ms
     int targetTime;
+    //the time given to TCP to ramp up before the measurement window in ms
+    int rampUpTime;
+    //length of the measurement slots in ms
+    int slotLength;
     //testCaches? true: don't randomize URL, false: randomize URL
     bool avoidCaches;
     //local/source port
@@ -74,16 +87,37 @@ private:
     //the measurement Timer for tracking the time slots
     QElapsedTimer measurementTimer;
 
-    //list of bytes received
-    QList<qint64> bytesReceived;
-    //list of times in which the bytes above were received
-    QList<qint64> timeIntervals;
+    //monotonic times of the connection phases in ns since the connect
+    QElapsedTimer phaseTimer;
+    qint64 connectedTime;
+    qint64 requestTime;
+    qint64 requestSentTime;
+    qint64 firstByteTime;
+    qint64 headerTime;
+    qint64 lastReadPhaseTime;
+    int headerMatched;
+
+    //reused buffer the received data is drained into and discarded
+    QByteArray scratch;
+    //bytes received per slot, binned while reading (fixed size)
+    QVector<qint64> slotBytes;
+    //relative time of the last read in ns
+    qint64 lastReadTime;
+
+    //measurement window relative to startTime in ns
+    qint64 windowBegin;
+    qint64 windowEnd;
+    //bytes read within the window and the times of the first and last read in it
+    qint64 windowBytes;
+    qint64 windowFirstRead;
+    qint64 windowLastRead;
 
     //some more or less magic constants used
     //TCP timeout on the 3-way handshake in ms
     static const int tcpConnectTimeout = 5000;
     static const int firstByteReceivedTimeout = 5000;
     static const int defaultPort = 80;
+    static const int scratchSize = 65536;
 
 public slots:
     //tells the thread to perform the 3-way handshake
@@ -91,8 +125,10 @@ public slots:
     void disconnectionHandling();
     void startDownload();
     void stopDownload();
+    //sets the window for averageThroughput(), absolute times in ns
+    void setMeasurementWindow(qint64 sTime, qint64 eTime);
     //reads data from the socket whenever there's data ready to be read
-    QByteArray read();
+    void read();
 
 signals:
     void TCPConnected(bool success);
@@ -102,6 +138,8 @@ signals:
 };
 
 
+class DownloadEngine;
+
 class HTTPDownload : public Measurement
 {
     Q_OBJECT
@@ -125,6 +163,16 @@ private:
     bool resultsTrustable();
     bool calculateResults();
 
+    //per stream results, from the engine or the threads
+    int streamCount() const;
+    DownloadThread::DownloadThreadStatus streamStatus(int stream) const;
+    qint64 measuredTimeInNs(int stream) const;
+    qreal averageThroughput(int stream) const;
+    QList<qreal> measurementSlots(int stream) const;
+    qint64 measurementTimeInNs() const;
+    QVariantMap tcpInfo(int stream) const;
+    QVariantMap phases(int stream) const;
+
     HTTPDownloadDefinitionPtr definition;
 
     Status currentStatus;
@@ -133,6 +181,13 @@ private:
     QList <QThread *> threads;
     QList <QPointer<DownloadThread> > workers;
 
+    //name resolution is shared by all connections
+    QElapsedTimer lookupTimer;
+    qint64 lookupTime;
+
+    //drives all streams from one thread where epoll is available
+    DownloadEngine *engine;
+
     QList <qreal> downloadSpeeds;
     qreal overallBandwidth;
 
@@ -153,7 +208,11 @@ private:
     //some more or less magic constants
     static const int maxRampUpTime = 10000; //max ramp-up time in milli-seconds for TCP to grow the CWND
     static const int minRampUpTime = 1000;
+#if defined(Q_OS_LINUX)
+    static const int maxThreads = 64;
+#else
     static const int maxThreads = 6;
+#endif
     static const int minThreads = 1;
     static const int maxTargetTime = 45000; //no download should last longer than that (security reasons)
     static const int minTargetTime = 2000; //so download should be shorter than this, really
@@ -162,6 +221,7 @@ private:
 private slots:
     bool startThreads(const QHostInfo &server);
     void downloadFinished();
+    void engineFinished();
 
 public slots:
     void TCPConnectionTracking(bool success);
@@ -172,6 +232,7 @@ signals:
     void statusChanged(Status status);
     void connectTCP();
     void startDownload();
+    void measurementWindow(qint64 sTime, qint64 eTime);
 };
 
 #endif // HTTPGETREQUEST_H
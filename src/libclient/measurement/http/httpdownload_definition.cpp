@@ -2,7 +2,7 @@
 
 HTTPDownloadDefinition::HTTPDownloadDefinition(const QString &url, const bool cacheTest, const int threads, \
                                                const int targetTime, const int rampUpTime, const int slotLength,
-                                               const quint16 sourcePort)
+                                               const quint16 sourcePort, const bool adaptive)
 : url(url)
 , avoidCaches(cacheTest)
 , threads(threads)
@@ -10,6 +10,7 @@ HTTPDownloadDefinition::HTTPDownloadDefinition(const QString &url, const bool ca
 , rampUpTime(rampUpTime)
 , slotLength(slotLength)
 , sourcePort(sourcePort)
+, adaptive(adaptive)
 {
 
 }
@@ -28,7 +29,8 @@ HTTPDownloadDefinitionPtr HTTPDownloadDefinition::fromVariant(const QVariant &va
                                                                 map.value("target_time", 10000).toInt(),
                                                                 map.value("ramp_up_time", 3000).toInt(),
                                                                 map.value("slot_length", 1000).toInt(),
-                                                                map.value("source_port", 0).toUInt()));
+                                                                map.value("source_port", 0).toUInt(),
+                                                                map.value("adaptive", false).toBool()));
 }
 
 QVariant HTTPDownloadDefinition::toVariant() const
@@ -41,5 +43,6 @@ QVariant HTTPDownloadDefinition::toVariant() const
     map.insert("ramp_up_time", rampUpTime);
     map.insert("slot_length", slotLength);
     map.insert("source_port", sourcePort);
+    map.insert("adaptive", adaptive);
     return map;
 }
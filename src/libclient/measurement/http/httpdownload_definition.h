@@ -13,7 +13,7 @@ class HTTPDownloadDefinition : public MeasurementDefinition
 public:
     HTTPDownloadDefinition(const QString &url, const bool avoidCaches, const int threads,
                            const int targetTime, const int rampUpTime, const int slotLength,
-                           const quint16 sourcePort);
+                           const quint16 sourcePort, const bool adaptive);
     ~HTTPDownloadDefinition();
 
     // Storage
@@ -27,6 +27,7 @@ public:
     int rampUpTime;
     int slotLength;
     int sourcePort;
+    bool adaptive; // threads and rampUpTime are upper bounds, see DownloadEngine
 
     // Serializable interface
     QVariant toVariant() const;
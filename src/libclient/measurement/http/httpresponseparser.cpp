@@ -0,0 +1,311 @@
+#include "httpresponseparser.h"
+
+#include <string.h>
+
+HttpResponseParser::HttpResponseParser()
+: m_bodyLimit(0)
+{
+    reset();
+}
+
+void HttpResponseParser::reset(bool headRequest)
+{
+    m_state = StatusLine;
+    m_headRequest = headRequest;
+    m_statusCode = 0;
+    m_keepAlive = false;
+    m_chunked = false;
+    m_contentLength = -1;
+    m_remaining = 0;
+    m_headerSize = 0;
+    m_bodySize = 0;
+    m_consumed = 0;
+    m_line.clear();
+    m_body.clear();
+}
+
+int HttpResponseParser::feed(const char *data, int size)
+{
+    int pos = 0;
+
+    while (pos < size && m_state != Complete && m_state != Invalid)
+    {
+        switch (m_state)
+        {
+        case Body:
+        case ChunkData:
+        case BodyUntilClose:
+        {
+            qint64 length = size - pos;
+
+            if (m_state != BodyUntilClose)
+            {
+                length = qMin(length, m_remaining);
+                m_remaining -= length;
+            }
+
+            if (m_body.size() < m_bodyLimit)
+            {
+                m_body.append(data + pos, qMin<int>(length, m_bodyLimit - m_body.size()));
+            }
+
+            m_bodySize += length;
+            pos += length;
+
+            if (m_remaining == 0 && m_state == Body)
+            {
+                m_state = Complete;
+            }
+            else if (m_remaining == 0 && m_state == ChunkData)
+            {
+                m_state = ChunkDataEnd;
+            }
+
+            break;
+        }
+
+        default:
+        {
+            // all other states consume one line at a time
+            const char *end = (const char *)memchr(data + pos, '\n', size - pos);
+            int length = end ? end - (data + pos) + 1 : size - pos;
+
+            if (m_state == StatusLine || m_state == Headers)
+            {
+                m_headerSize += length;
+            }
+
+            m_line.append(data + pos, length);
+            pos += length;
+
+            if (!end)
+            {
+                if (m_line.size() > maxLineLength)
+                {
+                    m_state = Invalid;
+                }
+
+                break;
+            }
+
+            m_line.chop(m_line.endsWith("\r\n") ? 2 : 1);
+
+            if (!parseLine(m_line))
+            {
+                m_state = Invalid;
+            }
+
+            m_line.clear();
+            break;
+        }
+        }
+    }
+
+    m_consumed += pos;
+    return pos;
+}
+
+void HttpResponseParser::finish()
+{
+    if (m_state == BodyUntilClose)
+    {
+        m_state = Complete;
+    }
+    else if (m_state != Complete)
+    {
+        m_state = Invalid;
+    }
+}
+
+void HttpResponseParser::setBodyLimit(int maxSize)
+{
+    m_bodyLimit = maxSize;
+}
+
+HttpResponseParser::State HttpResponseParser::state() const
+{
+    return m_state;
+}
+
+bool HttpResponseParser::isComplete() const
+{
+    return m_state == Complete;
+}
+
+bool HttpResponseParser::isValid() const
+{
+    return m_state != Invalid;
+}
+
+bool HttpResponseParser::headerComplete() const
+{
+    return m_state != StatusLine && m_state != Headers && m_state != Invalid;
+}
+
+bool HttpResponseParser::started() const
+{
+    return m_consumed > 0;
+}
+
+int HttpResponseParser::statusCode() const
+{
+    return m_statusCode;
+}
+
+bool HttpResponseParser::keepAlive() const
+{
+    return m_keepAlive;
+}
+
+qint64 HttpResponseParser::headerSize() const
+{
+    return m_headerSize;
+}
+
+qint64 HttpResponseParser::bodySize() const
+{
+    return m_bodySize;
+}
+
+QByteArray HttpResponseParser::body() const
+{
+    return m_body;
+}
+
+bool HttpResponseParser::parseLine(const QByteArray &line)
+{
+    switch (m_state)
+    {
+    case StatusLine:
+    {
+        // tolerate empty lines left over from a previous message
+        if (line.isEmpty())
+        {
+            return true;
+        }
+
+        if (!line.startsWith("HTTP/1."))
+        {
+            return false;
+        }
+
+        QList<QByteArray> parts = line.split(' ');
+        bool ok = false;
+
+        if (parts.size() > 1)
+        {
+            m_statusCode = parts.at(1).toInt(&ok);
+        }
+
+        // HTTP/1.1 connections are persistent unless told otherwise
+        m_keepAlive = line.startsWith("HTTP/1.1");
+        m_state = Headers;
+        return ok;
+    }
+
+    case Headers:
+    {
+        if (line.isEmpty())
+        {
+            headersDone();
+            return true;
+        }
+
+        int colon = line.indexOf(':');
+
+        if (colon <= 0)
+        {
+            return false;
+        }
+
+        QByteArray name = line.left(colon).trimmed().toLower();
+        QByteArray value = line.mid(colon + 1).trimmed().toLower();
+
+        if (name == "content-length")
+        {
+            bool ok = false;
+            m_contentLength = value.toLongLong(&ok);
+            return ok && m_contentLength >= 0;
+        }
+        else if (name == "transfer-encoding")
+        {
+            m_chunked = value.contains("chunked");
+        }
+        else if (name == "connection")
+        {
+            if (value.contains("close"))
+            {
+                m_keepAlive = false;
+            }
+            else if (value.contains("keep-alive"))
+            {
+                m_keepAlive = true;
+            }
+        }
+
+        return true;
+    }
+
+    case ChunkSize:
+    {
+        int extension = line.indexOf(';');
+        bool ok = false;
+        m_remaining = (extension < 0 ? line : line.left(extension)).trimmed().toLongLong(&ok, 16);
+
+        if (!ok || m_remaining < 0)
+        {
+            return false;
+        }
+
+        m_state = m_remaining == 0 ? Trailer : ChunkData;
+        return true;
+    }
+
+    case ChunkDataEnd:
+        m_state = ChunkSize;
+        return line.isEmpty();
+
+    case Trailer:
+        if (line.isEmpty())
+        {
+            m_state = Complete;
+        }
+
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+void HttpResponseParser::headersDone()
+{
+    // interim responses are followed by the real one
+    if (m_statusCode >= 100 && m_statusCode < 200)
+    {
+        m_state = StatusLine;
+        m_chunked = false;
+        m_contentLength = -1;
+        return;
+    }
+
+    if (m_headRequest || m_statusCode == 204 || m_statusCode == 304)
+    {
+        m_state = Complete;
+    }
+    else if (m_chunked)
+    {
+        m_state = ChunkSize;
+    }
+    else if (m_contentLength >= 0)
+    {
+        m_remaining = m_contentLength;
+        m_state = m_remaining == 0 ? Complete : Body;
+    }
+    else
+    {
+        // the body ends with the connection
+        m_keepAlive = false;
+        m_state = BodyUntilClose;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef HTTPRESPONSEPARSER_H
+#define HTTPRESPONSEPARSER_H
+
+#include <QByteArray>
+
+/*
+ * Incremental parser for HTTP/1.x responses as they arrive on a socket.
+ * Only the status line and the headers needed to find the end of the
+ * message (Content-Length, Transfer-Encoding, Connection) are kept, the
+ * body is counted and dropped unless a body limit is set. feed() stops at
+ * the end of a response so that pipelined responses can be parsed one
+ * after the other by calling reset() in between.
+ */
+class HttpResponseParser
+{
+public:
+    enum State
+    {
+        StatusLine,
+        Headers,
+        Body,
+        BodyUntilClose,
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        Trailer,
+        Complete,
+        Invalid
+    };
+
+    HttpResponseParser();
+
+    // the next response belongs to a GET (false) or HEAD (true) request
+    void reset(bool headRequest = false);
+
+    // returns the number of bytes consumed, less than size once complete
+    int feed(const char *data, int size);
+
+    // the connection was closed, completes bodies delimited by the close
+    void finish();
+
+    // keep up to maxSize bytes of the body (0 discards it)
+    void setBodyLimit(int maxSize);
+
+    State state() const;
+    bool isComplete() const;
+    bool isValid() const;
+    bool headerComplete() const;
+    bool started() const;
+
+    int statusCode() const;
+    bool keepAlive() const;
+    qint64 headerSize() const;
+    qint64 bodySize() const;
+    QByteArray body() const;
+
+private:
+    bool parseLine(const QByteArray &line);
+    void headersDone();
+
+    State m_state;
+    bool m_headRequest;
+    int m_statusCode;
+    bool m_keepAlive;
+    bool m_chunked;
+    qint64 m_contentLength;
+    qint64 m_remaining;
+    qint64 m_headerSize;
+    qint64 m_bodySize;
+    qint64 m_consumed;
+    int m_bodyLimit;
+    QByteArray m_line;
+    QByteArray m_body;
+
+    static const int maxLineLength = 8192;
+};
+
+#endif // HTTPRESPONSEPARSER_H
@@ -0,0 +1,234 @@
+#include "httpupload.h"
+#include "uploadengine.h"
+#include "../../log/logger.h"
+#include "../../client.h"
+#include "../../network/resolver.h"
+#include "types.h"
+
+#include <QtMath>
+#include <numeric>
+
+LOGGER(HTTPUpload);
+
+HTTPUpload::HTTPUpload(QObject *parent)
+: Measurement(parent)
+, currentStatus(HTTPUpload::Unknown)
+, engine(NULL)
+{
+    connect(this, SIGNAL(error(const QString &)), this,
+            SLOT(setErrorString(const QString &)));
+}
+
+HTTPUpload::~HTTPUpload()
+{
+    //waits for the engine thread
+    delete engine;
+}
+
+Measurement::Status HTTPUpload::status() const
+{
+    return currentStatus;
+}
+
+bool HTTPUpload::prepare(NetworkManager *networkManager,
+                         const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager)
+
+    definition = measurementDefinition.dynamicCast<HTTPUploadDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("received NULL definition");
+        return false;
+    }
+
+    if (definition->method != "POST" && definition->method != "PUT")
+    {
+        setErrorString("requested method wrong");
+        return false;
+    }
+
+    if (definition->threads > maxThreads || definition->threads < minThreads)
+    {
+        setErrorString("requested number of threads wrong");
+        return false;
+    }
+
+    if (definition->rampUpTime > maxRampUpTime || definition->rampUpTime < minRampUpTime)
+    {
+        setErrorString("requested ramp-up time wrong");
+        return false;
+    }
+
+    if (definition->targetTime > maxTargetTime || definition->targetTime < minTargetTime)
+    {
+        setErrorString("requested target time wrong");
+        return false;
+    }
+
+    if (definition->slotLength > definition->targetTime || definition->slotLength < minSlotLength)
+    {
+        setErrorString("requested slot length wrong");
+        return false;
+    }
+
+    requestUrl = QUrl::fromUserInput(definition->url);
+
+    if (!requestUrl.isValid())
+    {
+        setErrorString("invalid URL");
+        return false;
+    }
+
+    return true;
+}
+
+bool HTTPUpload::start()
+{
+    Client::instance()->resolver()->lookupHost(requestUrl.host(), this, SLOT(startEngine(QHostInfo)));
+
+    return true;
+}
+
+void HTTPUpload::startEngine(const QHostInfo &server)
+{
+    if (server.error() != QHostInfo::NoError)
+    {
+        emit error("Name resolution failed");
+        return;
+    }
+
+    // save (first) destination IP for the results
+    destinationIP = server.addresses().first();
+
+    engine = new UploadEngine(requestUrl, destinationIP, definition->method, definition->threads,
+                              definition->targetTime, definition->rampUpTime, definition->slotLength,
+                              definition->sourcePort);
+
+    connect(engine, &QThread::finished, this, &HTTPUpload::engineFinished);
+
+    setStatus(HTTPUpload::Running);
+
+    LOG_DEBUG(QString("Starting engine with %1 streams").arg(definition->threads));
+
+    engine->start();
+}
+
+void HTTPUpload::engineFinished()
+{
+    LOG_DEBUG("Upload finished (engine)");
+
+    setStatus(HTTPUpload::Finished);
+
+    for (int i = 0; i < engine->streamCount(); i++)
+    {
+        if (engine->streamStatus(i) == UploadEngine::FinishedSuccess)
+        {
+            calculateResults();
+            emit finished();
+            return;
+        }
+    }
+
+    emit error(engine->errorString().isEmpty() ? QString("Unable to calculate accurate results on the measurement.")
+                                               : engine->errorString());
+}
+
+//same rule as HTTPDownload: _all_ successfully finished streams must have
+//sent for 75% of the target time
+bool HTTPUpload::resultsTrustable()
+{
+    int unfinishedThreads = 0;
+
+    for (int i = 0; i < engine->streamCount(); i++)
+    {
+        if (engine->streamStatus(i) != UploadEngine::FinishedSuccess)
+        {
+            unfinishedThreads++;
+            continue;
+        }
+
+        if (engine->measuredTimeInNs(i) < (((double)definition->targetTime * 1000000) * 0.75))
+        {
+            return false;
+        }
+    }
+
+    return unfinishedThreads != definition->threads;
+}
+
+bool HTTPUpload::calculateResults()
+{
+    QVariantList threadResults;
+    int num_threads = 0;
+    qreal overallBandwidth = 0.0;
+    bool resultsOK = resultsTrustable();
+
+    for (int i = 0; i < engine->streamCount(); i++)
+    {
+        //only consider streams that finished successfully
+        if (engine->streamStatus(i) != UploadEngine::FinishedSuccess)
+        {
+            continue;
+        }
+
+        num_threads++;
+
+        QVariantMap thread;
+        qreal avg = engine->averageThroughput(i);
+        thread.insert("avg", avg);
+        overallBandwidth += avg;
+
+        QList<qreal> measurementSlots = engine->measurementSlots(i);
+
+        if (measurementSlots.size() > 0)
+        {
+            thread.insert("max", *std::max_element(measurementSlots.begin(), measurementSlots.end()));
+            thread.insert("min", *std::min_element(measurementSlots.begin(), measurementSlots.end()));
+
+            // calculate standard deviation
+            qreal sq_sum = std::inner_product(measurementSlots.begin(), measurementSlots.end(),
+                                              measurementSlots.begin(), 0.0);
+            thread.insert("stdev", qSqrt(qMax(0.0, sq_sum / measurementSlots.size() - avg * avg)));
+        }
+
+        thread.insert("slots", listToVariant(measurementSlots));
+        thread.insert("tcp_info", engine->tcpInfo(i));
+
+        threadResults.append(thread);
+    }
+
+    results.insert("actual_num_threads", num_threads);
+    results.insert("results_ok", resultsOK);
+    results.insert("bandwidth_bps_avg", overallBandwidth);
+    results.insert("bandwidth_bps_per_thread", threadResults);
+    results.insert("destination_ip", destinationIP.toString());
+
+    return true;
+}
+
+bool HTTPUpload::stop()
+{
+    if (engine)
+    {
+        engine->stop();
+        engine->wait();
+    }
+
+    return true;
+}
+
+Result HTTPUpload::result() const
+{
+    return Result(results);
+}
+
+void HTTPUpload::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
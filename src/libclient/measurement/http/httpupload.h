@@ -0,0 +1,68 @@
+#ifndef HTTPUPLOAD_H
+#define HTTPUPLOAD_H
+
+#include "../measurement.h"
+#include "httpupload_definition.h"
+
+#include <QHostInfo>
+#include <QHostAddress>
+#include <QUrl>
+
+class UploadEngine;
+
+/*
+ * Upstream counterpart of HTTPDownload: several parallel streams POST (or
+ * PUT) incompressible data to the server, results use the same schema and
+ * trustability rules as HTTPDownload.
+ */
+class HTTPUpload : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit HTTPUpload(QObject *parent = 0);
+    ~HTTPUpload();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+private:
+    //results
+    QVariantMap results;
+
+    void setStatus(Status status);
+    bool resultsTrustable();
+    bool calculateResults();
+
+    HTTPUploadDefinitionPtr definition;
+
+    Status currentStatus;
+    QUrl requestUrl;
+
+    //drives all streams from one thread
+    UploadEngine *engine;
+
+    QHostAddress destinationIP;
+
+    //same limits as HTTPDownload
+    static const int maxRampUpTime = 10000;
+    static const int minRampUpTime = 1000;
+    static const int maxThreads = 64;
+    static const int minThreads = 1;
+    static const int maxTargetTime = 45000;
+    static const int minTargetTime = 2000;
+    static const int minSlotLength = 250;
+
+private slots:
+    void startEngine(const QHostInfo &server);
+    void engineFinished();
+
+signals:
+    void statusChanged(Status status);
+};
+
+#endif // HTTPUPLOAD_H
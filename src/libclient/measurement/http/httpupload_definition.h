@@ -0,0 +1,35 @@
+#ifndef HTTPUPLOAD_DEFINITION_H
+#define HTTPUPLOAD_DEFINITION_H
+
+#include "../measurementdefinition.h"
+
+class HTTPUploadDefinition;
+
+typedef QSharedPointer<HTTPUploadDefinition> HTTPUploadDefinitionPtr;
+typedef QList<HTTPUploadDefinitionPtr> HTTPUploadDefinitionList;
+
+class HTTPUploadDefinition : public MeasurementDefinition
+{
+public:
+    HTTPUploadDefinition(const QString &url, const QString &method, const int threads,
+                         const int targetTime, const int rampUpTime, const int slotLength,
+                         const quint16 sourcePort);
+    ~HTTPUploadDefinition();
+
+    // Storage
+    static HTTPUploadDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getters
+    QString url;
+    QString method; // POST or PUT
+    int threads;
+    int targetTime;
+    int rampUpTime;
+    int slotLength;
+    int sourcePort;
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // HTTPUPLOAD_DEFINITION_H
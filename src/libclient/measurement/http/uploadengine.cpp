@@ -0,0 +1,537 @@
+#include "uploadengine.h"
+#include "../../log/logger.h"
+#include "../../networkhelper.h"
+
+#include <QRegularExpression>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/sockios.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+LOGGER(UploadEngine);
+
+UploadEngine::UploadEngine(const QUrl &url, const QHostAddress &server, const QString &method, int streams,
+                           int targetTimeMs, int rampUpTimeMs, int slotLengthMs, quint16 sourcePort,
+                           QObject *parent)
+: QThread(parent)
+, m_url(url)
+, m_server(server)
+, m_method(method)
+, m_targetTime(targetTimeMs)
+, m_rampUpTime(rampUpTimeMs)
+, m_slotLength(slotLengthMs)
+, m_sourcePort(sourcePort)
+, m_epollFd(-1)
+, m_windowBegin(-1)
+, m_windowEnd(-1)
+, m_stop(0)
+{
+    Stream stream;
+    stream.fd = -1;
+    stream.status = Inactive;
+    stream.offset = 0;
+    stream.bytesWritten = 0;
+    stream.bytesDelivered = 0;
+    stream.requestTime = 0;
+    stream.lastSendTime = 0;
+    stream.windowBytes = 0;
+    stream.windowFirstSend = -1;
+    stream.windowLastSend = -1;
+    //the upload never lasts longer than the ramp-up and the target time
+    stream.slotBytes.fill(0, (m_rampUpTime + m_targetTime) / m_slotLength + 2);
+    stream.tcpInfo.reserve(stream.slotBytes.size());
+
+    m_streams.fill(stream, streams);
+
+    QByteArray header = QByteArray::number(chunkSize, 16) + "\r\n";
+
+    m_body.reserve(header.size() + chunkSize + 2);
+    m_body.append(header);
+    m_body.append(NetworkHelper::incompressiblePayload(chunkSize));
+    m_body.append("\r\n");
+}
+
+UploadEngine::~UploadEngine()
+{
+    stop();
+    wait();
+}
+
+void UploadEngine::stop()
+{
+    m_stop.storeRelease(1);
+}
+
+int UploadEngine::streamCount() const
+{
+    return m_streams.size();
+}
+
+UploadEngine::StreamStatus UploadEngine::streamStatus(int stream) const
+{
+    return m_streams[stream].status;
+}
+
+qint64 UploadEngine::measuredTimeInNs(int stream) const
+{
+    const Stream &s = m_streams[stream];
+
+    if (m_windowBegin < 0 || s.lastSendTime < m_windowBegin)
+    {
+        return 0;
+    }
+
+    return qMin(s.lastSendTime, m_windowEnd) - m_windowBegin;
+}
+
+qreal UploadEngine::averageThroughput(int stream) const
+{
+    const Stream &s = m_streams[stream];
+
+    if (s.windowFirstSend < 0 || s.windowLastSend <= s.windowFirstSend)
+    {
+        return 0.0;
+    }
+
+    return (8.0 * (qreal)s.windowBytes)/(((qreal)(s.windowLastSend - s.windowFirstSend))/1000000000.0);
+}
+
+QList<qreal> UploadEngine::measurementSlots(int stream) const
+{
+    const Stream &s = m_streams[stream];
+    QList<qreal> slotList;
+
+    //slots start with the request, the slot of the last send is still incomplete
+    int completeSlots = qMin((int)((s.lastSendTime - s.requestTime) / ((qint64)m_slotLength * 1000000)),
+                             s.slotBytes.size());
+
+    for (int i = 0; i < completeSlots; i++)
+    {
+        slotList << ((qreal)s.slotBytes[i] * 8) / (m_slotLength / 1000.0);
+    }
+
+    return slotList;
+}
+
+QString UploadEngine::errorString() const
+{
+    return m_errorString;
+}
+
+QVariantMap UploadEngine::tcpInfo(int stream) const
+{
+    return m_streams[stream].tcpInfo.toVariant();
+}
+
+void UploadEngine::run()
+{
+    m_clock.start();
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_epollFd < 0)
+    {
+        m_errorString = QString("could not create epoll instance: %1").arg(strerror(errno));
+        return;
+    }
+
+    if (!openStreams() || awaitConnections() == 0)
+    {
+        m_errorString = "Unable to establish a TCP connection";
+    }
+    else if (sendRequests() == 0)
+    {
+        m_errorString = "No thread able to upload after TCP connection was established.";
+    }
+    else
+    {
+        transmit();
+    }
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        //streams still sending when the window ended are the successful ones
+        closeStream(i, m_streams[i].status == UploadInProgress ? FinishedSuccess : m_streams[i].status);
+    }
+
+    close(m_epollFd);
+    m_epollFd = -1;
+}
+
+bool UploadEngine::openStreams()
+{
+    struct sockaddr_storage remote;
+    socklen_t remoteLength;
+    int family;
+    int opened = 0;
+    quint16 nextPort = m_sourcePort;
+
+    memset(&remote, 0, sizeof(remote));
+
+    if (m_server.protocol() == QAbstractSocket::IPv6Protocol)
+    {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&remote;
+        Q_IPV6ADDR address = m_server.toIPv6Address();
+
+        family = AF_INET6;
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(m_url.port(defaultPort));
+        memcpy(&sin6->sin6_addr, &address, sizeof(sin6->sin6_addr));
+        remoteLength = sizeof(struct sockaddr_in6);
+    }
+    else
+    {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&remote;
+
+        family = AF_INET;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(m_url.port(defaultPort));
+        sin->sin_addr.s_addr = htonl(m_server.toIPv4Address());
+        remoteLength = sizeof(struct sockaddr_in);
+    }
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        Stream &stream = m_streams[i];
+
+        stream.fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (stream.fd < 0)
+        {
+            LOG_ERROR(QString("Could not create socket: %1").arg(strerror(errno)));
+            stream.status = FinishedError;
+            continue;
+        }
+
+        if (m_sourcePort > 0)
+        {
+            struct sockaddr_storage local;
+            bool bound = false;
+
+            memset(&local, 0, sizeof(local));
+            local.ss_family = family;
+
+            //every stream needs its own port
+            for (int tries = 0; tries < 16 && !bound; tries++, nextPort++)
+            {
+                if (family == AF_INET6)
+                {
+                    ((struct sockaddr_in6 *)&local)->sin6_port = htons(nextPort);
+                }
+                else
+                {
+                    ((struct sockaddr_in *)&local)->sin_port = htons(nextPort);
+                }
+
+                bound = bind(stream.fd, (struct sockaddr *)&local, remoteLength) == 0;
+            }
+
+            if (!bound)
+            {
+                LOG_ERROR("Could not bind port");
+                closeStream(i, FinishedError);
+                continue;
+            }
+        }
+
+        if (::connect(stream.fd, (struct sockaddr *)&remote, remoteLength) < 0 && errno != EINPROGRESS)
+        {
+            LOG_ERROR(QString("Could not connect: %1").arg(strerror(errno)));
+            closeStream(i, FinishedError);
+            continue;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLOUT;
+        event.data.u32 = i;
+
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, stream.fd, &event) < 0)
+        {
+            closeStream(i, FinishedError);
+            continue;
+        }
+
+        stream.status = ConnectingTCP;
+        opened++;
+    }
+
+    return opened > 0;
+}
+
+int UploadEngine::awaitConnections()
+{
+    QVector<struct epoll_event> events(m_streams.size());
+    qint64 deadline = m_clock.elapsed() + tcpConnectTimeout;
+    int connecting = 0;
+    int connected = 0;
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        connecting += m_streams[i].status == ConnectingTCP;
+    }
+
+    while (connecting > 0 && m_clock.elapsed() < deadline && !m_stop.loadAcquire())
+    {
+        int timeout = qMin<qint64>(deadline - m_clock.elapsed(), pollInterval);
+        int ready = epoll_wait(m_epollFd, events.data(), events.size(), qMax(timeout, 0));
+
+        for (int n = 0; n < ready; n++)
+        {
+            int i = events[n].data.u32;
+            int error = 0;
+            socklen_t length = sizeof(error);
+
+            if (m_streams[i].status != ConnectingTCP)
+            {
+                continue;
+            }
+
+            connecting--;
+
+            if (getsockopt(m_streams[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+            {
+                closeStream(i, FinishedError);
+                continue;
+            }
+
+            //keep waiting for writability, responses are read as well
+            struct epoll_event event;
+            event.events = EPOLLOUT | EPOLLIN;
+            event.data.u32 = i;
+            epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_streams[i].fd, &event);
+
+            m_streams[i].status = ConnectedTCP;
+            connected++;
+        }
+    }
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        if (m_streams[i].status == ConnectingTCP)
+        {
+            closeStream(i, FinishedError);
+        }
+    }
+
+    LOG_DEBUG(QString("%1 of %2 streams connected").arg(connected).arg(m_streams.size()));
+
+    return connected;
+}
+
+int UploadEngine::sendRequests()
+{
+    int sent = 0;
+    QByteArray request = QString("%1 %2 HTTP/1.1\r\n"
+                                 "Host: %3\r\n"
+                                 "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.9; rv:31.0) Gecko/20100101 Firefox/31.0\r\n"
+                                 "Content-Type: application/octet-stream\r\n"
+                                 "Transfer-Encoding: chunked\r\n\r\n")
+                         .arg(m_method).arg(m_url.path().isEmpty() ? "/" : m_url.path()).arg(m_url.host())
+                         .toLatin1();
+
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        Stream &stream = m_streams[i];
+
+        if (stream.status != ConnectedTCP)
+        {
+            continue;
+        }
+
+        stream.requestTime = m_clock.nsecsElapsed();
+
+        //the header always fits into the empty send buffer and is not counted
+        if (send(stream.fd, request.constData(), request.size(), MSG_NOSIGNAL) != request.size())
+        {
+            closeStream(i, FinishedError);
+            continue;
+        }
+
+        stream.status = UploadInProgress;
+        sent++;
+    }
+
+    LOG_DEBUG("Engine: upload requests sent");
+
+    return sent;
+}
+
+void UploadEngine::transmit()
+{
+    QVector<struct epoll_event> events(m_streams.size());
+
+    //all streams started together, give TCP the ramp-up time
+    m_windowBegin = m_clock.nsecsElapsed() + (qint64)m_rampUpTime * 1000000;
+    m_windowEnd = m_windowBegin + (qint64)m_targetTime * 1000000;
+
+    qint64 nextTick = m_clock.nsecsElapsed() + (qint64)m_slotLength * 1000000;
+
+    while (!m_stop.loadAcquire())
+    {
+        qint64 now = m_clock.nsecsElapsed();
+        int uploading = 0;
+
+        if (now >= nextTick)
+        {
+            sampleTcpInfo(now);
+            nextTick += (qint64)m_slotLength * 1000000;
+        }
+
+        for (int i = 0; i < m_streams.size(); i++)
+        {
+            uploading += m_streams[i].status == UploadInProgress;
+        }
+
+        if (now >= m_windowEnd || uploading == 0)
+        {
+            return;
+        }
+
+        int timeout = qMin<qint64>(pollInterval, qMax<qint64>(qMin(m_windowEnd, nextTick) - now, 0) / 1000000 + 1);
+        int ready = epoll_wait(m_epollFd, events.data(), events.size(), timeout);
+
+        now = m_clock.nsecsElapsed();
+
+        for (int n = 0; n < ready; n++)
+        {
+            int i = events[n].data.u32;
+
+            if (events[n].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                readResponse(i);
+            }
+
+            if (events[n].events & EPOLLOUT)
+            {
+                writeStream(i, now);
+            }
+        }
+    }
+}
+
+void UploadEngine::sampleTcpInfo(qint64 now)
+{
+    for (int i = 0; i < m_streams.size(); i++)
+    {
+        Stream &stream = m_streams[i];
+
+        if (stream.status == UploadInProgress)
+        {
+            stream.tcpInfo.sample(stream.fd, (now - stream.requestTime) / 1000000);
+        }
+    }
+}
+
+void UploadEngine::writeStream(int i, qint64 now)
+{
+    Stream &stream = m_streams[i];
+    ssize_t writeResult;
+
+    if (stream.fd < 0 || stream.status != UploadInProgress)
+    {
+        return;
+    }
+
+    //write until the socket pushes back, epoll tells us when there is room again
+    while ((writeResult = send(stream.fd, m_body.constData() + stream.offset, m_body.size() - stream.offset,
+                               MSG_NOSIGNAL)) > 0)
+    {
+        stream.bytesWritten += writeResult;
+        stream.offset = (stream.offset + writeResult) % m_body.size();
+    }
+
+    if (writeResult < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        //a premature disconnect ends the stream like in DownloadEngine
+        closeStream(i, stream.bytesDelivered > 0 ? FinishedSuccess : FinishedError);
+        return;
+    }
+
+    //bytes still in the send queue have not reached the peer yet
+    int queued = 0;
+
+    if (ioctl(stream.fd, SIOCOUTQ, &queued) < 0)
+    {
+        queued = 0;
+    }
+
+    qint64 bytes = stream.bytesWritten - queued - stream.bytesDelivered;
+
+    if (bytes <= 0)
+    {
+        return;
+    }
+
+    stream.bytesDelivered += bytes;
+    stream.lastSendTime = now;
+
+    int slot = (now - stream.requestTime) / ((qint64)m_slotLength * 1000000);
+
+    if (slot < stream.slotBytes.size())
+    {
+        stream.slotBytes[slot] += bytes;
+    }
+
+    if (now >= m_windowBegin && now <= m_windowEnd)
+    {
+        if (stream.windowFirstSend < 0)
+        {
+            stream.windowFirstSend = now;
+        }
+
+        stream.windowLastSend = now;
+        stream.windowBytes += bytes;
+    }
+}
+
+void UploadEngine::readResponse(int i)
+{
+    Stream &stream = m_streams[i];
+    char buffer[512];
+    ssize_t readResult;
+
+    if (stream.fd < 0)
+    {
+        return;
+    }
+
+    readResult = recv(stream.fd, buffer, sizeof(buffer), 0);
+
+    if (readResult > 0)
+    {
+        //servers answer early only if they reject the upload
+        QRegularExpression re("HTTP/\\d\\.\\d\\s+(\\d+)\\s+.*");
+        QString HTTPResponseCode = re.match(QByteArray(buffer, qMin<int>(readResult, 64))).captured(1);
+
+        if (HTTPResponseCode.toInt() >= 300)
+        {
+            LOG_ERROR(QString("Engine: unexpected HTTP response code %1").arg(HTTPResponseCode));
+            closeStream(i, FinishedError);
+        }
+    }
+    else if (readResult == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        closeStream(i, stream.status == UploadInProgress && stream.bytesDelivered > 0 ?
+                    FinishedSuccess : FinishedError);
+    }
+}
+
+void UploadEngine::closeStream(int i, StreamStatus status)
+{
+    Stream &stream = m_streams[i];
+
+    if (stream.fd >= 0)
+    {
+        //closing removes the socket from the epoll set
+        close(stream.fd);
+        stream.fd = -1;
+    }
+
+    stream.status = status;
+}
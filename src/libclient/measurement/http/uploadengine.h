@@ -0,0 +1,107 @@
+#ifndef UPLOADENGINE_H
+#define UPLOADENGINE_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QUrl>
+#include <QVector>
+
+#include "../../network/tcpinfoseries.h"
+
+/*
+ * Counterpart of DownloadEngine: drives all streams of an HTTPUpload from
+ * one thread with epoll. After the start barrier every stream sends one
+ * endless chunked request body built from a pre-generated random buffer,
+ * written only as fast as the socket accepts it. The bytes the peer has
+ * acknowledged (written minus still queued) are binned into slots.
+ */
+class UploadEngine : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum StreamStatus
+    {
+        Inactive,
+        ConnectingTCP,
+        ConnectedTCP,
+        UploadInProgress,
+        FinishedSuccess,
+        FinishedError
+    };
+
+    UploadEngine(const QUrl &url, const QHostAddress &server, const QString &method, int streams,
+                 int targetTimeMs, int rampUpTimeMs, int slotLengthMs, quint16 sourcePort,
+                 QObject *parent = 0);
+    ~UploadEngine();
+
+    // thread safe, the engine finishes within pollInterval
+    void stop();
+
+    // only valid once the thread has finished
+    int streamCount() const;
+    StreamStatus streamStatus(int stream) const;
+    qint64 measuredTimeInNs(int stream) const; //time the stream sent within the window
+    qreal averageThroughput(int stream) const; //average throughput in bps within the window
+    QList<qreal> measurementSlots(int stream) const; //throughput of each complete slot in bps
+    QString errorString() const;
+    QVariantMap tcpInfo(int stream) const; //TCP_INFO sampled once per slot
+
+protected:
+    void run();
+
+private:
+    struct Stream
+    {
+        int fd;
+        StreamStatus status;
+        //position in the body buffer, the body is the buffer repeated
+        int offset;
+        qint64 bytesWritten;
+        qint64 bytesDelivered;
+        //all times are relative to the engine clock in ns
+        qint64 requestTime;
+        qint64 lastSendTime;
+        qint64 windowBytes;
+        qint64 windowFirstSend;
+        qint64 windowLastSend;
+        QVector<qint64> slotBytes;
+        TcpInfoSeries tcpInfo;
+    };
+
+    bool openStreams();
+    int awaitConnections();
+    int sendRequests();
+    void transmit();
+    void sampleTcpInfo(qint64 now);
+    void writeStream(int stream, qint64 now);
+    void readResponse(int stream);
+    void closeStream(int stream, StreamStatus status);
+
+    QUrl m_url;
+    QHostAddress m_server;
+    QString m_method;
+    int m_targetTime;
+    int m_rampUpTime;
+    int m_slotLength;
+    quint16 m_sourcePort;
+
+    QVector<Stream> m_streams;
+    //one chunk of incompressible data including its chunked framing
+    QByteArray m_body;
+    int m_epollFd;
+    QElapsedTimer m_clock;
+    qint64 m_windowBegin;
+    qint64 m_windowEnd;
+    QAtomicInt m_stop;
+    QString m_errorString;
+
+    static const int tcpConnectTimeout = 5000;
+    static const int defaultPort = 80;
+    static const int chunkSize = 262144;
+    static const int pollInterval = 100;
+};
+
+#endif // UPLOADENGINE_H
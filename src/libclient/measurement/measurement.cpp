@@ -12,6 +12,7 @@ public:
     QDateTime startDateTime;
     QString errorString;
     QVariantMap preInfo;
+    QVariantList resolutions;
 };
 
 Measurement::Measurement(QObject *parent)
@@ -67,7 +68,14 @@ void Measurement::setStartDateTime(const QDateTime &startDateTime)
 
 QVariantMap Measurement::preInfo() const
 {
-    return d->preInfo;
+    if (d->resolutions.isEmpty())
+    {
+        return d->preInfo;
+    }
+
+    QVariantMap info = d->preInfo;
+    info.insert("dns_resolutions", d->resolutions);
+    return info;
 }
 
 void Measurement::setPreInfo(const QVariantMap &preInfo)
@@ -75,6 +83,11 @@ void Measurement::setPreInfo(const QVariantMap &preInfo)
     d->preInfo = preInfo;
 }
 
+void Measurement::addResolution(const QVariantMap &resolution)
+{
+    d->resolutions.append(resolution);
+}
+
 QString Measurement::errorString() const
 {
     return d->errorString;
@@ -53,12 +53,18 @@ public:
     QVariantMap preInfo() const;
     void setPreInfo(const QVariantMap &preInfo);
 
+    // name lookups done for this measurement, reported in pre_info
+    void addResolution(const QVariantMap &resolution);
+
     QString errorString() const;
 
 signals:
     void started();
     void finished();
     void error(const QString &message);
+    // intermediate results of long running measurements, reported like
+    // the final one
+    void resultAvailable(const Result &result);
 
 protected:
     class Private;
@@ -6,9 +6,17 @@
 #include "dnslookup/dnslookup_plugin.h"
 #include "reverse_dnslookup/reverseDnslookup_plugin.h"
 #include "packettrains/packettrainsplugin.h"
+#include "pageload/pageload_plugin.h"
+#include "videostreaming/videostreaming_plugin.h"
+#include "dnsquery/dnsquery_plugin.h"
 #include "ping/ping_plugin.h"
 #include "traceroute/traceroute_plugin.h"
 #include "wifilookup/wifilookup_plugin.h"
+#if defined(Q_OS_LINUX)
+#include "http/httpupload_plugin.h"
+#include "pingsweep/pingsweep_plugin.h"
+#include "traceroutecampaign/traceroutecampaign_plugin.h"
+#endif
 #include "../log/logger.h"
 
 #include <QHash>
@@ -31,6 +39,14 @@ public:
         addPlugin(new PingPlugin);
         addPlugin(new TraceroutePlugin);
         addPlugin(new WifiLookupPlugin);
+        addPlugin(new PageLoadPlugin);
+        addPlugin(new VideoStreamingPlugin);
+        addPlugin(new DnsQueryPlugin);
+#if defined(Q_OS_LINUX)
+        addPlugin(new HTTPUploadPlugin);
+        addPlugin(new PingSweepPlugin);
+        addPlugin(new TracerouteCampaignPlugin);
+#endif
     }
 
     ~Private()
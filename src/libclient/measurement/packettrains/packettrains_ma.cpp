@@ -5,6 +5,8 @@
 #include "../../trafficbudgetmanager.h"
 #include <QUdpSocket>
 #include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QtCore/QtMath>
 
 #ifdef Q_OS_WIN
 #include <WinSock2.h>
@@ -18,20 +20,43 @@ LOGGER(PacketTrainsMA);
 
 namespace help
 {
+    // sleeping overshoots by up to the timer slack of the OS, the time
+    // closer than this to a deadline is spent spinning instead
 #ifdef Q_OS_WIN
+    const qint64 spinThreshold = 2000000;
+
     inline void nanosleep(qint64 ns)
     {
         std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
     }
 #else
+    const qint64 spinThreshold = 100000;
+
     inline void nanosleep(qint64 ns)
     {
         struct timespec delay;
-        delay.tv_sec = 0;
-        delay.tv_nsec = ns;
+        delay.tv_sec = ns / 1000000000;
+        delay.tv_nsec = ns % 1000000000;
         ::nanosleep(&delay, NULL);
     }
 #endif
+
+    // QElapsedTimer uses CLOCK_MONOTONIC where available
+    inline qint64 waitUntil(const QElapsedTimer &timer, qint64 deadline)
+    {
+        qint64 now = timer.nsecsElapsed();
+
+        if (deadline - now > spinThreshold)
+        {
+            nanosleep(deadline - now - spinThreshold);
+        }
+
+        while ((now = timer.nsecsElapsed()) < deadline)
+        {
+        }
+
+        return now;
+    }
 }
 
 PacketTrainsMA::PacketTrainsMA()
@@ -39,6 +64,9 @@ PacketTrainsMA::PacketTrainsMA()
 {
     connect(this, SIGNAL(error(const QString &)), this,
             SLOT(setErrorString(const QString &)));
+
+    m_summaryTimer.setSingleShot(true);
+    connect(&m_summaryTimer, SIGNAL(timeout()), this, SLOT(summaryTimeout()));
 }
 
 bool PacketTrainsMA::start()
@@ -48,45 +76,178 @@ bool PacketTrainsMA::start()
 
     struct msg *message = reinterpret_cast<msg *>(buffer.data());
 
-    // calculate disperson
-    quint64 *disp = new quint64[definition->iterations];
-    quint64 R_MIN = definition->rateMin;
-    quint64 R_MAX = definition->rateMax;
-    quint64 delay = definition->delay;
-
-    for (int i = 0; i < definition->iterations; i++)
-    {
-        disp[i] = (quint64)(definition->packetSize * 1000000000.0 / ((R_MAX - R_MIN) / definition->iterations * i +
-                                                                     R_MIN));  // Linear Rate
-    }
+    // resolved once, not per datagram
+    QHostAddress address(definition->host);
 
     QElapsedTimer timer;
     timer.start();
 
+    qint64 deadline = timer.nsecsElapsed();
+
     // send trains
     for (int i = 0; i < definition->trainLength * definition->iterations; i++)
     {
+        qint64 now = help::waitUntil(timer, deadline);
+
         message->iter = htons(i / definition->trainLength);
         message->id = i % definition->trainLength;
+        message->otime = now;
 
-        message->otime = timer.nsecsElapsed();
-
-        m_udpSocket->writeDatagram(buffer, QHostAddress(definition->host), definition->port);
-
-        help::nanosleep(i / definition->trainLength);
+        if (m_udpSocket->writeDatagram(buffer, address, definition->port) < 0)
+        {
+            LOG_WARNING(QString("Unable to send packet: %1").arg(m_udpSocket->errorString()));
+            m_sendTimes[i] = -1;
+        }
+        else
+        {
+            m_sendTimes[i] = now;
+        }
 
+        // the next deadline follows the schedule, not the actual send time,
+        // so a late packet does not delay the rest of the train
         if (i % definition->trainLength == definition->trainLength - 1)
         {
-            help::nanosleep(delay);
+            deadline = timer.nsecsElapsed() + definition->delay;
+        }
+        else
+        {
+            deadline += m_gaps[i];
         }
     }
 
-    delete[] disp;
+    evaluatePacing();
+
+    // the MP evaluates after a second without packets
+    connect(m_udpSocket, SIGNAL(readyRead()), this, SLOT(readSummary()));
+    m_summaryTimer.start(5000);
 
-    emit finished();
     return true;
 }
 
+void PacketTrainsMA::readSummary()
+{
+    while (m_udpSocket->hasPendingDatagrams())
+    {
+        QByteArray datagram;
+        datagram.resize(m_udpSocket->pendingDatagramSize());
+        m_udpSocket->readDatagram(datagram.data(), datagram.size());
+
+        if (datagram.isEmpty() || !m_summaryTimer.isActive())
+        {
+            continue;
+        }
+
+        QJsonParseError error;
+        QJsonDocument document = QJsonDocument::fromJson(datagram, &error);
+
+        if (error.error != QJsonParseError::NoError || !document.isObject())
+        {
+            LOG_DEBUG("Ignoring datagram which is not a summary");
+            continue;
+        }
+
+        m_summaryTimer.stop();
+        m_results.insert("summary", document.toVariant());
+
+        LOG_INFO(QString("Available bandwidth: %1 KByte/s").arg(
+                     document.toVariant().toMap().value("available_bandwidth", -1).toInt()));
+
+        // the executor deletes us while finished() is emitted
+        disconnect(m_udpSocket, SIGNAL(readyRead()), this, SLOT(readSummary()));
+        emit finished();
+        return;
+    }
+}
+
+void PacketTrainsMA::summaryTimeout()
+{
+    LOG_WARNING("No summary received from the peer");
+    disconnect(m_udpSocket, SIGNAL(readyRead()), this, SLOT(readSummary()));
+    emit finished();
+}
+
+void PacketTrainsMA::evaluatePacing()
+{
+    QVariantList trains;
+    QVariantList sendTimes;
+
+    for (int train = 0; train < definition->iterations; train++)
+    {
+        qint64 gapErrorSum = 0;
+        qint64 gapErrorMax = 0;
+        qint64 first = -1;
+        qint64 last = -1;
+        qint64 requestedSpan = 0;
+        int gaps = 0;
+        int sent = 0;
+
+        for (int i = train * definition->trainLength; i < (train + 1) * definition->trainLength; i++)
+        {
+            sendTimes << m_sendTimes[i];
+
+            if (i > train * definition->trainLength)
+            {
+                requestedSpan += m_gaps[i - 1];
+            }
+
+            if (m_sendTimes[i] < 0)
+            {
+                continue;
+            }
+
+            // only gaps between consecutive packets are comparable
+            if (i > train * definition->trainLength && m_sendTimes[i - 1] >= 0)
+            {
+                qint64 gapError = qAbs(m_sendTimes[i] - m_sendTimes[i - 1] - m_gaps[i - 1]);
+                gapErrorSum += gapError;
+                gapErrorMax = qMax(gapErrorMax, gapError);
+                gaps++;
+            }
+
+            if (first < 0)
+            {
+                first = m_sendTimes[i];
+            }
+
+            last = m_sendTimes[i];
+            sent++;
+        }
+
+        // a chirp is compared by its mean rate
+        double requestedRate = definition->packetSize * (definition->trainLength - 1) * 1000000000.0 / requestedSpan;
+
+        QVariantMap map;
+        map.insert("packets_sent", sent);
+        map.insert("requested_rate", requestedRate);
+
+        if (definition->mode == "trains")
+        {
+            map.insert("requested_gap_ns", m_gaps[train * definition->trainLength]);
+        }
+
+        if (last > first)
+        {
+            // bytes after the first packet over the span of the train
+            double achievedRate = definition->packetSize * (sent - 1) * 1000000000.0 / (last - first);
+
+            map.insert("achieved_rate", achievedRate);
+            map.insert("rate_error", achievedRate / requestedRate - 1.0);
+        }
+
+        if (gaps > 0)
+        {
+            map.insert("gap_error_avg_ns", gapErrorSum / gaps);
+            map.insert("gap_error_max_ns", gapErrorMax);
+        }
+
+        trains << map;
+    }
+
+    m_results.clear();
+    m_results.insert("trains", trains);
+    m_results.insert("send_times_ns", sendTimes);
+}
+
 void PacketTrainsMA::handleError(QAbstractSocket::SocketError socketError)
 {
     if (socketError == QAbstractSocket::RemoteHostClosedError)
@@ -114,6 +275,24 @@ bool PacketTrainsMA::prepare(NetworkManager *networkManager, const MeasurementDe
         return false;
     }
 
+    if (definition->rateMin == 0 || definition->rateMax < definition->rateMin)
+    {
+        setErrorString("invalid rate range");
+        return false;
+    }
+
+    if (definition->mode != "trains" && definition->mode != "chirp")
+    {
+        setErrorString(QString("unknown mode: %1").arg(definition->mode));
+        return false;
+    }
+
+    if (definition->trainLength < (definition->mode == "chirp" ? 3 : 2))
+    {
+        setErrorString("train length too short");
+        return false;
+    }
+
     QString hostname = QString("%1:%2").arg(definition->host).arg(definition->port);
 
     m_udpSocket = qobject_cast<QUdpSocket *>(networkManager->establishConnection(hostname, taskId(), "packettrains_mp",
@@ -131,6 +310,38 @@ bool PacketTrainsMA::prepare(NetworkManager *networkManager, const MeasurementDe
     connect(m_udpSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
             SLOT(handleError(QAbstractSocket::SocketError)));
 
+    // calculate dispersion, the gap after every packet of a train
+    quint64 R_MIN = definition->rateMin;
+    quint64 R_MAX = definition->rateMax;
+
+    // a chirp shrinks the gaps exponentially so that its rates span the
+    // whole range from R_MIN to R_MAX in a single train
+    double spreadFactor = qPow((double) R_MAX / R_MIN, 1.0 / (definition->trainLength - 2));
+
+    m_gaps.fill(0, definition->iterations * definition->trainLength);
+
+    for (int i = 0; i < definition->iterations; i++)
+    {
+        for (int k = 0; k < definition->trainLength - 1; k++)
+        {
+            double rate;
+
+            if (definition->mode == "chirp")
+            {
+                rate = R_MIN * qPow(spreadFactor, k);  // Exponential Rate
+            }
+            else
+            {
+                rate = (R_MAX - R_MIN) / definition->iterations * i + R_MIN;  // Linear Rate
+            }
+
+            m_gaps[i * definition->trainLength + k] = (qint64)(definition->packetSize * 1000000000.0 / rate);
+        }
+    }
+
+    m_sendTimes.fill(-1, definition->iterations * definition->trainLength);
+    m_results.clear();
+
     if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(definition->iterations *
                                                                     definition->packetSize * definition->trainLength))
     {
@@ -143,10 +354,11 @@ bool PacketTrainsMA::prepare(NetworkManager *networkManager, const MeasurementDe
 
 bool PacketTrainsMA::stop()
 {
+    m_summaryTimer.stop();
     return true;
 }
 
 Result PacketTrainsMA::result() const
 {
-    return Result(QVariantMap(), definition->measurementUuid);
+    return Result(m_results, definition->measurementUuid);
 }
@@ -2,10 +2,21 @@
 #define PACKETTRAINS_MA_H
 
 #include <QUdpSocket>
+#include <QVector>
+#include <QTimer>
 
 #include "../measurement.h"
 #include "packettrainsdefinition.h"
 
+/*
+ * Sends trains of back to back datagrams to a PacketTrainsMP. In the
+ * "trains" mode every train has its own constant rate, in the "chirp" mode
+ * the rate grows exponentially within each train. The gaps are paced with
+ * a sleep that ends shortly before the deadline and a spin for the rest.
+ * The actual send time of every packet is recorded and compared to the
+ * requested rate. The measurement finishes once the MP sent back its
+ * summary.
+ */
 class PacketTrainsMA : public Measurement
 {
     Q_OBJECT
@@ -18,11 +29,19 @@ public:
     Result result() const;
 
 private:
+    void evaluatePacing();
+
     PacketTrainsDefinitionPtr definition;
     QUdpSocket *m_udpSocket;
+    QVector<qint64> m_gaps; // requested gap after every packet in ns
+    QVector<qint64> m_sendTimes; // ns, -1 if sending failed
+    QVariantMap m_results;
+    QTimer m_summaryTimer;
 
 public slots:
     void handleError(QAbstractSocket::SocketError socketError);
+    void readSummary();
+    void summaryTimeout();
 };
 
 #endif // PACKETTRAINS_MA_H
@@ -7,21 +7,115 @@ using namespace std;
 #include "../../network/networkmanager.h"
 #include "../../types.h"
 
+#include <QJsonDocument>
+#include <QtCore/QtMath>
+#include <algorithm>
+#include <numeric>
+#include <string.h>
+
 #ifdef Q_OS_WIN
 #include <WinSock2.h>
 #else
 #include <arpa/inet.h>
 #endif
 
+#if defined(Q_OS_LINUX)
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 LOGGER(PacketTrainsMA);
 
+namespace
+{
+    enum Trend
+    {
+        Ambiguous,
+        NonIncreasing,
+        Increasing
+    };
+
+    const char *trendNames[] = { "ambiguous", "non_increasing", "increasing" };
+
+    /*
+     * Trend of the one-way delays of a train as in pathload: the delays are
+     * grouped into sqrt(n) medians, the pairwise comparison test (PCT) is
+     * the fraction of increasing consecutive medians and the pairwise
+     * difference test (PDT) the overall increase relative to the sum of
+     * all changes.
+     */
+    Trend owdTrend(const QVector<qint64> &owds, double *pct, double *pdt)
+    {
+        int groups = qFloor(qSqrt(owds.size()));
+        int groupSize = groups > 0 ? owds.size() / groups : 0;
+
+        *pct = 0;
+        *pdt = 0;
+
+        if (groups < 3)
+        {
+            return Ambiguous;
+        }
+
+        QVector<qint64> medians(groups);
+
+        for (int i = 0; i < groups; i++)
+        {
+            QVector<qint64> group = owds.mid(i * groupSize, groupSize);
+            std::sort(group.begin(), group.end());
+            medians[i] = group.at(group.size() / 2);
+        }
+
+        int increases = 0;
+        qint64 changes = 0;
+
+        for (int i = 1; i < groups; i++)
+        {
+            if (medians[i] > medians[i - 1])
+            {
+                increases++;
+            }
+
+            changes += qAbs(medians[i] - medians[i - 1]);
+        }
+
+        *pct = (double) increases / (groups - 1);
+        *pdt = changes > 0 ? (double)(medians.last() - medians.first()) / changes : 0;
+
+        // thresholds from the pathload paper
+        if (*pct > 0.66 || *pdt > 0.55)
+        {
+            return Increasing;
+        }
+
+        if (*pct < 0.54 && *pdt < 0.45)
+        {
+            return NonIncreasing;
+        }
+
+        return Ambiguous;
+    }
+}
+
 PacketTrainsMP::PacketTrainsMP()
 : m_udpSocket(NULL)
+, m_packetsReceived(0)
+, m_peerPort(0)
+#if defined(Q_OS_LINUX)
+, m_sock(-1)
+, m_readNotifier(NULL)
+#endif
 {
     connect(this, SIGNAL(error(const QString &)), this,
             SLOT(setErrorString(const QString &)));
 }
 
+PacketTrainsMP::~PacketTrainsMP()
+{
+    stop();
+}
+
 bool PacketTrainsMP::start()
 {
    // Timeout for "nothing happens after start"
@@ -37,19 +131,66 @@ bool PacketTrainsMP::start()
 
     m_receiveTimer.invalidate();
 
+#if defined(Q_OS_LINUX)
+    if (m_readNotifier)
+    {
+        m_readNotifier->setEnabled(true);
+        return true;
+    }
+#endif
+
     // Signal for new packets
     connect(m_udpSocket, SIGNAL(readyRead()), this, SLOT(readPendingDatagrams()));
 
     return true;
 }
 
+void PacketTrainsMP::addSample(const char *data, qint64 size, qint64 timestamp)
+{
+    struct msg message;
+
+    if (size < (qint64)sizeof(message))
+    {
+        LOG_WARNING("Datagram is too short");
+        return;
+    }
+
+    // the datagram buffers are not aligned for the struct
+    memcpy(&message, data, sizeof(message));
+
+    int index = ntohs(message.iter) * definition->trainLength + message.id;
+
+    if (message.id >= definition->trainLength || index >= m_recvTimes.size())
+    {
+        LOG_WARNING("Packet does not belong to a train");
+        return;
+    }
+
+    if (m_recvTimes[index] >= 0)
+    {
+        LOG_DEBUG("Duplicate packet");
+        return;
+    }
+
+    m_sendTimes[index] = message.otime;
+    m_recvTimes[index] = timestamp;
+    m_recvOrder[index] = m_packetsReceived++;
+}
+
 void PacketTrainsMP::readPendingDatagrams()
 {
     m_timeout.start();
 
-    qint64 timestamp;
-    struct msg *message;
-    quint16 iter;
+#if defined(Q_OS_LINUX)
+    if (m_readNotifier)
+    {
+        while (receiveBatch())
+        {
+        }
+
+        return;
+    }
+#endif
 
     if (!m_receiveTimer.isValid())
     {
@@ -59,80 +200,414 @@ void PacketTrainsMP::readPendingDatagrams()
     while (m_udpSocket->hasPendingDatagrams())
     {
         // get time first
-        timestamp = m_receiveTimer.nsecsElapsed();
+        qint64 timestamp = m_receiveTimer.nsecsElapsed();
+        qint64 size = m_udpSocket->readDatagram(m_buffer.data(), m_buffer.size(), &m_peerAddress, &m_peerPort);
+
+        if (size < 0)
+        {
+            break;
+        }
+
+        addSample(m_buffer.constData(), size, timestamp);
+
+        m_timer.start();
+    }
+}
+
+#if defined(Q_OS_LINUX)
+bool PacketTrainsMP::receiveBatch()
+{
+    int controlSize = m_control.size() / batchSize;
 
-        QByteArray buffer;
-        buffer.resize(m_udpSocket->pendingDatagramSize());
+    // the kernel overwrites the lengths of the last call
+    for (int i = 0; i < batchSize; i++)
+    {
+        m_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        m_msgs[i].msg_hdr.msg_controllen = controlSize;
+        m_msgs[i].msg_hdr.msg_flags = 0;
+    }
 
-        QHostAddress sender;
-        quint16 senderPort;
+    int count = recvmmsg(m_sock, m_msgs.data(), batchSize, MSG_DONTWAIT, NULL);
 
-        m_udpSocket->readDatagram(buffer.data(), buffer.size(), &sender, &senderPort);
-        message = reinterpret_cast<msg *>(buffer.data());
+    if (count < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG_WARNING(QString("recvmmsg: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        }
 
-        message->rtime = timestamp;
-        message->r_id = m_packetsReceived++;
+        return false;
+    }
 
-        iter = ntohs(message->iter);
+    for (int i = 0; i < count; i++)
+    {
+        struct msghdr *hdr = &m_msgs[i].msg_hdr;
+        struct cmsghdr *cm;
+        qint64 timestamp = -1;
 
-        if (iter < m_rec.size())
+        for (cm = CMSG_FIRSTHDR(hdr); cm; cm = CMSG_NXTHDR(hdr, cm))
         {
-            m_rec[iter].append(*message);
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPNS)
+            {
+                struct timespec *ts = (struct timespec *) CMSG_DATA(cm);
+                timestamp = ts->tv_sec * Q_INT64_C(1000000000) + ts->tv_nsec;
+            }
         }
-        else
+
+        if (timestamp < 0)
         {
-            LOG_WARNING("Something went wrong"); // TODO
+            // same clock as the kernel timestamps
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            timestamp = now.tv_sec * Q_INT64_C(1000000000) + now.tv_nsec;
         }
 
+        addSample(static_cast<const char *>(m_iovecs[i].iov_base), m_msgs[i].msg_len, timestamp);
+    }
+
+    if (count > 0)
+    {
         m_timer.start();
+
+        // the summary goes back to where the trains came from
+        if (m_peerPort == 0)
+        {
+            const struct sockaddr *name = (const struct sockaddr *) &m_names[0];
+            m_peerAddress.setAddress(name);
+            m_peerPort = ntohs(name->sa_family == AF_INET6 ? ((const struct sockaddr_in6 *) name)->sin6_port
+                                                           : ((const struct sockaddr_in *) name)->sin_port);
+        }
     }
+
+    // a full batch means there may be more
+    return count == batchSize;
 }
+#endif
 
 void PacketTrainsMP::eval()
 {
-    foreach (const QList<msg> &l, m_rec)
+    m_trains.clear();
+    m_estimate.clear();
+
+    if (definition->mode == "chirp")
+    {
+        evalChirps();
+    }
+    else
     {
-        quint64 ts_otime[2] = {0}, ts_rtime[2] = {2};
+        evalTrains();
+    }
+
+    sendSummary();
+
+    emit finished();
+}
+
+void PacketTrainsMP::evalTrains()
+{
+    // bounds of the available bandwidth in bytes/s, -1 if unknown
+    double lowerBound = -1;
+    double upperBound = -1;
+    QVector<qint64> owds;
+
+    owds.reserve(definition->trainLength);
+
+    for (int train = 0; train < definition->iterations; train++)
+    {
+        qint64 ts_otime[2] = {0}, ts_rtime[2] = {0};
         double srate = 0, rrate = 0;
+        int count = 0;
+        int lastOrder = -1;
 
-        for (int i = 0; i < l.size(); i++)
+        owds.clear();
+
+        for (int i = train * definition->trainLength; i < (train + 1) * definition->trainLength; i++)
         {
-            if (l[i].id != l[i].r_id)
+            if (m_recvTimes[i] < 0)
+            {
+                continue;
+            }
+
+            if (m_recvOrder[i] < lastOrder)
             {
                 LOG_DEBUG("Packages out of order");
             }
-        }
 
-        /*
-        ts_otime[0] = l.first().otime.tv_sec * 1000000000 + l.first().otime.tv_nsec;
-        ts_otime[1] = l.last().otime.tv_sec * 1000000000 + l.last().otime.tv_nsec;
-        ts_rtime[0] = l.first().rtime.tv_sec * 1000000000 + l.first().rtime.tv_nsec;
-        ts_rtime[1] = l.last().rtime.tv_sec * 1000000000 + l.last().rtime.tv_nsec;
-        */
+            // the train spans from the first to the last packet on either side
+            if (count == 0)
+            {
+                ts_otime[0] = ts_otime[1] = m_sendTimes[i];
+                ts_rtime[0] = ts_rtime[1] = m_recvTimes[i];
+            }
+            else
+            {
+                ts_otime[0] = qMin(ts_otime[0], m_sendTimes[i]);
+                ts_otime[1] = qMax(ts_otime[1], m_sendTimes[i]);
+                ts_rtime[0] = qMin(ts_rtime[0], m_recvTimes[i]);
+                ts_rtime[1] = qMax(ts_rtime[1], m_recvTimes[i]);
+            }
 
-        ts_otime[0] = l.first().otime;
-        ts_otime[1] = l.last().otime;
-        ts_rtime[0] = l.first().rtime;
-        ts_rtime[1] = l.last().rtime;
+            // the clocks are not synchronized, only changes of the delay count
+            owds.append(m_recvTimes[i] - m_sendTimes[i]);
 
-        srate = (double) definition->packetSize * l.size() / (ts_otime[1] - ts_otime[0]) * 1000000000;
-        rrate = (double) definition->packetSize * l.size() / (ts_rtime[1] - ts_rtime[0]) * 1000000000;
+            lastOrder = m_recvOrder[i];
+            count++;
+        }
 
         // ignore infinite rates
-        if (ts_otime[0] != ts_rtime[1] && ts_rtime[0] != ts_rtime[1])
+        if (ts_otime[0] == ts_otime[1] || ts_rtime[0] == ts_rtime[1])
         {
-            m_recvSpeed.append(rrate / 1024);
-            m_sendSpeed.append(srate / 1024);
-            //cout<<"sending @ "<<fixed<<setprecision(2)<<srate / 1048576 * 8<<" MBit/s"<<endl;
-            //cout<<"receiving @ "<<fixed<<setprecision(2)<<rrate / 1048576 * 8<<" MBit/s"<<endl;
+            LOG_WARNING("Ignoring train due to infinite rate");
+            continue;
         }
-        else
+
+        srate = (double) definition->packetSize * count / (ts_otime[1] - ts_otime[0]) * 1000000000;
+        rrate = (double) definition->packetSize * count / (ts_rtime[1] - ts_rtime[0]) * 1000000000;
+
+        m_recvSpeed.append(rrate / 1024);
+        m_sendSpeed.append(srate / 1024);
+
+        qint64 minOwd = *std::min_element(owds.begin(), owds.end());
+        QVariantList relativeOwds;
+
+        for (int i = 0; i < owds.size(); i++)
         {
-            LOG_WARNING("Ignoring train due to infinite rate");
+            relativeOwds << owds.at(i) - minOwd;
+        }
+
+        double pct, pdt;
+        Trend trend = owdTrend(owds, &pct, &pdt);
+
+        // below the available bandwidth the queues do not grow, above they do
+        if (trend == NonIncreasing)
+        {
+            lowerBound = qMax(lowerBound, srate);
         }
+        else if (trend == Increasing && (upperBound < 0 || srate < upperBound))
+        {
+            upperBound = srate;
+        }
+
+        QVariantMap map;
+        map.insert("sending_speed", (int)(srate / 1024));
+        map.insert("receiving_speed", (int)(rrate / 1024));
+        map.insert("packets_received", count);
+        map.insert("pct", pct);
+        map.insert("pdt", pdt);
+        map.insert("trend", trendNames[trend]);
+        map.insert("owd_ns", relativeOwds);
+        m_trains << map;
     }
 
-    emit finished();
+    // a non-increasing train above an increasing one contradicts, the
+    // turning point is then somewhere in between
+    if (lowerBound >= 0 && upperBound >= 0 && lowerBound > upperBound)
+    {
+        qSwap(lowerBound, upperBound);
+    }
+
+    if (lowerBound >= 0 && upperBound >= 0)
+    {
+        m_estimate.insert("available_bandwidth", (int)((lowerBound + upperBound) / 2 / 1024));
+        m_estimate.insert("available_bandwidth_low", (int)(lowerBound / 1024));
+        m_estimate.insert("available_bandwidth_high", (int)(upperBound / 1024));
+    }
+    else if (lowerBound >= 0)
+    {
+        // no train was fast enough to fill the path
+        m_estimate.insert("available_bandwidth", (int)(lowerBound / 1024));
+        m_estimate.insert("available_bandwidth_low", (int)(lowerBound / 1024));
+    }
+    else if (upperBound >= 0)
+    {
+        // even the slowest train was too fast
+        m_estimate.insert("available_bandwidth", (int)(upperBound / 1024));
+        m_estimate.insert("available_bandwidth_high", (int)(upperBound / 1024));
+    }
+}
+
+void PacketTrainsMP::evalChirps()
+{
+    int length = definition->trainLength;
+    QVector<qint64> queueing(length);
+    QVector<double> rates(length - 1);
+    QVector<double> estimates(length - 1);
+    QList<double> chirpEstimates;
+
+    for (int chirp = 0; chirp < definition->iterations; chirp++)
+    {
+        int base = chirp * length;
+        bool complete = true;
+
+        for (int k = 0; k < length; k++)
+        {
+            complete = complete && m_recvTimes[base + k] >= 0;
+        }
+
+        // the excursions are meaningless with holes in the chirp
+        if (!complete)
+        {
+            LOG_WARNING("Ignoring chirp with lost packets");
+            continue;
+        }
+
+        qint64 minOwd = m_recvTimes[base] - m_sendTimes[base];
+
+        for (int k = 0; k < length; k++)
+        {
+            queueing[k] = m_recvTimes[base + k] - m_sendTimes[base + k];
+            minOwd = qMin(minOwd, queueing[k]);
+        }
+
+        QVariantList relativeOwds;
+
+        for (int k = 0; k < length; k++)
+        {
+            queueing[k] -= minOwd;
+            relativeOwds << queueing[k];
+        }
+
+        // instantaneous rates from the actual gaps at the sender
+        bool valid = true;
+
+        for (int k = 0; k < length - 1; k++)
+        {
+            qint64 gap = m_sendTimes[base + k + 1] - m_sendTimes[base + k];
+            valid = valid && gap > 0;
+            rates[k] = gap > 0 ? definition->packetSize * 1000000000.0 / gap : 0;
+            estimates[k] = -1;
+        }
+
+        if (!valid)
+        {
+            LOG_WARNING("Ignoring chirp due to infinite rate");
+            continue;
+        }
+
+        // pathChirp: a packet within a long enough excursion of the queueing
+        // delay whose successor queued more was sent above the available
+        // bandwidth; it is estimated by its own rate
+        int unterminated = -1;
+        int i = 0;
+
+        while (i < length - 1)
+        {
+            if (queueing[i] >= queueing[i + 1])
+            {
+                i++;
+                continue;
+            }
+
+            qint64 maxRise = 0;
+            int j;
+
+            for (j = i + 1; j < length; j++)
+            {
+                maxRise = qMax(maxRise, queueing[j] - queueing[i]);
+
+                // the excursion ends once the delay fell back to a
+                // decrease factor of 1.5 below its maximum
+                if ((queueing[j] - queueing[i]) * 3 <= maxRise * 2)
+                {
+                    break;
+                }
+            }
+
+            if (j == length)
+            {
+                unterminated = i;
+                break;
+            }
+
+            if (j - i >= busyPeriod)
+            {
+                for (int k = i; k < j; k++)
+                {
+                    if (queueing[k] < queueing[k + 1])
+                    {
+                        estimates[k] = rates[k];
+                    }
+                }
+            }
+
+            i = j;
+        }
+
+        // an excursion that lasts until the end of the chirp started at the
+        // available bandwidth, everything else is estimated by that rate or
+        // by the highest rate of the chirp
+        double fallback = unterminated >= 0 ? rates[unterminated] : rates[length - 2];
+        double weighted = 0;
+        qint64 span = 0;
+
+        for (int k = 0; k < length - 1; k++)
+        {
+            if (estimates[k] < 0 || (unterminated >= 0 && k >= unterminated))
+            {
+                estimates[k] = fallback;
+            }
+
+            qint64 gap = m_sendTimes[base + k + 1] - m_sendTimes[base + k];
+            weighted += estimates[k] * gap;
+            span += gap;
+        }
+
+        double estimate = weighted / span;
+        chirpEstimates << estimate;
+
+        QVariantMap map;
+        map.insert("available_bandwidth", (int)(estimate / 1024));
+        map.insert("lowest_rate", (int)(rates.first() / 1024));
+        map.insert("highest_rate", (int)(rates.last() / 1024));
+        map.insert("owd_ns", relativeOwds);
+        m_trains << map;
+    }
+
+    if (chirpEstimates.isEmpty())
+    {
+        return;
+    }
+
+    double mean = std::accumulate(chirpEstimates.begin(), chirpEstimates.end(), 0.0) / chirpEstimates.size();
+    m_estimate.insert("available_bandwidth", (int)(mean / 1024));
+
+    // 95% confidence interval of the mean over the chirps
+    if (chirpEstimates.size() > 1)
+    {
+        double sq_sum = 0;
+
+        foreach (double estimate, chirpEstimates)
+        {
+            sq_sum += (estimate - mean) * (estimate - mean);
+        }
+
+        double margin = 1.96 * qSqrt(sq_sum / (chirpEstimates.size() - 1)) / qSqrt(chirpEstimates.size());
+
+        m_estimate.insert("available_bandwidth_low", (int)(qMax(0.0, mean - margin) / 1024));
+        m_estimate.insert("available_bandwidth_high", (int)((mean + margin) / 1024));
+    }
+}
+
+void PacketTrainsMP::sendSummary()
+{
+    if (m_peerPort == 0)
+    {
+        LOG_WARNING("No peer to send the summary to");
+        return;
+    }
+
+    // fits into a single datagram, the per packet delays stay here
+    QVariantMap summary = m_estimate;
+    summary.insert("packets_received", m_packetsReceived);
+    summary.insert("sending_speed", listToVariant(m_sendSpeed));
+    summary.insert("receiving_speed", listToVariant(m_recvSpeed));
+
+    QByteArray datagram = QJsonDocument::fromVariant(summary).toJson(QJsonDocument::Compact);
+
+    if (m_udpSocket->writeDatagram(datagram, m_peerAddress, m_peerPort) < 0)
+    {
+        LOG_WARNING(QString("Unable to send summary: %1").arg(m_udpSocket->errorString()));
+    }
 }
 
 void PacketTrainsMP::handleError(QAbstractSocket::SocketError socketError)
@@ -160,6 +635,7 @@ bool PacketTrainsMP::prepare(NetworkManager *networkManager, const MeasurementDe
     if (definition.isNull())
     {
         setErrorString("Definition is empty");
+        return false;
     }
 
     m_udpSocket = qobject_cast<QUdpSocket *>(peerSocket());
@@ -176,13 +652,67 @@ bool PacketTrainsMP::prepare(NetworkManager *networkManager, const MeasurementDe
     connect(m_udpSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
             SLOT(handleError(QAbstractSocket::SocketError)));
 
+    // all samples are allocated up front, nothing is allocated while receiving
+    int samples = definition->iterations * definition->trainLength;
+    int datagramSize = qMax<int>(definition->packetSize, sizeof(msg));
+
     m_packetsReceived = 0;
-    m_rec.clear();
+    m_sendTimes.fill(0, samples);
+    m_recvTimes.fill(-1, samples);
+    m_recvOrder.fill(-1, samples);
+    m_buffer.resize(datagramSize);
+    m_timestampSource = "user";
+    m_trains.clear();
+    m_estimate.clear();
+    m_peerAddress.clear();
+    m_peerPort = 0;
+
+#if defined(Q_OS_LINUX)
+    // QUdpSocket only notifies again after readDatagram(), a duplicate of
+    // the descriptor with its own notifier can be drained with recvmmsg()
+    m_sock = dup(m_udpSocket->socketDescriptor());
+
+    if (m_sock < 0)
+    {
+        LOG_WARNING(QString("dup: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return true;
+    }
+
+    int n = 1;
 
-    for (int i = 0; i < definition->iterations; i++)
+    if (setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMPNS, &n, sizeof(n)) == 0)
     {
-        m_rec.append(QList<msg>());
+        m_timestampSource = "so_timestampns";
     }
+    else
+    {
+        LOG_DEBUG(QString("setsockopt SO_TIMESTAMPNS: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+    }
+
+    int controlSize = CMSG_SPACE(sizeof(struct timespec)) * 2;
+
+    m_buffer.resize(datagramSize * batchSize);
+    m_control.fill(0, controlSize * batchSize);
+    m_iovecs.resize(batchSize);
+    m_msgs.resize(batchSize);
+    m_names.resize(batchSize);
+
+    for (int i = 0; i < batchSize; i++)
+    {
+        m_iovecs[i].iov_base = m_buffer.data() + i * datagramSize;
+        m_iovecs[i].iov_len = datagramSize;
+
+        memset(&m_msgs[i], 0, sizeof(struct mmsghdr));
+        m_msgs[i].msg_hdr.msg_name = &m_names[i];
+        m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_msgs[i].msg_hdr.msg_iovlen = 1;
+        m_msgs[i].msg_hdr.msg_control = m_control.data() + i * controlSize;
+    }
+
+    m_readNotifier = new QSocketNotifier(m_sock, QSocketNotifier::Read, this);
+    m_readNotifier->setEnabled(false);
+    connect(m_readNotifier, SIGNAL(activated(int)), this, SLOT(readPendingDatagrams()));
+#endif
 
     return true;
 }
@@ -190,14 +720,29 @@ bool PacketTrainsMP::prepare(NetworkManager *networkManager, const MeasurementDe
 bool PacketTrainsMP::stop()
 {
     m_timeout.stop();
+
+#if defined(Q_OS_LINUX)
+    delete m_readNotifier;
+    m_readNotifier = NULL;
+
+    if (m_sock >= 0)
+    {
+        close(m_sock);
+        m_sock = -1;
+    }
+#endif
+
     return true;
 }
 
 Result PacketTrainsMP::result() const
 {
-    QVariantMap map;
+    QVariantMap map = m_estimate;
     map.insert("sending_speed", listToVariant(m_sendSpeed));
     map.insert("receiving_speed", listToVariant(m_recvSpeed));
+    map.insert("packets_received", m_packetsReceived);
+    map.insert("timestamp_source", m_timestampSource);
+    map.insert("trains", m_trains);
 
     return Result(map, getMeasurementUuid());
 }
@@ -4,15 +4,34 @@
 #include <QTimer>
 #include <QUdpSocket>
 #include <QElapsedTimer>
+#include <QVector>
+
+#if defined(Q_OS_LINUX)
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#endif
 
 #include "../measurement.h"
 #include "packettrainsdefinition.h"
 
+/*
+ * Receives the trains of a PacketTrainsMA. On Linux the datagrams are
+ * drained in batches with recvmmsg() and stamped by the kernel
+ * (SO_TIMESTAMPNS), so the measured dispersion is the one on the wire and
+ * not the latency of the event loop. Samples are stored in flat arrays
+ * indexed by train * trainLength + packet which are allocated in prepare().
+ *
+ * eval() looks for the rate at which the relative one-way delay within a
+ * train starts to increase (pathload's PCT/PDT trend tests) and sends a
+ * summary with the available bandwidth estimate back to the MA. Chirps
+ * are evaluated with the excursion based estimator of pathChirp instead.
+ */
 class PacketTrainsMP : public Measurement
 {
     Q_OBJECT
 public:
     explicit PacketTrainsMP();
+    ~PacketTrainsMP();
     Status status() const;
     bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
     bool start();
@@ -20,18 +39,47 @@ public:
     Result result() const;
 
 private:
+    void addSample(const char *data, qint64 size, qint64 timestamp);
+    void evalTrains();
+    void evalChirps();
+    void sendSummary();
+
     PacketTrainsDefinitionPtr definition;
     QUdpSocket *m_udpSocket;
     QTimer m_timer;
-    QList<QList<struct msg> > m_rec;
-    quint16 m_packetsReceived;
+    int m_packetsReceived;
+    QVector<qint64> m_sendTimes; // originate timestamp of the MA
+    QVector<qint64> m_recvTimes; // ns, -1 if the packet was lost
+    QVector<int> m_recvOrder; // position in the order of arrival
     QList<int> m_sendSpeed;
     QList<int> m_recvSpeed;
+    QByteArray m_buffer;
+    QString m_timestampSource;
+    QVariantList m_trains;
+    QVariantMap m_estimate;
+    QHostAddress m_peerAddress;
+    quint16 m_peerPort;
 
     QTimer m_timeout;
 
     QElapsedTimer m_receiveTimer;
 
+    // minimum length of an excursion in packets, as in pathChirp
+    static const int busyPeriod = 5;
+
+#if defined(Q_OS_LINUX)
+    bool receiveBatch();
+
+    static const int batchSize = 64;
+
+    int m_sock; // duplicate of the socket descriptor, read past QUdpSocket
+    QSocketNotifier *m_readNotifier;
+    QVector<struct mmsghdr> m_msgs;
+    QVector<struct iovec> m_iovecs;
+    QVector<struct sockaddr_storage> m_names;
+    QByteArray m_control;
+#endif
+
 public slots:
     void readPendingDatagrams();
     void eval();
@@ -2,7 +2,8 @@
 
 
 PacketTrainsDefinition::PacketTrainsDefinition(QString host, quint16 port, quint16 packetSize, quint16 trainLength,
-                                               quint8 iterations, quint64 rateMin, quint64 rateMax, quint64 delay)
+                                               quint8 iterations, quint64 rateMin, quint64 rateMax, quint64 delay,
+                                               const QString &mode)
 : host(host)
 , port(port)
 , packetSize(packetSize)
@@ -11,6 +12,7 @@ PacketTrainsDefinition::PacketTrainsDefinition(QString host, quint16 port, quint
 , rateMin(rateMin)
 , rateMax(rateMax)
 , delay(delay)
+, mode(mode)
 {
 
 }
@@ -26,6 +28,7 @@ QVariant PacketTrainsDefinition::toVariant() const
     map.insert("rate_min", rateMin);
     map.insert("rate_max", rateMax);
     map.insert("delay", delay);
+    map.insert("mode", mode);
     return map;
 }
 
@@ -39,5 +42,6 @@ PacketTrainsDefinitionPtr PacketTrainsDefinition::fromVariant(const QVariant &va
                                                                 map.value("iterations", 1).toUInt(),
                                                                 map.value("rate_min", 10485760).toUInt(),
                                                                 map.value("rate_max", 262144000).toUInt(),
-                                                                map.value("delay", 200000000).toUInt()));
+                                                                map.value("delay", 200000000).toUInt(),
+                                                                map.value("mode", "trains").toString()));
 }
@@ -16,7 +16,7 @@ class PacketTrainsDefinition : public MeasurementDefinition
 {
 public:
     PacketTrainsDefinition(QString host, quint16 port, quint16 packetSize, quint16 trainLength, quint8 iterations,
-                           quint64 rateMin, quint64 rateMax, quint64 delay);
+                           quint64 rateMin, quint64 rateMax, quint64 delay, const QString &mode);
 
     QString host;
     quint16 port;
@@ -26,6 +26,7 @@ public:
     quint64 rateMin;
     quint64 rateMax;
     quint64 delay;
+    QString mode; // "trains" sweeps the rate over the iterations, "chirp" within every train
 
     QVariant toVariant() const;
     static PacketTrainsDefinitionPtr fromVariant(const QVariant &variant);
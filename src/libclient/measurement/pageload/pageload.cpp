@@ -0,0 +1,696 @@
+#include "pageload.h"
+#include "../../log/logger.h"
+
+#include <QTcpSocket>
+
+LOGGER(PageLoad);
+
+PageLoad::PageLoad(QObject *parent)
+: Measurement(parent)
+, currentStatus(PageLoad::Unknown)
+, scratch(scratchSize, Qt::Uninitialized)
+, pendingObjects(0)
+, manifestLoaded(false)
+, timedOut(false)
+, done(false)
+{
+    connect(this, SIGNAL(error(const QString &)), this,
+            SLOT(setErrorString(const QString &)));
+
+    timeoutTimer.setSingleShot(true);
+    connect(&timeoutTimer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+PageLoad::~PageLoad()
+{
+    abortAll();
+    qDeleteAll(connections);
+}
+
+Measurement::Status PageLoad::status() const
+{
+    return currentStatus;
+}
+
+bool PageLoad::prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager)
+
+    definition = measurementDefinition.dynamicCast<PageLoadDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("received NULL definition");
+        return false;
+    }
+
+    if (definition->connectionsPerHost > maxConnectionsPerHost ||
+        definition->connectionsPerHost < minConnectionsPerHost)
+    {
+        setErrorString("requested number of connections per host wrong");
+        return false;
+    }
+
+    if (definition->timeout > maxTimeout || definition->timeout < minTimeout)
+    {
+        setErrorString("requested timeout wrong");
+        return false;
+    }
+
+    manifestUrl = QUrl::fromUserInput(definition->manifest);
+
+    if (!manifestUrl.isValid() || manifestUrl.scheme() != "http")
+    {
+        setErrorString("invalid manifest URL");
+        return false;
+    }
+
+    return true;
+}
+
+bool PageLoad::start()
+{
+    clock.start();
+    timeoutTimer.start(definition->timeout);
+    setStatus(PageLoad::Running);
+
+    // the manifest is object 0, everything else is only known once it arrived
+    addObject(manifestUrl);
+    dispatch();
+
+    return true;
+}
+
+bool PageLoad::stop()
+{
+    timeoutTimer.stop();
+    done = true;
+    abortAll();
+
+    return true;
+}
+
+Result PageLoad::result() const
+{
+    return Result(results);
+}
+
+void PageLoad::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+void PageLoad::addObject(const QUrl &url)
+{
+    Object object;
+    object.url = url;
+    object.host = QString("%1:%2").arg(url.host()).arg(url.port(defaultPort));
+    object.connection = -1;
+    object.reused = false;
+    object.retried = false;
+    object.failed = false;
+    object.statusCode = 0;
+    object.headerBytes = 0;
+    object.bodyBytes = 0;
+    object.queuedTime = clock.nsecsElapsed();
+    object.sentTime = -1;
+    object.firstByteTime = -1;
+    object.doneTime = -1;
+
+    objects.append(object);
+    pendingObjects++;
+
+    // only plain HTTP is emulated
+    if (!url.isValid() || url.scheme() != "http" || failedHosts.contains(object.host))
+    {
+        finishObject(objects.size() - 1, true);
+        return;
+    }
+
+    queue.append(objects.size() - 1);
+}
+
+void PageLoad::dispatch()
+{
+    if (done)
+    {
+        return;
+    }
+
+    QHash<QString, int> waiting;
+    QHash<QString, QUrl> waitingUrls;
+    QList<int>::iterator it = queue.begin();
+
+    while (it != queue.end())
+    {
+        const Object &object = objects.at(*it);
+        int connection = idleConnection(object.host);
+
+        if (connection >= 0 && sendRequest(connection, *it))
+        {
+            it = queue.erase(it);
+            continue;
+        }
+
+        waiting[object.host]++;
+        waitingUrls.insert(object.host, object.url);
+        ++it;
+    }
+
+    // one new connection per waiting object as long as the pool allows it
+    QHash<QString, int>::const_iterator host = waiting.constBegin();
+
+    for (; host != waiting.constEnd(); ++host)
+    {
+        int open = 0;
+        int connecting = 0;
+
+        foreach (const Connection *connection, connections)
+        {
+            if (connection->socket && connection->host == host.key() && !connection->closing)
+            {
+                open++;
+
+                if (!connection->connected)
+                {
+                    connecting++;
+                }
+            }
+        }
+
+        int missing = qMin(host.value() - connecting, definition->connectionsPerHost - open);
+
+        for (int i = 0; i < missing; i++)
+        {
+            openConnection(waitingUrls.value(host.key()));
+        }
+    }
+}
+
+int PageLoad::idleConnection(const QString &host) const
+{
+    int best = -1;
+
+    for (int i = 0; i < connections.size(); i++)
+    {
+        const Connection *connection = connections.at(i);
+
+        if (!connection->socket || !connection->connected || connection->closing || connection->host != host)
+        {
+            continue;
+        }
+
+        if (connection->inFlight.isEmpty())
+        {
+            return i;
+        }
+
+        // pipeline only behind a completed response that kept the connection open
+        if (definition->pipelining && connection->requests > connection->inFlight.size() &&
+            connection->inFlight.size() < maxPipelineDepth &&
+            (best < 0 || connection->inFlight.size() < connections.at(best)->inFlight.size()))
+        {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+void PageLoad::openConnection(const QUrl &url)
+{
+    Connection *connection = new Connection;
+    connection->socket = new QTcpSocket(this);
+    connection->host = QString("%1:%2").arg(url.host()).arg(url.port(defaultPort));
+    connection->connected = false;
+    connection->closing = false;
+    connection->requests = 0;
+    connection->openTime = clock.nsecsElapsed();
+    connection->connectedTime = -1;
+    connection->closedTime = -1;
+
+    connections.append(connection);
+    socketConnections.insert(connection->socket, connections.size() - 1);
+
+    connect(connection->socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+    connect(connection->socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+    connect(connection->socket, SIGNAL(disconnected()), this, SLOT(socketClosed()));
+    connect(connection->socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketClosed()));
+
+    LOG_DEBUG(QString("Opening connection %1 to %2").arg(connections.size() - 1).arg(connection->host));
+
+    // the name lookup is part of the connection setup, as in a browser
+    connection->socket->connectToHost(url.host(), url.port(defaultPort));
+}
+
+bool PageLoad::sendRequest(int connection, int object)
+{
+    Connection *c = connections.at(connection);
+    Object &o = objects[object];
+
+    QString path = o.url.path(QUrl::FullyEncoded);
+
+    if (path.isEmpty())
+    {
+        path = "/";
+    }
+
+    if (o.url.hasQuery())
+    {
+        path.append('?').append(o.url.query(QUrl::FullyEncoded));
+    }
+
+    QString host = o.url.port(defaultPort) == defaultPort ? o.url.host()
+                                                         : QString("%1:%2").arg(o.url.host()).arg(o.url.port());
+
+    QByteArray request = QString("GET %1 HTTP/1.1\r\n"
+                                 "Host: %2\r\n"
+                                 "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.9; rv:31.0) Gecko/20100101 Firefox/31.0\r\n"
+                                 "Accept: */*\r\n"
+                                 "Connection: keep-alive\r\n\r\n").arg(path).arg(host).toLatin1();
+
+    if (c->socket->write(request) != request.size())
+    {
+        // the socket reports the error on its own, take nothing more
+        c->closing = true;
+        return false;
+    }
+
+    o.connection = connection;
+    o.reused = c->requests > 0;
+    o.sentTime = clock.nsecsElapsed();
+
+    c->requests++;
+    c->inFlight.append(object);
+
+    return true;
+}
+
+void PageLoad::readConnection(int connection)
+{
+    Connection *c = connections.at(connection);
+    qint64 readResult;
+
+    while ((readResult = c->socket->read(scratch.data(), scratch.size())) > 0)
+    {
+        int offset = 0;
+
+        while (offset < readResult)
+        {
+            // data nobody asked for or after the last response of the connection
+            if (c->inFlight.isEmpty() || c->closing)
+            {
+                c->closing = true;
+                return;
+            }
+
+            int object = c->inFlight.first();
+
+            if (objects.at(object).firstByteTime < 0)
+            {
+                objects[object].firstByteTime = clock.nsecsElapsed();
+            }
+
+            c->parser.setBodyLimit(object == 0 ? maxManifestSize : 0);
+            offset += c->parser.feed(scratch.constData() + offset, readResult - offset);
+
+            if (!c->parser.isValid())
+            {
+                LOG_WARNING(QString("Invalid response on connection %1").arg(connection));
+                c->closing = true;
+                return;
+            }
+
+            if (c->parser.isComplete())
+            {
+                responseDone(connection);
+            }
+        }
+    }
+}
+
+void PageLoad::responseDone(int connection)
+{
+    Connection *c = connections.at(connection);
+    int object = c->inFlight.takeFirst();
+
+    objects[object].statusCode = c->parser.statusCode();
+    objects[object].headerBytes = c->parser.headerSize();
+    objects[object].bodyBytes = c->parser.bodySize();
+
+    if (!c->parser.keepAlive())
+    {
+        c->closing = true;
+    }
+
+    QByteArray body = c->parser.body();
+    c->parser.reset();
+
+    finishObject(object, false);
+
+    if (object == 0)
+    {
+        loadObjects(body);
+    }
+}
+
+void PageLoad::closeConnection(int connection)
+{
+    Connection *c = connections.at(connection);
+
+    if (!c->socket)
+    {
+        return;
+    }
+
+    // a response may be delimited by the close
+    if (!c->inFlight.isEmpty() && c->parser.started() && c->parser.isValid())
+    {
+        c->parser.finish();
+
+        if (c->parser.isComplete())
+        {
+            responseDone(connection);
+        }
+    }
+
+    // requests without any answer are sent once more on another connection,
+    // the server may have closed an idle connection just as they were sent
+    QList<int> retry;
+    bool answered = c->parser.started();
+
+    while (!c->inFlight.isEmpty())
+    {
+        int object = c->inFlight.takeFirst();
+
+        if (!answered && !objects.at(object).retried)
+        {
+            objects[object].retried = true;
+            objects[object].connection = -1;
+            retry.append(object);
+        }
+        else
+        {
+            finishObject(object, true);
+        }
+
+        answered = false;
+    }
+
+    queue = retry + queue;
+
+    socketConnections.remove(c->socket);
+    c->socket->disconnect(this);
+    c->socket->abort();
+    c->socket->deleteLater();
+    c->socket = NULL;
+    c->closedTime = clock.nsecsElapsed();
+
+    if (c->connected)
+    {
+        return;
+    }
+
+    // give up on a host only if no connection to it could be established
+    foreach (const Connection *other, connections)
+    {
+        if (other->socket && other->host == c->host && other->connected)
+        {
+            return;
+        }
+    }
+
+    LOG_WARNING(QString("Unable to connect to %1").arg(c->host));
+    failHost(c->host);
+}
+
+void PageLoad::failHost(const QString &host)
+{
+    failedHosts.insert(host);
+
+    QList<int>::iterator it = queue.begin();
+
+    while (it != queue.end())
+    {
+        if (objects.at(*it).host == host)
+        {
+            finishObject(*it, true);
+            it = queue.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void PageLoad::loadObjects(const QByteArray &manifest)
+{
+    // checkFinished() reports a manifest that could not be loaded
+    if (objects.first().statusCode != 200)
+    {
+        return;
+    }
+
+    manifestLoaded = true;
+
+    foreach (const QByteArray &line, manifest.split('\n'))
+    {
+        QByteArray entry = line.trimmed();
+
+        if (entry.isEmpty() || entry.startsWith('#'))
+        {
+            continue;
+        }
+
+        if (objects.size() > maxObjects)
+        {
+            LOG_WARNING(QString("Manifest lists more than %1 objects, ignoring the rest").arg(maxObjects));
+            break;
+        }
+
+        addObject(manifestUrl.resolved(QUrl(QString::fromUtf8(entry))));
+    }
+
+    LOG_DEBUG(QString("Manifest lists %1 objects").arg(objects.size() - 1));
+}
+
+void PageLoad::finishObject(int object, bool failed)
+{
+    objects[object].failed = failed;
+    objects[object].doneTime = clock.nsecsElapsed();
+    pendingObjects--;
+}
+
+void PageLoad::checkFinished()
+{
+    if (done)
+    {
+        return;
+    }
+
+    if (!manifestLoaded)
+    {
+        const Object &manifest = objects.first();
+
+        if (manifest.doneTime >= 0)
+        {
+            done = true;
+            timeoutTimer.stop();
+            abortAll();
+            setStatus(PageLoad::Finished);
+
+            QString message = manifest.failed ? QString("Unable to load the manifest")
+                                              : QString("Manifest request failed with HTTP status %1")
+                                                .arg(manifest.statusCode);
+            QMetaObject::invokeMethod(this, "error", Qt::QueuedConnection, Q_ARG(QString, message));
+        }
+
+        return;
+    }
+
+    if (pendingObjects > 0)
+    {
+        return;
+    }
+
+    done = true;
+    timeoutTimer.stop();
+    abortAll();
+    calculateResults();
+    setStatus(PageLoad::Finished);
+
+    // called from socket signals, let them return first
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+void PageLoad::calculateResults()
+{
+    QVariantList objectResults;
+    QVariantList connectionResults;
+    int objectsOk = 0;
+    int reusedRequests = 0;
+    qint64 loadTime = 0;
+
+    foreach (const Object &object, objects)
+    {
+        QVariantMap map;
+        map.insert("url", object.url.toString());
+        map.insert("status_code", object.statusCode);
+        map.insert("connection", object.connection);
+        map.insert("reused", object.reused);
+        map.insert("retried", object.retried);
+        map.insert("failed", object.failed);
+        map.insert("header_bytes", object.headerBytes);
+        map.insert("body_bytes", object.bodyBytes);
+        map.insert("queued_ns", object.queuedTime);
+        map.insert("sent_ns", object.sentTime);
+        map.insert("first_byte_ns", object.firstByteTime);
+        map.insert("done_ns", object.doneTime);
+        objectResults.append(map);
+
+        if (!object.failed && object.statusCode >= 200 && object.statusCode < 400)
+        {
+            objectsOk++;
+        }
+
+        if (object.reused)
+        {
+            reusedRequests++;
+        }
+
+        loadTime = qMax(loadTime, object.doneTime);
+    }
+
+    foreach (const Connection *connection, connections)
+    {
+        QVariantMap map;
+        map.insert("host", connection->host);
+        map.insert("requests", connection->requests);
+        map.insert("opened_ns", connection->openTime);
+        map.insert("connect_ns", connection->connectedTime < 0 ? -1 : connection->connectedTime - connection->openTime);
+        map.insert("closed_ns", connection->closedTime);
+        connectionResults.append(map);
+    }
+
+    results.insert("load_time_ns", loadTime);
+    results.insert("timed_out", timedOut);
+    results.insert("pipelining", definition->pipelining);
+    results.insert("object_count", objects.size());
+    results.insert("objects_ok", objectsOk);
+    results.insert("objects_failed", objects.size() - objectsOk);
+    results.insert("connection_count", connections.size());
+    results.insert("reused_requests", reusedRequests);
+    results.insert("objects", objectResults);
+    results.insert("connections", connectionResults);
+}
+
+void PageLoad::abortAll()
+{
+    foreach (Connection *connection, connections)
+    {
+        if (connection->socket)
+        {
+            connection->socket->disconnect(this);
+            connection->socket->abort();
+            connection->socket->deleteLater();
+            connection->socket = NULL;
+            connection->closedTime = clock.nsecsElapsed();
+        }
+    }
+
+    socketConnections.clear();
+}
+
+void PageLoad::socketConnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    int connection = socketConnections.value(socket, -1);
+
+    if (connection < 0)
+    {
+        return;
+    }
+
+    connections.at(connection)->connected = true;
+    connections.at(connection)->connectedTime = clock.nsecsElapsed();
+
+    dispatch();
+}
+
+void PageLoad::socketReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    int connection = socketConnections.value(socket, -1);
+
+    if (connection < 0)
+    {
+        return;
+    }
+
+    readConnection(connection);
+
+    if (connections.at(connection)->closing)
+    {
+        closeConnection(connection);
+    }
+
+    dispatch();
+    checkFinished();
+}
+
+void PageLoad::socketClosed()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    int connection = socketConnections.value(socket, -1);
+
+    if (connection < 0)
+    {
+        return;
+    }
+
+    // whatever is still buffered arrived before the close
+    if (connections.at(connection)->connected)
+    {
+        readConnection(connection);
+    }
+
+    closeConnection(connection);
+
+    dispatch();
+    checkFinished();
+}
+
+void PageLoad::timeout()
+{
+    LOG_WARNING("Page load timed out");
+
+    timedOut = true;
+    done = true;
+    abortAll();
+
+    for (int i = 0; i < objects.size(); i++)
+    {
+        if (objects.at(i).doneTime < 0)
+        {
+            objects[i].failed = true;
+        }
+    }
+
+    pendingObjects = 0;
+    queue.clear();
+    setStatus(PageLoad::Finished);
+
+    if (!manifestLoaded)
+    {
+        emit error("Timeout while loading the manifest");
+        return;
+    }
+
+    calculateResults();
+    emit finished();
+}
@@ -0,0 +1,128 @@
+#ifndef PAGELOAD_H
+#define PAGELOAD_H
+
+#include "../measurement.h"
+#include "../http/httpresponseparser.h"
+#include "pageload_definition.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+
+class QTcpSocket;
+
+/*
+ * Emulates a browser loading a page: the manifest (the "document") is
+ * fetched first, then every object it lists is requested through a pool of
+ * persistent connections with at most connectionsPerHost connections per
+ * host, like browsers do for HTTP/1.1. All sockets are driven by the event
+ * loop, nothing blocks. Objects wait in document order until a connection
+ * of their host is idle (or, with pipelining, has room for another request).
+ */
+class CLIENT_API PageLoad : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit PageLoad(QObject *parent = 0);
+    ~PageLoad();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+private:
+    struct Object
+    {
+        QUrl url;
+        QString host; // pool key, host:port
+        int connection; // -1 while queued
+        bool reused; // sent on a connection that already carried a request
+        bool retried;
+        bool failed;
+        int statusCode;
+        qint64 headerBytes;
+        qint64 bodyBytes;
+        // ns since the start of the measurement, -1 if not reached
+        qint64 queuedTime;
+        qint64 sentTime;
+        qint64 firstByteTime;
+        qint64 doneTime;
+    };
+
+    struct Connection
+    {
+        QTcpSocket *socket; // NULL once closed
+        QString host;
+        bool connected;
+        bool closing; // takes no further requests
+        int requests;
+        QList<int> inFlight; // objects in request order
+        HttpResponseParser parser;
+        qint64 openTime;
+        qint64 connectedTime;
+        qint64 closedTime;
+    };
+
+    void setStatus(Status status);
+    void addObject(const QUrl &url);
+    void dispatch();
+    int idleConnection(const QString &host) const;
+    void openConnection(const QUrl &url);
+    bool sendRequest(int connection, int object);
+    void readConnection(int connection);
+    void responseDone(int connection);
+    void closeConnection(int connection);
+    void failHost(const QString &host);
+    void loadObjects(const QByteArray &manifest);
+    void finishObject(int object, bool failed);
+    void checkFinished();
+    void calculateResults();
+    void abortAll();
+
+    PageLoadDefinitionPtr definition;
+    Status currentStatus;
+    QUrl manifestUrl;
+
+    QElapsedTimer clock;
+    QTimer timeoutTimer;
+    QVector<Object> objects;
+    QList<Connection *> connections;
+    QHash<QTcpSocket *, int> socketConnections;
+    QList<int> queue; // objects waiting for a connection, in document order
+    QSet<QString> failedHosts;
+    QByteArray scratch;
+    int pendingObjects;
+    bool manifestLoaded;
+    bool timedOut;
+    bool done;
+
+    QVariantMap results;
+
+    static const int maxConnectionsPerHost = 16;
+    static const int minConnectionsPerHost = 1;
+    static const int maxPipelineDepth = 4;
+    static const int maxObjects = 1000;
+    static const int maxManifestSize = 1048576;
+    static const int maxTimeout = 120000;
+    static const int minTimeout = 1000;
+    static const int defaultPort = 80;
+    static const int scratchSize = 65536;
+
+private slots:
+    void socketConnected();
+    void socketReadyRead();
+    void socketClosed();
+    void timeout();
+
+signals:
+    void statusChanged(Status status);
+};
+
+#endif // PAGELOAD_H
@@ -0,0 +1,35 @@
+#include "pageload_definition.h"
+
+PageLoadDefinition::PageLoadDefinition(const QString &manifest, const int connectionsPerHost,
+                                       const bool pipelining, const int timeout)
+: manifest(manifest)
+, connectionsPerHost(connectionsPerHost)
+, pipelining(pipelining)
+, timeout(timeout)
+{
+
+}
+
+PageLoadDefinition::~PageLoadDefinition()
+{
+
+}
+
+PageLoadDefinitionPtr PageLoadDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    return PageLoadDefinitionPtr(new PageLoadDefinition(map.value("manifest", "").toString(),
+                                                        map.value("connections_per_host", 6).toInt(),
+                                                        map.value("pipelining", false).toBool(),
+                                                        map.value("timeout", 30000).toInt()));
+}
+
+QVariant PageLoadDefinition::toVariant() const
+{
+    QVariantMap map;
+    map.insert("manifest", manifest);
+    map.insert("connections_per_host", connectionsPerHost);
+    map.insert("pipelining", pipelining);
+    map.insert("timeout", timeout);
+    return map;
+}
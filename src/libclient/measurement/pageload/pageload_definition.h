@@ -0,0 +1,31 @@
+#ifndef PAGELOAD_DEFINITION_H
+#define PAGELOAD_DEFINITION_H
+
+#include "../measurementdefinition.h"
+
+class PageLoadDefinition;
+
+typedef QSharedPointer<PageLoadDefinition> PageLoadDefinitionPtr;
+typedef QList<PageLoadDefinitionPtr> PageLoadDefinitionList;
+
+class CLIENT_API PageLoadDefinition : public MeasurementDefinition
+{
+public:
+    PageLoadDefinition(const QString &manifest, const int connectionsPerHost, const bool pipelining,
+                       const int timeout);
+    ~PageLoadDefinition();
+
+    // Storage
+    static PageLoadDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getters
+    QString manifest; // URL of a document listing one object URL per line
+    int connectionsPerHost;
+    bool pipelining;
+    int timeout;
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // PAGELOAD_DEFINITION_H
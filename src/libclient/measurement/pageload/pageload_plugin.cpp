@@ -0,0 +1,21 @@
+#include "pageload_plugin.h"
+#include "pageload.h"
+#include "pageload_definition.h"
+
+QStringList PageLoadPlugin::measurements() const
+{
+    return QStringList()
+           << "pageload";
+}
+
+MeasurementPtr PageLoadPlugin::createMeasurement(const QString &name)
+{
+    Q_UNUSED(name);
+    return MeasurementPtr(new PageLoad);
+}
+
+MeasurementDefinitionPtr PageLoadPlugin::createMeasurementDefinition(const QString &name, const QVariant &data)
+{
+    Q_UNUSED(name);
+    return PageLoadDefinition::fromVariant(data);
+}
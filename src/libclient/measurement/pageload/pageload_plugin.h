@@ -0,0 +1,16 @@
+#ifndef PAGELOAD_PLUGIN_H
+#define PAGELOAD_PLUGIN_H
+
+#include "../measurementplugin.h"
+
+class PageLoadPlugin : public MeasurementPlugin
+{
+public:
+    // MeasurementPlugin interface
+    QStringList measurements() const;
+
+    MeasurementPtr createMeasurement(const QString &name);
+    MeasurementDefinitionPtr createMeasurementDefinition(const QString &name, const QVariant &data);
+};
+
+#endif // PAGELOAD_PLUGIN_H
@@ -6,6 +6,7 @@
 #include <QVector>
 #include <QProcess>
 #include <QList>
+#include <QHostInfo>
 
 #if defined(Q_OS_WIN)
 #include <QtConcurrent/QtConcurrentRun>
@@ -16,7 +17,14 @@
 #undef min
 #include<pcap.h>
 #include <cstring>
-#elif defined(Q_OS_LINUX) || defined(Q_OS_MAC)
+#elif defined(Q_OS_LINUX)
+#include <netinet/in.h>
+#include <QMap>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#elif defined(Q_OS_MAC)
 #include <netinet/in.h>
 #else
 #error Platform not supported.
@@ -66,8 +74,12 @@ typedef void pcap_t;
 struct PingProbe
 {
     int sock;
+    quint16 sequence;
+    quint32 replies;
     quint64 sendTime;
     quint64 recvTime;
+    quint64 sendTimeNs;
+    quint64 recvTimeNs;
     sockaddr_any source;
 #if defined(Q_OS_WIN)
     ping::PacketType type;
@@ -94,8 +106,12 @@ struct PingProbe
 
     PingProbe()
     : sock(0)
+    , sequence(0)
+    , replies(0)
     , sendTime(0)
     , recvTime(0)
+    , sendTimeNs(0)
+    , recvTimeNs(0)
     , source()
 #if defined(Q_OS_WIN)
     , type()
@@ -134,9 +150,27 @@ private:
     int initSocket();
     bool sendUdpData(PingProbe *probe);
     bool sendTcpData(PingProbe *probe);
+#if defined(Q_OS_LINUX)
+    bool sendIcmpData(PingProbe *probe);
+    bool receiveData(int sock, int flags);
+    // quotedDestination is the destination of the datagram an ICMP error
+    // refers to, NULL for direct replies
+    int matchProbe(const char *data, int length, const sockaddr_any *quotedDestination) const;
+    void handleReply(int index);
+    void sendProbe();
+    void readReplies();
+    void tcpProbeReady(int sock);
+    void finishTcpProbe(int sock);
+    void checkTimeouts();
+    void scheduleTimeout();
+    void checkFinished();
+    void closeSockets();
+#else
     void receiveData(PingProbe *probe);
     void ping(PingProbe *probe);
+#endif
 #if defined(Q_OS_WIN)
+    bool openCapture();
     void processUdpPackets(QVector<PingProbe> *probes);
     void processTcpPackets(QVector<PingProbe> *probes);
 #endif
@@ -153,6 +187,26 @@ private:
     pcap_t *m_capture;
     sockaddr_any m_destAddress;
 
+#if defined(Q_OS_LINUX)
+    // event-driven engine: probes are sent on m_sendTimer, replies are
+    // collected via socket notifiers and matched by sequence number
+    int m_sock;
+    quint16 m_identifier;
+    int m_highestSequence;
+    quint32 m_duplicates;
+    quint32 m_reordered;
+    quint32 m_lateReplies;
+    quint32 m_txCounter;
+    QHash<quint32, quint16> m_txIds;
+    QString m_timestampSource;
+    QMap<quint16, int> m_outstanding;
+    QHash<int, QSocketNotifier *> m_tcpNotifiers;
+    QSocketNotifier *m_readNotifier;
+    QTimer m_sendTimer;
+    QTimer m_timeoutTimer;
+    QElapsedTimer m_clock;
+#endif
+
     // for system ping only
     QProcess process;
     QTextStream stream;
@@ -162,12 +216,15 @@ signals:
     void destinationUnreachable(const PingProbe &probe);
     void ttlExceeded(const PingProbe &probe);
     void udpResponse(const PingProbe &probe);
+    void echoReply(const PingProbe &probe);
     void timeout(const PingProbe &probe);
     void tcpReset(const PingProbe &probe);
     void tcpConnect(const PingProbe &probe);
     void ping(int time);
 
 private slots:
+    // start() continues here once the host is resolved
+    void hostResolved(const QHostInfo &info);
     void started();
     void finished(int exitCode, QProcess::ExitStatus exitStatus);
     void readyRead();
@@ -3,7 +3,8 @@
 PingDefinition::PingDefinition(const QString &host, const quint32 &count, const quint32 &interval,
                                      const quint32 &receiveTimeout, const int &ttl,
                                      const quint16 &destinationPort, const quint16 &sourcePort,
-                                     const quint32 &payload, const ping::PingType &type)
+                                     const quint32 &payload, const ping::PingType &type,
+                                     const bool &preciseTimestamps)
 : host(host)
 , count(count)
 , interval(interval)
@@ -13,6 +14,7 @@ PingDefinition::PingDefinition(const QString &host, const quint32 &count, const
 , sourcePort(sourcePort)
 , payload(payload)
 , type(type)
+, preciseTimestamps(preciseTimestamps)
 {
 
 }
@@ -34,7 +36,8 @@ PingDefinitionPtr PingDefinition::fromVariant(const QVariant &variant)
                                                       map.value("source_port", 33434).toUInt(),
                                                       map.value("payload", 74).toUInt(),
                                                       pingTypeFromString(map.value(
-                                                                             "type", "Udp").toString().toLatin1())));
+                                                                             "type", "Udp").toString().toLatin1()),
+                                                      map.value("precise_timestamps", false).toBool()));
 }
 
 QVariant PingDefinition::toVariant() const
@@ -49,5 +52,6 @@ QVariant PingDefinition::toVariant() const
     map.insert("source_port", sourcePort);
     map.insert("payload", payload);
     map.insert("type", pingTypeToString(type));
+    map.insert("precise_timestamps", preciseTimestamps);
     return map;
 }
@@ -16,7 +16,7 @@ public:
     ~PingDefinition();
     PingDefinition(const QString &host, const quint32 &count, const quint32 &interval, const quint32 &receiveTimeout,
                       const int &ttl, const quint16 &destinationPort, const quint16 &sourcePort, const quint32 &payload,
-                      const ping::PingType &type);
+                      const ping::PingType &type, const bool &preciseTimestamps = false);
 
     // Storage
     static PingDefinitionPtr fromVariant(const QVariant &variant);
@@ -31,6 +31,7 @@ public:
     quint16 sourcePort;
     quint32 payload;
     ping::PingType type;
+    bool preciseTimestamps;
 
     // Serializable interface
     QVariant toVariant() const;
@@ -3,62 +3,85 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
-#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <linux/errqueue.h>
 #include <linux/icmp.h>
+#include <linux/net_tstamp.h>
 #if defined(Q_OS_ANDROID)
 #include <netinet/in6.h>
 #endif
 #include <netinet/icmp6.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <time.h>
 #include <numeric>
 
 #include <QtMath>
-#include <QThread>
+#include <QEventLoop>
 
 #include "ping.h"
 #include "../../log/logger.h"
 #include "../../client.h"
 #include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
 
 LOGGER("Ping");
 
 namespace
 {
-    bool getAddress(const QString &address, sockaddr_any *addr)
+    /*
+     * Written to the start of every UDP probe payload. ICMP errors quote
+     * the offending datagram and echo servers return it, which allows
+     * matching any reply to the probe that caused it.
+     */
+    struct ProbeTag
     {
-        struct addrinfo hints;
-        struct addrinfo *rp = NULL, *result = NULL;
+        quint16 identifier;
+        quint16 sequence;
+    };
 
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = PF_UNSPEC;
+    quint64 currentTime()
+    {
+        struct timeval tv;
 
-        if (getaddrinfo(address.toLatin1(), NULL, &hints, &result))
-        {
-            return false;
-        }
+        gettimeofday(&tv, NULL);
 
-        for (rp = result; rp && rp->ai_family != AF_INET &&
-             rp->ai_family != AF_INET6;
-             rp = rp->ai_next)
-        {
-        }
+        return tv.tv_sec * Q_UINT64_C(1000000) + tv.tv_usec;
+    }
 
-        if (!rp)
-        {
-            freeaddrinfo(result);
-            return false;
-        }
+    // same clock as the kernel software timestamps (CLOCK_REALTIME)
+    quint64 currentTimeNs()
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
 
-        memcpy(addr, rp->ai_addr, rp->ai_addrlen);
+        return ts.tv_sec * Q_UINT64_C(1000000000) + ts.tv_nsec;
+    }
 
-        freeaddrinfo(result);
+    // the first usable address of a lookup
+    bool firstAddress(const QHostInfo &info, sockaddr_any *addr)
+    {
+        foreach (const QHostAddress &address, info.addresses())
+        {
+            if (address.protocol() == QAbstractSocket::IPv4Protocol)
+            {
+                addr->sin.sin_family = AF_INET;
+                addr->sin.sin_addr.s_addr = htonl(address.toIPv4Address());
+                return true;
+            }
+            else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+            {
+                Q_IPV6ADDR ip = address.toIPv6Address();
+                addr->sin6.sin6_family = AF_INET6;
+                memcpy(&addr->sin6.sin6_addr, ip.c, sizeof(ip.c));
+                return true;
+            }
+        }
 
-        return true;
+        return false;
     }
 
     QByteArray randomizePayload(const quint32 size)
@@ -81,6 +104,21 @@ namespace
 
         return payload;
     }
+
+    bool sameHost(const sockaddr_any &a, const sockaddr_any &b)
+    {
+        if (a.sa.sa_family != b.sa.sa_family)
+        {
+            return false;
+        }
+
+        if (a.sa.sa_family == AF_INET)
+        {
+            return a.sin.sin_addr.s_addr == b.sin.sin_addr.s_addr;
+        }
+
+        return !memcmp(&a.sin6.sin6_addr, &b.sin6.sin6_addr, sizeof(a.sin6.sin6_addr));
+    }
 }
 
 Ping::Ping(QObject *parent)
@@ -91,10 +129,26 @@ Ping::Ping(QObject *parent)
 , m_device(NULL)
 , m_capture(NULL)
 , m_destAddress()
+, m_sock(-1)
+, m_identifier(0)
+, m_highestSequence(-1)
+, m_duplicates(0)
+, m_reordered(0)
+, m_lateReplies(0)
+, m_txCounter(0)
+, m_readNotifier(NULL)
 , stream(&process)
 {
     connect(this, SIGNAL(error(const QString &)), this,
             SLOT(setErrorString(const QString &)));
+
+    m_sendTimer.setSingleShot(true);
+    m_sendTimer.setTimerType(Qt::PreciseTimer);
+    m_timeoutTimer.setSingleShot(true);
+    m_timeoutTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(&m_sendTimer, &QTimer::timeout, this, &Ping::sendProbe);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &Ping::checkTimeouts);
 }
 
 Ping::~Ping()
@@ -104,6 +158,8 @@ Ping::~Ping()
         process.kill();
         process.waitForFinished(500);
     }
+
+    closeSockets();
 }
 
 Measurement::Status Ping::status() const
@@ -141,6 +197,12 @@ bool Ping::prepare(NetworkManager *networkManager, const MeasurementDefinitionPt
         }
     }
 
+    if (definition->type != ping::System && definition->count > 65535)
+    {
+        setErrorString("count is too large (> 65535)");
+        return false;
+    }
+
     if (definition->receiveTimeout > 60000)
     {
         setErrorString("receive timeout is too large (> 60 s)");
@@ -162,37 +224,14 @@ bool Ping::prepare(NetworkManager *networkManager, const MeasurementDefinitionPt
         return true;
     }
 
+    // the host is resolved by start() so DNS does not block the executor
     memset(&m_destAddress, 0, sizeof(m_destAddress));
 
-    // resolve
-    if (!getAddress(definition->host, &m_destAddress))
-    {
-        setErrorString(QString("could not resolve hostname '%1'").arg(definition->host));
-        return false;
-    }
-
-    if (m_destAddress.sa.sa_family == AF_INET)
-    {
-        m_destAddress.sin.sin_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
-    }
-    else if (m_destAddress.sa.sa_family == AF_INET6)
-    {
-        m_destAddress.sin6.sin6_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
-    }
-    else
-    {
-        setErrorString(QString("unknown address family '%1'").arg(
-                           m_destAddress.sa.sa_family));
-        return false;
-    }
-
     return true;
 }
 
 bool Ping::start()
 {
-    PingProbe probe;
-
     setStatus(Ping::Running);
 
     if (definition->type == ping::System)
@@ -211,55 +250,99 @@ bool Ping::start()
         return true;
     }
 
-    probe.sock = initSocket();
+    // a Ping object may be started several times (e.g. by Traceroute)
+    closeSockets();
+    m_pingProbes.clear();
+    m_outstanding.clear();
+    pingTime.clear();
+    m_pingsSent = 0;
+    m_pingsReceived = 0;
+    m_highestSequence = -1;
+    m_duplicates = 0;
+    m_reordered = 0;
+    m_lateReplies = 0;
+    m_txCounter = 0;
+    m_txIds.clear();
+    m_identifier = qrand() & 0xffff;
+
+    // the first probe is sent from hostResolved() so start() never emits
+    // finished() itself
+    Client::instance()->resolver()->lookupHost(definition->host, this, SLOT(hostResolved(QHostInfo)));
+
+    return true;
+}
 
-    if (probe.sock < 0)
+void Ping::hostResolved(const QHostInfo &info)
+{
+    if (currentStatus != Ping::Running)
     {
-        setErrorString(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
-        return false;
+        return;
     }
 
-    for (quint32 i = 0; i < definition->count; i++)
+    memset(&m_destAddress, 0, sizeof(m_destAddress));
+
+    if (!firstAddress(info, &m_destAddress))
     {
-        ping(&probe);
-        m_pingProbes.append(probe);
-        QThread::msleep(definition->interval);
+        setStatus(Ping::Error);
+        emit error(QString("could not resolve hostname '%1'").arg(definition->host));
+        return;
     }
 
-    close(probe.sock);
+    if (definition->type == ping::Icmp)
+    {
+        // ICMP has no ports, the kernel rejects them on ping sockets
+    }
+    else if (m_destAddress.sa.sa_family == AF_INET)
+    {
+        m_destAddress.sin.sin_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
+    }
+    else
+    {
+        m_destAddress.sin6.sin6_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
+    }
 
-    foreach (const PingProbe &probe, m_pingProbes)
+    if (definition->type == ping::Udp || definition->type == ping::Icmp)
     {
-        float pt = (probe.recvTime - probe.sendTime) / 1000.;
+        // all UDP and ICMP probes share one socket, TCP probes get their own
+        // socket in sendTcpData()
+        m_sock = initSocket();
 
-        if (pt >= definition->receiveTimeout)
+        if (m_sock < 0)
         {
-            if (m_pingsReceived > 0)
-            {
-                m_pingsReceived--;
-            }
-
-            continue;
+            setStatus(Ping::Error);
+            emit error(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+            return;
         }
 
-        if (probe.sendTime > 0 && probe.recvTime > 0 && probe.sendTime != probe.recvTime)
-        {
-            pingTime.append(pt);
-        }
+        m_readNotifier = new QSocketNotifier(m_sock, QSocketNotifier::Read, this);
+        connect(m_readNotifier, &QSocketNotifier::activated, this, &Ping::readReplies);
     }
 
-    setStatus(Ping::Finished);
-    emit Measurement::finished();
-
-    return true;
+    m_clock.start();
+    m_sendTimer.start(0);
 }
 
 bool Ping::stop()
 {
+    if (definition.isNull())
+    {
+        return true;
+    }
+
     if (definition->type == ping::System)
     {
         process.kill();
     }
+    else
+    {
+        // a lookup still running must not start probing anymore
+        if (currentStatus == Ping::Running)
+        {
+            setStatus(Ping::Finished);
+        }
+
+        closeSockets();
+    }
 
     return true;
 }
@@ -312,6 +395,26 @@ Result Ping::result() const
     res.insert("round_trip_sent", m_pingsSent);  // count successfull pings only
     res.insert("round_trip_received", m_pingsReceived);
 
+    if (definition->type != ping::System)
+    {
+        res.insert("round_trip_duplicates", m_duplicates);
+        res.insert("round_trip_reordered", m_reordered);
+        res.insert("round_trip_late", m_lateReplies);
+
+        QVariantList roundTripNs;
+
+        foreach (const PingProbe &probe, m_pingProbes)
+        {
+            if (probe.replies > 0 && probe.recvTimeNs > probe.sendTimeNs)
+            {
+                roundTripNs << probe.recvTimeNs - probe.sendTimeNs;
+            }
+        }
+
+        res.insert("round_trip_ns", roundTripNs);
+        res.insert("timestamp_source", m_timestampSource);
+    }
+
     if (m_pingsSent > 0)
     {
         res.insert("round_trip_loss", (m_pingsSent - m_pingsReceived) / static_cast<float>(m_pingsSent));
@@ -343,33 +446,20 @@ quint32 Ping::estimateTraffic() const
      */
     quint32 est = 2 * 14;  // Ethernet header
 
-    switch (m_destAddress.sa.sa_family)
-    {
-    case AF_INET:
-        est += 2 * 20;  // IPv4 header
-        break;
-
-    case AF_INET6:
-        est += 2 * 40;  // IPv6 header
-        break;
-    }
+    // the host is resolved by start(), assume the larger IPv6 headers
+    est += 2 * 40;  // IPv6 header
 
     switch (definition->type)
     {
     case ping::Udp:
         est += 2 * (8 + definition->payload);  // UDP header + payload
 
-        switch (m_destAddress.sa.sa_family)
-        {
-        case AF_INET:
-            est += 36;  // ICMPv4 response
-            break;
+        est += 56;  // ICMPv6 response
 
-        case AF_INET6:
-            est += 56;  // ICMPv6 response
-            break;
-        }
+        break;
 
+    case ping::Icmp:
+        est += 2 * (8 + definition->payload);  // ICMP echo header + payload
         break;
 
     case ping::Tcp:
@@ -389,16 +479,7 @@ quint32 Ping::estimateTraffic() const
          *     124 bytes (IPv4)
          *     154 bytes (IPv6)
          */
-        switch (m_destAddress.sa.sa_family)
-        {
-        case AF_INET:
-            est += 124;
-            break;
-
-        case AF_INET6:
-            est += 154;
-            break;
-        }
+        est += 154;
 
         break;
 
@@ -420,6 +501,7 @@ int Ping::initSocket()
     int n = 0;
     int sock = 0;
     int ttl = definition->ttl ? definition->ttl : 64;
+    quint16 sourcePort = definition->sourcePort;
     sockaddr_any src_addr;
     struct linger sockLinger;
 
@@ -437,6 +519,13 @@ int Ping::initSocket()
     {
         sock = socket(m_destAddress.sa.sa_family, SOCK_STREAM, IPPROTO_TCP);
     }
+    else if (definition->type == ping::Icmp)
+    {
+        // unprivileged ping socket, requires the group to be allowed by
+        // net.ipv4.ping_group_range
+        sock = socket(m_destAddress.sa.sa_family, SOCK_DGRAM,
+                      m_destAddress.sa.sa_family == AF_INET6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP);
+    }
     else
     {
         // this should never happen
@@ -478,12 +567,26 @@ int Ping::initSocket()
 
     src_addr.sa.sa_family = m_destAddress.sa.sa_family;
 
+    // concurrent TCP probes cannot share the same 5-tuple, let the kernel
+    // pick a source port while another connect() is still in flight
+    if (definition->type == ping::Tcp && !m_tcpNotifiers.isEmpty())
+    {
+        sourcePort = 0;
+    }
+
+    // the port of a ping socket is the ICMP identifier, the kernel picks a
+    // free one for us
+    if (definition->type == ping::Icmp)
+    {
+        sourcePort = 0;
+    }
+
     // use RECVRR
     n = 1;
 
     if (m_destAddress.sa.sa_family == AF_INET)
     {
-        src_addr.sin.sin_port = htons(definition->sourcePort);
+        src_addr.sin.sin_port = htons(sourcePort);
 
         if (bind(sock, (struct sockaddr *) &src_addr, sizeof(src_addr.sin)) < 0)
         {
@@ -500,7 +603,7 @@ int Ping::initSocket()
     }
     else if (m_destAddress.sa.sa_family == AF_INET6)
     {
-        src_addr.sin6.sin6_port = htons(definition->sourcePort);
+        src_addr.sin6.sin6_port = htons(sourcePort);
 
         if (bind(sock, (struct sockaddr *) &src_addr, sizeof(src_addr.sin6)) < 0)
         {
@@ -526,6 +629,44 @@ int Ping::initSocket()
         goto cleanup;
     }
 
+    // the end of a TCP handshake is only visible through the socket
+    // becoming writeable, hence there is no kernel timestamp for it
+    m_timestampSource = definition->type == ping::Tcp ? "user" : "so_timestamp";
+
+    if (definition->preciseTimestamps && definition->type != ping::Tcp)
+    {
+        // software timestamps for sent packets are reported on the error
+        // queue and tagged with a per-socket counter (OPT_ID)
+        n = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+            SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID;
+#ifdef SOF_TIMESTAMPING_OPT_TSONLY
+        n |= SOF_TIMESTAMPING_OPT_TSONLY;
+#endif
+
+        if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &n, sizeof(n)) == 0)
+        {
+            m_timestampSource = "so_timestamping";
+        }
+        else
+        {
+            LOG_DEBUG(QString("setsockopt SO_TIMESTAMPING: %1").arg(
+                          QString::fromLocal8Bit(strerror(errno))));
+
+            n = 1;
+
+            // receive timestamps with nanosecond resolution at least
+            if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &n, sizeof(n)) == 0)
+            {
+                m_timestampSource = "so_timestampns";
+            }
+            else
+            {
+                LOG_DEBUG(QString("setsockopt SO_TIMESTAMPNS: %1").arg(
+                              QString::fromLocal8Bit(strerror(errno))));
+            }
+        }
+    }
+
     // set TTL
     if (setsockopt(sock, SOL_IP, IP_TTL, &ttl, sizeof(ttl)) < 0)
     {
@@ -544,24 +685,29 @@ cleanup:
 bool Ping::sendUdpData(PingProbe *probe)
 {
     int ret = 0;
-    struct timeval tv;
+    QByteArray payload = randomizePayload(definition->payload);
 
-    memset(&tv, 0, sizeof(tv));
+    if (payload.size() >= (int)sizeof(ProbeTag))
+    {
+        ProbeTag tag;
+        tag.identifier = htons(m_identifier);
+        tag.sequence = htons(probe->sequence);
+        memcpy(payload.data(), &tag, sizeof(tag));
+    }
 
-    gettimeofday(&tv, NULL);
-    probe->sendTime = tv.tv_sec * 1e6 + tv.tv_usec;
+    probe->sock = m_sock;
+    probe->sendTimeNs = currentTimeNs();
+    probe->sendTime = probe->sendTimeNs / 1000;
 
     if (m_destAddress.sa.sa_family == AF_INET)
     {
-        ret = sendto(probe->sock, randomizePayload(definition->payload).data(),
-                     definition->payload, 0, (sockaddr *)&m_destAddress,
-                     sizeof(m_destAddress.sin));
+        ret = sendto(probe->sock, payload.constData(), definition->payload, 0,
+                     (sockaddr *)&m_destAddress, sizeof(m_destAddress.sin));
     }
     else if (m_destAddress.sa.sa_family == AF_INET6)
     {
-        ret = sendto(probe->sock, randomizePayload(definition->payload).data(),
-                     definition->payload, 0, (sockaddr *)&m_destAddress,
-                     sizeof(m_destAddress.sin6));
+        ret = sendto(probe->sock, payload.constData(), definition->payload, 0,
+                     (sockaddr *)&m_destAddress, sizeof(m_destAddress.sin6));
     }
 
     if (ret < 0)
@@ -570,140 +716,113 @@ bool Ping::sendUdpData(PingProbe *probe)
         return false;
     }
 
+    // the kernel counts every sent datagram, the TX timestamp refers to it
+    if (m_timestampSource == "so_timestamping")
+    {
+        m_txIds.insert(m_txCounter++, probe->sequence);
+    }
+
     return true;
 }
 
-bool Ping::sendTcpData(PingProbe *probe)
+bool Ping::sendIcmpData(PingProbe *probe)
 {
     int ret = 0;
-    struct timeval tv;
+    QByteArray packet(sizeof(struct icmphdr), 0);
+    struct icmphdr *icmp = (struct icmphdr *) packet.data();
+
+    // identifier and checksum are filled in by the kernel
+    icmp->type = m_destAddress.sa.sa_family == AF_INET6 ? ICMP6_ECHO_REQUEST : ICMP_ECHO;
+    icmp->un.echo.sequence = htons(probe->sequence);
 
-    memset(&tv, 0, sizeof(tv));
-    gettimeofday(&tv, NULL);
-    probe->sendTime = tv.tv_sec * 1e6 + tv.tv_usec;
+    packet.append(randomizePayload(definition->payload));
+
+    probe->sock = m_sock;
+    probe->sendTimeNs = currentTimeNs();
+    probe->sendTime = probe->sendTimeNs / 1000;
 
     if (m_destAddress.sa.sa_family == AF_INET)
     {
-        ret = ::connect(probe->sock, (sockaddr *)&m_destAddress,
-                        sizeof(struct sockaddr_in));
+        ret = sendto(probe->sock, packet.constData(), packet.size(), 0,
+                     (sockaddr *)&m_destAddress, sizeof(m_destAddress.sin));
     }
     else if (m_destAddress.sa.sa_family == AF_INET6)
     {
-        ret = ::connect(probe->sock, (sockaddr *)&m_destAddress,
-                        sizeof(struct sockaddr_in6));
+        ret = sendto(probe->sock, packet.constData(), packet.size(), 0,
+                     (sockaddr *)&m_destAddress, sizeof(m_destAddress.sin6));
     }
 
-    gettimeofday(&tv, NULL);
-    probe->recvTime = tv.tv_sec * 1e6 + tv.tv_usec;
-    memcpy(&probe->source, &(m_destAddress), sizeof(sockaddr_any));
-
-    //for a TCP socket we only call connect (remeber, the socket is non-blocking)
     if (ret < 0)
     {
-        if (errno == ECONNRESET || errno == ECONNREFUSED)
-        {
-            m_pingsSent++;
-            m_pingsReceived++;
-            //check immediately, as connect could return immediately if called
-            //for host-local addresses
-            emit tcpReset(*probe);
-        }
-        else if (errno == EINPROGRESS)
-        {
-            //the call to connect came right back, we now wait a little
-            //till it goes through or till we receive a reset
-            struct pollfd pfd;
-            int ret = 0;
-
-            memset(&pfd, 0, sizeof(pfd));
-            pfd.fd = probe->sock;
-            pfd.events = POLLIN | POLLOUT | POLLERR;
-
-            //careful: when an error occured, the socket becomes also writeable
-            //i.e. POLLOUT.
-            if ((ret = poll(&pfd, 1, definition->receiveTimeout)) < 0)
-            {
-                LOG_WARNING(QString("poll: %1").arg(QString::fromLocal8Bit(
-                                                        strerror(errno))));
-                goto tcpcleanup;
-            }
+        LOG_WARNING(QString("send: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return false;
+    }
 
-            gettimeofday(&tv, NULL);
-            probe->recvTime = tv.tv_sec * 1e6 + tv.tv_usec;
-            memcpy(&probe->source, &(m_destAddress), sizeof(sockaddr_any));
+    if (m_timestampSource == "so_timestamping")
+    {
+        m_txIds.insert(m_txCounter++, probe->sequence);
+    }
 
-            //timeout... the other end is not responding...
-            //maybe a stupid Windows host or something
-            //other went wrong (ICMP)... need to distinguish
-            //the two
-            if (ret == 0)
-            {
-                //it seems counter intuitive, but we
-                //return true here, so we actually
-                //try to read from the socket...
-                return true;
-            }
+    return true;
+}
 
-            m_pingsSent++;
+bool Ping::sendTcpData(PingProbe *probe)
+{
+    int ret = 0;
 
-            //the call to connect could have failed (RST) or actually went through
-            //need to check
-            int error_num = 0;
-            socklen_t len = sizeof(error_num);
+    probe->sock = initSocket();
 
-            if (getsockopt(probe->sock, SOL_SOCKET, SO_ERROR, &error_num, &len) < 0)
-            {
-                LOG_WARNING(QString("getsockopt: %1").arg(QString::fromLocal8Bit(
-                                                              strerror(error_num))));
-                goto tcpcleanup;
-            }
+    if (probe->sock < 0)
+    {
+        LOG_WARNING(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return false;
+    }
 
+    probe->sendTimeNs = currentTimeNs();
+    probe->sendTime = probe->sendTimeNs / 1000;
 
-            if (error_num == 0)
-            {
-                //connection established
-                m_pingsReceived++;
-                emit tcpConnect(*probe);
-                goto tcpcleanup;
-            }
-            else if (error_num == ECONNRESET || error_num == ECONNREFUSED)
-            {
-                //we really expected this reset...
-                m_pingsReceived++;
-                emit tcpReset(*probe);
-                goto tcpcleanup;
-            }
-            else
-            {
-                //unexpected
-                LOG_WARNING(QString("getsockopt: %1").arg(QString::fromLocal8Bit(
-                                                              strerror(error_num))));
-                goto tcpcleanup;
-            }
-        }
-        else
-        {
-            //unexpected
-            LOG_WARNING(QString("connect: %1").arg(QString::fromLocal8Bit(
-                                                       strerror(errno))));
-            goto tcpcleanup;
-        }
+    if (m_destAddress.sa.sa_family == AF_INET)
+    {
+        ret = ::connect(probe->sock, (sockaddr *)&m_destAddress,
+                        sizeof(struct sockaddr_in));
+    }
+    else if (m_destAddress.sa.sa_family == AF_INET6)
+    {
+        ret = ::connect(probe->sock, (sockaddr *)&m_destAddress,
+                        sizeof(struct sockaddr_in6));
     }
 
-tcpcleanup:
-    //closing after unsuccessful connect() OK
-    close(probe->sock);
-    probe->sock = initSocket();
+    //for a TCP socket we only call connect (remember, the socket is non-blocking)
+    if (ret < 0 && errno == EINPROGRESS)
+    {
+        //the call to connect came right back, the socket becomes writeable
+        //once the handshake went through or a reset was received
+        QSocketNotifier *notifier = new QSocketNotifier(probe->sock, QSocketNotifier::Write, this);
+        connect(notifier, &QSocketNotifier::activated, this, &Ping::tcpProbeReady);
+        m_tcpNotifiers.insert(probe->sock, notifier);
+        return true;
+    }
 
-    if (probe->sock < 0)
+    if (ret < 0 && errno != ECONNRESET && errno != ECONNREFUSED)
     {
-        LOG_WARNING(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        //unexpected
+        LOG_WARNING(QString("connect: %1").arg(QString::fromLocal8Bit(
+                                                   strerror(errno))));
+        close(probe->sock);
+        probe->sock = -1;
+        return false;
     }
 
-    return false;
+    //connect could return immediately for host-local addresses, the probe is
+    //answered right away then and handled by sendProbe()
+    probe->recvTimeNs = currentTimeNs();
+    probe->recvTime = probe->recvTimeNs / 1000;
+    memcpy(&probe->source, &(m_destAddress), sizeof(sockaddr_any));
+
+    return true;
 }
 
-void Ping::receiveData(PingProbe *probe)
+bool Ping::receiveData(int sock, int flags)
 {
     struct msghdr msg;
     sockaddr_any from;
@@ -713,7 +832,12 @@ void Ping::receiveData(PingProbe *probe)
     struct cmsghdr *cm;
     struct sock_extended_err *ee = NULL;
     struct timeval *tv;
-    bool udp_response = false;
+    struct timespec *ts;
+    quint64 recvTimeNs = 0;
+    quint32 txId = 0;
+    bool txTimestamp = false;
+    ssize_t length = 0;
+    int index = -1;
 
     memset(&msg, 0, sizeof(msg));
     msg.msg_name = &from;
@@ -725,52 +849,14 @@ void Ping::receiveData(PingProbe *probe)
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
 
-    // poll here
-    struct pollfd pfd;
-    memset(&pfd, 0, sizeof(pfd));
-    pfd.fd = probe->sock;
-    pfd.events = POLLIN | POLLERR;
-
-    // Don't poll on TCP sockets since the sendTcpData method already does
-    // that.
-    if (definition->type == ping::Udp)
-    {
-        if (poll(&pfd, 1, definition->receiveTimeout) < 0)
-        {
-            LOG_WARNING(QString("poll: %1").arg(QString::fromLocal8Bit(strerror(errno))));
-            goto cleanup;
-        }
-    }
-
-    if (!pfd.revents)
-    {
-        // indicate a timeout by zeroing the ping duration
-        probe->recvTime = probe->sendTime;
-        emit timeout(*probe);
-
-        if (definition->type == ping::Tcp)
-        {
-            close(probe->sock);
-            probe->sock = initSocket();
-        }
-
-        goto cleanup;
-    }
-
-    if (recvmsg(probe->sock, &msg, MSG_ERRQUEUE) < 0)
+    if ((length = recvmsg(sock, &msg, flags | MSG_DONTWAIT)) < 0)
     {
-        // receive UDP packet
-        if (recvmsg(probe->sock, &msg, 0) < 0)
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
         {
             LOG_WARNING(QString("recvmsg: %1").arg(QString::fromLocal8Bit(strerror(errno))));
-            goto cleanup;
         }
 
-        udp_response = true;
-
-        // msg_name provides the source address if the initial request packet
-        // was successful
-        memcpy(&probe->source, &from, sizeof(sockaddr_any));
+        return false;
     }
 
     if (msg.msg_flags & MSG_CTRUNC)
@@ -789,7 +875,18 @@ void Ping::receiveData(PingProbe *probe)
             {
             case SO_TIMESTAMP:
                 tv = (struct timeval *) ptr;
-                probe->recvTime = tv->tv_sec * 1e6 + tv->tv_usec;
+                recvTimeNs = (tv->tv_sec * Q_UINT64_C(1000000) + tv->tv_usec) * 1000;
+                break;
+
+            case SO_TIMESTAMPNS:
+                ts = (struct timespec *) ptr;
+                recvTimeNs = ts->tv_sec * Q_UINT64_C(1000000000) + ts->tv_nsec;
+                break;
+
+            case SO_TIMESTAMPING:
+                // ts[0] holds the software timestamp
+                ts = ((struct scm_timestamping *) ptr)->ts;
+                recvTimeNs = ts->tv_sec * Q_UINT64_C(1000000000) + ts->tv_nsec;
                 break;
             }
 
@@ -801,6 +898,12 @@ void Ping::receiveData(PingProbe *probe)
             case IP_RECVERR:
                 ee = (struct sock_extended_err *) ptr;
 
+                if (ee->ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                {
+                    txTimestamp = true;
+                    txId = ee->ee_data;
+                }
+
                 if (ee->ee_origin != SO_EE_ORIGIN_ICMP)
                 {
                     ee = NULL;
@@ -809,7 +912,8 @@ void Ping::receiveData(PingProbe *probe)
 
                 if (ee->ee_type == ICMP_SOURCE_QUENCH || ee->ee_type == ICMP_REDIRECT)
                 {
-                    goto cleanup;
+                    // not an answer to our probe, but keep draining
+                    return true;
                 }
 
                 break;
@@ -826,6 +930,12 @@ void Ping::receiveData(PingProbe *probe)
             case IPV6_RECVERR:
                 ee = (struct sock_extended_err *) ptr;
 
+                if (ee->ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                {
+                    txTimestamp = true;
+                    txId = ee->ee_data;
+                }
+
                 if (ee->ee_origin != SO_EE_ORIGIN_ICMP6)
                 {
                     ee = NULL;
@@ -845,50 +955,392 @@ void Ping::receiveData(PingProbe *probe)
         }
     }
 
+    // the kernel reports when a probe actually left, which replaces the
+    // user space send time
+    if (txTimestamp)
+    {
+        if (recvTimeNs && m_txIds.contains(txId))
+        {
+            PingProbe &probe = m_pingProbes[m_txIds.take(txId)];
+            probe.sendTimeNs = recvTimeNs;
+        }
+
+        return true;
+    }
+
+    // errors which did not originate from ICMP (e.g. local ones) carry no answer
+    if ((flags & MSG_ERRQUEUE) && !ee)
+    {
+        return true;
+    }
+
+    // echo replies and quoted echo requests start with the ICMP header,
+    // which carries the sequence number whatever the payload size
+    if (definition->type == ping::Icmp)
+    {
+        if (length >= (ssize_t)sizeof(struct icmphdr))
+        {
+            struct icmphdr icmp;
+            memcpy(&icmp, buf, sizeof(icmp));
+
+            if (ntohs(icmp.un.echo.sequence) < m_pingProbes.size())
+            {
+                index = ntohs(icmp.un.echo.sequence);
+            }
+        }
+    }
+    else
+    {
+        index = matchProbe(buf, length, ee ? &from : NULL);
+    }
+
+    if (index < 0)
+    {
+        return true;
+    }
+
+    PingProbe &probe = m_pingProbes[index];
+
+    if (probe.replies > 0)
+    {
+        probe.replies++;
+        m_duplicates++;
+        return true;
+    }
+
+    if (!m_outstanding.contains(probe.sequence))
+    {
+        // the probe has already been reported as timed out
+        m_lateReplies++;
+        return true;
+    }
+
+    probe.recvTimeNs = recvTimeNs ? recvTimeNs : currentTimeNs();
+    probe.recvTime = probe.recvTimeNs / 1000;
+
     if (ee)
     {
-        memcpy(&probe->source, SO_EE_OFFENDER(ee), sizeof(probe->source));
+        memcpy(&probe.source, SO_EE_OFFENDER(ee), sizeof(probe.source));
 
         if ((ee->ee_type == ICMP_TIME_EXCEEDED && ee->ee_code == ICMP_EXC_TTL) || ee->ee_type == ICMP6_TIME_EXCEEDED)
         {
-            m_pingsReceived++;
-            emit ttlExceeded(*probe);
+            handleReply(index);
+            emit ttlExceeded(probe);
         }
         else if (ee->ee_type == ICMP_DEST_UNREACH || ee->ee_type == ICMP6_DST_UNREACH)
         {
-            m_pingsReceived++;
-            emit destinationUnreachable(*probe);
+            handleReply(index);
+            emit destinationUnreachable(probe);
+        }
+    }
+    else
+    {
+        // msg_name provides the source address if the initial request packet
+        // was successful
+        memcpy(&probe.source, &from, sizeof(sockaddr_any));
+        handleReply(index);
+
+        if (definition->type == ping::Icmp)
+        {
+            emit echoReply(probe);
+        }
+        else
+        {
+            emit udpResponse(probe);
+        }
+    }
+
+    return true;
+}
+
+int Ping::matchProbe(const char *data, int length, const sockaddr_any *quotedDestination) const
+{
+    if (length >= (int)sizeof(ProbeTag))
+    {
+        ProbeTag tag;
+        memcpy(&tag, data, sizeof(tag));
+
+        if (ntohs(tag.identifier) == m_identifier && ntohs(tag.sequence) < m_pingProbes.size())
+        {
+            return ntohs(tag.sequence);
         }
     }
 
-    if (udp_response)
+    // routers which quote only the first 8 bytes of the datagram leave us
+    // nothing to match, blame the oldest outstanding probe then. Only ICMP
+    // errors about a datagram to our destination qualify, anything else
+    // arriving on the socket is not an answer.
+    if (quotedDestination && sameHost(*quotedDestination, m_destAddress) && !m_outstanding.isEmpty())
     {
-        m_pingsReceived++;
-        emit udpResponse(*probe);
+        return m_outstanding.constBegin().value();
     }
 
-cleanup:
-    return;
+    return -1;
+}
+
+void Ping::handleReply(int index)
+{
+    PingProbe &probe = m_pingProbes[index];
+
+    probe.replies++;
+    m_outstanding.remove(probe.sequence);
+    m_pingsReceived++;
+
+    if ((int)probe.sequence < m_highestSequence)
+    {
+        m_reordered++;
+    }
+    else
+    {
+        m_highestSequence = probe.sequence;
+    }
+
+    emit ping(static_cast<int>((probe.recvTimeNs - probe.sendTimeNs) / 1000000));
 }
 
-void Ping::ping(PingProbe *probe)
+void Ping::sendProbe()
 {
-    bool ret = false;
+    PingProbe probe;
+    bool sent = false;
+
+    probe.sequence = m_pingProbes.size();
 
-    // send
     if (definition->type == ping::Udp)
     {
-        ret = sendUdpData(probe);
+        sent = sendUdpData(&probe);
     }
     else if (definition->type == ping::Tcp)
     {
-        ret = sendTcpData(probe);
+        sent = sendTcpData(&probe);
+    }
+    else if (definition->type == ping::Icmp)
+    {
+        sent = sendIcmpData(&probe);
     }
 
-    if (ret)
+    m_pingProbes.append(probe);
+
+    if (sent)
     {
         m_pingsSent++;
-        receiveData(probe);
+        m_outstanding.insert(probe.sequence, m_pingProbes.size() - 1);
+
+        // TCP connect() may have been answered immediately
+        if (definition->type == ping::Tcp && probe.recvTime > 0)
+        {
+            finishTcpProbe(probe.sock);
+        }
+    }
+
+    // schedule the next probe relative to the start of the run so the
+    // interval does not drift with the time spent on replies
+    if ((quint32)m_pingProbes.size() < definition->count)
+    {
+        qint64 next = (qint64)m_pingProbes.size() * definition->interval - m_clock.elapsed();
+        m_sendTimer.start(qMax(Q_INT64_C(0), next));
+    }
+
+    scheduleTimeout();
+    checkFinished();
+}
+
+void Ping::readReplies()
+{
+    // errors (ICMP) first, then regular datagrams, until both are drained
+    while (receiveData(m_sock, MSG_ERRQUEUE))
+    {
+    }
+
+    while (receiveData(m_sock, 0))
+    {
+    }
+
+    scheduleTimeout();
+    checkFinished();
+}
+
+void Ping::tcpProbeReady(int sock)
+{
+    finishTcpProbe(sock);
+    scheduleTimeout();
+    checkFinished();
+}
+
+void Ping::finishTcpProbe(int sock)
+{
+    int index = -1;
+
+    for (QMap<quint16, int>::const_iterator it = m_outstanding.constBegin(); it != m_outstanding.constEnd(); ++it)
+    {
+        if (m_pingProbes[it.value()].sock == sock)
+        {
+            index = it.value();
+            break;
+        }
+    }
+
+    if (QSocketNotifier *notifier = m_tcpNotifiers.take(sock))
+    {
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+    }
+
+    if (index < 0)
+    {
+        close(sock);
+        return;
+    }
+
+    PingProbe &probe = m_pingProbes[index];
+
+    //the call to connect could have failed (RST) or actually went through
+    //need to check
+    int error_num = 0;
+    socklen_t len = sizeof(error_num);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error_num, &len) < 0)
+    {
+        error_num = errno;
+    }
+
+    if (!probe.recvTime)
+    {
+        probe.recvTimeNs = currentTimeNs();
+        probe.recvTime = probe.recvTimeNs / 1000;
+        memcpy(&probe.source, &(m_destAddress), sizeof(sockaddr_any));
+    }
+
+    //closing after connect() is OK, SO_LINGER makes this send a RST
+    close(sock);
+    probe.sock = -1;
+
+    if (error_num == 0)
+    {
+        //connection established
+        handleReply(index);
+        emit tcpConnect(probe);
+    }
+    else if (error_num == ECONNRESET || error_num == ECONNREFUSED)
+    {
+        //we really expected this reset...
+        handleReply(index);
+        emit tcpReset(probe);
+    }
+    else
+    {
+        //unexpected, treat the probe as lost
+        LOG_WARNING(QString("connect: %1").arg(QString::fromLocal8Bit(
+                                                   strerror(error_num))));
+        m_outstanding.remove(probe.sequence);
+        probe.recvTime = probe.sendTime;
+        probe.recvTimeNs = probe.sendTimeNs;
+        emit timeout(probe);
+    }
+}
+
+void Ping::checkTimeouts()
+{
+    quint64 now = currentTime();
+    QList<int> expired;
+
+    foreach (int index, m_outstanding)
+    {
+        if (now - m_pingProbes[index].sendTime >= definition->receiveTimeout * Q_UINT64_C(1000))
+        {
+            expired.append(index);
+        }
+    }
+
+    foreach (int index, expired)
+    {
+        PingProbe &probe = m_pingProbes[index];
+
+        m_outstanding.remove(probe.sequence);
+
+        if (definition->type == ping::Tcp && probe.sock >= 0)
+        {
+            delete m_tcpNotifiers.take(probe.sock);
+            close(probe.sock);
+            probe.sock = -1;
+        }
+
+        // indicate a timeout by zeroing the ping duration
+        probe.recvTime = probe.sendTime;
+        probe.recvTimeNs = probe.sendTimeNs;
+        emit timeout(probe);
+    }
+
+    scheduleTimeout();
+    checkFinished();
+}
+
+void Ping::scheduleTimeout()
+{
+    if (m_outstanding.isEmpty())
+    {
+        m_timeoutTimer.stop();
+        return;
+    }
+
+    // probes are sent in sequence order, the first one expires first
+    quint64 deadline = m_pingProbes[m_outstanding.constBegin().value()].sendTime +
+                       definition->receiveTimeout * Q_UINT64_C(1000);
+    quint64 now = currentTime();
+
+    m_timeoutTimer.start(deadline > now ? (deadline - now) / 1000 + 1 : 0);
+}
+
+void Ping::checkFinished()
+{
+    if (currentStatus != Ping::Running ||
+        (quint32)m_pingProbes.size() < definition->count ||
+        !m_outstanding.isEmpty())
+    {
+        return;
+    }
+
+    closeSockets();
+
+    // one entry per probe so they line up with the sequence numbers,
+    // timeouts are reported as 0
+    foreach (const PingProbe &probe, m_pingProbes)
+    {
+        if (probe.replies > 0 && probe.sendTimeNs > 0 && probe.recvTimeNs > probe.sendTimeNs)
+        {
+            pingTime.append((probe.recvTimeNs - probe.sendTimeNs) / 1000000.);
+        }
+        else
+        {
+            pingTime.append(0.0);
+        }
+    }
+
+    // this may delete us, so it has to be the last thing done
+    setStatus(Ping::Finished);
+    emit Measurement::finished();
+}
+
+void Ping::closeSockets()
+{
+    m_sendTimer.stop();
+    m_timeoutTimer.stop();
+
+    delete m_readNotifier;
+    m_readNotifier = NULL;
+
+    for (QHash<int, QSocketNotifier *>::const_iterator it = m_tcpNotifiers.constBegin(); it != m_tcpNotifiers.constEnd();
+         ++it)
+    {
+        delete it.value();
+        close(it.key());
+    }
+
+    m_tcpNotifiers.clear();
+
+    if (m_sock >= 0)
+    {
+        close(m_sock);
+        m_sock = -1;
     }
 }
 
@@ -944,19 +1396,37 @@ void Ping::readyRead()
 
 void Ping::waitForFinished()
 {
-    process.waitForFinished(1000);
+    if (definition->type == ping::System)
+    {
+        process.waitForFinished(1000);
+        return;
+    }
+
+    if (currentStatus == Ping::Running)
+    {
+        QEventLoop loop;
+        connect(this, SIGNAL(finished()), &loop, SLOT(quit()));
+        connect(this, SIGNAL(error(const QString &)), &loop, SLOT(quit()));
+        loop.exec();
+    }
 }
 
 float Ping::averagePingTime() const
 {
     float time = 0;
+    int replies = 0;
 
+    // timeouts are 0
     foreach (float t, pingTime)
     {
-        time += t;
+        if (t > 0)
+        {
+            time += t;
+            replies++;
+        }
     }
 
-    return time / pingTime.size();
+    return replies > 0 ? time / replies : 0;
 }
 
 // vim: set sts=4 sw=4 et:
@@ -14,6 +14,7 @@
 #include "../../log/logger.h"
 #include "../../client.h"
 #include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
 
 //#include <arpa/inet.h>
 
@@ -25,34 +26,29 @@ LOGGER(Ping);
 
 namespace
 {
-    bool getAddress(const QString &address, sockaddr_any *addr)
+    // the first usable address of a lookup
+    bool firstAddress(const QHostInfo &info, sockaddr_any *addr)
     {
-        struct addrinfo *rp = NULL, *result = NULL;
-
-        if (getaddrinfo(address.toLatin1(), NULL, NULL, &result))
-        {
-            return false;
-        }
-
-        for (rp = result; rp && rp->ai_family != AF_INET &&
-             rp->ai_family != AF_INET6;
-             rp = rp->ai_next)
+        foreach (const QHostAddress &address, info.addresses())
         {
+            if (address.protocol() == QAbstractSocket::IPv4Protocol)
+            {
+                addr->sin.sin_family = AF_INET;
+                addr->sin.sin_len = sizeof(addr->sin);
+                addr->sin.sin_addr.s_addr = htonl(address.toIPv4Address());
+                return true;
+            }
+            else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+            {
+                Q_IPV6ADDR ip = address.toIPv6Address();
+                addr->sin6.sin6_family = AF_INET6;
+                addr->sin6.sin6_len = sizeof(addr->sin6);
+                memcpy(&addr->sin6.sin6_addr, ip.c, sizeof(ip.c));
+                return true;
+            }
         }
 
-        if (!rp)
-        {
-            //being here means that neither a v4 nor a v6 address was found
-            //does that make any sense? Could this happen?
-            freeaddrinfo(result);
-            return false;
-        }
-
-        memcpy(addr, rp->ai_addr, rp->ai_addrlen);
-
-        freeaddrinfo(result);
-
-        return true;
+        return false;
     }
 
     //for the Mac OS version of UDPPing, the ICMP socket is used only
@@ -215,38 +211,14 @@ bool Ping::prepare(NetworkManager *networkManager, const MeasurementDefinitionPt
         return true;
     }
 
+    // the host is resolved by start() so DNS does not block the executor
     memset(&m_destAddress, 0, sizeof(m_destAddress));
 
-    // resolve
-    if (!getAddress(definition->host, &m_destAddress))
-    {
-        setErrorString(QString("could not resolve hostname '%1'").arg(definition->host));
-        return false;
-    }
-
-    if (m_destAddress.sa.sa_family == AF_INET)
-    {
-        m_destAddress.sin.sin_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
-    }
-    else if (m_destAddress.sa.sa_family == AF_INET6)
-    {
-        m_destAddress.sin6.sin6_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
-    }
-    else
-    {
-        // unreachable
-        setErrorString(QString("unknown address family '%1'").arg(
-                           m_destAddress.sa.sa_family));
-        return false;
-    }
-
     return true;
 }
 
 bool Ping::start()
 {
-    PingProbe probe;
-
     setStatus(Ping::Running);
 
     if (definition->type == ping::System)
@@ -264,12 +236,40 @@ bool Ping::start()
         return true;
     }
 
+    Client::instance()->resolver()->lookupHost(definition->host, this, SLOT(hostResolved(QHostInfo)));
+
+    return true;
+}
+
+void Ping::hostResolved(const QHostInfo &info)
+{
+    PingProbe probe;
+
+    memset(&m_destAddress, 0, sizeof(m_destAddress));
+
+    if (!firstAddress(info, &m_destAddress))
+    {
+        setStatus(Ping::Error);
+        emit error(QString("could not resolve hostname '%1'").arg(definition->host));
+        return;
+    }
+
+    if (m_destAddress.sa.sa_family == AF_INET)
+    {
+        m_destAddress.sin.sin_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
+    }
+    else
+    {
+        m_destAddress.sin6.sin6_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
+    }
+
     probe.sock = initSocket();
 
     if (probe.sock < 0)
     {
-        setErrorString(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
-        return false;
+        setStatus(Ping::Error);
+        emit error(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return;
     }
 
     probe.icmpSock = initIcmpSocket(m_destAddress);
@@ -277,8 +277,9 @@ bool Ping::start()
     if (probe.icmpSock < 0)
     {
         close(probe.sock);
-        setErrorString(QString("icmp socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
-        return false;
+        setStatus(Ping::Error);
+        emit error(QString("icmp socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return;
     }
 
     for (quint32 i = 0; i < definition->count; i++)
@@ -313,8 +314,6 @@ bool Ping::start()
 
     setStatus(Ping::Finished);
     emit Measurement::finished();
-
-    return true;
 }
 
 bool Ping::stop()
@@ -401,32 +400,15 @@ quint32 Ping::estimateTraffic() const
      */
     quint32 est = 2 * 14;  // Ethernet header
 
-    switch (m_destAddress.sa.sa_family)
-    {
-    case AF_INET:
-        est += 2 * 20;  // IPv4 header
-        break;
-
-    case AF_INET6:
-        est += 2 * 40;  // IPv6 header
-        break;
-    }
+    // the host is resolved by start(), assume the larger IPv6 headers
+    est += 2 * 40;  // IPv6 header
 
     switch (definition->type)
     {
     case ping::Udp:
         est += 2 * (8 + definition->payload);  // UDP header + payload
 
-        switch (m_destAddress.sa.sa_family)
-        {
-        case AF_INET:
-            est += 36;  // ICMPv4 response
-            break;
-
-        case AF_INET6:
-            est += 56;  // ICMPv6 response
-            break;
-        }
+        est += 56;  // ICMPv6 response
 
         break;
 
@@ -447,16 +429,7 @@ quint32 Ping::estimateTraffic() const
          *     124 bytes (IPv4)
          *     154 bytes (IPv6)
          */
-        switch (m_destAddress.sa.sa_family)
-        {
-        case AF_INET:
-            est += 124;
-            break;
-
-        case AF_INET6:
-            est += 154;
-            break;
-        }
+        est += 154;
 
         break;
 
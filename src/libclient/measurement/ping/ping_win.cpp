@@ -2,6 +2,7 @@
 #include "../../log/logger.h"
 #include "../../client.h"
 #include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
 
 #include <time.h>
 #include <Windows.h>
@@ -60,6 +61,29 @@ namespace
         return true;
     }
 
+    // the first usable address of a lookup
+    bool firstAddress(const QHostInfo &info, sockaddr_any *addr)
+    {
+        foreach (const QHostAddress &address, info.addresses())
+        {
+            if (address.protocol() == QAbstractSocket::IPv4Protocol)
+            {
+                addr->sin.sin_family = AF_INET;
+                addr->sin.sin_addr.s_addr = htonl(address.toIPv4Address());
+                return true;
+            }
+            else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+            {
+                Q_IPV6ADDR ip = address.toIPv6Address();
+                addr->sin6.sin6_family = AF_INET6;
+                memcpy(&addr->sin6.sin6_addr, ip.c, sizeof(ip.c));
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     PingProbe handleIpv4Response(const u_char *data,
                                  const pcap_pkthdr *header,
                                  const sockaddr_any &destination,
@@ -529,12 +553,6 @@ bool Ping::prepare(NetworkManager *networkManager, const MeasurementDefinitionPt
 {
     Q_UNUSED(networkManager);
 
-    pcap_if_t *alldevs;
-    char errbuf[PCAP_ERRBUF_SIZE] = "";
-    char source[PCAP_BUF_SIZE] = "";
-    char address[INET6_ADDRSTRLEN] = "";
-    struct bpf_program fcode;
-
     definition = measurementDefinition.dynamicCast<PingDefinition>();
 
     if (definition.isNull())
@@ -573,14 +591,19 @@ bool Ping::prepare(NetworkManager *networkManager, const MeasurementDefinitionPt
         return true;
     }
 
+    // the host is resolved by start() so DNS does not block the executor
     memset(&m_destAddress, 0, sizeof(m_destAddress));
 
-    // resolve
-    if (!getAddress(definition->host, &m_destAddress))
-    {
-        setErrorString(QString("could not resolve hostname '%1'").arg(definition->host));
-        return false;
-    }
+    return true;
+}
+
+bool Ping::openCapture()
+{
+    pcap_if_t *alldevs;
+    char errbuf[PCAP_ERRBUF_SIZE] = "";
+    char source[PCAP_BUF_SIZE] = "";
+    char address[INET6_ADDRSTRLEN] = "";
+    struct bpf_program fcode;
 
     m_destAddress.sin.sin_port = htons(definition->destinationPort ? definition->destinationPort : 33434);
 
@@ -681,8 +704,6 @@ bool Ping::prepare(NetworkManager *networkManager, const MeasurementDefinitionPt
 
 bool Ping::start()
 {
-    PingProbe probe;
-
     setStatus(Ping::Running);
 
     if (definition->type == ping::System)
@@ -700,12 +721,38 @@ bool Ping::start()
         return true;
     }
 
+    Client::instance()->resolver()->lookupHost(definition->host, this, SLOT(hostResolved(QHostInfo)));
+
+    return true;
+}
+
+void Ping::hostResolved(const QHostInfo &info)
+{
+    PingProbe probe;
+
+    memset(&m_destAddress, 0, sizeof(m_destAddress));
+
+    if (!firstAddress(info, &m_destAddress))
+    {
+        setStatus(Ping::Error);
+        emit error(QString("could not resolve hostname '%1'").arg(definition->host));
+        return;
+    }
+
+    if (!openCapture())
+    {
+        setStatus(Ping::Error);
+        emit error(errorString());
+        return;
+    }
+
     probe.sock = initSocket();
 
     if (probe.sock < 0)
     {
-        setErrorString("Failed to initialize socket");
-        return false;
+        setStatus(Ping::Error);
+        emit error("Failed to initialize socket");
+        return;
     }
 
     ping(&probe);
@@ -713,8 +760,6 @@ bool Ping::start()
 
     setStatus(Ping::Finished);
     emit Measurement::finished();
-
-    return true;
 }
 
 bool Ping::stop()
@@ -797,32 +842,15 @@ quint32 Ping::estimateTraffic() const
      */
     quint32 est = 2 * 14;  // Ethernet header
 
-    switch (m_destAddress.sa.sa_family)
-    {
-    case AF_INET:
-        est += 2 * 20;  // IPv4 header
-        break;
-
-    case AF_INET6:
-        est += 2 * 40;  // IPv6 header
-        break;
-    }
+    // the host is resolved by start(), assume the larger IPv6 headers
+    est += 2 * 40;  // IPv6 header
 
     switch (definition->type)
     {
     case ping::Udp:
         est += 2 * (8 + definition->payload);  // UDP header + payload
 
-        switch (m_destAddress.sa.sa_family)
-        {
-        case AF_INET:
-            est += 36;  // ICMPv4 response
-            break;
-
-        case AF_INET6:
-            est += 56;  // ICMPv6 response
-            break;
-        }
+        est += 56;  // ICMPv6 response
 
         break;
 
@@ -843,16 +871,7 @@ quint32 Ping::estimateTraffic() const
          *     124 bytes (IPv4)
          *     154 bytes (IPv6)
          */
-        switch (m_destAddress.sa.sa_family)
-        {
-        case AF_INET:
-            est += 124;
-            break;
-
-        case AF_INET6:
-            est += 154;
-            break;
-        }
+        est += 154;
 
         break;
 
@@ -0,0 +1,687 @@
+#include "pingsweep.h"
+#include "../../log/logger.h"
+#include "../../client.h"
+#include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/icmp.h>
+#include <netinet/icmp6.h>
+#include <sys/socket.h>
+
+#include <QtMath>
+
+LOGGER(PingSweep);
+
+namespace
+{
+    const quint16 udpPort = 33434;
+
+    /*
+     * Written to the start of every probe payload (after the ICMP header for
+     * ICMP probes). The magic value tells our probes apart from the ones of
+     * other measurements, target and sequence identify the probe.
+     */
+    struct SweepTag
+    {
+        quint16 magic;
+        quint16 target;
+        quint16 sequence;
+    };
+
+    quint64 currentTimeNs()
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        return ts.tv_sec * Q_UINT64_C(1000000000) + ts.tv_nsec;
+    }
+
+    bool toSockaddr(const QHostAddress &address, sockaddr_any *addr)
+    {
+        memset(addr, 0, sizeof(*addr));
+
+        if (address.protocol() == QAbstractSocket::IPv4Protocol)
+        {
+            addr->sin.sin_family = AF_INET;
+            addr->sin.sin_addr.s_addr = htonl(address.toIPv4Address());
+            return true;
+        }
+        else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+        {
+            Q_IPV6ADDR ip = address.toIPv6Address();
+            addr->sin6.sin6_family = AF_INET6;
+            memcpy(&addr->sin6.sin6_addr, ip.c, sizeof(ip.c));
+            return true;
+        }
+
+        return false;
+    }
+}
+
+PingSweep::PingSweep(QObject *parent)
+: Measurement(parent)
+, currentStatus(Unknown)
+, m_nextProbe(0)
+, m_magic(0)
+, m_sock4(-1)
+, m_sock6(-1)
+, m_notifier4(NULL)
+, m_notifier6(NULL)
+, m_resolveTime(0)
+{
+    m_sendTimer.setSingleShot(true);
+    m_sendTimer.setTimerType(Qt::PreciseTimer);
+    m_timeoutTimer.setSingleShot(true);
+    m_timeoutTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(&m_sendTimer, &QTimer::timeout, this, &PingSweep::sendProbes);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &PingSweep::checkTimeouts);
+}
+
+PingSweep::~PingSweep()
+{
+    closeSockets();
+}
+
+Measurement::Status PingSweep::status() const
+{
+    return currentStatus;
+}
+
+void PingSweep::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+bool PingSweep::prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager);
+
+    definition = measurementDefinition.dynamicCast<PingSweepDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("Definition is empty");
+        return false;
+    }
+
+    if (definition->type != ping::Icmp && definition->type != ping::Udp)
+    {
+        setErrorString("Ping type not supported");
+        return false;
+    }
+
+    if (definition->hosts.isEmpty() || definition->hosts.size() > 65535)
+    {
+        setErrorString("number of hosts must be between 1 and 65535");
+        return false;
+    }
+
+    if (definition->count > 65535)
+    {
+        setErrorString("count is too large (> 65535)");
+        return false;
+    }
+
+    if (definition->payload < sizeof(SweepTag) || definition->payload > 1400)
+    {
+        setErrorString(QString("payload must be between %1 and 1400 bytes").arg(sizeof(SweepTag)));
+        return false;
+    }
+
+    if (definition->receiveTimeout > 60000)
+    {
+        setErrorString("receive timeout is too large (> 60 s)");
+        return false;
+    }
+
+    if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(estimateTraffic()))
+    {
+        setErrorString("not enough traffic available");
+        return false;
+    }
+
+    m_targets.clear();
+    m_targets.resize(definition->hosts.size());
+
+    for (int i = 0; i < definition->hosts.size(); i++)
+    {
+        m_targets[i].host = definition->hosts.at(i);
+        m_targets[i].slot = -1;
+        m_targets[i].received = 0;
+        m_targets[i].duplicates = 0;
+        memset(&m_targets[i].address, 0, sizeof(sockaddr_any));
+    }
+
+    return true;
+}
+
+bool PingSweep::start()
+{
+    setStatus(PingSweep::Running);
+
+    m_magic = qrand() & 0xffff;
+    m_clock.start();
+
+    // all names are resolved in parallel, probing starts once the last
+    // lookup came back
+    for (int i = 0; i < m_targets.size(); i++)
+    {
+        m_lookups.insert(Client::instance()->resolver()->lookupHost(m_targets[i].host, this,
+                                                                     SLOT(lookedUp(QHostInfo))), i);
+    }
+
+    return true;
+}
+
+bool PingSweep::stop()
+{
+    foreach (int id, m_lookups.keys())
+    {
+        Client::instance()->resolver()->abortHostLookup(id);
+    }
+
+    m_lookups.clear();
+    closeSockets();
+
+    return true;
+}
+
+void PingSweep::lookedUp(const QHostInfo &info)
+{
+    if (!m_lookups.contains(info.lookupId()))
+    {
+        return;
+    }
+
+    Target &target = m_targets[m_lookups.take(info.lookupId())];
+
+    if (info.error() != QHostInfo::NoError)
+    {
+        target.errorString = info.errorString();
+    }
+    else
+    {
+        foreach (const QHostAddress &address, info.addresses())
+        {
+            if (toSockaddr(address, &target.address))
+            {
+                break;
+            }
+        }
+
+        if (target.address.sa.sa_family == 0)
+        {
+            target.errorString = "no usable address";
+        }
+    }
+
+    if (m_lookups.isEmpty())
+    {
+        m_resolveTime = m_clock.elapsed();
+        startProbing();
+    }
+}
+
+void PingSweep::startProbing()
+{
+    m_slots.clear();
+
+    for (int i = 0; i < m_targets.size(); i++)
+    {
+        Target &target = m_targets[i];
+
+        if (!target.errorString.isEmpty())
+        {
+            continue;
+        }
+
+        int &sock = target.address.sa.sa_family == AF_INET6 ? m_sock6 : m_sock4;
+
+        if (sock < 0 && (sock = initSocket(target.address.sa.sa_family)) < 0)
+        {
+            target.errorString = QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+            continue;
+        }
+
+        if (definition->type == ping::Udp)
+        {
+            if (target.address.sa.sa_family == AF_INET6)
+            {
+                target.address.sin6.sin6_port = htons(udpPort);
+            }
+            else
+            {
+                target.address.sin.sin_port = htons(udpPort);
+            }
+        }
+
+        target.slot = m_slots.size();
+        target.probes.resize(definition->count);
+        m_slots.append(i);
+    }
+
+    if (m_sock4 >= 0)
+    {
+        m_notifier4 = new QSocketNotifier(m_sock4, QSocketNotifier::Read, this);
+        connect(m_notifier4, &QSocketNotifier::activated, this, &PingSweep::readReplies);
+    }
+
+    if (m_sock6 >= 0)
+    {
+        m_notifier6 = new QSocketNotifier(m_sock6, QSocketNotifier::Read, this);
+        connect(m_notifier6, &QSocketNotifier::activated, this, &PingSweep::readReplies);
+    }
+
+    m_nextProbe = 0;
+    m_clock.start();
+    sendProbes();
+}
+
+void PingSweep::sendProbes()
+{
+    quint32 total = m_slots.size() * definition->count;
+    qint64 spacing = 0;
+
+    // every target is probed once per interval, the probes of one round are
+    // spread evenly over the interval
+    while (m_nextProbe < total)
+    {
+        spacing = (qint64)m_nextProbe * definition->interval / m_slots.size();
+
+        if (spacing > m_clock.elapsed())
+        {
+            break;
+        }
+
+        quint16 sequence = m_nextProbe / m_slots.size();
+        int index = m_slots.at(m_nextProbe % m_slots.size());
+        Target &target = m_targets[index];
+        PingProbe &probe = target.probes[sequence];
+        QByteArray packet;
+        int sock = target.address.sa.sa_family == AF_INET6 ? m_sock6 : m_sock4;
+
+        if (definition->type == ping::Icmp)
+        {
+            struct icmphdr icmp;
+
+            // identifier and checksum are filled in by the kernel
+            memset(&icmp, 0, sizeof(icmp));
+            icmp.type = target.address.sa.sa_family == AF_INET6 ? ICMP6_ECHO_REQUEST : ICMP_ECHO;
+            icmp.un.echo.sequence = htons(sequence);
+            packet.append((const char *) &icmp, sizeof(icmp));
+        }
+
+        SweepTag tag;
+        tag.magic = htons(m_magic);
+        tag.target = htons(index);
+        tag.sequence = htons(sequence);
+        packet.append((const char *) &tag, sizeof(tag));
+        packet.append(QByteArray(definition->payload - sizeof(tag), 'X'));
+
+        probe.sock = sock;
+        probe.sequence = sequence;
+        probe.sendTimeNs = currentTimeNs();
+        probe.sendTime = probe.sendTimeNs / 1000;
+
+        if (sendto(sock, packet.constData(), packet.size(), 0, &target.address.sa,
+                   target.address.sa.sa_family == AF_INET6 ? sizeof(target.address.sin6) : sizeof(target.address.sin)) < 0)
+        {
+            LOG_DEBUG(QString("send to %1: %2").arg(target.host).arg(QString::fromLocal8Bit(strerror(errno))));
+            probe.sendTime = 0;
+            probe.sendTimeNs = 0;
+        }
+        else
+        {
+            m_outstanding.insert(m_nextProbe, index);
+        }
+
+        m_nextProbe++;
+    }
+
+    if (m_nextProbe < total)
+    {
+        m_sendTimer.start(qMax(Q_INT64_C(0), spacing - m_clock.elapsed()));
+    }
+
+    scheduleTimeout();
+    checkFinished();
+}
+
+void PingSweep::readReplies(int sock)
+{
+    // errors (ICMP) first, then regular datagrams, until both are drained
+    while (receiveData(sock, MSG_ERRQUEUE))
+    {
+    }
+
+    while (receiveData(sock, 0))
+    {
+    }
+
+    scheduleTimeout();
+    checkFinished();
+}
+
+bool PingSweep::receiveData(int sock, int flags)
+{
+    struct msghdr msg;
+    sockaddr_any from;
+    struct iovec iov;
+    char buf[1500];
+    char control[256];
+    struct cmsghdr *cm;
+    struct sock_extended_err *ee = NULL;
+    quint64 recvTimeNs = 0;
+    ssize_t length = 0;
+    int offset = definition->type == ping::Icmp ? sizeof(struct icmphdr) : 0;
+    SweepTag tag;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if ((length = recvmsg(sock, &msg, flags | MSG_DONTWAIT)) < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG_WARNING(QString("recvmsg: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        }
+
+        return false;
+    }
+
+    for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPNS)
+        {
+            struct timespec *ts = (struct timespec *) CMSG_DATA(cm);
+            recvTimeNs = ts->tv_sec * Q_UINT64_C(1000000000) + ts->tv_nsec;
+        }
+        else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+        {
+            ee = (struct sock_extended_err *) CMSG_DATA(cm);
+
+            if (ee->ee_origin != SO_EE_ORIGIN_ICMP && ee->ee_origin != SO_EE_ORIGIN_ICMP6)
+            {
+                ee = NULL;
+            }
+        }
+    }
+
+    if ((flags & MSG_ERRQUEUE) && !ee)
+    {
+        return true;
+    }
+
+    // demultiplex by the tag, replies without one cannot be assigned
+    if (length < offset + (int)sizeof(tag))
+    {
+        return true;
+    }
+
+    memcpy(&tag, buf + offset, sizeof(tag));
+
+    if (ntohs(tag.magic) != m_magic || ntohs(tag.target) >= m_targets.size())
+    {
+        return true;
+    }
+
+    Target &target = m_targets[ntohs(tag.target)];
+    quint16 sequence = ntohs(tag.sequence);
+
+    if (target.slot < 0 || sequence >= target.probes.size())
+    {
+        return true;
+    }
+
+    PingProbe &probe = target.probes[sequence];
+    quint32 number = sequence * m_slots.size() + target.slot;
+
+    if (ee)
+    {
+        // only an error sent by the target itself (e.g. port unreachable
+        // for UDP probes) proves that the target is alive
+        if (QHostAddress((sockaddr *) SO_EE_OFFENDER(ee)) != QHostAddress(&target.address.sa))
+        {
+            return true;
+        }
+
+        memcpy(&probe.source, SO_EE_OFFENDER(ee), sizeof(probe.source));
+    }
+    else
+    {
+        memcpy(&probe.source, &from, sizeof(probe.source));
+    }
+
+    if (probe.replies++ > 0)
+    {
+        target.duplicates++;
+        return true;
+    }
+
+    // late replies are counted as lost
+    if (m_outstanding.remove(number) == 0)
+    {
+        return true;
+    }
+
+    probe.recvTimeNs = recvTimeNs ? recvTimeNs : currentTimeNs();
+    probe.recvTime = probe.recvTimeNs / 1000;
+    target.received++;
+
+    return true;
+}
+
+void PingSweep::checkTimeouts()
+{
+    quint64 now = currentTimeNs();
+    quint64 timeout = definition->receiveTimeout * Q_UINT64_C(1000000);
+
+    // probes are sent in probe number order, so the first ones expire first
+    while (!m_outstanding.isEmpty())
+    {
+        QMap<quint32, int>::iterator it = m_outstanding.begin();
+        const PingProbe &probe = m_targets[it.value()].probes[it.key() / m_slots.size()];
+
+        if (now - probe.sendTimeNs < timeout)
+        {
+            break;
+        }
+
+        m_outstanding.erase(it);
+    }
+
+    scheduleTimeout();
+    checkFinished();
+}
+
+void PingSweep::scheduleTimeout()
+{
+    if (m_outstanding.isEmpty())
+    {
+        m_timeoutTimer.stop();
+        return;
+    }
+
+    QMap<quint32, int>::const_iterator it = m_outstanding.constBegin();
+    quint64 deadline = m_targets[it.value()].probes[it.key() / m_slots.size()].sendTimeNs +
+                       definition->receiveTimeout * Q_UINT64_C(1000000);
+    quint64 now = currentTimeNs();
+
+    m_timeoutTimer.start(deadline > now ? (deadline - now) / 1000000 + 1 : 0);
+}
+
+void PingSweep::checkFinished()
+{
+    if (currentStatus != PingSweep::Running ||
+        m_nextProbe < m_slots.size() * definition->count ||
+        !m_outstanding.isEmpty())
+    {
+        return;
+    }
+
+    closeSockets();
+
+    // this may delete us, so it has to be the last thing done
+    setStatus(PingSweep::Finished);
+    emit finished();
+}
+
+void PingSweep::closeSockets()
+{
+    m_sendTimer.stop();
+    m_timeoutTimer.stop();
+
+    delete m_notifier4;
+    m_notifier4 = NULL;
+    delete m_notifier6;
+    m_notifier6 = NULL;
+
+    if (m_sock4 >= 0)
+    {
+        close(m_sock4);
+        m_sock4 = -1;
+    }
+
+    if (m_sock6 >= 0)
+    {
+        close(m_sock6);
+        m_sock6 = -1;
+    }
+}
+
+int PingSweep::initSocket(int family)
+{
+    int n = 1;
+    int sock = -1;
+
+    if (definition->type == ping::Icmp)
+    {
+        sock = socket(family, SOCK_DGRAM, family == AF_INET6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP);
+    }
+    else
+    {
+        sock = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    }
+
+    if (sock < 0)
+    {
+        LOG_ERROR(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return -1;
+    }
+
+    if ((family == AF_INET && setsockopt(sock, SOL_IP, IP_RECVERR, &n, sizeof(n)) < 0) ||
+        (family == AF_INET6 && setsockopt(sock, IPPROTO_IPV6, IPV6_RECVERR, &n, sizeof(n)) < 0))
+    {
+        LOG_ERROR(QString("setsockopt RECVERR: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        close(sock);
+        return -1;
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &n, sizeof(n)) < 0)
+    {
+        LOG_ERROR(QString("setsockopt SO_TIMESTAMPNS: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        close(sock);
+        return -1;
+    }
+
+    // a whole round may arrive at once, make sure it fits
+    n = 256 * 1024;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n)) < 0)
+    {
+        LOG_DEBUG(QString("setsockopt SO_RCVBUF: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+    }
+
+    return sock;
+}
+
+Result PingSweep::result() const
+{
+    QVariantList targets;
+
+    foreach (const Target &target, m_targets)
+    {
+        QVariantMap res;
+        QVariantList roundTripMs;
+        quint32 sent = 0;
+        qreal min = 0.0, max = 0.0, sum = 0.0, sq_sum = 0.0;
+
+        res.insert("host", target.host);
+
+        if (!target.errorString.isEmpty())
+        {
+            res.insert("error", target.errorString);
+            targets << res;
+            continue;
+        }
+
+        foreach (const PingProbe &probe, target.probes)
+        {
+            if (probe.sendTimeNs > 0)
+            {
+                sent++;
+            }
+
+            if (probe.replies > 0 && probe.recvTimeNs > probe.sendTimeNs)
+            {
+                qreal rtt = (probe.recvTimeNs - probe.sendTimeNs) / 1000000.;
+
+                min = roundTripMs.isEmpty() ? rtt : qMin(min, rtt);
+                max = qMax(max, rtt);
+                sum += rtt;
+                sq_sum += rtt * rtt;
+                roundTripMs << rtt;
+            }
+        }
+
+        qreal avg = roundTripMs.isEmpty() ? 0.0 : sum / roundTripMs.size();
+
+        res.insert("destination_ip", QHostAddress(&target.address.sa).toString());
+        res.insert("round_trip_ms", roundTripMs);
+        res.insert("round_trip_avg", avg);
+        res.insert("round_trip_min", min);
+        res.insert("round_trip_max", max);
+        res.insert("round_trip_stdev", roundTripMs.isEmpty() ? 0.0 : qSqrt(qMax(0.0, sq_sum / roundTripMs.size() - avg * avg)));
+        res.insert("round_trip_sent", sent);
+        res.insert("round_trip_received", target.received);
+        res.insert("round_trip_duplicates", target.duplicates);
+        res.insert("round_trip_loss", sent > 0 ? (sent - target.received) / static_cast<float>(sent) : 0);
+
+        targets << res;
+    }
+
+    QVariantMap map;
+    map.insert("targets", targets);
+    map.insert("resolve_ms", m_resolveTime);
+
+    return Result(map);
+}
+
+quint32 PingSweep::estimateTraffic() const
+{
+    // Ethernet + IPv6 header (worst case) + ICMP/UDP header + payload,
+    // request and response
+    quint32 est = 2 * (14 + 40 + 8 + definition->payload);
+
+    return est * definition->count * definition->hosts.size();
+}
@@ -0,0 +1,84 @@
+#ifndef PINGSWEEP_H
+#define PINGSWEEP_H
+
+#include <QHostInfo>
+#include <QVector>
+#include <QMap>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+
+#include "../measurement.h"
+#include "../ping/ping.h"
+#include "pingsweep_definition.h"
+
+/*
+ * Pings a list of targets at once. All targets share one socket per address
+ * family, replies are demultiplexed by the target index and sequence number
+ * carried in every probe payload.
+ */
+class PingSweep : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit PingSweep(QObject *parent = 0);
+    ~PingSweep();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+private:
+    struct Target
+    {
+        QString host;
+        sockaddr_any address;
+        QString errorString;
+        QVector<PingProbe> probes;
+        int slot;
+        quint32 received;
+        quint32 duplicates;
+    };
+
+    void setStatus(Status status);
+    quint32 estimateTraffic() const;
+    int initSocket(int family);
+    void startProbing();
+    void sendProbes();
+    void readReplies(int sock);
+    bool receiveData(int sock, int flags);
+    void checkTimeouts();
+    void scheduleTimeout();
+    void checkFinished();
+    void closeSockets();
+
+    PingSweepDefinitionPtr definition;
+    Status currentStatus;
+    QVector<Target> m_targets;
+    QVector<int> m_slots; // resolved targets in send order
+    QHash<int, int> m_lookups; // lookup id -> target index
+    QMap<quint32, int> m_outstanding; // probe number -> target index
+    quint32 m_nextProbe;
+    quint16 m_magic;
+    int m_sock4;
+    int m_sock6;
+    QSocketNotifier *m_notifier4;
+    QSocketNotifier *m_notifier6;
+    QTimer m_sendTimer;
+    QTimer m_timeoutTimer;
+    QElapsedTimer m_clock;
+    qint64 m_resolveTime;
+
+signals:
+    void statusChanged(Status status);
+
+private slots:
+    void lookedUp(const QHostInfo &info);
+};
+
+#endif // PINGSWEEP_H
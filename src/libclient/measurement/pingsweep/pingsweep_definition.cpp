@@ -0,0 +1,41 @@
+#include "pingsweep_definition.h"
+
+PingSweepDefinition::PingSweepDefinition(const QStringList &hosts, const quint32 &count, const quint32 &interval,
+                                         const quint32 &receiveTimeout, const quint32 &payload,
+                                         const ping::PingType &type)
+: hosts(hosts)
+, count(count)
+, interval(interval)
+, receiveTimeout(receiveTimeout)
+, payload(payload)
+, type(type)
+{
+}
+
+PingSweepDefinition::~PingSweepDefinition()
+{
+}
+
+PingSweepDefinitionPtr PingSweepDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    return PingSweepDefinitionPtr(new PingSweepDefinition(map.value("hosts").toStringList(),
+                                                          map.value("count", 3).toUInt(),
+                                                          map.value("interval", 1000).toUInt(),
+                                                          map.value("timeout", 1000).toUInt(),
+                                                          map.value("payload", 56).toUInt(),
+                                                          pingTypeFromString(map.value(
+                                                                                 "type", "Icmp").toString())));
+}
+
+QVariant PingSweepDefinition::toVariant() const
+{
+    QVariantMap map;
+    map.insert("hosts", hosts);
+    map.insert("count", count);
+    map.insert("interval", interval);
+    map.insert("timeout", receiveTimeout);
+    map.insert("payload", payload);
+    map.insert("type", pingTypeToString(type));
+    return map;
+}
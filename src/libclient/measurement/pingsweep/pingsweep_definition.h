@@ -0,0 +1,36 @@
+#ifndef PINGSWEEP_DEFINITION_H
+#define PINGSWEEP_DEFINITION_H
+
+#include "../measurementdefinition.h"
+#include "../../types.h"
+
+#include <QStringList>
+
+class PingSweepDefinition;
+
+typedef QSharedPointer<PingSweepDefinition> PingSweepDefinitionPtr;
+typedef QList<PingSweepDefinitionPtr> PingSweepDefinitionList;
+
+class CLIENT_API PingSweepDefinition : public MeasurementDefinition
+{
+public:
+    PingSweepDefinition(const QStringList &hosts, const quint32 &count, const quint32 &interval,
+                        const quint32 &receiveTimeout, const quint32 &payload, const ping::PingType &type);
+    ~PingSweepDefinition();
+
+    // Storage
+    static PingSweepDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getters
+    QStringList hosts;
+    quint32 count;
+    quint32 interval;
+    quint32 receiveTimeout;
+    quint32 payload;
+    ping::PingType type;
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // PINGSWEEP_DEFINITION_H
@@ -0,0 +1,21 @@
+#include "pingsweep_plugin.h"
+#include "pingsweep.h"
+#include "pingsweep_definition.h"
+
+QStringList PingSweepPlugin::measurements() const
+{
+    return QStringList()
+           << "ping_sweep";
+}
+
+MeasurementPtr PingSweepPlugin::createMeasurement(const QString &name)
+{
+    Q_UNUSED(name);
+    return MeasurementPtr(new PingSweep);
+}
+
+MeasurementDefinitionPtr PingSweepPlugin::createMeasurementDefinition(const QString &name, const QVariant &data)
+{
+    Q_UNUSED(name);
+    return PingSweepDefinition::fromVariant(data);
+}
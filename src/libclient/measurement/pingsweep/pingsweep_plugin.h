@@ -0,0 +1,18 @@
+#ifndef PINGSWEEP_PLUGIN_H
+#define PINGSWEEP_PLUGIN_H
+
+#include "../measurement.h"
+#include "../measurementdefinition.h"
+#include "../measurementplugin.h"
+
+class PingSweepPlugin : public MeasurementPlugin
+{
+public:
+    // MeasurementPlugin interface
+    QStringList measurements() const;
+
+    MeasurementPtr createMeasurement(const QString &name);
+    MeasurementDefinitionPtr createMeasurementDefinition(const QString &name, const QVariant &data);
+};
+
+#endif // PINGSWEEP_PLUGIN_H
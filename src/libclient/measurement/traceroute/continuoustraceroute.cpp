@@ -0,0 +1,342 @@
+#include "continuoustraceroute.h"
+#include "udpprober.h"
+#include "../../log/logger.h"
+#include "../../client.h"
+#include "../../trafficbudgetmanager.h"
+
+#include <arpa/inet.h>
+#include <QHostAddress>
+#include <QtMath>
+#include <QtGlobal>
+
+LOGGER(ContinuousTraceroute);
+
+ContinuousTraceroute::ContinuousTraceroute(QObject *parent)
+: Measurement(parent)
+, currentStatus(Unknown)
+, m_discovery(new Traceroute(this))
+, m_prober(new UdpProber(this))
+, m_destAddress()
+, m_rounds(0)
+{
+    m_snapshotTimer.setTimerType(Qt::PreciseTimer);
+    m_durationTimer.setSingleShot(true);
+
+    // its traffic is part of our estimate
+    m_discovery->setAccountTraffic(false);
+
+    connect(m_discovery, &Measurement::finished, this, &ContinuousTraceroute::discoveryFinished);
+    // queued, the discovery is still emitting when we get deleted
+    connect(m_discovery, &Measurement::error, this, &Measurement::error, Qt::QueuedConnection);
+    connect(m_prober, &UdpProber::response, this, &ContinuousTraceroute::probeResponse);
+    connect(&m_roundTimer, &QTimer::timeout, this, &ContinuousTraceroute::sendRound);
+    connect(&m_snapshotTimer, &QTimer::timeout, this, &ContinuousTraceroute::takeSnapshot);
+    connect(&m_durationTimer, &QTimer::timeout, this, &ContinuousTraceroute::finishRounds);
+}
+
+ContinuousTraceroute::~ContinuousTraceroute()
+{
+}
+
+Measurement::Status ContinuousTraceroute::status() const
+{
+    return currentStatus;
+}
+
+void ContinuousTraceroute::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+bool ContinuousTraceroute::prepare(NetworkManager *networkManager,
+                                   const MeasurementDefinitionPtr &measurementDefinition)
+{
+    definition = measurementDefinition.dynamicCast<ContinuousTracerouteDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("Definition is empty");
+        return false;
+    }
+
+    if (definition->interval == 0 || definition->duration == 0 || definition->historySize == 0 ||
+        definition->snapshotInterval == 0)
+    {
+        setErrorString("interval, duration, history_size and snapshot_interval must not be 0");
+        return false;
+    }
+
+    if (definition->historySize > 65535)
+    {
+        setErrorString("history_size is too large (> 65535)");
+        return false;
+    }
+
+    // checks the remaining parameters and chooses the ports for both of us
+    if (!m_discovery->prepare(networkManager, measurementDefinition))
+    {
+        setErrorString(m_discovery->errorString());
+        return false;
+    }
+
+    if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(estimateTraffic()))
+    {
+        setErrorString("not enough traffic available");
+        return false;
+    }
+
+    return true;
+}
+
+bool ContinuousTraceroute::start()
+{
+    m_hops.clear();
+    m_probeIds.clear();
+    m_rounds = 0;
+
+    setStatus(ContinuousTraceroute::Running);
+
+    if (!m_discovery->start())
+    {
+        setErrorString(m_discovery->errorString());
+        return false;
+    }
+
+    return true;
+}
+
+bool ContinuousTraceroute::stop()
+{
+    m_discovery->stop();
+    m_roundTimer.stop();
+    m_snapshotTimer.stop();
+    m_durationTimer.stop();
+    m_prober->close();
+    return true;
+}
+
+quint32 ContinuousTraceroute::estimateTraffic() const
+{
+    // the discovery, then one UDP probe and its ICMP response per hop and
+    // round
+    quint32 est = 2 * 14 + 2 * (8 + definition->payload);
+
+    // the host is not resolved yet, IPv6 has the larger headers
+    est += 2 * 40 + 56;
+
+    return m_discovery->estimateTraffic() +
+           est * definition->maxTtl * (definition->duration / definition->interval + 1);
+}
+
+void ContinuousTraceroute::discoveryFinished()
+{
+    QVariantMap route = m_discovery->result().probeResult();
+    QVariantList hops = route.value("results").toList();
+
+    // the discovery resolved the host, with the port already set
+    m_destAddress = m_discovery->destination();
+    m_discovery->stop();
+
+    // errors are queued, the discovery is still emitting its finished()
+    if (hops.isEmpty())
+    {
+        setStatus(ContinuousTraceroute::Error);
+        QMetaObject::invokeMethod(this, "error", Qt::QueuedConnection,
+                                  Q_ARG(QString, "path discovery found no hops"));
+        return;
+    }
+
+    HopHistory history;
+    history.rtts.fill(pending, definition->historySize);
+    history.sent = 0;
+    history.received = 0;
+
+    m_hops.fill(history, hops.size());
+
+    for (int i = 0; i < hops.size(); i++)
+    {
+        m_hops[i].address = hops[i].toMap().value("hop").toString();
+    }
+
+    if (!m_prober->open(m_destAddress.sa.sa_family, definition->sourcePort, definition->payload,
+                        definition->receiveTimeout))
+    {
+        setStatus(ContinuousTraceroute::Error);
+        QMetaObject::invokeMethod(this, "error", Qt::QueuedConnection,
+                                  Q_ARG(QString, "could not open probe socket"));
+        return;
+    }
+
+    m_clock.start();
+    m_roundTimer.start(definition->interval);
+    m_snapshotTimer.start(definition->snapshotInterval);
+    m_durationTimer.start(definition->duration);
+
+    sendRound();
+}
+
+void ContinuousTraceroute::sendRound()
+{
+    m_rounds++;
+
+    // the round's slot, whenever the responses arrive
+    int slot = (m_rounds - 1) % definition->historySize;
+
+    for (int ttl = 1; ttl <= m_hops.size(); ttl++)
+    {
+        HopHistory &hop = m_hops[ttl - 1];
+
+        // the same port per TTL as during the discovery
+        sockaddr_any destination = m_destAddress;
+        UdpProber::setPort(&destination, definition->destinationPort + ttl - 1);
+
+        int id = m_prober->send(destination, ttl);
+
+        hop.sent++;
+
+        if (id < 0)
+        {
+            // counts as lost
+            hop.rtts[slot] = -1;
+            continue;
+        }
+
+        hop.rtts[slot] = pending;
+        m_probeIds.insert(id, qMakePair(ttl, m_rounds));
+    }
+}
+
+void ContinuousTraceroute::probeResponse(int id, const PingProbe &probe, traceroute::Response response)
+{
+    if (!m_probeIds.contains(id))
+    {
+        return;
+    }
+
+    QPair<int, quint32> position = m_probeIds.take(id);
+    HopHistory &hop = m_hops[position.first - 1];
+    // the slot is reused once the history has wrapped around
+    bool current = position.second + definition->historySize > m_rounds;
+    int slot = (position.second - 1) % definition->historySize;
+
+    if (response == traceroute::TIMEOUT)
+    {
+        if (current)
+        {
+            hop.rtts[slot] = -1;
+        }
+    }
+    else
+    {
+        // keep the interface which answered last, routes may change
+        hop.address = QHostAddress(&probe.source.sa).toString();
+        hop.received++;
+
+        if (current)
+        {
+            hop.rtts[slot] = (qint32)((probe.recvTimeNs - probe.sendTimeNs) / 1000);
+        }
+    }
+}
+
+QVariantMap ContinuousTraceroute::snapshot() const
+{
+    QVariantList hops;
+
+    for (int i = 0; i < m_hops.size(); i++)
+    {
+        const HopHistory &history = m_hops[i];
+        quint32 size = history.rtts.size();
+        qint32 min = 0, max = 0, previous = -1;
+        qreal sum = 0.0, sqSum = 0.0, jitter = 0.0;
+        int samples = 0, received = 0, differences = 0;
+
+        // the last rounds in the order they were sent, those still waiting
+        // for a response are left out
+        for (quint32 round = m_rounds > size ? m_rounds - size + 1 : 1; round <= m_rounds; round++)
+        {
+            qint32 rtt = history.rtts[(round - 1) % size];
+
+            if (rtt == pending)
+            {
+                continue;
+            }
+
+            samples++;
+
+            if (rtt < 0)
+            {
+                continue;
+            }
+
+            min = received ? qMin(min, rtt) : rtt;
+            max = qMax(max, rtt);
+            sum += rtt;
+            sqSum += (qreal)rtt * rtt;
+            received++;
+
+            // mean difference between consecutive answered probes
+            if (previous >= 0)
+            {
+                jitter += qAbs(rtt - previous);
+                differences++;
+            }
+
+            previous = rtt;
+        }
+
+        qreal avg = received ? sum / received : 0.0;
+
+        QVariantMap hop;
+        hop.insert("ttl", i + 1);
+        hop.insert("hop", history.address);
+        hop.insert("sent", history.sent);
+        hop.insert("received", history.received);
+        hop.insert("samples", samples);
+        hop.insert("loss", samples ? 100.0 * (samples - received) / samples : 0.0);
+        hop.insert("rtt_min", min);
+        hop.insert("rtt_max", max);
+        hop.insert("rtt_avg", avg);
+        hop.insert("rtt_stdev", received ? qSqrt(qMax(0.0, sqSum / received - avg * avg)) : 0.0);
+        hop.insert("jitter", differences ? jitter / differences : 0.0);
+        hops << hop;
+    }
+
+    QVariantMap map;
+    map.insert("round", m_rounds);
+    map.insert("elapsed", m_clock.isValid() ? m_clock.elapsed() : 0);
+    map.insert("hops", hops);
+
+    return map;
+}
+
+void ContinuousTraceroute::takeSnapshot()
+{
+    // reported right away, the run may take a long time
+    emit resultAvailable(result());
+}
+
+void ContinuousTraceroute::finishRounds()
+{
+    m_roundTimer.stop();
+    m_snapshotTimer.stop();
+    m_prober->close();
+    m_probeIds.clear();
+
+    setStatus(ContinuousTraceroute::Finished);
+    emit finished();
+}
+
+Result ContinuousTraceroute::result() const
+{
+    QVariantMap map;
+    map.insert("hop_count", m_hops.size());
+    map.insert("rounds", m_rounds);
+    map.insert("snapshot", snapshot());
+
+    return Result(map, definition->measurementUuid);
+}
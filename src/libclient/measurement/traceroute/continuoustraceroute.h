@@ -0,0 +1,79 @@
+#ifndef CONTINUOUSTRACEROUTE_H
+#define CONTINUOUSTRACEROUTE_H
+
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "../measurement.h"
+#include "traceroute.h"
+#include "continuoustraceroute_definition.h"
+
+class UdpProber;
+
+/*
+ * MTR-like traceroute: the path is discovered once by a regular Traceroute,
+ * afterwards every known hop gets one probe per round. The last
+ * 'historySize' probes of each hop are kept in a ring buffer from which
+ * loss, RTT and jitter are computed for the periodic snapshots. Each
+ * snapshot is reported as an intermediate result, the final result is the
+ * last one.
+ */
+class ContinuousTraceroute : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit ContinuousTraceroute(QObject *parent = 0);
+    ~ContinuousTraceroute();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager,
+                 const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+    QVariantMap snapshot() const;
+
+signals:
+    void statusChanged(Status status);
+
+private:
+    struct HopHistory
+    {
+        QString address;
+        QVector<qint32> rtts; // us, -1 if lost, slot is (round - 1) % historySize
+        quint32 sent;
+        quint32 received;
+    };
+
+    // no response yet
+    enum { pending = -2 };
+
+    void setStatus(Status status);
+    quint32 estimateTraffic() const;
+    void discoveryFinished();
+    void sendRound();
+    void probeResponse(int id, const PingProbe &probe, traceroute::Response response);
+    void takeSnapshot();
+    void finishRounds();
+
+    ContinuousTracerouteDefinitionPtr definition;
+    Status currentStatus;
+    Traceroute *m_discovery;
+    UdpProber *m_prober;
+    sockaddr_any m_destAddress;
+    QVector<HopHistory> m_hops; // index is ttl - 1
+    QHash<int, QPair<int, quint32> > m_probeIds; // probe id -> ttl, round
+    quint32 m_rounds;
+    QTimer m_roundTimer;
+    QTimer m_snapshotTimer;
+    QTimer m_durationTimer;
+    QElapsedTimer m_clock;
+};
+
+#endif // CONTINUOUSTRACEROUTE_H
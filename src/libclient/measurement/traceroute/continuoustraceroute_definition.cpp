@@ -0,0 +1,35 @@
+#include "continuoustraceroute_definition.h"
+
+ContinuousTracerouteDefinition::ContinuousTracerouteDefinition(const TracerouteDefinition &traceroute,
+                                                               const quint32 &duration,
+                                                               const quint32 &historySize,
+                                                               const quint32 &snapshotInterval)
+: TracerouteDefinition(traceroute)
+, duration(duration)
+, historySize(historySize)
+, snapshotInterval(snapshotInterval)
+{
+}
+
+ContinuousTracerouteDefinition::~ContinuousTracerouteDefinition()
+{
+}
+
+ContinuousTracerouteDefinitionPtr ContinuousTracerouteDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    return ContinuousTracerouteDefinitionPtr(new ContinuousTracerouteDefinition(
+                                                 *TracerouteDefinition::fromVariant(variant),
+                                                 map.value("duration", 60000).toUInt(),
+                                                 map.value("history_size", 100).toUInt(),
+                                                 map.value("snapshot_interval", 10000).toUInt()));
+}
+
+QVariant ContinuousTracerouteDefinition::toVariant() const
+{
+    QVariantMap map = TracerouteDefinition::toVariant().toMap();
+    map.insert("duration", duration);
+    map.insert("history_size", historySize);
+    map.insert("snapshot_interval", snapshotInterval);
+    return map;
+}
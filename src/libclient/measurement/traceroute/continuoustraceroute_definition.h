@@ -0,0 +1,30 @@
+#ifndef CONTINUOUSTRACEROUTE_DEFINITION_H
+#define CONTINUOUSTRACEROUTE_DEFINITION_H
+
+#include "traceroute_definition.h"
+
+class ContinuousTracerouteDefinition;
+
+typedef QSharedPointer<ContinuousTracerouteDefinition> ContinuousTracerouteDefinitionPtr;
+
+// the path is discovered with the plain traceroute parameters
+class ContinuousTracerouteDefinition : public TracerouteDefinition
+{
+public:
+    ContinuousTracerouteDefinition(const TracerouteDefinition &traceroute, const quint32 &duration,
+                                   const quint32 &historySize, const quint32 &snapshotInterval);
+    ~ContinuousTracerouteDefinition();
+
+    // Storage
+    static ContinuousTracerouteDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getter
+    quint32 duration; // run time in ms, rounds are 'interval' apart
+    quint32 historySize; // probes per hop kept for the statistics
+    quint32 snapshotInterval; // ms between snapshots
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // CONTINUOUSTRACEROUTE_DEFINITION_H
@@ -0,0 +1,548 @@
+#include "multipathtraceroute.h"
+#include "udpprober.h"
+#include "../../log/logger.h"
+#include "../../client.h"
+#include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <QDateTime>
+#include <QHostAddress>
+#include <QMap>
+#include <QtGlobal>
+
+LOGGER(MultipathTraceroute);
+
+namespace
+{
+    /*
+     * Flows to send to a hop with k interfaces seen so far so that a k+1st
+     * one would have shown up with a probability of 95% (Veitch et al.,
+     * "Failure control in multipath route tracing").
+     */
+    const int stoppingPoints[] = {6, 11, 16, 21, 27, 33, 38, 44, 51, 57, 63, 70, 76, 83, 90, 96};
+    const int stoppingPointCount = sizeof(stoppingPoints) / sizeof(stoppingPoints[0]);
+
+    QString hopAddress(const Hop &hop)
+    {
+        if (hop.response == traceroute::TIMEOUT)
+        {
+            return QString();
+        }
+
+        return QHostAddress(&hop.probe.source.sa).toString();
+    }
+}
+
+MultipathTraceroute::MultipathTraceroute(QObject *parent)
+: Measurement(parent)
+, currentStatus(Unknown)
+, m_prober(new UdpProber(this))
+, m_destAddress()
+, m_nextTtl(0)
+, m_openTtls(0)
+, m_completedTtls(0)
+, m_lastTtl(0)
+, m_reached(false)
+, m_probesSent(0)
+, m_nextSend(0)
+{
+    m_sendTimer.setSingleShot(true);
+    m_sendTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(m_prober, &UdpProber::response, this, &MultipathTraceroute::probeResponse);
+    connect(&m_sendTimer, &QTimer::timeout, this, &MultipathTraceroute::sendProbes);
+}
+
+MultipathTraceroute::~MultipathTraceroute()
+{
+}
+
+Measurement::Status MultipathTraceroute::status() const
+{
+    return currentStatus;
+}
+
+void MultipathTraceroute::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+bool MultipathTraceroute::prepare(NetworkManager *networkManager,
+                                  const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager);
+    definition = measurementDefinition.dynamicCast<MultipathTracerouteDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("Definition is empty");
+        return false;
+    }
+
+    if (definition->type != ping::Udp)
+    {
+        setErrorString("Ping type not supported");
+        return false;
+    }
+
+    if (definition->maxTtl == 0 || definition->window == 0 || definition->flows == 0 ||
+        definition->probeRate == 0)
+    {
+        setErrorString("max_ttl, window, flows and probe_rate must not be 0");
+        return false;
+    }
+
+    if (definition->maxTtl > 255)
+    {
+        setErrorString("max_ttl is too large (> 255)");
+        return false;
+    }
+
+    if (definition->payload > 1400)
+    {
+        setErrorString("payload is too large (> 1400 bytes)");
+        return false;
+    }
+
+    if (definition->flows > 65535)
+    {
+        setErrorString("flows is too large (> 65535)");
+        return false;
+    }
+
+    // flows are told apart by their destination port
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    if (definition->destinationPort == 0 && definition->flows < 64512)
+    {
+        definition->destinationPort = (qrand() % (64512 - definition->flows)) + 1024;
+    }
+
+    if (definition->sourcePort == 0)
+    {
+        definition->sourcePort = (qrand() % 64511) + 1024; // range 1024 - 65535
+    }
+
+    if (definition->destinationPort == 0 ||
+        (quint32)definition->destinationPort + definition->flows - 1 > 65535)
+    {
+        setErrorString("destination_port + flows exceeds the port range");
+        return false;
+    }
+
+    // resolved by start() so DNS does not block the executor
+    memset(&m_destAddress, 0, sizeof(m_destAddress));
+
+    if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(estimateTraffic()))
+    {
+        setErrorString("not enough traffic available");
+        return false;
+    }
+
+    return true;
+}
+
+bool MultipathTraceroute::start()
+{
+    setStatus(MultipathTraceroute::Running);
+
+    Client::instance()->resolver()->lookupHost(definition->host, this, SLOT(hostResolved(QHostInfo)));
+
+    return true;
+}
+
+void MultipathTraceroute::hostResolved(const QHostInfo &info)
+{
+    if (currentStatus != MultipathTraceroute::Running)
+    {
+        return;
+    }
+
+    if (!UdpProber::firstAddress(info, &m_destAddress))
+    {
+        setStatus(MultipathTraceroute::Error);
+        emit error(QString("could not resolve hostname '%1'").arg(definition->host));
+        return;
+    }
+
+    if (!m_prober->open(m_destAddress.sa.sa_family, definition->sourcePort, definition->payload,
+                        definition->receiveTimeout))
+    {
+        setStatus(MultipathTraceroute::Error);
+        emit error("could not open probe socket");
+        return;
+    }
+
+    TtlState state;
+    state.done = 0;
+    state.complete = false;
+
+    m_ttls.fill(state, definition->maxTtl);
+    m_queue.clear();
+    m_probeIds.clear();
+    m_nextTtl = 0;
+    m_openTtls = 0;
+    m_completedTtls = 0;
+    m_lastTtl = definition->maxTtl;
+    m_reached = false;
+    m_probesSent = 0;
+    m_nextSend = 0;
+    m_clock.start();
+
+    openTtls();
+    sendProbes();
+}
+
+bool MultipathTraceroute::stop()
+{
+    if (currentStatus == MultipathTraceroute::Running)
+    {
+        setStatus(MultipathTraceroute::Finished);
+    }
+
+    m_sendTimer.stop();
+    m_prober->close();
+    return true;
+}
+
+quint32 MultipathTraceroute::estimateTraffic() const
+{
+    // a UDP probe and its ICMP response, for the worst case of all flows
+    // on all hops
+    quint32 est = 2 * 14 + 2 * (8 + definition->payload);
+
+    // the host is not resolved yet, IPv6 has the larger headers
+    est += 2 * 40 + 56;
+
+    return est * definition->flows * definition->maxTtl;
+}
+
+int MultipathTraceroute::flowsNeeded(int interfaces) const
+{
+    int needed = stoppingPoints[qBound(0, interfaces - 1, stoppingPointCount - 1)];
+
+    return qMin(needed, (int)definition->flows);
+}
+
+QStringList MultipathTraceroute::interfaces(int ttl) const
+{
+    QStringList addresses;
+
+    foreach (const Hop &hop, m_ttls[ttl - 1].hops)
+    {
+        QString address = hopAddress(hop);
+
+        if (!address.isEmpty() && !addresses.contains(address))
+        {
+            addresses << address;
+        }
+    }
+
+    return addresses;
+}
+
+void MultipathTraceroute::openTtls()
+{
+    while (currentStatus == MultipathTraceroute::Running && m_openTtls < (int)definition->window &&
+           m_nextTtl < m_lastTtl)
+    {
+        m_nextTtl++;
+        m_openTtls++;
+        requestFlows(m_nextTtl, flowsNeeded(1));
+    }
+}
+
+void MultipathTraceroute::requestFlows(int ttl, int flows)
+{
+    TtlState &state = m_ttls[ttl - 1];
+    Hop hop = {PingProbe(), traceroute::TIMEOUT};
+
+    for (int flow = state.hops.size(); flow < flows; flow++)
+    {
+        state.hops.append(hop);
+        m_queue.append(qMakePair(ttl, flow));
+    }
+
+    // an active timer already waits for the next deadline
+    if (!m_sendTimer.isActive())
+    {
+        scheduleSend();
+    }
+}
+
+void MultipathTraceroute::scheduleSend()
+{
+    if (currentStatus != MultipathTraceroute::Running || m_queue.isEmpty())
+    {
+        m_sendTimer.stop();
+        return;
+    }
+
+    qint64 wait = m_nextSend - m_clock.nsecsElapsed();
+
+    // round up, sending early would exceed the rate
+    m_sendTimer.start(wait > 0 ? (int)((wait + 999999) / 1000000) : 0);
+}
+
+void MultipathTraceroute::sendProbes()
+{
+    // probes follow a schedule of deadlines, so the rate does not depend on
+    // the timer granularity; several probes are due per timeout above
+    // 1000 pps
+    qint64 gap = qMax(Q_INT64_C(1), Q_INT64_C(1000000000) / definition->probeRate);
+    qint64 now = m_clock.nsecsElapsed();
+
+    while (currentStatus == MultipathTraceroute::Running && !m_queue.isEmpty() && m_nextSend <= now)
+    {
+        QPair<int, int> probe = m_queue.takeFirst();
+
+        // hops beyond the destination are not needed anymore
+        if (probe.first > m_lastTtl)
+        {
+            continue;
+        }
+
+        m_nextSend += gap;
+
+        sockaddr_any destination = m_destAddress;
+        quint16 port = definition->destinationPort + probe.second;
+
+        UdpProber::setPort(&destination, port);
+
+        int id = m_prober->send(destination, probe.first);
+
+        if (id < 0)
+        {
+            // counts as lost
+            Hop hop = {PingProbe(), traceroute::TIMEOUT};
+            probeDone(probe.first, probe.second, hop);
+            continue;
+        }
+
+        m_probeIds.insert(id, probe);
+        m_probesSent++;
+    }
+
+    // no credit is saved up while waiting for responses
+    if (m_queue.isEmpty() && m_nextSend < now)
+    {
+        m_nextSend = now;
+    }
+
+    scheduleSend();
+}
+
+void MultipathTraceroute::probeResponse(int id, const PingProbe &probe, traceroute::Response response)
+{
+    if (!m_probeIds.contains(id))
+    {
+        return;
+    }
+
+    QPair<int, int> position = m_probeIds.take(id);
+    Hop hop = {probe, response};
+
+    probeDone(position.first, position.second, hop);
+}
+
+void MultipathTraceroute::probeDone(int ttl, int flow, const Hop &hop)
+{
+    TtlState &state = m_ttls[ttl - 1];
+
+    state.hops[flow] = hop;
+    state.done++;
+
+    if (state.done == state.hops.size())
+    {
+        ttlDone(ttl);
+    }
+}
+
+void MultipathTraceroute::ttlDone(int ttl)
+{
+    TtlState &state = m_ttls[ttl - 1];
+    int needed = flowsNeeded(interfaces(ttl).size());
+
+    // every new interface raises the number of flows to send
+    if (state.hops.size() < needed)
+    {
+        requestFlows(ttl, needed);
+        return;
+    }
+
+    bool exceeded = false;
+    bool reached = false;
+
+    foreach (const Hop &hop, state.hops)
+    {
+        exceeded |= hop.response == traceroute::TTL_EXCEEDED;
+        reached |= hop.response == traceroute::UDP_RESPONSE ||
+                   hop.response == traceroute::DESTINATION_UNREACHABLE;
+    }
+
+    // paths of different lengths reach the host over several hops, the
+    // route ends where no flow is forwarded any further
+    if (reached && !exceeded)
+    {
+        m_reached = true;
+        m_lastTtl = qMin(m_lastTtl, ttl);
+    }
+
+    state.complete = true;
+    m_openTtls--;
+
+    ttlCompleted();
+    openTtls();
+}
+
+void MultipathTraceroute::ttlCompleted()
+{
+    if (currentStatus != MultipathTraceroute::Running)
+    {
+        return;
+    }
+
+    while (m_completedTtls < m_lastTtl && m_ttls[m_completedTtls].complete)
+    {
+        m_completedTtls++;
+
+        int silent = 0;
+
+        for (int t = m_completedTtls; t > 0 && silent < (int)definition->maxSilentHops; t--, silent++)
+        {
+            if (!interfaces(t).isEmpty())
+            {
+                break;
+            }
+        }
+
+        if (definition->maxSilentHops > 0 && silent >= (int)definition->maxSilentHops)
+        {
+            m_lastTtl = m_completedTtls;
+        }
+    }
+
+    if (m_completedTtls >= m_lastTtl)
+    {
+        finishRoute();
+    }
+}
+
+void MultipathTraceroute::finishRoute()
+{
+    m_sendTimer.stop();
+    m_prober->close();
+    m_queue.clear();
+    m_probeIds.clear();
+
+    setStatus(MultipathTraceroute::Finished);
+
+    // we are called from within the prober, let it unwind before the
+    // executor deletes us
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+Result MultipathTraceroute::result() const
+{
+    QVariantList hops;
+    QVariantList links;
+    QVector<QStringList> addresses(m_lastTtl);
+    int width = 0;
+
+    for (int t = 1; t <= m_lastTtl && t <= m_ttls.size(); t++)
+    {
+        const TtlState &state = m_ttls[t - 1];
+        QVariantList ifaces;
+        int lost = 0;
+
+        addresses[t - 1] = interfaces(t);
+        width = qMax(width, addresses[t - 1].size());
+
+        foreach (const QString &address, addresses[t - 1])
+        {
+            quint64 min = 0, max = 0, sum = 0;
+            int flows = 0;
+
+            foreach (const Hop &hop, state.hops)
+            {
+                if (hopAddress(hop) != address)
+                {
+                    continue;
+                }
+
+                quint64 rtt = hop.probe.recvTime - hop.probe.sendTime;
+
+                min = flows ? qMin(min, rtt) : rtt;
+                max = qMax(max, rtt);
+                sum += rtt;
+                flows++;
+            }
+
+            QVariantMap iface;
+            iface.insert("address", address);
+            iface.insert("flows", flows);
+            iface.insert("rtt_min", min);
+            iface.insert("rtt_max", max);
+            iface.insert("rtt_avg", (qreal)sum / flows);
+            ifaces << iface;
+        }
+
+        foreach (const Hop &hop, state.hops)
+        {
+            lost += hop.response == traceroute::TIMEOUT;
+        }
+
+        QVariantMap hop;
+        hop.insert("ttl", t);
+        hop.insert("flows", state.hops.size());
+        hop.insert("lost", lost);
+        hop.insert("interfaces", ifaces);
+        hops << hop;
+    }
+
+    // a link is seen when a flow shows up on both of its interfaces,
+    // interfaces are referenced by their index in the hop
+    for (int t = 1; t < m_lastTtl && t < m_ttls.size(); t++)
+    {
+        const QVector<Hop> &near = m_ttls[t - 1].hops;
+        const QVector<Hop> &far = m_ttls[t].hops;
+        QMap<QPair<int, int>, int> seen;
+
+        for (int flow = 0; flow < near.size() && flow < far.size(); flow++)
+        {
+            int from = addresses[t - 1].indexOf(hopAddress(near[flow]));
+            int to = addresses[t].indexOf(hopAddress(far[flow]));
+
+            if (from >= 0 && to >= 0)
+            {
+                seen[qMakePair(from, to)]++;
+            }
+        }
+
+        for (QMap<QPair<int, int>, int>::const_iterator it = seen.constBegin(); it != seen.constEnd(); ++it)
+        {
+            QVariantMap link;
+            link.insert("ttl", t);
+            link.insert("from", it.key().first);
+            link.insert("to", it.key().second);
+            link.insert("flows", it.value());
+            links << link;
+        }
+    }
+
+    QVariantMap map;
+    map.insert("hops", hops);
+    map.insert("links", links);
+    map.insert("hop_count", hops.size());
+    map.insert("max_width", width);
+    map.insert("probes_sent", m_probesSent);
+    map.insert("reached", m_reached);
+
+    return Result(map);
+}
@@ -0,0 +1,90 @@
+#ifndef MULTIPATHTRACEROUTE_H
+#define MULTIPATHTRACEROUTE_H
+
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "../measurement.h"
+#include "traceroute.h"
+#include "multipathtraceroute_definition.h"
+
+class UdpProber;
+
+/*
+ * Paris-style traceroute which enumerates the load balanced paths to a host.
+ *
+ * Every flow keeps its five tuple for all TTLs (flow n uses the destination
+ * port destinationPort + n), so per-flow load balancers forward it the same
+ * way at each hop. All TTLs of the window are probed with several flows at
+ * once; a hop is done when enough flows have been sent to rule out another
+ * interface with 95% confidence (the MDA stopping rule), given the number
+ * of interfaces already seen there. Links between hops are derived from the
+ * flows probed at both ends.
+ */
+class MultipathTraceroute : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit MultipathTraceroute(QObject *parent = 0);
+    ~MultipathTraceroute();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager,
+                 const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+private:
+    struct TtlState
+    {
+        QVector<Hop> hops; // index is the flow
+        int done;
+        bool complete;
+    };
+
+    void setStatus(Status status);
+    quint32 estimateTraffic() const;
+    int flowsNeeded(int interfaces) const;
+    QStringList interfaces(int ttl) const;
+    void openTtls();
+    void requestFlows(int ttl, int flows);
+    void scheduleSend();
+    void sendProbes();
+    void probeResponse(int id, const PingProbe &probe, traceroute::Response response);
+    void probeDone(int ttl, int flow, const Hop &hop);
+    void ttlDone(int ttl);
+    void ttlCompleted();
+    void finishRoute();
+
+    MultipathTracerouteDefinitionPtr definition;
+    Status currentStatus;
+    UdpProber *m_prober;
+    sockaddr_any m_destAddress;
+    QVector<TtlState> m_ttls; // index is ttl - 1
+    QList<QPair<int, int> > m_queue; // ttl, flow of probes waiting to be sent
+    QHash<int, QPair<int, int> > m_probeIds; // probe id -> ttl, flow
+    int m_nextTtl;
+    int m_openTtls;
+    int m_completedTtls;
+    int m_lastTtl;
+    bool m_reached;
+    quint32 m_probesSent;
+    qint64 m_nextSend; // ns on m_clock
+    QTimer m_sendTimer;
+    QElapsedTimer m_clock;
+
+signals:
+    void statusChanged(Status status);
+
+private slots:
+    void hostResolved(const QHostInfo &info);
+};
+
+#endif // MULTIPATHTRACEROUTE_H
@@ -0,0 +1,31 @@
+#include "multipathtraceroute_definition.h"
+
+MultipathTracerouteDefinition::MultipathTracerouteDefinition(const TracerouteDefinition &traceroute,
+                                                             const quint32 &flows,
+                                                             const quint32 &probeRate)
+: TracerouteDefinition(traceroute)
+, flows(flows)
+, probeRate(probeRate)
+{
+}
+
+MultipathTracerouteDefinition::~MultipathTracerouteDefinition()
+{
+}
+
+MultipathTracerouteDefinitionPtr MultipathTracerouteDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    return MultipathTracerouteDefinitionPtr(new MultipathTracerouteDefinition(
+                                                *TracerouteDefinition::fromVariant(variant),
+                                                map.value("flows", 64).toUInt(),
+                                                map.value("probe_rate", 100).toUInt()));
+}
+
+QVariant MultipathTracerouteDefinition::toVariant() const
+{
+    QVariantMap map = TracerouteDefinition::toVariant().toMap();
+    map.insert("flows", flows);
+    map.insert("probe_rate", probeRate);
+    return map;
+}
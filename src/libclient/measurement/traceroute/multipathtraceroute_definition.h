@@ -0,0 +1,29 @@
+#ifndef MULTIPATHTRACEROUTE_DEFINITION_H
+#define MULTIPATHTRACEROUTE_DEFINITION_H
+
+#include "traceroute_definition.h"
+
+class MultipathTracerouteDefinition;
+
+typedef QSharedPointer<MultipathTracerouteDefinition> MultipathTracerouteDefinitionPtr;
+
+// count and interval of the plain traceroute are not used
+class MultipathTracerouteDefinition : public TracerouteDefinition
+{
+public:
+    MultipathTracerouteDefinition(const TracerouteDefinition &traceroute, const quint32 &flows,
+                                  const quint32 &probeRate);
+    ~MultipathTracerouteDefinition();
+
+    // Storage
+    static MultipathTracerouteDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getter
+    quint32 flows; // maximum number of flows per hop
+    quint32 probeRate; // probes per second
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // MULTIPATHTRACEROUTE_DEFINITION_H
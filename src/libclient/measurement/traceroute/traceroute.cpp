@@ -1,24 +1,45 @@
 #include "../../log/logger.h"
+#include "../../client.h"
+#include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
 #include "traceroute.h"
+#if defined(Q_OS_LINUX)
+#include "udpprober.h"
+#endif
 
 #if defined(Q_OS_LINUX) || defined(Q_OS_MAC)
 #include <arpa/inet.h>
+#include <string.h>
 #elif defined(Q_OS_WIN)
 #include <winsock2.h>
 #endif
 #include <numeric>
 #include <QtMath>
 #include <QtGlobal>
+#include <QHostAddress>
 
 LOGGER("Traceroute");
 
 Traceroute::Traceroute(QObject *parent)
 : Measurement(parent)
-, currentStatus(Unknown)
+#if defined(Q_OS_LINUX)
+, m_prober(new UdpProber(this))
+, m_accountTraffic(true)
+, m_destAddress()
+, m_openTtls(0)
+, m_completedTtls(0)
+, m_lastTtl(0)
+#else
 , m_ping()
+#endif
+, currentStatus(Unknown)
 , endOfRoute(false)
 , ttl(0)
 {
+#if defined(Q_OS_LINUX)
+    connect(m_prober, &UdpProber::response, this, &Traceroute::probeResponse);
+    connect(&m_sendTimer, &QTimer::timeout, this, &Traceroute::sendProbes);
+#endif
 }
 
 Traceroute::~Traceroute()
@@ -39,12 +60,336 @@ void Traceroute::setStatus(Status status)
     }
 }
 
+#if defined(Q_OS_LINUX)
 bool Traceroute::prepare(NetworkManager *networkManager,
                          const MeasurementDefinitionPtr &measurementDefinition)
 {
     Q_UNUSED(networkManager);
     definition = measurementDefinition.dynamicCast<TracerouteDefinition>();
 
+    if (definition.isNull())
+    {
+        setErrorString("Definition is empty");
+        return false;
+    }
+
+    if (definition->type != ping::Udp)
+    {
+        setErrorString("Ping type not supported");
+        return false;
+    }
+
+    if (definition->count == 0 || definition->maxTtl == 0 || definition->window == 0)
+    {
+        setErrorString("count, max_ttl and window must not be 0");
+        return false;
+    }
+
+    if (definition->maxTtl > 255)
+    {
+        setErrorString("max_ttl is too large (> 255)");
+        return false;
+    }
+
+    if (definition->payload > 1400)
+    {
+        setErrorString("payload is too large (> 1400 bytes)");
+        return false;
+    }
+
+    // initialize ports randomly if not given
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    if (definition->destinationPort == 0)
+    {
+        // leave room for one port per TTL
+        definition->destinationPort = (qrand() % (64512 - definition->maxTtl)) + 1024;
+    }
+
+    if (definition->sourcePort == 0)
+    {
+        definition->sourcePort = (qrand() % 64511) + 1024; // range 1024 - 65535
+    }
+
+    if (definition->destinationPort + definition->maxTtl - 1 > 65535)
+    {
+        setErrorString("destination_port + max_ttl exceeds the port range");
+        return false;
+    }
+
+    // resolved by start() so DNS does not block the executor
+    memset(&m_destAddress, 0, sizeof(m_destAddress));
+
+    if (m_accountTraffic && !Client::instance()->trafficBudgetManager()->addUsedTraffic(estimateTraffic()))
+    {
+        setErrorString("not enough traffic available");
+        return false;
+    }
+
+    return true;
+}
+
+bool Traceroute::start()
+{
+    setStatus(Traceroute::Running);
+
+    // resolve once for all hops
+    Client::instance()->resolver()->lookupHost(definition->host, this, SLOT(hostResolved(QHostInfo)));
+
+    return true;
+}
+
+sockaddr_any Traceroute::destination() const
+{
+    return m_destAddress;
+}
+
+void Traceroute::setAccountTraffic(bool account)
+{
+    m_accountTraffic = account;
+}
+
+void Traceroute::hostResolved(const QHostInfo &info)
+{
+    if (currentStatus != Traceroute::Running)
+    {
+        return;
+    }
+
+    if (!UdpProber::firstAddress(info, &m_destAddress))
+    {
+        setStatus(Traceroute::Error);
+        emit error(QString("could not resolve hostname '%1'").arg(definition->host));
+        return;
+    }
+
+    UdpProber::setPort(&m_destAddress, definition->destinationPort);
+
+    if (!m_prober->open(m_destAddress.sa.sa_family, definition->sourcePort, definition->payload,
+                        definition->receiveTimeout))
+    {
+        setStatus(Traceroute::Error);
+        emit error("could not open probe socket");
+        return;
+    }
+
+    TtlState state;
+    Hop hop = {PingProbe(), traceroute::TIMEOUT};
+    state.hops.fill(hop, definition->count);
+    state.sent = 0;
+    state.done = 0;
+
+    m_ttls.fill(state, definition->maxTtl);
+    m_probeIds.clear();
+    m_openTtls = 0;
+    m_completedTtls = 0;
+    m_lastTtl = definition->maxTtl;
+    endOfRoute = false;
+    ttl = 0;
+
+    // all TTLs of the window are probed at once, further probes of a TTL
+    // follow every interval
+    openTtls();
+
+    if (definition->interval > 0)
+    {
+        m_sendTimer.start(definition->interval);
+    }
+}
+
+bool Traceroute::stop()
+{
+    if (currentStatus == Traceroute::Running)
+    {
+        setStatus(Traceroute::Finished);
+    }
+
+    m_sendTimer.stop();
+    m_prober->close();
+    return true;
+}
+
+quint32 Traceroute::estimateTraffic() const
+{
+    // like a UDP ping (Ethernet, IP and UDP headers, payload and the ICMP
+    // response) for every probe up to the maximum TTL
+    quint32 est = 2 * 14 + 2 * (8 + definition->payload);
+
+    // the host is not resolved yet, IPv6 has the larger headers
+    est += 2 * 40 + 56;
+
+    return est * definition->count * definition->maxTtl;
+}
+
+void Traceroute::openTtls()
+{
+    while (currentStatus == Traceroute::Running && m_openTtls < (int)definition->window &&
+           ttl < m_lastTtl)
+    {
+        ttl++;
+        m_openTtls++;
+
+        do
+        {
+            sendProbe(ttl);
+        }
+        while (definition->interval == 0 && m_ttls[ttl - 1].sent < definition->count);
+
+        ttlCompleted();
+    }
+}
+
+void Traceroute::sendProbes()
+{
+    // one more probe for every open TTL which has not sent all of them yet
+    for (int t = m_completedTtls + 1; t <= ttl; t++)
+    {
+        sendProbe(t);
+    }
+
+    ttlCompleted();
+}
+
+void Traceroute::sendProbe(int probeTtl)
+{
+    TtlState &state = m_ttls[probeTtl - 1];
+
+    if (state.sent >= definition->count)
+    {
+        return;
+    }
+
+    // every TTL has its own destination port, so replies which quote only
+    // the headers can still be told apart
+    sockaddr_any destination = m_destAddress;
+    UdpProber::setPort(&destination, definition->destinationPort + probeTtl - 1);
+
+    int id = m_prober->send(destination, probeTtl);
+
+    if (id < 0)
+    {
+        // counts as lost
+        state.sent++;
+        state.done++;
+
+        if (state.done == definition->count)
+        {
+            m_openTtls--;
+        }
+
+        return;
+    }
+
+    m_probeIds.insert(id, qMakePair(probeTtl, (int)state.sent));
+    state.sent++;
+}
+
+void Traceroute::probeResponse(int id, const PingProbe &probe, traceroute::Response response)
+{
+    if (!m_probeIds.contains(id))
+    {
+        return;
+    }
+
+    QPair<int, int> position = m_probeIds.take(id);
+    TtlState &state = m_ttls[position.first - 1];
+    Hop hop = {probe, response};
+
+    state.hops[position.second] = hop;
+    state.done++;
+
+    if (state.done == definition->count)
+    {
+        m_openTtls--;
+    }
+
+    if (response == traceroute::UDP_RESPONSE || response == traceroute::DESTINATION_UNREACHABLE)
+    {
+        // no need to go any further
+        endOfRoute = true;
+        m_lastTtl = qMin(m_lastTtl, position.first);
+    }
+
+    ttlCompleted();
+    openTtls();
+}
+
+void Traceroute::ttlCompleted()
+{
+    if (currentStatus != Traceroute::Running)
+    {
+        return;
+    }
+
+    // TTLs are evaluated in order, as soon as all their probes are answered
+    while (m_completedTtls < m_lastTtl && m_ttls[m_completedTtls].done == definition->count)
+    {
+        m_completedTtls++;
+
+        int silent = 0;
+
+        for (int t = m_completedTtls; t > 0 && silent < (int)definition->maxSilentHops; t--, silent++)
+        {
+            bool answered = false;
+
+            foreach (const Hop &hop, m_ttls[t - 1].hops)
+            {
+                answered |= hop.response != traceroute::TIMEOUT;
+            }
+
+            if (answered)
+            {
+                break;
+            }
+        }
+
+        if (definition->maxSilentHops > 0 && silent >= (int)definition->maxSilentHops)
+        {
+            m_lastTtl = m_completedTtls;
+        }
+    }
+
+    if (m_completedTtls >= m_lastTtl)
+    {
+        finishRoute();
+    }
+}
+
+void Traceroute::finishRoute()
+{
+    m_sendTimer.stop();
+    m_prober->close();
+
+    hops.clear();
+
+    for (int t = 0; t < m_lastTtl; t++)
+    {
+        foreach (const Hop &hop, m_ttls[t].hops)
+        {
+            hops << hop;
+        }
+    }
+
+    setStatus(Traceroute::Finished);
+
+    // we are called from within the prober, let it unwind before the
+    // executor deletes us
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+#else
+bool Traceroute::prepare(NetworkManager *networkManager,
+                         const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager);
+    definition = measurementDefinition.dynamicCast<TracerouteDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("Definition is empty");
+        return false;
+    }
+
     if (definition->type != ping::Udp)
     {
         setErrorString("Ping type not supported");
@@ -81,6 +426,12 @@ bool Traceroute::prepare(NetworkManager *networkManager,
     connect(&m_ping, SIGNAL(error(const QString &)), &m_ping,
             SLOT(setErrorString(const QString &)));
 
+    // the ping resolves asynchronously and reports failures this way, which
+    // ends the traceroute as well; queued as the executor deletes us (and
+    // m_ping) on error
+    connect(&m_ping, SIGNAL(error(const QString &)), this,
+            SIGNAL(error(const QString &)), Qt::QueuedConnection);
+
     return true;
 }
 
@@ -97,6 +448,38 @@ bool Traceroute::stop()
     return true;
 }
 
+void Traceroute::ping()
+{
+    if (++ttl > (int)definition->maxTtl)
+    {
+        emit finished();
+        return;
+    }
+
+    PingDefinition pingDef(definition->host,
+                                 definition->count,
+                                 definition->interval,
+                                 definition->receiveTimeout,
+                                 ttl,
+                                 definition->destinationPort,
+                                 definition->sourcePort,
+                                 definition->payload,
+                                 definition->type);
+
+    if (m_ping.prepare(NULL, PingPlugin().createMeasurementDefinition(
+                           "ping",
+                           pingDef.toVariant())))
+    {
+        m_ping.start();
+    }
+    else
+    {
+        emit error("ping preparation failed");
+    }
+}
+
+#endif // Q_OS_LINUX
+
 Result Traceroute::result() const
 {
     QVariantList res;
@@ -104,11 +487,13 @@ Result Traceroute::result() const
     QVariantMap hop;
     QVariantMap probe;
     QList<quint64> pingTime;
+    QString address;
 
     for (int i = 0; i < hops.size(); i += definition->count)
     {
         pings.clear();
         pingTime.clear();
+        address.clear();
 
         for (quint32 k = 0; k < definition->count; k++)
         {
@@ -120,6 +505,11 @@ Result Traceroute::result() const
             // use only successful pings for the statistics
             if (hops[i + k].response != traceroute::TIMEOUT)
             {
+                if (address.isEmpty())
+                {
+                    address = QHostAddress(&hops[i + k].probe.source.sa).toString();
+                }
+
                 pingTime.append(hops[i + k].probe.recvTime - hops[i + k].probe.sendTime);
             }
 
@@ -155,9 +545,9 @@ Result Traceroute::result() const
             stdev = qSqrt(sq_sum / pingTime.size() - avg * avg);
         }
 
-        hop.insert("hop", QString(inet_ntoa(hops[i].probe.source.sin.sin_addr)));
+        hop.insert("hop", address);
         hop.insert("pings", pings);
-        hop.insert("ttl", i / 3 + 1);
+        hop.insert("ttl", i / (int)definition->count + 1);
         hop.insert("rtt_min", min);
         hop.insert("rtt_max", max);
         hop.insert("rtt_avg", avg);
@@ -174,36 +564,6 @@ Result Traceroute::result() const
     return Result(map);
 }
 
-void Traceroute::ping()
-{
-    if (++ttl == 20)
-    {
-        emit finished();
-        return;
-    }
-
-    PingDefinition pingDef(definition->host,
-                                 definition->count,
-                                 definition->interval,
-                                 definition->receiveTimeout,
-                                 ttl,
-                                 definition->destinationPort,
-                                 definition->sourcePort,
-                                 definition->payload,
-                                 definition->type);
-
-    if (m_ping.prepare(NULL, PingPlugin().createMeasurementDefinition(
-                           "ping",
-                           pingDef.toVariant())))
-    {
-        m_ping.start();
-    }
-    else
-    {
-        emit error("ping preparation failed");
-    }
-}
-
 void Traceroute::destinationUnreachable(const PingProbe &probe)
 {
     Hop hop = {probe, traceroute::DESTINATION_UNREACHABLE};
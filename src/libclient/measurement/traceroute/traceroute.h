@@ -4,6 +4,10 @@
 #include <QtGlobal>
 #include <QMutex>
 #include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QTimer>
 
 #include "../measurement.h"
 #include "../../task/scheduledefinition.h"
@@ -29,6 +33,10 @@ struct Hop
     traceroute::Response response;
 };
 
+#if defined(Q_OS_LINUX)
+class UdpProber;
+#endif
+
 class Traceroute : public Measurement
 {
     Q_OBJECT
@@ -44,13 +52,50 @@ public:
     bool stop();
     Result result() const;
 
+#if defined(Q_OS_LINUX)
+    // valid once the path is being probed
+    sockaddr_any destination() const;
+
+    // for measurements which run a traceroute as a part of theirs and
+    // account for its traffic themselves
+    void setAccountTraffic(bool account);
+    quint32 estimateTraffic() const;
+#endif
+
 private:
     void setStatus(Status status);
+#if defined(Q_OS_LINUX)
+    struct TtlState
+    {
+        QVector<Hop> hops;
+        quint32 sent;
+        quint32 done;
+    };
+
+    void openTtls();
+    void sendProbes();
+    void sendProbe(int probeTtl);
+    void probeResponse(int id, const PingProbe &probe, traceroute::Response response);
+    void ttlCompleted();
+    void finishRoute();
+
+    UdpProber *m_prober;
+    bool m_accountTraffic;
+    sockaddr_any m_destAddress;
+    QVector<TtlState> m_ttls; // index is ttl - 1
+    QHash<int, QPair<int, int> > m_probeIds; // probe id -> ttl, probe index
+    int m_openTtls;
+    int m_completedTtls;
+    int m_lastTtl;
+    QTimer m_sendTimer;
+#else
     void ping();
 
+    Ping m_ping;
+#endif
+
     TracerouteDefinitionPtr definition;
     Status currentStatus;
-    Ping m_ping;
     QList<Hop> hops;
     bool endOfRoute;
     int ttl;
@@ -65,6 +110,11 @@ public slots:
     void timeout(const PingProbe &probe);
     void udpResponse(const PingProbe &probe);
     void pingFinished();
+
+#if defined(Q_OS_LINUX)
+private slots:
+    void hostResolved(const QHostInfo &info);
+#endif
 };
 
 #endif // TRACEROUTE_H
@@ -7,7 +7,10 @@ TracerouteDefinition::TracerouteDefinition(const QString &host,
                                            const quint16 &destinationPort,
                                            const quint16 &sourcePort,
                                            const quint32 &payload,
-                                           const ping::PingType &type)
+                                           const ping::PingType &type,
+                                           const quint32 &maxTtl,
+                                           const quint32 &window,
+                                           const quint32 &maxSilentHops)
 : host(host)
 , count(count)
 , interval(interval)
@@ -16,6 +19,9 @@ TracerouteDefinition::TracerouteDefinition(const QString &host,
 , sourcePort(sourcePort)
 , payload(payload)
 , type(type)
+, maxTtl(maxTtl)
+, window(window)
+, maxSilentHops(maxSilentHops)
 {
 }
 
@@ -35,7 +41,10 @@ TracerouteDefinitionPtr TracerouteDefinition::fromVariant(const QVariant &varian
                                        map.value("source_port", 33434).toUInt(),
                                        map.value("payload", 74).toUInt(),
                                        pingTypeFromString(map.value(
-                                                              "ping_type", "Udp").toString().toLatin1())));
+                                                              "ping_type", "Udp").toString().toLatin1()),
+                                       map.value("max_ttl", 30).toUInt(),
+                                       map.value("window", 8).toUInt(),
+                                       map.value("max_silent_hops", 5).toUInt()));
 }
 
 QVariant TracerouteDefinition::toVariant() const
@@ -49,5 +58,8 @@ QVariant TracerouteDefinition::toVariant() const
     map.insert("source_port", sourcePort);
     map.insert("payload", payload);
     map.insert("ping_type", pingTypeToString(type));
+    map.insert("max_ttl", maxTtl);
+    map.insert("window", window);
+    map.insert("max_silent_hops", maxSilentHops);
     return map;
 }
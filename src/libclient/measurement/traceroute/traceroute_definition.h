@@ -17,7 +17,8 @@ public:
                          const quint32 &interval, const quint32 &receiveTimeout,
                          const quint16 &destinationPort,
                          const quint16 &sourcePort, const quint32 &payload,
-                         const ping::PingType &type);
+                         const ping::PingType &type, const quint32 &maxTtl = 30,
+                         const quint32 &window = 8, const quint32 &maxSilentHops = 5);
     ~TracerouteDefinition();
 
     // Storage
@@ -32,6 +33,9 @@ public:
     quint16 sourcePort;
     quint32 payload;
     ping::PingType type;
+    quint32 maxTtl;
+    quint32 window; // number of TTLs probed at the same time
+    quint32 maxSilentHops; // stop after that many consecutive hops without response
 
     // Serializable interface
     QVariant toVariant() const;
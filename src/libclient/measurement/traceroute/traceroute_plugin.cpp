@@ -1,21 +1,56 @@
 #include "traceroute_plugin.h"
 #include "traceroute.h"
 #include "traceroute_definition.h"
+#if defined(Q_OS_LINUX)
+#include "multipathtraceroute.h"
+#include "multipathtraceroute_definition.h"
+#include "continuoustraceroute.h"
+#include "continuoustraceroute_definition.h"
+#endif
 
 QStringList TraceroutePlugin::measurements() const
 {
     return QStringList()
-           << "traceroute";
+           << "traceroute"
+#if defined(Q_OS_LINUX)
+           << "multipath_traceroute"
+           << "continuous_traceroute"
+#endif
+           ;
 }
 
 MeasurementPtr TraceroutePlugin::createMeasurement(const QString &name)
 {
+#if defined(Q_OS_LINUX)
+    if (name == "multipath_traceroute")
+    {
+        return MeasurementPtr(new MultipathTraceroute);
+    }
+    else if (name == "continuous_traceroute")
+    {
+        return MeasurementPtr(new ContinuousTraceroute);
+    }
+#else
     Q_UNUSED(name);
+#endif
+
     return MeasurementPtr(new Traceroute);
 }
 
 MeasurementDefinitionPtr TraceroutePlugin::createMeasurementDefinition(const QString &name, const QVariant &data)
 {
+#if defined(Q_OS_LINUX)
+    if (name == "multipath_traceroute")
+    {
+        return MultipathTracerouteDefinition::fromVariant(data);
+    }
+    else if (name == "continuous_traceroute")
+    {
+        return ContinuousTracerouteDefinition::fromVariant(data);
+    }
+#else
     Q_UNUSED(name);
+#endif
+
     return TracerouteDefinition::fromVariant(data);
 }
@@ -0,0 +1,454 @@
+#include "udpprober.h"
+#include "../../log/logger.h"
+
+#include <errno.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <linux/icmp.h>
+#include <netinet/icmp6.h>
+#include <sys/socket.h>
+
+LOGGER(UdpProber);
+
+namespace
+{
+    /*
+     * Written to the start of every probe payload, routers following RFC 1812
+     * quote enough of the datagram to return it.
+     */
+    struct ProbeTag
+    {
+        quint16 magic;
+        quint16 reserved;
+        quint32 id;
+    };
+
+    quint64 currentTimeNs()
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        return ts.tv_sec * Q_UINT64_C(1000000000) + ts.tv_nsec;
+    }
+
+    bool sameDestination(const sockaddr_any &a, const sockaddr_any &b)
+    {
+        if (a.sa.sa_family != b.sa.sa_family)
+        {
+            return false;
+        }
+
+        if (a.sa.sa_family == AF_INET)
+        {
+            return a.sin.sin_port == b.sin.sin_port && a.sin.sin_addr.s_addr == b.sin.sin_addr.s_addr;
+        }
+
+        return a.sin6.sin6_port == b.sin6.sin6_port &&
+               !memcmp(&a.sin6.sin6_addr, &b.sin6.sin6_addr, sizeof(a.sin6.sin6_addr));
+    }
+}
+
+UdpProber::UdpProber(QObject *parent)
+: QObject(parent)
+, m_sock(-1)
+, m_family(AF_UNSPEC)
+, m_magic(0)
+, m_payload(0)
+, m_receiveTimeout(0)
+, m_nextId(0)
+, m_notifier(NULL)
+{
+    m_timeoutTimer.setSingleShot(true);
+    m_timeoutTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &UdpProber::checkTimeouts);
+}
+
+UdpProber::~UdpProber()
+{
+    close();
+}
+
+bool UdpProber::firstAddress(const QHostInfo &info, sockaddr_any *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+
+    foreach (const QHostAddress &address, info.addresses())
+    {
+        if (address.protocol() == QAbstractSocket::IPv4Protocol)
+        {
+            addr->sin.sin_family = AF_INET;
+            addr->sin.sin_addr.s_addr = htonl(address.toIPv4Address());
+            return true;
+        }
+        else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+        {
+            Q_IPV6ADDR ip = address.toIPv6Address();
+            addr->sin6.sin6_family = AF_INET6;
+            memcpy(&addr->sin6.sin6_addr, ip.c, sizeof(ip.c));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void UdpProber::setPort(sockaddr_any *addr, quint16 port)
+{
+    if (addr->sa.sa_family == AF_INET)
+    {
+        addr->sin.sin_port = htons(port);
+    }
+    else
+    {
+        addr->sin6.sin6_port = htons(port);
+    }
+}
+
+bool UdpProber::open(int family, quint16 sourcePort, quint32 payload, quint32 receiveTimeout)
+{
+    int n = 1;
+    sockaddr_any src_addr;
+
+    close();
+
+    m_family = family;
+    m_payload = payload;
+    m_receiveTimeout = receiveTimeout;
+    m_magic = qrand() & 0xffff;
+
+    if ((m_sock = socket(family, SOCK_DGRAM, IPPROTO_UDP)) < 0)
+    {
+        LOG_ERROR(QString("socket: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return false;
+    }
+
+    memset(&src_addr, 0, sizeof(src_addr));
+    src_addr.sa.sa_family = family;
+
+    if (family == AF_INET)
+    {
+        src_addr.sin.sin_port = htons(sourcePort);
+
+        if (bind(m_sock, &src_addr.sa, sizeof(src_addr.sin)) < 0 ||
+            setsockopt(m_sock, SOL_IP, IP_RECVERR, &n, sizeof(n)) < 0)
+        {
+            LOG_ERROR(QString("bind/IP_RECVERR: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+            goto cleanup;
+        }
+    }
+    else
+    {
+        src_addr.sin6.sin6_port = htons(sourcePort);
+
+        if (bind(m_sock, &src_addr.sa, sizeof(src_addr.sin6)) < 0 ||
+            setsockopt(m_sock, IPPROTO_IPV6, IPV6_RECVERR, &n, sizeof(n)) < 0)
+        {
+            LOG_ERROR(QString("bind/IPV6_RECVERR: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+            goto cleanup;
+        }
+    }
+
+    if (setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMPNS, &n, sizeof(n)) < 0)
+    {
+        LOG_ERROR(QString("setsockopt SO_TIMESTAMPNS: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        goto cleanup;
+    }
+
+    m_notifier = new QSocketNotifier(m_sock, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &UdpProber::readResponses);
+
+    return true;
+
+cleanup:
+    ::close(m_sock);
+    m_sock = -1;
+    return false;
+}
+
+void UdpProber::close()
+{
+    m_timeoutTimer.stop();
+    m_outstanding.clear();
+
+    delete m_notifier;
+    m_notifier = NULL;
+
+    if (m_sock >= 0)
+    {
+        ::close(m_sock);
+        m_sock = -1;
+    }
+}
+
+bool UdpProber::isOpen() const
+{
+    return m_sock >= 0;
+}
+
+int UdpProber::outstanding() const
+{
+    return m_outstanding.size();
+}
+
+int UdpProber::send(const sockaddr_any &destination, int ttl)
+{
+    QByteArray payload(m_payload, 'X');
+    Outstanding entry;
+    int ret = 0;
+
+    if (m_sock < 0)
+    {
+        return -1;
+    }
+
+    if (payload.size() >= (int)sizeof(ProbeTag))
+    {
+        ProbeTag tag;
+        tag.magic = htons(m_magic);
+        tag.reserved = 0;
+        tag.id = htonl(m_nextId);
+        memcpy(payload.data(), &tag, sizeof(tag));
+    }
+
+    // the socket is only used by us and sendto() is synchronous, so the TTL
+    // can be changed for every single probe
+    if (m_family == AF_INET)
+    {
+        ret = setsockopt(m_sock, SOL_IP, IP_TTL, &ttl, sizeof(ttl));
+    }
+    else
+    {
+        ret = setsockopt(m_sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
+    }
+
+    if (ret < 0)
+    {
+        LOG_WARNING(QString("setsockopt TTL: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return -1;
+    }
+
+    entry.destination = destination;
+    entry.probe.sock = m_sock;
+    entry.probe.sequence = m_nextId & 0xffff;
+    entry.probe.sendTimeNs = currentTimeNs();
+    entry.probe.sendTime = entry.probe.sendTimeNs / 1000;
+
+    if (sendto(m_sock, payload.constData(), payload.size(), 0, &destination.sa,
+               m_family == AF_INET ? sizeof(destination.sin) : sizeof(destination.sin6)) < 0)
+    {
+        LOG_WARNING(QString("send: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return -1;
+    }
+
+    m_outstanding.insert(m_nextId, entry);
+
+    if (!m_timeoutTimer.isActive())
+    {
+        scheduleTimeout();
+    }
+
+    return m_nextId++;
+}
+
+void UdpProber::readResponses()
+{
+    // errors (ICMP) first, then regular datagrams, until both are drained;
+    // a receiver may close us from within response()
+    while (m_sock >= 0 && receiveData(MSG_ERRQUEUE))
+    {
+    }
+
+    while (m_sock >= 0 && receiveData(0))
+    {
+    }
+
+    if (m_sock >= 0)
+    {
+        scheduleTimeout();
+    }
+}
+
+bool UdpProber::receiveData(int flags)
+{
+    struct msghdr msg;
+    sockaddr_any from;
+    struct iovec iov;
+    char buf[1500];
+    char control[256];
+    struct cmsghdr *cm;
+    struct sock_extended_err *ee = NULL;
+    quint64 recvTimeNs = 0;
+    ssize_t length = 0;
+    traceroute::Response response = traceroute::UDP_RESPONSE;
+
+    memset(&from, 0, sizeof(from));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if ((length = recvmsg(m_sock, &msg, flags | MSG_DONTWAIT)) < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG_WARNING(QString("recvmsg: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        }
+
+        return false;
+    }
+
+    for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPNS)
+        {
+            struct timespec *ts = (struct timespec *) CMSG_DATA(cm);
+            recvTimeNs = ts->tv_sec * Q_UINT64_C(1000000000) + ts->tv_nsec;
+        }
+        else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+        {
+            ee = (struct sock_extended_err *) CMSG_DATA(cm);
+        }
+    }
+
+    if (flags & MSG_ERRQUEUE)
+    {
+        if (!ee || (ee->ee_origin != SO_EE_ORIGIN_ICMP && ee->ee_origin != SO_EE_ORIGIN_ICMP6))
+        {
+            return true;
+        }
+
+        if ((ee->ee_origin == SO_EE_ORIGIN_ICMP && ee->ee_type == ICMP_TIME_EXCEEDED) ||
+            (ee->ee_origin == SO_EE_ORIGIN_ICMP6 && ee->ee_type == ICMP6_TIME_EXCEEDED))
+        {
+            response = traceroute::TTL_EXCEEDED;
+        }
+        else if ((ee->ee_origin == SO_EE_ORIGIN_ICMP && ee->ee_type == ICMP_DEST_UNREACH) ||
+                 (ee->ee_origin == SO_EE_ORIGIN_ICMP6 && ee->ee_type == ICMP6_DST_UNREACH))
+        {
+            response = traceroute::DESTINATION_UNREACHABLE;
+        }
+        else
+        {
+            return true;
+        }
+    }
+
+    // for errors msg_name holds the destination of the quoted datagram,
+    // for responses the sender which is the destination of our probe
+    int id = matchProbe(buf, length, from);
+
+    if (id < 0)
+    {
+        return true;
+    }
+
+    PingProbe probe = m_outstanding.take(id).probe;
+
+    probe.replies = 1;
+    probe.recvTimeNs = recvTimeNs ? recvTimeNs : currentTimeNs();
+    probe.recvTime = probe.recvTimeNs / 1000;
+
+    if (ee)
+    {
+        memcpy(&probe.source, SO_EE_OFFENDER(ee), sizeof(probe.source));
+    }
+    else
+    {
+        memcpy(&probe.source, &from, sizeof(probe.source));
+    }
+
+    emit response(id, probe, response);
+
+    return true;
+}
+
+int UdpProber::matchProbe(const char *data, int length, const sockaddr_any &destination) const
+{
+    if (length >= (int)sizeof(ProbeTag))
+    {
+        ProbeTag tag;
+        memcpy(&tag, data, sizeof(tag));
+
+        if (ntohs(tag.magic) == m_magic)
+        {
+            // late or duplicate responses are not outstanding anymore
+            return m_outstanding.contains(ntohl(tag.id)) ? (int)ntohl(tag.id) : -1;
+        }
+    }
+
+    // routers which quote only the first 8 bytes of the datagram leave us
+    // the quoted headers only, which are ambiguous if several outstanding
+    // probes went to the same destination
+    int id = -1;
+
+    for (QMap<int, Outstanding>::const_iterator it = m_outstanding.constBegin(); it != m_outstanding.constEnd(); ++it)
+    {
+        if (sameDestination(it.value().destination, destination))
+        {
+            if (id >= 0)
+            {
+                return -1;
+            }
+
+            id = it.key();
+        }
+    }
+
+    return id;
+}
+
+void UdpProber::checkTimeouts()
+{
+    quint64 now = currentTimeNs();
+    quint64 timeout = m_receiveTimeout * Q_UINT64_C(1000000);
+
+    // probes are sent in id order, so the first ones expire first
+    while (m_sock >= 0 && !m_outstanding.isEmpty())
+    {
+        QMap<int, Outstanding>::iterator it = m_outstanding.begin();
+
+        if (now - it.value().probe.sendTimeNs < timeout)
+        {
+            break;
+        }
+
+        int id = it.key();
+        PingProbe probe = it.value().probe;
+        m_outstanding.erase(it);
+
+        // indicate a timeout by zeroing the ping duration
+        probe.recvTime = probe.sendTime;
+        probe.recvTimeNs = probe.sendTimeNs;
+        emit response(id, probe, traceroute::TIMEOUT);
+    }
+
+    if (m_sock >= 0)
+    {
+        scheduleTimeout();
+    }
+}
+
+void UdpProber::scheduleTimeout()
+{
+    if (m_outstanding.isEmpty())
+    {
+        m_timeoutTimer.stop();
+        return;
+    }
+
+    quint64 deadline = m_outstanding.constBegin().value().probe.sendTimeNs + m_receiveTimeout * Q_UINT64_C(1000000);
+    quint64 now = currentTimeNs();
+
+    m_timeoutTimer.start(deadline > now ? (deadline - now) / 1000000 + 1 : 0);
+}
@@ -0,0 +1,68 @@
+#ifndef UDPPROBER_H
+#define UDPPROBER_H
+
+#include <QObject>
+#include <QMap>
+#include <QTimer>
+#include <QSocketNotifier>
+
+#include "traceroute.h"
+
+/*
+ * Sends UDP probes with individual TTLs and destinations over one socket and
+ * matches ICMP errors and UDP responses back to them. Probes are identified
+ * by a tag in the payload (quoted by ICMP errors) or, if the quote is too
+ * short, by the destination address and port of the quoted headers. The
+ * latter only works if a single outstanding probe was sent there, so
+ * callers should vary the destination port per TTL.
+ *
+ * Every probe gets exactly one response() signal, timeouts included.
+ */
+class UdpProber : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UdpProber(QObject *parent = 0);
+    ~UdpProber();
+
+    // the first usable address of a lookup, the port is left 0
+    static bool firstAddress(const QHostInfo &info, sockaddr_any *addr);
+    static void setPort(sockaddr_any *addr, quint16 port);
+
+    bool open(int family, quint16 sourcePort, quint32 payload, quint32 receiveTimeout);
+    void close();
+    bool isOpen() const;
+
+    // returns the probe id or -1 if sending failed
+    int send(const sockaddr_any &destination, int ttl);
+    int outstanding() const;
+
+signals:
+    void response(int id, const PingProbe &probe, traceroute::Response response);
+
+private:
+    struct Outstanding
+    {
+        PingProbe probe;
+        sockaddr_any destination;
+    };
+
+    void readResponses();
+    bool receiveData(int flags);
+    int matchProbe(const char *data, int length, const sockaddr_any &destination) const;
+    void checkTimeouts();
+    void scheduleTimeout();
+
+    int m_sock;
+    int m_family;
+    quint16 m_magic;
+    quint32 m_payload;
+    quint32 m_receiveTimeout;
+    int m_nextId;
+    QMap<int, Outstanding> m_outstanding; // probe id -> probe, in send order
+    QSocketNotifier *m_notifier;
+    QTimer m_timeoutTimer;
+};
+
+#endif // UDPPROBER_H
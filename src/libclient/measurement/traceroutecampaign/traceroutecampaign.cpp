@@ -0,0 +1,627 @@
+#include "traceroutecampaign.h"
+#include "../traceroute/udpprober.h"
+#include "../../log/logger.h"
+#include "../../client.h"
+#include "../../trafficbudgetmanager.h"
+#include "../../network/resolver.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <QHostAddress>
+
+LOGGER(TracerouteCampaign);
+
+namespace
+{
+    bool toSockaddr(const QHostAddress &address, sockaddr_any *addr)
+    {
+        memset(addr, 0, sizeof(*addr));
+
+        if (address.protocol() == QAbstractSocket::IPv4Protocol)
+        {
+            addr->sin.sin_family = AF_INET;
+            addr->sin.sin_addr.s_addr = htonl(address.toIPv4Address());
+            return true;
+        }
+        else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+        {
+            Q_IPV6ADDR ip = address.toIPv6Address();
+            addr->sin6.sin6_family = AF_INET6;
+            memcpy(&addr->sin6.sin6_addr, ip.c, sizeof(ip.c));
+            return true;
+        }
+
+        return false;
+    }
+
+    QString hopAddress(const Hop &hop)
+    {
+        if (hop.response == traceroute::TIMEOUT)
+        {
+            return QString();
+        }
+
+        return QHostAddress(&hop.probe.source.sa).toString();
+    }
+
+    // what probes without a reply are reported as
+    Hop timedOut()
+    {
+        Hop hop = {PingProbe(), traceroute::TIMEOUT};
+        return hop;
+    }
+}
+
+TracerouteCampaign::TracerouteCampaign(QObject *parent)
+: Measurement(parent)
+, currentStatus(Unknown)
+, m_prober4(new UdpProber(this))
+, m_prober6(new UdpProber(this))
+, m_nextTrace(0)
+, m_activeTraces(0)
+, m_finishedTraces(0)
+, m_probesSent(0)
+, m_nextSend(0)
+, m_duration(0)
+{
+    m_sendTimer.setSingleShot(true);
+    m_sendTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(m_prober4, &UdpProber::response, this, &TracerouteCampaign::probeResponse4);
+    connect(m_prober6, &UdpProber::response, this, &TracerouteCampaign::probeResponse6);
+    connect(&m_sendTimer, &QTimer::timeout, this, &TracerouteCampaign::sendProbes);
+}
+
+TracerouteCampaign::~TracerouteCampaign()
+{
+}
+
+Measurement::Status TracerouteCampaign::status() const
+{
+    return currentStatus;
+}
+
+void TracerouteCampaign::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+bool TracerouteCampaign::prepare(NetworkManager *networkManager,
+                                 const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager);
+    definition = measurementDefinition.dynamicCast<TracerouteCampaignDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("Definition is empty");
+        return false;
+    }
+
+    if (definition->hosts.isEmpty())
+    {
+        setErrorString("no hosts given");
+        return false;
+    }
+
+    if (definition->count == 0 || definition->maxTtl == 0 || definition->concurrency == 0 ||
+        definition->probeRate == 0)
+    {
+        setErrorString("count, max_ttl, concurrency and probe_rate must not be 0");
+        return false;
+    }
+
+    if (definition->maxTtl > 255 || definition->maxSilentHops > 255)
+    {
+        setErrorString("max_ttl and max_silent_hops must not exceed 255");
+        return false;
+    }
+
+    if (definition->startTtl == 0 || definition->startTtl > definition->maxTtl)
+    {
+        setErrorString("start_ttl must be between 1 and max_ttl");
+        return false;
+    }
+
+    if (definition->prefixLength4 > 32 || definition->prefixLength6 > 128)
+    {
+        setErrorString("prefix_length_v4 must be between 0 and 32, prefix_length_v6 between 0 and 128");
+        return false;
+    }
+
+    if (definition->payload > 1400)
+    {
+        setErrorString("payload is too large (> 1400 bytes)");
+        return false;
+    }
+
+    // one port per probe and TTL
+    if (definition->destinationPort == 0 ||
+        definition->destinationPort + (quint64)definition->maxTtl * definition->count - 1 > 65535)
+    {
+        setErrorString("destination_port + max_ttl * count exceeds the port range");
+        return false;
+    }
+
+    if (!Client::instance()->trafficBudgetManager()->addUsedTraffic(estimateTraffic()))
+    {
+        setErrorString("not enough traffic available");
+        return false;
+    }
+
+    return true;
+}
+
+bool TracerouteCampaign::start()
+{
+    Trace trace;
+
+    trace.ttl = 0;
+    trace.pending = 0;
+    trace.forward = true;
+    trace.silent = 0;
+    trace.lowestTtl = 0;
+    trace.highestTtl = 0;
+    trace.reached = false;
+    memset(&trace.address, 0, sizeof(trace.address));
+
+    m_traces.fill(trace, definition->hosts.size());
+
+    for (int i = 0; i < m_traces.size(); i++)
+    {
+        m_traces[i].host = definition->hosts[i];
+    }
+
+    m_lookups.clear();
+    m_queue.clear();
+    m_probeIds4.clear();
+    m_probeIds6.clear();
+    m_localStopSet.clear();
+    m_globalStopSet.clear();
+    m_nextTrace = 0;
+    m_activeTraces = 0;
+    m_finishedTraces = 0;
+    m_probesSent = 0;
+    m_nextSend = 0;
+
+    setStatus(TracerouteCampaign::Running);
+
+    m_clock.start();
+
+    startTraces();
+
+    return true;
+}
+
+bool TracerouteCampaign::stop()
+{
+    if (currentStatus == TracerouteCampaign::Running)
+    {
+        setStatus(TracerouteCampaign::Finished);
+    }
+
+    foreach (int id, m_lookups.keys())
+    {
+        Client::instance()->resolver()->abortHostLookup(id);
+    }
+
+    m_lookups.clear();
+    m_sendTimer.stop();
+    m_prober4->close();
+    m_prober6->close();
+
+    return true;
+}
+
+quint32 TracerouteCampaign::estimateTraffic() const
+{
+    // a UDP probe and its ICMP response on every hop of every destination,
+    // the stop sets usually save most of it
+    quint32 est = 2 * 14 + 2 * (8 + definition->payload) + 2 * 40 + 56;
+
+    return est * definition->count * definition->maxTtl * definition->hosts.size();
+}
+
+void TracerouteCampaign::startTraces()
+{
+    while (m_activeTraces < (int)definition->concurrency && m_nextTrace < m_traces.size())
+    {
+        m_activeTraces++;
+        m_lookups.insert(Client::instance()->resolver()->lookupHost(m_traces[m_nextTrace].host, this,
+                                                                    SLOT(lookedUp(QHostInfo))),
+                         m_nextTrace);
+        m_nextTrace++;
+    }
+}
+
+void TracerouteCampaign::lookedUp(const QHostInfo &info)
+{
+    if (!m_lookups.contains(info.lookupId()))
+    {
+        return;
+    }
+
+    int index = m_lookups.take(info.lookupId());
+    Trace &trace = m_traces[index];
+
+    if (info.error() != QHostInfo::NoError)
+    {
+        trace.errorString = info.errorString();
+    }
+    else
+    {
+        foreach (const QHostAddress &address, info.addresses())
+        {
+            if (toSockaddr(address, &trace.address))
+            {
+                // destinations in the same prefix share global stop set entries
+                int length = address.protocol() == QAbstractSocket::IPv4Protocol ?
+                             definition->prefixLength4 : definition->prefixLength6;
+                QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(
+                                                      QString("%1/%2").arg(address.toString()).arg(length));
+                trace.prefix = QString("%1/%2").arg(subnet.first.toString()).arg(subnet.second);
+                break;
+            }
+        }
+
+        if (trace.address.sa.sa_family == 0)
+        {
+            trace.errorString = "no usable address";
+        }
+        else if (!prober(trace.address.sa.sa_family))
+        {
+            trace.errorString = "could not open probe socket";
+        }
+    }
+
+    if (!trace.errorString.isEmpty())
+    {
+        traceDone();
+        return;
+    }
+
+    trace.ttl = definition->startTtl;
+    trace.lowestTtl = trace.ttl;
+    trace.highestTtl = trace.ttl;
+    probeHop(index);
+}
+
+UdpProber *TracerouteCampaign::prober(int family)
+{
+    UdpProber *udpProber = family == AF_INET ? m_prober4 : m_prober6;
+
+    // source port 0 lets the kernel choose
+    if (!udpProber->isOpen() && !udpProber->open(family, 0, definition->payload, definition->receiveTimeout))
+    {
+        return NULL;
+    }
+
+    return udpProber;
+}
+
+void TracerouteCampaign::probeHop(int trace)
+{
+    int first = (m_traces[trace].ttl - 1) * definition->count;
+
+    m_traces[trace].pending = definition->count;
+
+    for (int slot = first; slot < first + (int)definition->count; slot++)
+    {
+        m_queue.append(qMakePair(trace, slot));
+    }
+
+    // an active timer already waits for the next deadline
+    if (!m_sendTimer.isActive())
+    {
+        scheduleSend();
+    }
+}
+
+void TracerouteCampaign::scheduleSend()
+{
+    if (currentStatus != TracerouteCampaign::Running || m_queue.isEmpty())
+    {
+        m_sendTimer.stop();
+        return;
+    }
+
+    qint64 wait = m_nextSend - m_clock.nsecsElapsed();
+
+    // round up, sending early would exceed the rate
+    m_sendTimer.start(wait > 0 ? (int)((wait + 999999) / 1000000) : 0);
+}
+
+void TracerouteCampaign::sendProbes()
+{
+    // the same deadline schedule as the multipath traceroute, the rate does
+    // not depend on the timer granularity
+    qint64 gap = qMax(Q_INT64_C(1), Q_INT64_C(1000000000) / definition->probeRate);
+    qint64 now = m_clock.nsecsElapsed();
+
+    while (currentStatus == TracerouteCampaign::Running && !m_queue.isEmpty() && m_nextSend <= now)
+    {
+        QPair<int, int> entry = m_queue.takeFirst();
+        const Trace &trace = m_traces[entry.first];
+        int ttl = entry.second / definition->count + 1;
+        int id = -1;
+
+        // every probe of a trace has its own destination port, so replies
+        // which quote only the headers can still be told apart
+        sockaddr_any destination = trace.address;
+        UdpProber::setPort(&destination, definition->destinationPort + entry.second);
+
+        if (destination.sa.sa_family == AF_INET)
+        {
+            if ((id = m_prober4->send(destination, ttl)) >= 0)
+            {
+                m_probeIds4.insert(id, entry);
+            }
+        }
+        else
+        {
+            if ((id = m_prober6->send(destination, ttl)) >= 0)
+            {
+                m_probeIds6.insert(id, entry);
+            }
+        }
+
+        m_nextSend += gap;
+
+        if (id < 0)
+        {
+            // counts as lost
+            probeDone(entry.first, entry.second, timedOut());
+            continue;
+        }
+
+        m_probesSent++;
+    }
+
+    // no credit is saved up while waiting for responses
+    if (m_queue.isEmpty() && m_nextSend < now)
+    {
+        m_nextSend = now;
+    }
+
+    scheduleSend();
+}
+
+void TracerouteCampaign::probeResponse4(int id, const PingProbe &probe, traceroute::Response response)
+{
+    if (m_probeIds4.contains(id))
+    {
+        QPair<int, int> entry = m_probeIds4.take(id);
+        Hop hop = {probe, response};
+        probeDone(entry.first, entry.second, hop);
+    }
+}
+
+void TracerouteCampaign::probeResponse6(int id, const PingProbe &probe, traceroute::Response response)
+{
+    if (m_probeIds6.contains(id))
+    {
+        QPair<int, int> entry = m_probeIds6.take(id);
+        Hop hop = {probe, response};
+        probeDone(entry.first, entry.second, hop);
+    }
+}
+
+void TracerouteCampaign::probeDone(int trace, int slot, const Hop &hop)
+{
+    // most probes of a campaign are never answered, only replies are kept
+    if (hop.response != traceroute::TIMEOUT)
+    {
+        m_traces[trace].hops.insert(slot, hop);
+    }
+
+    if (--m_traces[trace].pending == 0)
+    {
+        hopDone(trace);
+    }
+}
+
+void TracerouteCampaign::hopDone(int index)
+{
+    Trace &trace = m_traces[index];
+    int first = (trace.ttl - 1) * definition->count;
+    QString address;
+    bool reached = false;
+
+    for (int slot = first; slot < first + (int)definition->count; slot++)
+    {
+        Hop hop = trace.hops.value(slot, timedOut());
+
+        if (address.isEmpty())
+        {
+            address = hopAddress(hop);
+        }
+
+        reached |= hop.response == traceroute::UDP_RESPONSE ||
+                   hop.response == traceroute::DESTINATION_UNREACHABLE;
+    }
+
+    if (trace.forward)
+    {
+        trace.highestTtl = trace.ttl;
+
+        if (reached)
+        {
+            trace.reached = true;
+            forwardDone(index, "destination");
+            return;
+        }
+
+        if (!address.isEmpty())
+        {
+            QString key = address + " " + trace.prefix;
+
+            if (m_globalStopSet.contains(key))
+            {
+                forwardDone(index, "global_stop_set");
+                return;
+            }
+
+            m_globalStopSet.insert(key);
+        }
+
+        trace.silent = address.isEmpty() ? trace.silent + 1 : 0;
+
+        if (definition->maxSilentHops > 0 && trace.silent >= (int)definition->maxSilentHops)
+        {
+            forwardDone(index, "silent");
+        }
+        else if (trace.ttl >= (int)definition->maxTtl)
+        {
+            forwardDone(index, "max_ttl");
+        }
+        else
+        {
+            trace.ttl++;
+            probeHop(index);
+        }
+
+        return;
+    }
+
+    trace.lowestTtl = trace.ttl;
+
+    // the destination is closer than startTtl
+    if (reached)
+    {
+        trace.reached = true;
+        trace.highestTtl = trace.ttl;
+    }
+
+    if (!address.isEmpty() && m_localStopSet.contains(address))
+    {
+        trace.backwardStop = "local_stop_set";
+        traceDone();
+        return;
+    }
+
+    if (!address.isEmpty())
+    {
+        m_localStopSet.insert(address);
+    }
+
+    if (trace.ttl == 1)
+    {
+        trace.backwardStop = "first_hop";
+        traceDone();
+    }
+    else
+    {
+        trace.ttl--;
+        probeHop(index);
+    }
+}
+
+void TracerouteCampaign::forwardDone(int index, const QString &reason)
+{
+    Trace &trace = m_traces[index];
+
+    trace.forwardStop = reason;
+    trace.forward = false;
+
+    if (definition->startTtl > 1)
+    {
+        trace.ttl = definition->startTtl - 1;
+        probeHop(index);
+    }
+    else
+    {
+        trace.backwardStop = "first_hop";
+        traceDone();
+    }
+}
+
+void TracerouteCampaign::traceDone()
+{
+    m_activeTraces--;
+    m_finishedTraces++;
+
+    startTraces();
+
+    if (m_finishedTraces == m_traces.size())
+    {
+        finishCampaign();
+    }
+}
+
+void TracerouteCampaign::finishCampaign()
+{
+    m_duration = m_clock.elapsed();
+    m_sendTimer.stop();
+    m_prober4->close();
+    m_prober6->close();
+
+    setStatus(TracerouteCampaign::Finished);
+
+    // we are called from within the prober or a lookup, let them unwind
+    // before the executor deletes us
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+Result TracerouteCampaign::result() const
+{
+    QVariantList traces;
+
+    foreach (const Trace &trace, m_traces)
+    {
+        QVariantMap map;
+        map.insert("host", trace.host);
+
+        if (!trace.errorString.isEmpty())
+        {
+            map.insert("error", trace.errorString);
+            traces << map;
+            continue;
+        }
+
+        QVariantList hops;
+
+        for (int ttl = trace.lowestTtl; ttl > 0 && ttl <= trace.highestTtl; ttl++)
+        {
+            QVariantList rtts;
+            QString address;
+
+            for (quint32 k = 0; k < definition->count; k++)
+            {
+                Hop hop = trace.hops.value((ttl - 1) * definition->count + k, timedOut());
+
+                if (address.isEmpty())
+                {
+                    address = hopAddress(hop);
+                }
+
+                rtts << (int)(hop.probe.recvTime - hop.probe.sendTime);
+            }
+
+            QVariantMap hop;
+            hop.insert("ttl", ttl);
+            hop.insert("hop", address);
+            hop.insert("rtt", rtts);
+            hops << hop;
+        }
+
+        map.insert("address", QHostAddress(&trace.address.sa).toString());
+        map.insert("reached", trace.reached);
+        map.insert("forward_stop", trace.forwardStop);
+        map.insert("backward_stop", trace.backwardStop);
+        map.insert("hops", hops);
+        traces << map;
+    }
+
+    QVariantMap map;
+    map.insert("traces", traces);
+    map.insert("probes_sent", m_probesSent);
+    map.insert("duration", m_duration);
+    map.insert("local_stop_set_size", m_localStopSet.size());
+    map.insert("global_stop_set_size", m_globalStopSet.size());
+
+    return Result(map);
+}
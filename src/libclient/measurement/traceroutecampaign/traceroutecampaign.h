@@ -0,0 +1,105 @@
+#ifndef TRACEROUTECAMPAIGN_H
+#define TRACEROUTECAMPAIGN_H
+
+#include <QHostInfo>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "../measurement.h"
+#include "../traceroute/traceroute.h"
+#include "traceroutecampaign_definition.h"
+
+class UdpProber;
+
+/*
+ * Traces many destinations at once following Doubletree: every trace
+ * starts at startTtl and probes forward until it reaches the destination or
+ * an interface already known on the way to the same destination prefix
+ * (global stop set), then backward until it meets an interface seen by an
+ * earlier trace (local stop set). All traces share one socket per address
+ * family and the probe rate limit.
+ */
+class TracerouteCampaign : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit TracerouteCampaign(QObject *parent = 0);
+    ~TracerouteCampaign();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+signals:
+    void statusChanged(Status status);
+
+private:
+    struct Trace
+    {
+        QString host;
+        sockaddr_any address;
+        QString prefix;
+        QString errorString;
+        QHash<int, Hop> hops; // slot -> reply, count slots per ttl, ttl-major
+        int ttl;
+        int pending;
+        bool forward;
+        int silent;
+        int lowestTtl;
+        int highestTtl;
+        bool reached;
+        QString forwardStop;
+        QString backwardStop;
+    };
+
+    typedef QHash<int, QPair<int, int> > ProbeIds; // probe id -> trace, hop slot
+
+    void setStatus(Status status);
+    quint32 estimateTraffic() const;
+    void startTraces();
+    UdpProber *prober(int family);
+    void probeHop(int trace);
+    void scheduleSend();
+    void sendProbes();
+    void probeResponse4(int id, const PingProbe &probe, traceroute::Response response);
+    void probeResponse6(int id, const PingProbe &probe, traceroute::Response response);
+    void probeDone(int trace, int slot, const Hop &hop);
+    void hopDone(int trace);
+    void forwardDone(int trace, const QString &reason);
+    void traceDone();
+    void finishCampaign();
+
+    TracerouteCampaignDefinitionPtr definition;
+    Status currentStatus;
+    QVector<Trace> m_traces;
+    QHash<int, int> m_lookups; // lookup id -> trace index
+    QList<QPair<int, int> > m_queue; // trace, hop slot of probes waiting to be sent
+    ProbeIds m_probeIds4;
+    ProbeIds m_probeIds6;
+    QSet<QString> m_localStopSet; // interfaces
+    QSet<QString> m_globalStopSet; // interface and destination prefix
+    UdpProber *m_prober4;
+    UdpProber *m_prober6;
+    int m_nextTrace;
+    int m_activeTraces;
+    int m_finishedTraces;
+    quint32 m_probesSent;
+    qint64 m_nextSend; // ns on m_clock
+    QTimer m_sendTimer;
+    QElapsedTimer m_clock;
+    qint64 m_duration;
+
+private slots:
+    void lookedUp(const QHostInfo &info);
+};
+
+#endif // TRACEROUTECAMPAIGN_H
@@ -0,0 +1,66 @@
+#include "traceroutecampaign_definition.h"
+
+TracerouteCampaignDefinition::TracerouteCampaignDefinition(const QStringList &hosts, const quint32 &count,
+                                                           const quint32 &receiveTimeout,
+                                                           const quint16 &destinationPort,
+                                                           const quint32 &payload, const quint32 &maxTtl,
+                                                           const quint32 &startTtl,
+                                                           const quint32 &maxSilentHops,
+                                                           const quint32 &concurrency,
+                                                           const quint32 &probeRate,
+                                                           const quint32 &prefixLength4,
+                                                           const quint32 &prefixLength6)
+: hosts(hosts)
+, count(count)
+, receiveTimeout(receiveTimeout)
+, destinationPort(destinationPort)
+, payload(payload)
+, maxTtl(maxTtl)
+, startTtl(startTtl)
+, maxSilentHops(maxSilentHops)
+, concurrency(concurrency)
+, probeRate(probeRate)
+, prefixLength4(prefixLength4)
+, prefixLength6(prefixLength6)
+{
+}
+
+TracerouteCampaignDefinition::~TracerouteCampaignDefinition()
+{
+}
+
+TracerouteCampaignDefinitionPtr TracerouteCampaignDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    return TracerouteCampaignDefinitionPtr(new TracerouteCampaignDefinition(
+                                               map.value("hosts").toStringList(),
+                                               map.value("count", 1).toUInt(),
+                                               map.value("receive_timeout", 1000).toUInt(),
+                                               map.value("destination_port", 33434).toUInt(),
+                                               map.value("payload", 74).toUInt(),
+                                               map.value("max_ttl", 30).toUInt(),
+                                               map.value("start_ttl", 4).toUInt(),
+                                               map.value("max_silent_hops", 5).toUInt(),
+                                               map.value("concurrency", 32).toUInt(),
+                                               map.value("probe_rate", 500).toUInt(),
+                                               map.value("prefix_length_v4", 24).toUInt(),
+                                               map.value("prefix_length_v6", 48).toUInt()));
+}
+
+QVariant TracerouteCampaignDefinition::toVariant() const
+{
+    QVariantMap map;
+    map.insert("hosts", hosts);
+    map.insert("count", count);
+    map.insert("receive_timeout", receiveTimeout);
+    map.insert("destination_port", destinationPort);
+    map.insert("payload", payload);
+    map.insert("max_ttl", maxTtl);
+    map.insert("start_ttl", startTtl);
+    map.insert("max_silent_hops", maxSilentHops);
+    map.insert("concurrency", concurrency);
+    map.insert("probe_rate", probeRate);
+    map.insert("prefix_length_v4", prefixLength4);
+    map.insert("prefix_length_v6", prefixLength6);
+    return map;
+}
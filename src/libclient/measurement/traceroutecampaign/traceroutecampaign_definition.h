@@ -0,0 +1,46 @@
+#ifndef TRACEROUTECAMPAIGN_DEFINITION_H
+#define TRACEROUTECAMPAIGN_DEFINITION_H
+
+#include "../measurementdefinition.h"
+#include "../../types.h"
+
+#include <QStringList>
+
+class TracerouteCampaignDefinition;
+
+typedef QSharedPointer<TracerouteCampaignDefinition> TracerouteCampaignDefinitionPtr;
+typedef QList<TracerouteCampaignDefinitionPtr> TracerouteCampaignDefinitionList;
+
+class CLIENT_API TracerouteCampaignDefinition : public MeasurementDefinition
+{
+public:
+    TracerouteCampaignDefinition(const QStringList &hosts, const quint32 &count,
+                                 const quint32 &receiveTimeout, const quint16 &destinationPort,
+                                 const quint32 &payload, const quint32 &maxTtl,
+                                 const quint32 &startTtl, const quint32 &maxSilentHops,
+                                 const quint32 &concurrency, const quint32 &probeRate,
+                                 const quint32 &prefixLength4, const quint32 &prefixLength6);
+    ~TracerouteCampaignDefinition();
+
+    // Storage
+    static TracerouteCampaignDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getters
+    QStringList hosts;
+    quint32 count; // probes per hop
+    quint32 receiveTimeout;
+    quint16 destinationPort; // first of max_ttl * count ports, one per probe and TTL
+    quint32 payload;
+    quint32 maxTtl;
+    quint32 startTtl; // first hop probed, forward from here, then backward
+    quint32 maxSilentHops;
+    quint32 concurrency; // destinations traced at the same time
+    quint32 probeRate; // probes per second for the whole campaign
+    quint32 prefixLength4; // destinations sharing this prefix share global stop set entries
+    quint32 prefixLength6;
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // TRACEROUTECAMPAIGN_DEFINITION_H
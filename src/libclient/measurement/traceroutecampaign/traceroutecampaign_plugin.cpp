@@ -0,0 +1,21 @@
+#include "traceroutecampaign_plugin.h"
+#include "traceroutecampaign.h"
+#include "traceroutecampaign_definition.h"
+
+QStringList TracerouteCampaignPlugin::measurements() const
+{
+    return QStringList()
+           << "traceroute_campaign";
+}
+
+MeasurementPtr TracerouteCampaignPlugin::createMeasurement(const QString &name)
+{
+    Q_UNUSED(name);
+    return MeasurementPtr(new TracerouteCampaign);
+}
+
+MeasurementDefinitionPtr TracerouteCampaignPlugin::createMeasurementDefinition(const QString &name, const QVariant &data)
+{
+    Q_UNUSED(name);
+    return TracerouteCampaignDefinition::fromVariant(data);
+}
@@ -0,0 +1,18 @@
+#ifndef TRACEROUTECAMPAIGN_PLUGIN_H
+#define TRACEROUTECAMPAIGN_PLUGIN_H
+
+#include "../measurement.h"
+#include "../measurementdefinition.h"
+#include "../measurementplugin.h"
+
+class TracerouteCampaignPlugin : public MeasurementPlugin
+{
+public:
+    // MeasurementPlugin interface
+    QStringList measurements() const;
+
+    MeasurementPtr createMeasurement(const QString &name);
+    MeasurementDefinitionPtr createMeasurementDefinition(const QString &name, const QVariant &data);
+};
+
+#endif // TRACEROUTECAMPAIGN_PLUGIN_H
@@ -0,0 +1,538 @@
+#include "videostreaming.h"
+#include "../../log/logger.h"
+#include "../../types.h"
+
+#include <QTcpSocket>
+
+LOGGER(VideoStreaming);
+
+VideoStreaming::VideoStreaming(QObject *parent)
+: Measurement(parent)
+, currentStatus(VideoStreaming::Unknown)
+, socket(NULL)
+, scratch(scratchSize, Qt::Uninitialized)
+, currentSegment(0)
+, slotCount(0)
+, sampleCount(0)
+, requestPending(false)
+, requestSent(false)
+, done(false)
+, buffer(0)
+, lastUpdate(0)
+, playing(false)
+, startupDelay(-1)
+, stallStart(-1)
+, stallCount(0)
+, stallDuration(0)
+{
+    connect(this, SIGNAL(error(const QString &)), this,
+            SLOT(setErrorString(const QString &)));
+
+    requestTimer.setSingleShot(true);
+    timeoutTimer.setSingleShot(true);
+    connect(&requestTimer, SIGNAL(timeout()), this, SLOT(requestSegment()));
+    connect(&slotTimer, SIGNAL(timeout()), this, SLOT(sampleSlot()));
+    connect(&timeoutTimer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+VideoStreaming::~VideoStreaming()
+{
+}
+
+Measurement::Status VideoStreaming::status() const
+{
+    return currentStatus;
+}
+
+bool VideoStreaming::prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition)
+{
+    Q_UNUSED(networkManager)
+
+    definition = measurementDefinition.dynamicCast<VideoStreamingDefinition>();
+
+    if (definition.isNull())
+    {
+        setErrorString("received NULL definition");
+        return false;
+    }
+
+    if (definition->bitrates.isEmpty())
+    {
+        setErrorString("no bitrates given");
+        return false;
+    }
+
+    for (int i = 0; i < definition->bitrates.size(); i++)
+    {
+        if (definition->bitrates.at(i) <= 0 || (i > 0 && definition->bitrates.at(i) <= definition->bitrates.at(i - 1)))
+        {
+            setErrorString("bitrates must be positive and ascending");
+            return false;
+        }
+    }
+
+    if (definition->segmentDuration < minSegmentDuration)
+    {
+        setErrorString("requested segment duration wrong");
+        return false;
+    }
+
+    if (definition->segmentCount < 1 || definition->segmentCount > maxSegmentCount)
+    {
+        setErrorString("requested segment count wrong");
+        return false;
+    }
+
+    if (definition->bufferSize < definition->segmentDuration)
+    {
+        setErrorString("requested buffer size wrong");
+        return false;
+    }
+
+    if (definition->reservoir < 0 || definition->cushion <= 0)
+    {
+        setErrorString("requested reservoir or cushion wrong");
+        return false;
+    }
+
+    if (definition->timeout < definition->segmentDuration || definition->timeout > maxTimeout)
+    {
+        setErrorString("requested timeout wrong");
+        return false;
+    }
+
+    if (definition->slotLength < minSlotLength || definition->slotLength > definition->timeout)
+    {
+        setErrorString("requested slot length wrong");
+        return false;
+    }
+
+    QUrl url = QUrl::fromUserInput(QString(definition->url).replace("$Bandwidth$", "0").replace("$Number$", "0"));
+
+    if (!url.isValid() || url.scheme() != "http")
+    {
+        setErrorString("invalid URL");
+        return false;
+    }
+
+    // everything that grows with the session is allocated here
+    Segment segment;
+    segment.bitrate = 0;
+    segment.bytes = 0;
+    segment.requestTime = -1;
+    segment.doneTime = -1;
+    segment.bufferLevel = 0;
+    segments.fill(segment, definition->segmentCount);
+
+    slotCount = definition->timeout / definition->slotLength + 1;
+    slotBytes.fill(0, slotCount);
+    bufferSlots.fill(0, slotCount);
+
+    return true;
+}
+
+bool VideoStreaming::start()
+{
+    socket = new QTcpSocket(this);
+    connect(socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketError()));
+    connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(socketClosed()));
+
+    clock.start();
+    slotTimer.start(definition->slotLength);
+    timeoutTimer.start(definition->timeout);
+    setStatus(VideoStreaming::Running);
+
+    requestSegment();
+
+    return true;
+}
+
+bool VideoStreaming::stop()
+{
+    done = true;
+    requestTimer.stop();
+    slotTimer.stop();
+    timeoutTimer.stop();
+
+    if (socket)
+    {
+        socket->disconnect(this);
+        socket->abort();
+    }
+
+    return true;
+}
+
+Result VideoStreaming::result() const
+{
+    return Result(results);
+}
+
+void VideoStreaming::setStatus(Status status)
+{
+    if (currentStatus != status)
+    {
+        currentStatus = status;
+        emit statusChanged(status);
+    }
+}
+
+int VideoStreaming::chooseBitrate() const
+{
+    const QList<int> &bitrates = definition->bitrates;
+    qint64 reservoir = (qint64)definition->reservoir * 1000000;
+    qint64 cushion = (qint64)definition->cushion * 1000000;
+
+    if (buffer <= reservoir)
+    {
+        return bitrates.first();
+    }
+
+    if (buffer >= reservoir + cushion)
+    {
+        return bitrates.last();
+    }
+
+    // highest bitrate below the linear map of the buffer level
+    qreal target = bitrates.first() + (bitrates.last() - bitrates.first()) * (qreal)(buffer - reservoir) / cushion;
+    int bitrate = bitrates.first();
+
+    foreach (int candidate, bitrates)
+    {
+        if (candidate <= target)
+        {
+            bitrate = candidate;
+        }
+    }
+
+    return bitrate;
+}
+
+void VideoStreaming::updateBuffer(qint64 now)
+{
+    if (playing)
+    {
+        qint64 played = now - lastUpdate;
+
+        if (played >= buffer)
+        {
+            // ran dry at lastUpdate + buffer
+            stallStart = lastUpdate + buffer;
+            stallCount++;
+            buffer = 0;
+            playing = false;
+        }
+        else
+        {
+            buffer -= played;
+        }
+    }
+
+    lastUpdate = now;
+}
+
+void VideoStreaming::requestSegment()
+{
+    if (done)
+    {
+        return;
+    }
+
+    qint64 now = clock.nsecsElapsed();
+    updateBuffer(now);
+
+    // a player only requests what fits into its buffer
+    qint64 excess = buffer + (qint64)(definition->segmentDuration - definition->bufferSize) * 1000000;
+
+    if (excess > 0)
+    {
+        requestTimer.start(excess / 1000000 + 1);
+        return;
+    }
+
+    Segment &segment = segments[currentSegment];
+    segment.bitrate = chooseBitrate();
+    segment.requestTime = now;
+
+    segmentUrl = QUrl::fromUserInput(QString(definition->url)
+                                     .replace("$Bandwidth$", QString::number(segment.bitrate * 1000))
+                                     .replace("$Number$", QString::number(currentSegment + 1)));
+
+    if (socket->state() == QAbstractSocket::ConnectedState)
+    {
+        sendRequest();
+        return;
+    }
+
+    requestPending = true;
+
+    if (socket->state() == QAbstractSocket::UnconnectedState)
+    {
+        socket->connectToHost(segmentUrl.host(), segmentUrl.port(defaultPort));
+    }
+}
+
+void VideoStreaming::sendRequest()
+{
+    QString path = segmentUrl.path(QUrl::FullyEncoded);
+
+    if (path.isEmpty())
+    {
+        path = "/";
+    }
+
+    if (segmentUrl.hasQuery())
+    {
+        path.append('?').append(segmentUrl.query(QUrl::FullyEncoded));
+    }
+
+    QString host = segmentUrl.port(defaultPort) == defaultPort
+                   ? segmentUrl.host() : QString("%1:%2").arg(segmentUrl.host()).arg(segmentUrl.port());
+
+    QByteArray request = QString("GET %1 HTTP/1.1\r\n"
+                                 "Host: %2\r\n"
+                                 "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.9; rv:31.0) Gecko/20100101 Firefox/31.0\r\n"
+                                 "Accept: */*\r\n"
+                                 "Connection: keep-alive\r\n\r\n").arg(path).arg(host).toLatin1();
+
+    requestPending = false;
+    parser.reset();
+
+    if (socket->write(request) != request.size())
+    {
+        fail("Unable to send the segment request");
+        return;
+    }
+
+    requestSent = true;
+}
+
+void VideoStreaming::segmentDone(qint64 now)
+{
+    requestSent = false;
+
+    if (parser.statusCode() != 200)
+    {
+        fail(QString("Segment %1 request failed with HTTP status %2").arg(currentSegment + 1)
+             .arg(parser.statusCode()));
+        return;
+    }
+
+    updateBuffer(now);
+    buffer += (qint64)definition->segmentDuration * 1000000;
+
+    Segment &segment = segments[currentSegment];
+    segment.bytes = parser.bodySize();
+    segment.doneTime = now;
+    segment.bufferLevel = buffer;
+
+    // playback (re)starts as soon as a segment is buffered
+    if (!playing)
+    {
+        playing = true;
+
+        if (startupDelay < 0)
+        {
+            startupDelay = now;
+        }
+        else
+        {
+            stallDuration += now - stallStart;
+        }
+    }
+
+    if (!parser.keepAlive())
+    {
+        // reconnects with the next request
+        socket->abort();
+    }
+
+    if (++currentSegment == segments.size())
+    {
+        finish(true);
+        return;
+    }
+
+    requestSegment();
+}
+
+void VideoStreaming::finish(bool completed)
+{
+    qint64 now = clock.nsecsElapsed();
+    updateBuffer(now);
+
+    stop();
+    calculateResults(completed);
+    setStatus(VideoStreaming::Finished);
+
+    // may be called from socket signals, let them return first
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+void VideoStreaming::fail(const QString &message)
+{
+    stop();
+    setStatus(VideoStreaming::Finished);
+
+    QMetaObject::invokeMethod(this, "error", Qt::QueuedConnection, Q_ARG(QString, message));
+}
+
+void VideoStreaming::calculateResults(bool completed)
+{
+    QVariantList segmentResults;
+    QList<qreal> slotThroughput;
+    int switches = 0;
+    qint64 bitrateSum = 0;
+    qint64 stalled = stallDuration;
+
+    // a stall that lasts until the end
+    if (!playing && startupDelay >= 0)
+    {
+        stalled += lastUpdate - stallStart;
+    }
+
+    for (int i = 0; i < currentSegment; i++)
+    {
+        const Segment &segment = segments.at(i);
+
+        QVariantMap map;
+        map.insert("bitrate", segment.bitrate);
+        map.insert("bytes", segment.bytes);
+        map.insert("request_ns", segment.requestTime);
+        map.insert("done_ns", segment.doneTime);
+        map.insert("buffer_ms", segment.bufferLevel / 1000000);
+        segmentResults.append(map);
+
+        bitrateSum += segment.bitrate;
+
+        if (i > 0 && segment.bitrate != segments.at(i - 1).bitrate)
+        {
+            switches++;
+        }
+    }
+
+    // only complete slots, the last one is cut short
+    int lastSlot = qMin<qint64>(lastUpdate / ((qint64)definition->slotLength * 1000000), slotCount);
+
+    for (int i = 0; i < lastSlot; i++)
+    {
+        slotThroughput.append(slotBytes.at(i) * 8 * 1000.0 / definition->slotLength);
+    }
+
+    results.insert("completed", completed);
+    results.insert("segments_downloaded", currentSegment);
+    results.insert("startup_delay_ns", startupDelay);
+    results.insert("stall_count", stallCount);
+    results.insert("stall_duration_ns", stalled);
+    results.insert("bitrate_switches", switches);
+    results.insert("average_bitrate", currentSegment > 0 ? (qreal)bitrateSum / currentSegment : 0.0);
+    results.insert("segments", segmentResults);
+    results.insert("buffer_level", listToVariant(bufferSlots.mid(0, sampleCount).toList()));
+    results.insert("slots", listToVariant(slotThroughput));
+}
+
+void VideoStreaming::socketConnected()
+{
+    if (requestPending)
+    {
+        sendRequest();
+    }
+}
+
+void VideoStreaming::socketError()
+{
+    // errors of an open connection show up as a close
+    if (requestPending)
+    {
+        fail(QString("Unable to connect: %1").arg(socket->errorString()));
+    }
+}
+
+void VideoStreaming::socketReadyRead()
+{
+    qint64 readResult;
+
+    while ((readResult = socket->read(scratch.data(), scratch.size())) > 0)
+    {
+        qint64 now = clock.nsecsElapsed();
+        int slot = now / ((qint64)definition->slotLength * 1000000);
+
+        if (slot < slotCount)
+        {
+            slotBytes[slot] += readResult;
+        }
+
+        if (!requestSent)
+        {
+            LOG_WARNING("Unexpected data on the connection");
+            continue;
+        }
+
+        parser.feed(scratch.constData(), readResult);
+
+        if (!parser.isValid())
+        {
+            fail(QString("Invalid response for segment %1").arg(currentSegment + 1));
+            return;
+        }
+
+        // there is no more data until the next request
+        if (parser.isComplete())
+        {
+            segmentDone(now);
+            return;
+        }
+    }
+}
+
+void VideoStreaming::socketClosed()
+{
+    // the next request came while the connection was going down
+    if (requestPending)
+    {
+        socket->connectToHost(segmentUrl.host(), segmentUrl.port(defaultPort));
+        return;
+    }
+
+    if (!requestSent)
+    {
+        return;
+    }
+
+    // whatever is still buffered arrived before the close
+    socketReadyRead();
+
+    if (!requestSent || done)
+    {
+        return;
+    }
+
+    // the segment may be delimited by the close
+    parser.finish();
+
+    if (!parser.isComplete())
+    {
+        fail(QString("Connection closed while loading segment %1").arg(currentSegment + 1));
+        return;
+    }
+
+    segmentDone(clock.nsecsElapsed());
+}
+
+void VideoStreaming::sampleSlot()
+{
+    updateBuffer(clock.nsecsElapsed());
+
+    if (sampleCount < slotCount)
+    {
+        bufferSlots[sampleCount++] = buffer / 1000000;
+    }
+}
+
+void VideoStreaming::timeout()
+{
+    LOG_WARNING(QString("Streaming timed out after %1 segments").arg(currentSegment));
+    finish(false);
+}
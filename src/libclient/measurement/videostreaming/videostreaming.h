@@ -0,0 +1,114 @@
+#ifndef VIDEOSTREAMING_H
+#define VIDEOSTREAMING_H
+
+#include "../measurement.h"
+#include "../http/httpresponseparser.h"
+#include "videostreaming_definition.h"
+
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+
+class QTcpSocket;
+
+/*
+ * Emulates a segment based video player (DASH/HLS style). Segments of a
+ * fixed media duration are fetched one after the other over a persistent
+ * connection, the bitrate of each is chosen by a buffer based algorithm
+ * (BBA-0): the lowest bitrate while the buffer is below the reservoir, the
+ * highest once it is above reservoir + cushion, linear in between. Playback
+ * is simulated against the monotonic clock, it starts once a segment is
+ * buffered and stalls whenever the buffer runs dry. Like HTTPDownload the
+ * received bytes are binned into fixed slots, the buffer level is sampled
+ * at every slot; all per-segment and per-slot state is preallocated.
+ */
+class CLIENT_API VideoStreaming : public Measurement
+{
+    Q_OBJECT
+
+public:
+    explicit VideoStreaming(QObject *parent = 0);
+    ~VideoStreaming();
+
+    // Measurement interface
+    Status status() const;
+    bool prepare(NetworkManager *networkManager, const MeasurementDefinitionPtr &measurementDefinition);
+    bool start();
+    bool stop();
+    Result result() const;
+
+private:
+    struct Segment
+    {
+        int bitrate; // kbps
+        qint64 bytes;
+        // ns since the start of the measurement, -1 if not reached
+        qint64 requestTime;
+        qint64 doneTime;
+        qint64 bufferLevel; // ns of media buffered once the segment arrived
+    };
+
+    void setStatus(Status status);
+    int chooseBitrate() const;
+    void updateBuffer(qint64 now);
+    void sendRequest();
+    void segmentDone(qint64 now);
+    void finish(bool completed);
+    void fail(const QString &message);
+    void calculateResults(bool completed);
+
+    VideoStreamingDefinitionPtr definition;
+    Status currentStatus;
+
+    QTcpSocket *socket;
+    HttpResponseParser parser;
+    QUrl segmentUrl;
+    QByteArray scratch;
+    QElapsedTimer clock;
+    QTimer requestTimer; // waits until the buffer has room for a segment
+    QTimer slotTimer;
+    QTimer timeoutTimer;
+
+    QVector<Segment> segments;
+    QVector<qint64> slotBytes;
+    QVector<int> bufferSlots; // buffer level in ms at the end of each slot
+    int currentSegment;
+    int slotCount;
+    int sampleCount;
+    bool requestPending; // waits for the connection
+    bool requestSent;
+    bool done;
+
+    // playback state, all in ns
+    qint64 buffer;
+    qint64 lastUpdate;
+    bool playing;
+    qint64 startupDelay;
+    qint64 stallStart;
+    int stallCount;
+    qint64 stallDuration;
+
+    QVariantMap results;
+
+    static const int minSegmentDuration = 100;
+    static const int maxSegmentCount = 10000;
+    static const int minSlotLength = 100;
+    static const int maxTimeout = 3600000;
+    static const int defaultPort = 80;
+    static const int scratchSize = 65536;
+
+private slots:
+    void requestSegment();
+    void socketConnected();
+    void socketError();
+    void socketReadyRead();
+    void socketClosed();
+    void sampleSlot();
+    void timeout();
+
+signals:
+    void statusChanged(Status status);
+};
+
+#endif // VIDEOSTREAMING_H
@@ -0,0 +1,55 @@
+#include "videostreaming_definition.h"
+#include "../../types.h"
+
+VideoStreamingDefinition::VideoStreamingDefinition(const QString &url, const QList<int> &bitrates,
+                                                   const int segmentDuration, const int segmentCount,
+                                                   const int bufferSize, const int reservoir,
+                                                   const int cushion, const int slotLength, const int timeout)
+: url(url)
+, bitrates(bitrates)
+, segmentDuration(segmentDuration)
+, segmentCount(segmentCount)
+, bufferSize(bufferSize)
+, reservoir(reservoir)
+, cushion(cushion)
+, slotLength(slotLength)
+, timeout(timeout)
+{
+
+}
+
+VideoStreamingDefinition::~VideoStreamingDefinition()
+{
+
+}
+
+VideoStreamingDefinitionPtr VideoStreamingDefinition::fromVariant(const QVariant &variant)
+{
+    QVariantMap map = variant.toMap();
+    QVariant bitrates = map.value("bitrates", QVariantList() << 350 << 750 << 1500 << 3000 << 6000);
+
+    return VideoStreamingDefinitionPtr(new VideoStreamingDefinition(map.value("url", "").toString(),
+                                                                    listFromVariant<int>(bitrates),
+                                                                    map.value("segment_duration", 2000).toInt(),
+                                                                    map.value("segment_count", 30).toInt(),
+                                                                    map.value("buffer_size", 30000).toInt(),
+                                                                    map.value("reservoir", 5000).toInt(),
+                                                                    map.value("cushion", 15000).toInt(),
+                                                                    map.value("slot_length", 1000).toInt(),
+                                                                    map.value("timeout", 120000).toInt()));
+}
+
+QVariant VideoStreamingDefinition::toVariant() const
+{
+    QVariantMap map;
+    map.insert("url", url);
+    map.insert("bitrates", listToVariant(bitrates));
+    map.insert("segment_duration", segmentDuration);
+    map.insert("segment_count", segmentCount);
+    map.insert("buffer_size", bufferSize);
+    map.insert("reservoir", reservoir);
+    map.insert("cushion", cushion);
+    map.insert("slot_length", slotLength);
+    map.insert("timeout", timeout);
+    return map;
+}
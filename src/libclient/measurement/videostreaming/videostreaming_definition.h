@@ -0,0 +1,37 @@
+#ifndef VIDEOSTREAMING_DEFINITION_H
+#define VIDEOSTREAMING_DEFINITION_H
+
+#include "../measurementdefinition.h"
+
+class VideoStreamingDefinition;
+
+typedef QSharedPointer<VideoStreamingDefinition> VideoStreamingDefinitionPtr;
+typedef QList<VideoStreamingDefinitionPtr> VideoStreamingDefinitionList;
+
+class CLIENT_API VideoStreamingDefinition : public MeasurementDefinition
+{
+public:
+    VideoStreamingDefinition(const QString &url, const QList<int> &bitrates, const int segmentDuration,
+                             const int segmentCount, const int bufferSize, const int reservoir,
+                             const int cushion, const int slotLength, const int timeout);
+    ~VideoStreamingDefinition();
+
+    // Storage
+    static VideoStreamingDefinitionPtr fromVariant(const QVariant &variant);
+
+    // Getters
+    QString url; // segment template with $Bandwidth$ (bps) and $Number$
+    QList<int> bitrates; // kbps, ascending
+    int segmentDuration; // ms of media per segment
+    int segmentCount;
+    int bufferSize; // ms of media the player buffers at most
+    int reservoir; // ms, below this the lowest bitrate is used
+    int cushion; // ms, above reservoir + cushion the highest bitrate is used
+    int slotLength;
+    int timeout;
+
+    // Serializable interface
+    QVariant toVariant() const;
+};
+
+#endif // VIDEOSTREAMING_DEFINITION_H
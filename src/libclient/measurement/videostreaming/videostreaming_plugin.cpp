@@ -0,0 +1,21 @@
+#include "videostreaming_plugin.h"
+#include "videostreaming.h"
+#include "videostreaming_definition.h"
+
+QStringList VideoStreamingPlugin::measurements() const
+{
+    return QStringList()
+           << "videostreaming";
+}
+
+MeasurementPtr VideoStreamingPlugin::createMeasurement(const QString &name)
+{
+    Q_UNUSED(name);
+    return MeasurementPtr(new VideoStreaming);
+}
+
+MeasurementDefinitionPtr VideoStreamingPlugin::createMeasurementDefinition(const QString &name, const QVariant &data)
+{
+    Q_UNUSED(name);
+    return VideoStreamingDefinition::fromVariant(data);
+}
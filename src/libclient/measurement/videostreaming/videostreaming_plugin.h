@@ -0,0 +1,16 @@
+#ifndef VIDEOSTREAMING_PLUGIN_H
+#define VIDEOSTREAMING_PLUGIN_H
+
+#include "../measurementplugin.h"
+
+class VideoStreamingPlugin : public MeasurementPlugin
+{
+public:
+    // MeasurementPlugin interface
+    QStringList measurements() const;
+
+    MeasurementPtr createMeasurement(const QString &name);
+    MeasurementDefinitionPtr createMeasurementDefinition(const QString &name, const QVariant &data);
+};
+
+#endif // VIDEOSTREAMING_PLUGIN_H
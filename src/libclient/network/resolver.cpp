@@ -0,0 +1,214 @@
+#include "resolver.h"
+#include "../measurement/measurement.h"
+#include "../log/logger.h"
+
+#include <QPointer>
+
+LOGGER(Resolver);
+
+namespace
+{
+    // ms until cached answers and failures expire
+    const qint64 positiveTtl = 60000;
+    const qint64 negativeTtl = 10000;
+}
+
+/*
+ * One pending lookupHost() call, lives in the thread of the caller which
+ * is where the receiver gets called.
+ */
+class ResolverLookup : public QObject
+{
+    Q_OBJECT
+
+public:
+    ResolverLookup(Resolver *resolver, int id, const QString &name, QObject *receiver,
+                   const char *member)
+    : resolver(resolver)
+    , id(id)
+    , hostInfoId(-1)
+    , name(name)
+    , receiver(receiver)
+    , fromCache(false)
+    , aborted(false)
+    {
+        // SLOT() prefixes the signature with a code, invokeMethod() wants
+        // the bare name
+        QByteArray signature(member + 1);
+        method = signature.left(signature.indexOf('('));
+        timer.start();
+    }
+
+    Resolver *resolver;
+    int id;
+    int hostInfoId;
+    QString name;
+    QPointer<QObject> receiver;
+    QByteArray method;
+    QElapsedTimer timer;
+    QHostInfo info;
+    bool fromCache;
+    bool aborted;
+
+public slots:
+    void lookedUp(const QHostInfo &result)
+    {
+        resolver->store(name, result);
+        info = result;
+        deliver();
+    }
+
+    void deliver()
+    {
+        if (aborted)
+        {
+            return;
+        }
+
+        resolver->finished(id);
+        info.setLookupId(id);
+        Resolver::record(receiver, name, info, fromCache, timer.nsecsElapsed());
+
+        if (receiver)
+        {
+            QMetaObject::invokeMethod(receiver, method.constData(), Qt::DirectConnection, Q_ARG(QHostInfo, info));
+        }
+
+        deleteLater();
+    }
+};
+
+Resolver::Resolver(QObject *parent)
+: QObject(parent)
+, m_nextId(0)
+{
+    m_clock.start();
+}
+
+Resolver::~Resolver()
+{
+}
+
+int Resolver::lookupHost(const QString &name, QObject *receiver, const char *member)
+{
+    int id;
+
+    m_mutex.lock();
+    id = m_nextId++;
+    m_mutex.unlock();
+
+    ResolverLookup *lookup = new ResolverLookup(this, id, name, receiver, member);
+
+    m_mutex.lock();
+    m_lookups.insert(id, lookup);
+    m_mutex.unlock();
+
+    if (cached(name, &lookup->info))
+    {
+        // callers expect the result later, like from QHostInfo
+        lookup->fromCache = true;
+        QMetaObject::invokeMethod(lookup, "deliver", Qt::QueuedConnection);
+    }
+    else
+    {
+        lookup->hostInfoId = QHostInfo::lookupHost(name, lookup, SLOT(lookedUp(QHostInfo)));
+    }
+
+    return id;
+}
+
+void Resolver::abortHostLookup(int id)
+{
+    m_mutex.lock();
+    ResolverLookup *lookup = m_lookups.take(id);
+    m_mutex.unlock();
+
+    if (!lookup)
+    {
+        return;
+    }
+
+    if (lookup->hostInfoId >= 0)
+    {
+        QHostInfo::abortHostLookup(lookup->hostInfoId);
+    }
+
+    lookup->aborted = true;
+    lookup->deleteLater();
+}
+
+bool Resolver::cached(const QString &name, QHostInfo *info)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, CacheEntry>::iterator it = m_cache.find(name);
+
+    if (it == m_cache.end())
+    {
+        return false;
+    }
+
+    if (it.value().expires <= m_clock.elapsed())
+    {
+        m_cache.erase(it);
+        return false;
+    }
+
+    *info = it.value().info;
+
+    return true;
+}
+
+void Resolver::store(const QString &name, const QHostInfo &info)
+{
+    CacheEntry entry;
+
+    // timeouts and other transient errors are not worth remembering
+    if (info.error() == QHostInfo::NoError && !info.addresses().isEmpty())
+    {
+        entry.expires = m_clock.elapsed() + positiveTtl;
+    }
+    else if (info.error() == QHostInfo::HostNotFound)
+    {
+        entry.expires = m_clock.elapsed() + negativeTtl;
+    }
+    else
+    {
+        return;
+    }
+
+    entry.info = info;
+
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(name, entry);
+}
+
+void Resolver::finished(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_lookups.remove(id);
+}
+
+void Resolver::record(QObject *receiver, const QString &name, const QHostInfo &info, bool cached,
+                      qint64 latency)
+{
+    Measurement *measurement = qobject_cast<Measurement *>(receiver);
+
+    if (!measurement)
+    {
+        return;
+    }
+
+    QVariantMap resolution;
+    resolution.insert("host", name);
+    resolution.insert("latency_us", latency / 1000);
+    resolution.insert("cached", cached);
+
+    if (info.error() != QHostInfo::NoError)
+    {
+        resolution.insert("error", info.errorString());
+    }
+
+    measurement->addResolution(resolution);
+}
+
+#include "resolver.moc"
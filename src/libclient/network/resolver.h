@@ -0,0 +1,61 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "../export.h"
+
+#include <QObject>
+#include <QHostInfo>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+
+class ResolverLookup;
+
+/*
+ * Name resolution shared by the whole client. Answers are cached, failed
+ * lookups (host not found) for a shorter time. The system resolver does not
+ * report record TTLs, so entries expire after a fixed time which stays below
+ * common TTLs.
+ *
+ * Lookups done for a measurement are recorded with their latency in its
+ * pre_info if the receiver is the measurement.
+ *
+ * Thread safe. Results are always delivered asynchronously, cached ones
+ * included, by a direct call in the thread that started the lookup.
+ */
+class CLIENT_API Resolver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Resolver(QObject *parent = 0);
+    ~Resolver();
+
+    // same semantics as QHostInfo::lookupHost(), the result carries the
+    // returned id
+    int lookupHost(const QString &name, QObject *receiver, const char *member);
+    void abortHostLookup(int id);
+
+private:
+    friend class ResolverLookup;
+
+    struct CacheEntry
+    {
+        QHostInfo info;
+        qint64 expires;
+    };
+
+    bool cached(const QString &name, QHostInfo *info);
+    void store(const QString &name, const QHostInfo &info);
+    void finished(int id);
+    static void record(QObject *receiver, const QString &name, const QHostInfo &info, bool cached,
+                       qint64 latency);
+
+    QMutex m_mutex;
+    QHash<QString, CacheEntry> m_cache;
+    QHash<int, ResolverLookup *> m_lookups;
+    int m_nextId;
+    QElapsedTimer m_clock;
+};
+
+#endif // RESOLVER_H
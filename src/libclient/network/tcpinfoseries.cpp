@@ -0,0 +1,99 @@
+#include "tcpinfoseries.h"
+
+#if defined(Q_OS_LINUX)
+#include <stddef.h>
+#include <sys/socket.h>
+#include <linux/tcp.h>
+#endif
+
+namespace
+{
+    template <typename T>
+    QVariantList toList(const QVector<T> &values)
+    {
+        QVariantList list;
+        list.reserve(values.size());
+
+        foreach (const T &value, values)
+        {
+            list << value;
+        }
+
+        return list;
+    }
+}
+
+TcpInfoSeries::TcpInfoSeries(int capacity)
+{
+    reserve(capacity);
+}
+
+void TcpInfoSeries::reserve(int capacity)
+{
+    m_time.reserve(capacity);
+    m_rtt.reserve(capacity);
+    m_rttVar.reserve(capacity);
+    m_sndCwnd.reserve(capacity);
+    m_retransmits.reserve(capacity);
+    m_rcvSpace.reserve(capacity);
+    m_deliveryRate.reserve(capacity);
+}
+
+bool TcpInfoSeries::sample(int fd, qint64 time)
+{
+#if defined(Q_OS_LINUX)
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+
+    if (fd < 0 || getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) < 0)
+    {
+        return false;
+    }
+
+    m_time << time;
+    m_rtt << info.tcpi_rtt;
+    m_rttVar << info.tcpi_rttvar;
+    m_sndCwnd << info.tcpi_snd_cwnd;
+    m_retransmits << info.tcpi_total_retrans;
+    m_rcvSpace << info.tcpi_rcv_space;
+
+    // older kernels return a shorter struct without the delivery rate
+    if (length >= offsetof(struct tcp_info, tcpi_delivery_rate) + sizeof(info.tcpi_delivery_rate))
+    {
+        m_deliveryRate << info.tcpi_delivery_rate * 8;
+    }
+    else
+    {
+        m_deliveryRate << 0;
+    }
+
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(time);
+    return false;
+#endif
+}
+
+int TcpInfoSeries::size() const
+{
+    return m_time.size();
+}
+
+bool TcpInfoSeries::isEmpty() const
+{
+    return m_time.isEmpty();
+}
+
+QVariantMap TcpInfoSeries::toVariant() const
+{
+    QVariantMap map;
+    map.insert("time", toList(m_time));
+    map.insert("rtt", toList(m_rtt));
+    map.insert("rttvar", toList(m_rttVar));
+    map.insert("snd_cwnd", toList(m_sndCwnd));
+    map.insert("retransmits", toList(m_retransmits));
+    map.insert("rcv_space", toList(m_rcvSpace));
+    map.insert("delivery_rate", toList(m_deliveryRate));
+    return map;
+}
@@ -0,0 +1,43 @@
+#ifndef TCPINFOSERIES_H
+#define TCPINFOSERIES_H
+
+#include "../export.h"
+
+#include <QVariant>
+#include <QVector>
+
+/*
+ * Time series of TCP_INFO samples of one connection, to tell whether a
+ * throughput result was limited by loss, the receive window or the RTT.
+ * Stored column-wise and exported the same way to keep results compact.
+ * Sampling does nothing where TCP_INFO is not available (non-Linux).
+ */
+class CLIENT_API TcpInfoSeries
+{
+public:
+    // reserves room for capacity samples, sample() does not allocate below that
+    explicit TcpInfoSeries(int capacity = 0);
+
+    void reserve(int capacity);
+
+    // time in ms, relative to whatever the measurement uses as its start
+    bool sample(int fd, qint64 time);
+
+    int size() const;
+    bool isEmpty() const;
+
+    // {"time": [ms], "rtt": [us], "rttvar": [us], "snd_cwnd": [segments],
+    //  "retransmits": [total], "rcv_space": [bytes], "delivery_rate": [bps]}
+    QVariantMap toVariant() const;
+
+private:
+    QVector<qint64> m_time;
+    QVector<quint32> m_rtt;
+    QVector<quint32> m_rttVar;
+    QVector<quint32> m_sndCwnd;
+    QVector<quint32> m_retransmits;
+    QVector<quint32> m_rcvSpace;
+    QVector<quint64> m_deliveryRate;
+};
+
+#endif // TCPINFOSERIES_H
@@ -3,6 +3,9 @@
 #include <QNetworkInterface>
 #include <QHostInfo>
 #include <QStringList>
+#include <QDateTime>
+
+#include <string.h>
 
 bool RemoteHost::isValid() const
 {
@@ -69,3 +72,19 @@ RemoteHost NetworkHelper::remoteHost(const QString &hostname)
 
     return host;
 }
+
+QByteArray NetworkHelper::incompressiblePayload(int size)
+{
+    QByteArray payload(size, Qt::Uninitialized);
+    quint64 state = QDateTime::currentMSecsSinceEpoch() | 1;
+
+    for (int i = 0; i < payload.size(); i += 8)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        memcpy(payload.data() + i, &state, qMin(8, payload.size() - i));
+    }
+
+    return payload;
+}
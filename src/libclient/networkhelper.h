@@ -19,6 +19,10 @@ public:
     static bool isLocalIpAddress(const QHostAddress &host);
 
     static RemoteHost remoteHost(const QString &hostname);
+
+    // xorshift output for bulk transfers, it does not compress, so
+    // middleboxes can not make the link look faster than it is
+    static QByteArray incompressiblePayload(int size);
 };
 
 #endif // NETWORKHELPER_H
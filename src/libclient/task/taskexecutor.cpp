@@ -45,6 +45,7 @@ public slots:
 
             connect(measurement.data(), SIGNAL(finished()), this, SLOT(measurementFinished()));
             connect(measurement.data(), SIGNAL(error(const QString &)), this, SLOT(measurementError(const QString &)));
+            connect(measurement.data(), SIGNAL(resultAvailable(Result)), this, SLOT(measurementResult(Result)));
 
             if (observer)
             {
@@ -115,6 +116,17 @@ public slots:
         measurement.clear();
     }
 
+    void measurementResult(const Result &measurementResult)
+    {
+        Result result = measurementResult;
+        result.setStartDateTime(measurement->startDateTime());
+        result.setEndDateTime(measurement->startDateTime().addMSecs(timer.elapsed()));
+        result.setPreInfo(measurement->preInfo());
+        result.setPostInfo(localInformation.getVariables());
+
+        emit resultAvailable(currentTest, result);
+    }
+
     void measurementError(const QString &errorMsg)
     {
         measurement->disconnect(this, SLOT(measurementFinished()));
@@ -137,6 +149,7 @@ public slots:
 signals:
     void started(const ScheduleDefinition &test);
     void finished(const ScheduleDefinition &test, const Result &result);
+    void resultAvailable(const ScheduleDefinition &test, const Result &result);
 };
 
 class TaskExecutor::Private : public QObject
@@ -159,6 +172,8 @@ public:
 
         connect(&executor, SIGNAL(started(ScheduleDefinition)), q, SIGNAL(started(ScheduleDefinition)));
         connect(&executor, SIGNAL(finished(ScheduleDefinition, Result)), q, SIGNAL(finished(ScheduleDefinition, Result)));
+        connect(&executor, SIGNAL(resultAvailable(ScheduleDefinition, Result)), q,
+                SIGNAL(resultAvailable(ScheduleDefinition, Result)));
     }
 
     ~Private()
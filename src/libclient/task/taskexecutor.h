@@ -37,6 +37,8 @@ signals:
 
     void started(const ScheduleDefinition &test);
     void finished(const ScheduleDefinition &test, const Result &result);
+    // the measurement is still running, the result goes to the same report
+    void resultAvailable(const ScheduleDefinition &test, const Result &result);
 
 protected:
     class Private;
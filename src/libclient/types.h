@@ -29,7 +29,8 @@ namespace ping
         Unknown,
         System,
         Udp,
-        Tcp
+        Tcp,
+        Icmp
     };
 }
 
@@ -83,6 +84,10 @@ inline QString pingTypeToString(const ping::PingType &type)
     {
         return "Tcp";
     }
+    else if (type == ping::Icmp)
+    {
+        return "Icmp";
+    }
 
     return "";
 }
@@ -101,6 +106,10 @@ inline ping::PingType pingTypeFromString(const QString &type)
     {
         return ping::Tcp;
     }
+    else if (type == "Icmp")
+    {
+        return ping::Icmp;
+    }
 
     return ping::Unknown;
 }
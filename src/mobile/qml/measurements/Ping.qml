@@ -85,7 +85,8 @@ Base {
         {
             "label": "Type",
             "type": "ComboBox",
-            "model": ["System", "Udp", "Tcp"]
+            "model": Qt.platform.os === "linux" || Qt.platform.os === "android" ?
+                         ["Icmp", "System", "Udp", "Tcp"] : ["System", "Udp", "Tcp"]
         }
 
     ]
@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG -= app_bundle
+QT += testlib network
+
+TARGET = tst_dnsquery
+HEADERS = ../stubserver.h
+SOURCES = tst_dnsquery.cpp
+
+include($$SOURCE_DIRECTORY/src/libclient/libclient.pri)
@@ -0,0 +1,295 @@
+#include <QtTest>
+#include <QUdpSocket>
+
+#include "measurement/dnsquery/dnsquery.h"
+#include "../stubserver.h"
+
+// answers A and AAAA queries for *.example on the same UDP and TCP port
+class StubServer : public StubTcpServer
+{
+    Q_OBJECT
+
+public:
+    StubServer()
+    : udpQueries(0)
+    , tcpQueries(0)
+    , dropped(false)
+    {
+        // the TCP fallback goes to the port of the UDP server
+        for (int i = 0; i < 10; i++)
+        {
+            udp.bind(QHostAddress::LocalHost, 0);
+
+            if (server.listen(QHostAddress::LocalHost, udp.localPort()))
+            {
+                break;
+            }
+
+            udp.close();
+        }
+
+        connect(&udp, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+    }
+
+    QString address() const
+    {
+        return QString("127.0.0.1:%1").arg(udp.localPort());
+    }
+
+    QUdpSocket udp;
+    int udpQueries;
+    int tcpQueries;
+    bool dropped;
+
+protected:
+    // answers every length prefixed query over TCP
+    void process(QTcpSocket *socket, QByteArray &buffer)
+    {
+        while (buffer.size() >= 2)
+        {
+            int length = ((quint8)buffer.at(0) << 8) | (quint8)buffer.at(1);
+
+            if (buffer.size() < 2 + length)
+            {
+                break;
+            }
+
+            QByteArray response = answer(buffer.mid(2, length), true);
+            buffer.remove(0, 2 + length);
+            tcpQueries++;
+
+            QByteArray prefix;
+            append16(prefix, response.size());
+            socket->write(prefix + response);
+        }
+    }
+
+private:
+    static void append16(QByteArray &data, quint16 value)
+    {
+        data.append((char)(value >> 8));
+        data.append((char)(value & 0xff));
+    }
+
+    static void appendRecord(QByteArray &data, quint16 type, quint32 ttl, const QByteArray &rdata)
+    {
+        append16(data, 0xc00c); // the name of the question
+        append16(data, type);
+        append16(data, 1);
+        append16(data, ttl >> 16);
+        append16(data, ttl & 0xffff);
+        append16(data, rdata.size());
+        data.append(rdata);
+    }
+
+    static QByteArray answer(const QByteArray &query, bool overTcp)
+    {
+        DnsMessage message;
+        message.parse(query);
+
+        QString name = message.questionName();
+        quint16 type = message.questionType();
+        QByteArray response = query;
+        int rcode = 0;
+        bool truncated = false;
+        int answers = 0;
+
+        if (name == "nx.example")
+        {
+            rcode = 3;
+        }
+        else if (name == "big.example" && !overTcp)
+        {
+            truncated = true;
+        }
+        else if (name == "big.example")
+        {
+            for (answers = 0; answers < 20; answers++)
+            {
+                appendRecord(response, DnsMessage::A, 30, QByteArray("\xc0\x00\x02", 3) + (char)answers);
+            }
+        }
+        else if (name == "many.example" && type == DnsMessage::A)
+        {
+            for (answers = 0; answers < 3; answers++)
+            {
+                appendRecord(response, DnsMessage::A, 60 * (answers + 1), QByteArray("\xc0\x00\x02", 3) + (char)answers);
+            }
+        }
+        else if (type == DnsMessage::A)
+        {
+            appendRecord(response, DnsMessage::A, 300, QByteArray("\xc0\x00\x02\x01", 4));
+            answers = 1;
+        }
+        else if (type == DnsMessage::AAAA)
+        {
+            QByteArray ip6(16, '\0');
+            ip6[0] = 0x20;
+            ip6[1] = 0x01;
+            ip6[2] = 0x0d;
+            ip6[3] = (char)0xb8;
+            ip6[15] = 1;
+            appendRecord(response, DnsMessage::AAAA, 600, ip6);
+            answers = 1;
+        }
+
+        quint16 flags = 0x8180 | rcode | (truncated ? 0x0200 : 0);
+        response[2] = (char)(flags >> 8);
+        response[3] = (char)(flags & 0xff);
+        response[6] = 0;
+        response[7] = (char)answers;
+
+        return response;
+    }
+
+private slots:
+    void readDatagrams()
+    {
+        while (udp.hasPendingDatagrams())
+        {
+            QByteArray query(udp.pendingDatagramSize(), '\0');
+            QHostAddress sender;
+            quint16 port;
+            udp.readDatagram(query.data(), query.size(), &sender, &port);
+            udpQueries++;
+
+            DnsMessage message;
+            message.parse(query);
+
+            if (message.questionName() == "silent.example")
+            {
+                continue;
+            }
+
+            // only the first attempt gets lost
+            if (message.questionName() == "drop.example" && !dropped)
+            {
+                dropped = true;
+                continue;
+            }
+
+            udp.writeDatagram(answer(query, false), sender, port);
+        }
+    }
+};
+
+class TestDnsQuery : public QObject
+{
+    Q_OBJECT
+
+    bool run(DnsQuery &query, const QStringList &names, const QStringList &types, const QString &server,
+             int retries = 2)
+    {
+        DnsQueryDefinitionPtr definition(new DnsQueryDefinition(names, types, QStringList() << server, 300, retries,
+                                                                4));
+        return runMeasurement(query, definition, 10000);
+    }
+
+    static QVariantMap find(const QVariantMap &result, const QString &name, const QString &type)
+    {
+        foreach (const QVariant &query, result.value("queries").toList())
+        {
+            QVariantMap map = query.toMap();
+
+            if (map.value("name") == name && map.value("type") == type)
+            {
+                return map;
+            }
+        }
+
+        return QVariantMap();
+    }
+
+private slots:
+    void resolvesConcurrently()
+    {
+        StubServer server;
+        DnsQuery query;
+
+        QVERIFY(run(query, QStringList() << "a.example" << "b.example" << "c.example" << "many.example",
+                    QStringList() << "A" << "AAAA", server.address()));
+
+        QVariantMap result = query.result().probeResult();
+        QCOMPARE(result.value("query_count").toInt(), 8);
+        QCOMPARE(result.value("failed").toInt(), 0);
+
+        QVariantMap a = find(result, "b.example", "A");
+        QCOMPARE(a.value("rcode").toInt(), 0);
+        QCOMPARE(a.value("answer_count").toInt(), 1);
+        QCOMPARE(a.value("ttls").toList().value(0).toInt(), 300);
+        QCOMPARE(a.value("answers").toList().value(0).toMap().value("value").toString(), QString("192.0.2.1"));
+        QVERIFY(a.value("rtt_ns").toLongLong() > 0);
+        QCOMPARE(a.value("attempts").toInt(), 1);
+
+        QVariantMap aaaa = find(result, "c.example", "AAAA");
+        QCOMPARE(aaaa.value("answers").toList().value(0).toMap().value("value").toString(), QString("2001:db8::1"));
+        QCOMPARE(aaaa.value("ttls").toList().value(0).toInt(), 600);
+
+        QVariantMap many = find(result, "many.example", "A");
+        QCOMPARE(many.value("ttls").toList(), QVariantList() << 60 << 120 << 180);
+    }
+
+    void reportsRcode()
+    {
+        StubServer server;
+        DnsQuery query;
+
+        QVERIFY(run(query, QStringList() << "nx.example", QStringList() << "A", server.address()));
+
+        QVariantMap nx = find(query.result().probeResult(), "nx.example", "A");
+        QCOMPARE(nx.value("rcode").toInt(), 3);
+        QCOMPARE(nx.value("rcode_name").toString(), QString("NXDOMAIN"));
+        QCOMPARE(nx.value("answer_count").toInt(), 0);
+    }
+
+    void fallsBackToTcp()
+    {
+        StubServer server;
+        DnsQuery query;
+
+        QVERIFY(run(query, QStringList() << "big.example", QStringList() << "A", server.address()));
+
+        QVariantMap big = find(query.result().probeResult(), "big.example", "A");
+        QCOMPARE(big.value("truncated").toBool(), true);
+        QCOMPARE(big.value("answer_count").toInt(), 20);
+        QVERIFY(big.value("tcp_rtt_ns").toLongLong() > 0);
+        QCOMPARE(server.tcpQueries, 1);
+    }
+
+    void retriesOnTimeout()
+    {
+        StubServer server;
+        DnsQuery query;
+
+        QVERIFY(run(query, QStringList() << "drop.example" << "silent.example", QStringList() << "A",
+                    server.address(), 1));
+
+        QVariantMap result = query.result().probeResult();
+        QVariantMap drop = find(result, "drop.example", "A");
+        QCOMPARE(drop.value("attempts").toInt(), 2);
+        QCOMPARE(drop.value("answer_count").toInt(), 1);
+        QVERIFY(!drop.contains("error"));
+
+        QVariantMap silent = find(result, "silent.example", "A");
+        QCOMPARE(silent.value("attempts").toInt(), 2);
+        QCOMPARE(silent.value("error").toString(), QString("timeout"));
+        QCOMPARE(result.value("timeouts").toInt(), 1);
+    }
+
+    void rejectsInvalidDefinition()
+    {
+        DnsQuery query;
+
+        DnsQueryDefinitionPtr type(new DnsQueryDefinition(QStringList() << "a.example", QStringList() << "BOGUS",
+                                                          QStringList() << "127.0.0.1", 1000, 1, 1));
+        QVERIFY(!query.prepare(NULL, type));
+
+        DnsQueryDefinitionPtr server(new DnsQueryDefinition(QStringList() << "a.example", QStringList() << "A",
+                                                            QStringList() << "not a server", 1000, 1, 1));
+        QVERIFY(!query.prepare(NULL, server));
+    }
+};
+
+QTEST_MAIN(TestDnsQuery)
+
+#include "tst_dnsquery.moc"
@@ -3,4 +3,7 @@ TEMPLATE = subdirs
 SUBDIRS += \
         timing \
         scheduler \
-        tasks
+        tasks \
+        pageload \
+        videostreaming \
+        dnsquery
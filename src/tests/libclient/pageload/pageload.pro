@@ -0,0 +1,9 @@
+CONFIG += testcase
+CONFIG -= app_bundle
+QT += testlib network
+
+TARGET = tst_pageload
+HEADERS = ../stubserver.h
+SOURCES = tst_pageload.cpp
+
+include($$SOURCE_DIRECTORY/src/libclient/libclient.pri)
@@ -0,0 +1,122 @@
+#include <QtTest>
+
+#include "measurement/pageload/pageload.h"
+#include "../stubserver.h"
+
+// serves a manifest listing objectCount objects, odd objects chunked
+class PageServer : public StubHttpServer
+{
+    Q_OBJECT
+
+public:
+    explicit PageServer(int objectCount)
+    : objectCount(objectCount)
+    {
+    }
+
+    static QByteArray object(int index)
+    {
+        return QByteArray(100 + index * 10, 'a' + index % 26);
+    }
+
+    int objectCount;
+
+protected:
+    QByteArray respond(const QByteArray &path)
+    {
+        if (path == "/manifest")
+        {
+            QByteArray manifest("# objects\n");
+
+            for (int i = 0; i < objectCount; i++)
+            {
+                manifest.append(QString("object/%1\n").arg(i).toLatin1());
+            }
+
+            return ok(manifest);
+        }
+        else if (path.startsWith("/object/"))
+        {
+            int index = path.mid(8).toInt();
+            return index % 2 ? chunked(object(index)) : ok(object(index));
+        }
+
+        return notFound();
+    }
+
+private:
+    static QByteArray chunked(const QByteArray &body)
+    {
+        int half = body.size() / 2;
+        return QString("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n%1\r\n").arg(half, 0, 16).toLatin1() +
+               body.left(half) + QString("\r\n%1;ext=1\r\n").arg(body.size() - half, 0, 16).toLatin1() +
+               body.mid(half) + "\r\n0\r\n\r\n";
+    }
+};
+
+class TestPageLoad : public QObject
+{
+    Q_OBJECT
+
+    bool run(PageLoad &pageLoad, const QString &manifest, int connectionsPerHost, bool pipelining)
+    {
+        PageLoadDefinitionPtr definition(new PageLoadDefinition(manifest, connectionsPerHost, pipelining, 10000));
+        return runMeasurement(pageLoad, definition, 10000);
+    }
+
+private slots:
+    void loadsAllObjects()
+    {
+        PageServer server(20);
+        PageLoad pageLoad;
+
+        QVERIFY(run(pageLoad, server.url("/manifest"), 6, false));
+
+        QVariantMap result = pageLoad.result().probeResult();
+        QCOMPARE(result.value("object_count").toInt(), 21);
+        QCOMPARE(result.value("objects_ok").toInt(), 21);
+        QCOMPARE(result.value("timed_out").toBool(), false);
+        QVERIFY(result.value("connection_count").toInt() <= 6);
+        QCOMPARE(result.value("connection_count").toInt(), server.connections);
+
+        // only the first request of a connection is not reused
+        QVERIFY(result.value("reused_requests").toInt() >= 21 - server.connections);
+
+        QVariantList objects = result.value("objects").toList();
+
+        for (int i = 1; i < objects.size(); i++)
+        {
+            QVariantMap object = objects.at(i).toMap();
+            QCOMPARE(object.value("status_code").toInt(), 200);
+            QCOMPARE(object.value("body_bytes").toInt(), PageServer::object(i - 1).size());
+            QVERIFY(object.value("first_byte_ns").toLongLong() >= object.value("sent_ns").toLongLong());
+            QVERIFY(object.value("done_ns").toLongLong() >= object.value("first_byte_ns").toLongLong());
+        }
+    }
+
+    void pipelinesOnOneConnection()
+    {
+        PageServer server(10);
+        PageLoad pageLoad;
+
+        QVERIFY(run(pageLoad, server.url("/manifest"), 1, true));
+
+        QVariantMap result = pageLoad.result().probeResult();
+        QCOMPARE(result.value("objects_ok").toInt(), 11);
+        QCOMPARE(result.value("connection_count").toInt(), 1);
+        QCOMPARE(server.requests, 11);
+    }
+
+    void missingManifest()
+    {
+        PageServer server(0);
+        PageLoad pageLoad;
+
+        QVERIFY(!run(pageLoad, server.url("/missing"), 6, false));
+        QVERIFY(pageLoad.errorString().contains("404"));
+    }
+};
+
+QTEST_MAIN(TestPageLoad)
+
+#include "tst_pageload.moc"
@@ -0,0 +1,122 @@
+#ifndef STUBSERVER_H
+#define STUBSERVER_H
+
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "measurement/measurement.h"
+
+// prepares and starts the measurement, then waits until it finished or failed
+inline bool runMeasurement(Measurement &measurement, const MeasurementDefinitionPtr &definition, int timeout)
+{
+    if (!measurement.prepare(NULL, definition))
+    {
+        return false;
+    }
+
+    QSignalSpy finished(&measurement, SIGNAL(finished()));
+    QSignalSpy error(&measurement, SIGNAL(error(const QString &)));
+    measurement.start();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (finished.isEmpty() && error.isEmpty() && timer.elapsed() < timeout)
+    {
+        QTest::qWait(10);
+    }
+
+    return finished.count() == 1;
+}
+
+/* Accepts TCP connections and collects the received bytes per socket,
+ * subclasses consume the complete requests from the buffer.
+ */
+class StubTcpServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    StubTcpServer()
+    : connections(0)
+    {
+        connect(&server, SIGNAL(newConnection()), this, SLOT(accept()));
+    }
+
+    QTcpServer server;
+    int connections;
+
+protected:
+    // answers every complete request and leaves the rest in the buffer
+    virtual void process(QTcpSocket *socket, QByteArray &buffer) = 0;
+
+private slots:
+    void accept()
+    {
+        while (server.hasPendingConnections())
+        {
+            QTcpSocket *socket = server.nextPendingConnection();
+            connect(socket, SIGNAL(readyRead()), this, SLOT(read()));
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+            connections++;
+        }
+    }
+
+    void read()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        QByteArray buffer = socket->property("buffer").toByteArray() + socket->readAll();
+        process(socket, buffer);
+        socket->setProperty("buffer", buffer);
+    }
+};
+
+// answers HTTP requests on a local port, pipelined ones in order
+class StubHttpServer : public StubTcpServer
+{
+    Q_OBJECT
+
+public:
+    StubHttpServer()
+    : requests(0)
+    {
+        server.listen(QHostAddress::LocalHost);
+    }
+
+    QString url(const QString &path) const
+    {
+        return QString("http://127.0.0.1:%1%2").arg(server.serverPort()).arg(path);
+    }
+
+    static QByteArray ok(const QByteArray &body)
+    {
+        return QString("HTTP/1.1 200 OK\r\nContent-Length: %1\r\n\r\n").arg(body.size()).toLatin1() + body;
+    }
+
+    static QByteArray notFound()
+    {
+        return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    int requests;
+
+protected:
+    virtual QByteArray respond(const QByteArray &path) = 0;
+
+    void process(QTcpSocket *socket, QByteArray &buffer)
+    {
+        int end;
+
+        while ((end = buffer.indexOf("\r\n\r\n")) >= 0)
+        {
+            QByteArray path = buffer.left(buffer.indexOf("\r\n")).split(' ').value(1);
+            buffer.remove(0, end + 4);
+            requests++;
+
+            socket->write(respond(path));
+        }
+    }
+};
+
+#endif // STUBSERVER_H
@@ -0,0 +1,92 @@
+#include <QtTest>
+
+#include "measurement/videostreaming/videostreaming.h"
+#include "../stubserver.h"
+
+static const int segmentDuration = 200;
+
+// serves synthetic segments /video/<bps>/<number> of the matching size
+class SegmentServer : public StubHttpServer
+{
+    Q_OBJECT
+
+public:
+    QString url() const
+    {
+        return StubHttpServer::url("/video/$Bandwidth$/$Number$");
+    }
+
+    static int segmentSize(int bitrate)
+    {
+        return bitrate / 8 * segmentDuration / 1000;
+    }
+
+protected:
+    QByteArray respond(const QByteArray &path)
+    {
+        QList<QByteArray> parts = path.split('/');
+
+        if (parts.size() != 4 || parts.at(1) != "video")
+        {
+            return notFound();
+        }
+
+        return ok(QByteArray(segmentSize(parts.at(2).toInt()), 'v'));
+    }
+};
+
+class TestVideoStreaming : public QObject
+{
+    Q_OBJECT
+
+    bool run(VideoStreaming &streaming, const QString &url)
+    {
+        VideoStreamingDefinitionPtr definition(new VideoStreamingDefinition(url, QList<int>() << 100 << 200 << 400,
+                                                                            segmentDuration, 15, 1000, 200, 400,
+                                                                            100, 20000));
+        return runMeasurement(streaming, definition, 20000);
+    }
+
+private slots:
+    void streamsAllSegments()
+    {
+        SegmentServer server;
+        VideoStreaming streaming;
+
+        QVERIFY(run(streaming, server.url()));
+
+        QVariantMap result = streaming.result().probeResult();
+        QCOMPARE(result.value("completed").toBool(), true);
+        QCOMPARE(result.value("segments_downloaded").toInt(), 15);
+        QCOMPARE(result.value("stall_count").toInt(), 0);
+        QVERIFY(result.value("startup_delay_ns").toLongLong() >= 0);
+
+        // the buffer based choice climbs from the lowest to the highest bitrate
+        QVariantList segments = result.value("segments").toList();
+        QCOMPARE(segments.first().toMap().value("bitrate").toInt(), 100);
+        QCOMPARE(segments.last().toMap().value("bitrate").toInt(), 400);
+        QVERIFY(result.value("bitrate_switches").toInt() >= 2);
+
+        foreach (const QVariant &segment, segments)
+        {
+            QVariantMap map = segment.toMap();
+            QCOMPARE(map.value("bytes").toInt(), SegmentServer::segmentSize(map.value("bitrate").toInt() * 1000));
+            QVERIFY(map.value("buffer_ms").toInt() <= 1000);
+        }
+
+        QVERIFY(!result.value("buffer_level").toList().isEmpty());
+    }
+
+    void missingSegment()
+    {
+        SegmentServer server;
+        VideoStreaming streaming;
+
+        QVERIFY(!run(streaming, QString(server.url()).replace("video", "missing")));
+        QVERIFY(streaming.errorString().contains("404"));
+    }
+};
+
+QTEST_MAIN(TestVideoStreaming)
+
+#include "tst_videostreaming.moc"